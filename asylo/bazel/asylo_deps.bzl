@@ -282,46 +282,6 @@ def asylo_deps(toolchain_path = None):
         )
         _bazel_version_repository(name = "bazel_version")
 
-    # Google certificate transparency has a merkletree implementation.
-    if not native.existing_rule("com_google_certificate_transparency"):
-        http_archive(
-            name = "com_google_certificate_transparency",
-            # Non-release commit 335536d introduced Merkle trees. They have not been
-            # modified since.
-            urls = ["https://github.com/google/certificate-transparency/archive/335536d7276e375bdcfd740056506bf503221f03.tar.gz"],
-            build_file_content = """
-cc_library(
-    name = "merkletree",
-    hdrs = ["cpp/merkletree/merkle_tree.h"],
-    strip_include_prefix = "cpp",
-    deps = ["merkletree_impl"],
-    visibility = ["//visibility:public"],
-)
-
-cc_library(
-    name = "merkletree_impl",
-    srcs = [
-        "cpp/merkletree/merkle_tree.cc",
-        "cpp/merkletree/merkle_tree_math.cc",
-        "cpp/merkletree/serial_hasher.cc",
-        "cpp/merkletree/tree_hasher.cc",
-    ],
-    strip_include_prefix = "cpp",
-    hdrs = [
-       "cpp/merkletree/merkle_tree.h",
-       "cpp/merkletree/merkle_tree_interface.h",
-       "cpp/merkletree/merkle_tree_math.h",
-       "cpp/merkletree/serial_hasher.h",
-       "cpp/merkletree/tree_hasher.h",
-   ],
-    deps = ["@boringssl//:crypto"],
-    alwayslink = 1,
-)
-""",
-            sha256 = "3a787ff86b55069dad1e394b6f5d225a29a8f70557133064dc69d47a64b614fc",
-            strip_prefix = "certificate-transparency-335536d7276e375bdcfd740056506bf503221f03",
-        )
-
     # Required by protobuf
     if not native.existing_rule("bazel_skylib"):
         http_archive(
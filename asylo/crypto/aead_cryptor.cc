@@ -17,13 +17,18 @@
  */
 #include "asylo/crypto/aead_cryptor.h"
 
+#include <algorithm>
 #include <cstddef>
+#include <functional>
 #include <memory>
+#include <vector>
 
 #include "absl/memory/memory.h"
 #include "absl/strings/str_cat.h"
+#include "asylo/crypto/counter_nonce_generator.h"
 #include "asylo/crypto/random_nonce_generator.h"
 #include "asylo/util/status_macros.h"
+#include "asylo/util/worker_pool.h"
 
 namespace asylo {
 namespace experimental {
@@ -39,6 +44,67 @@ constexpr size_t kAesGcmMaxMessageSize = static_cast<size_t>(1) << 25;
 constexpr uint64_t kAesGcmSivMaxSealedMessages = UINT64_C(1) << 48;
 constexpr size_t kAesGcmSivMaxMessageSize = static_cast<size_t>(1) << 25;
 
+// The maximum number of threads, including the calling thread, among which a
+// batch is split.
+constexpr int kMaxBatchThreadCount = 64;
+
+// Returns the worker threads shared by the batches of all cryptors.
+WorkerPool *BatchWorkers() {
+  static WorkerPool *workers = new WorkerPool(kMaxBatchThreadCount - 1);
+  return workers;
+}
+
+// Returns an error unless every span describing a batch of |count| messages has
+// |count| elements.
+Status CheckBatchSizes(size_t count, size_t associated_data_count,
+                       size_t buffer_count, size_t size_count) {
+  if (associated_data_count != count || buffer_count != count ||
+      size_count != count) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  absl::StrCat("Batch of ", count, " messages has ",
+                               associated_data_count, " associated data, ",
+                               buffer_count, " output buffers and ",
+                               size_count, " output sizes"));
+  }
+  return Status::OkStatus();
+}
+
+// Runs |op| on each message index in [0, |count|), splitting the indices into
+// contiguous ranges among up to |thread_count| threads, one of which is the
+// calling thread and the others of which are taken from BatchWorkers(). Returns
+// the failure of the lowest failing index, if any.
+Status ForEachMessage(size_t count, int thread_count,
+                      const std::function<Status(size_t)> &op) {
+  size_t range_count = std::max<size_t>(
+      1, std::min<size_t>(
+             count, std::min(std::max(thread_count, 1), kMaxBatchThreadCount)));
+  size_t range_size = (count + range_count - 1) / range_count;
+  std::vector<Status> results(range_count);
+  auto run_range = [count, range_size, &op, &results](size_t range) {
+    size_t end = std::min(count, (range + 1) * range_size);
+    for (size_t i = range * range_size; i < end; ++i) {
+      Status status = op(i);
+      if (!status.ok()) {
+        results[range] =
+            status.WithPrependedContext(absl::StrCat("Message ", i));
+        return;
+      }
+    }
+  };
+
+  if (range_count == 1) {
+    run_range(0);
+  } else {
+    BatchWorkers()->ParallelFor(range_count, run_range);
+  }
+  for (const Status &status : results) {
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  return Status::OkStatus();
+}
+
 }  // namespace
 
 StatusOr<std::unique_ptr<AeadCryptor>> AeadCryptor::CreateAesGcmCryptor(
@@ -50,6 +116,20 @@ StatusOr<std::unique_ptr<AeadCryptor>> AeadCryptor::CreateAesGcmCryptor(
       RandomNonceGenerator::CreateAesGcmNonceGenerator()));
 }
 
+StatusOr<std::unique_ptr<AeadCryptor>>
+AeadCryptor::CreateAesGcmCounterNonceCryptor(ByteContainerView key) {
+  std::unique_ptr<AeadKey> aead_key;
+  ASYLO_ASSIGN_OR_RETURN(aead_key, AeadKey::CreateAesGcmKey(key));
+  std::unique_ptr<CounterNonceGenerator> nonce_generator;
+  ASYLO_ASSIGN_OR_RETURN(
+      nonce_generator,
+      CounterNonceGenerator::CreateAesGcmNonceGenerator(
+          kAesGcmMaxSealedMessages));
+  return absl::WrapUnique<AeadCryptor>(new AeadCryptor(
+      std::move(aead_key), kAesGcmMaxMessageSize, kAesGcmMaxSealedMessages,
+      std::move(nonce_generator)));
+}
+
 StatusOr<std::unique_ptr<AeadCryptor>> AeadCryptor::CreateAesGcmSivCryptor(
     ByteContainerView key) {
   std::unique_ptr<AeadKey> aead_key;
@@ -112,7 +192,7 @@ Status AeadCryptor::Seal(ByteContainerView plaintext,
                   absl::StrCat("Reached maximum number of sealed messages (",
                                max_sealed_messages_, ")"));
   }
-  nonce_generator_->NextNonce(nonce);
+  ASYLO_RETURN_IF_ERROR(nonce_generator_->NextNonce(nonce));
   ASYLO_RETURN_IF_ERROR(key_->Seal(plaintext, associated_data, nonce,
                                    ciphertext, ciphertext_size));
   number_of_sealed_messages_++;
@@ -127,6 +207,68 @@ Status AeadCryptor::Open(ByteContainerView ciphertext,
                     plaintext_size);
 }
 
+Status AeadCryptor::SealBatch(
+    absl::Span<const ByteContainerView> plaintexts,
+    absl::Span<const ByteContainerView> associated_data,
+    absl::Span<uint8_t> nonces,
+    absl::Span<const absl::Span<uint8_t>> ciphertexts,
+    absl::Span<size_t> ciphertext_sizes, int thread_count) {
+  size_t count = plaintexts.size();
+  ASYLO_RETURN_IF_ERROR(CheckBatchSizes(count, associated_data.size(),
+                                        ciphertexts.size(),
+                                        ciphertext_sizes.size()));
+  for (size_t i = 0; i < count; ++i) {
+    if (plaintexts[i].size() > max_message_size_) {
+      return Status(error::GoogleError::INVALID_ARGUMENT,
+                    absl::StrCat("Message ", i, ": Plaintext size ",
+                                 plaintexts[i].size(),
+                                 " exceeds maximum message size (",
+                                 max_message_size_, " bytes)"));
+    }
+  }
+  if (count > max_sealed_messages_ - number_of_sealed_messages_) {
+    return Status(error::GoogleError::FAILED_PRECONDITION,
+                  absl::StrCat("Batch of ", count,
+                               " messages would exceed maximum number of "
+                               "sealed messages (",
+                               max_sealed_messages_, ")"));
+  }
+
+  size_t nonce_size = NonceSize();
+  ASYLO_RETURN_IF_ERROR(nonce_generator_->NextNonces(count, nonces));
+  number_of_sealed_messages_ += count;
+
+  return ForEachMessage(count, thread_count, [&](size_t i) {
+    return key_->Seal(plaintexts[i], associated_data[i],
+                      nonces.subspan(i * nonce_size, nonce_size),
+                      ciphertexts[i], &ciphertext_sizes[i]);
+  });
+}
+
+Status AeadCryptor::OpenBatch(
+    absl::Span<const ByteContainerView> ciphertexts,
+    absl::Span<const ByteContainerView> associated_data,
+    ByteContainerView nonces, absl::Span<const absl::Span<uint8_t>> plaintexts,
+    absl::Span<size_t> plaintext_sizes, int thread_count) {
+  size_t count = ciphertexts.size();
+  ASYLO_RETURN_IF_ERROR(CheckBatchSizes(count, associated_data.size(),
+                                        plaintexts.size(),
+                                        plaintext_sizes.size()));
+  size_t nonce_size = NonceSize();
+  if (nonces.size() / nonce_size < count) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  absl::StrCat("Nonces size ", nonces.size(), " is too small ",
+                               "for a batch of ", count, " messages"));
+  }
+
+  return ForEachMessage(count, thread_count, [&](size_t i) {
+    return key_->Open(
+        ciphertexts[i], associated_data[i],
+        ByteContainerView(nonces.data() + i * nonce_size, nonce_size),
+        plaintexts[i], &plaintext_sizes[i]);
+  });
+}
+
 AeadCryptor::AeadCryptor(
     std::unique_ptr<AeadKey> key, size_t max_message_size,
     uint64_t max_sealed_messages,
@@ -35,6 +35,8 @@ namespace experimental {
 /// An AEAD cryptor that provides Seal() and Open() functionality. Currently
 /// supported configurations:
 /// * AES-GCM-128 and AES-GCM-256 with 96-bit random nonces.
+/// * AES-GCM-128 and AES-GCM-256 with 96-bit nonces made of a random prefix
+///   and a message counter.
 /// * AES-GCM-SIV-128 and AES-GCM-SIV-256 with 96-bit random nonces. (For
 ///   information on AES-GCM-SIV see https://cyber.biu.ac.il/aes-gcm-siv/)
 class AeadCryptor {
@@ -48,6 +50,20 @@ class AeadCryptor {
   static StatusOr<std::unique_ptr<AeadCryptor>> CreateAesGcmCryptor(
       ByteContainerView key);
 
+  /// Creates a cryptor that uses AES-GCM for Seal() and Open(), and generates
+  /// 96-bit nonces for use in Seal() from a random 64-bit prefix and a 32-bit
+  /// message counter. Unlike CreateAesGcmCryptor(), Seal() draws no randomness,
+  /// and nonces are guaranteed not to repeat within the cryptor's
+  /// MaxSealedMessages(). Nonces of cryptors created separately with the same
+  /// key, including across restarts, repeat only if their random prefixes
+  /// collide.
+  ///
+  /// \param key The underlying key used for encryption and decryption.
+  /// \return A pointer to the created cryptor, or a non-OK Status if creation
+  ///         failed.
+  static StatusOr<std::unique_ptr<AeadCryptor>> CreateAesGcmCounterNonceCryptor(
+      ByteContainerView key);
+
   /// Creates a cryptor that uses AES-GCM-SIV for Seal() and Open(), and
   /// generates random 96-bit nonces for use in Seal().
   ///
@@ -132,6 +148,59 @@ class AeadCryptor {
               ByteContainerView nonce, absl::Span<uint8_t> plaintext,
               size_t *plaintext_size);
 
+  /// Implements the AEAD Seal operation for a batch of messages.
+  ///
+  /// Seals `plaintexts[i]` with `associated_data[i]` into `ciphertexts[i]`,
+  /// with the same requirements on each message as Seal(), and returns its
+  /// final size through `ciphertext_sizes[i]`. All spans of messages must have
+  /// the same size. The nonces for the whole batch are generated together and
+  /// written consecutively to `nonces`, the i-th nonce occupying NonceSize()
+  /// bytes starting at `i * NonceSize()`.
+  ///
+  /// The batch is validated before any message is sealed, and is rejected as a
+  /// whole if it would exceed MaxSealedMessages(). Every message in an accepted
+  /// batch counts towards MaxSealedMessages(), even if sealing it fails.
+  ///
+  /// \param plaintexts The secrets that will be sealed.
+  /// \param associated_data The authenticated data for each message.
+  /// \param[out] nonces The generated nonces.
+  /// \param ciphertexts The buffers to which each message is sealed.
+  /// \param[out] ciphertext_sizes The size of each sealed message.
+  /// \param thread_count The number of threads among which the batch is split,
+  ///        at most 64. Threads other than the calling thread are taken from a
+  ///        pool shared by all cryptors.
+  /// \return The resulting status of the batch. If a message fails to seal,
+  ///         the failure of the first such message.
+  Status SealBatch(absl::Span<const ByteContainerView> plaintexts,
+                   absl::Span<const ByteContainerView> associated_data,
+                   absl::Span<uint8_t> nonces,
+                   absl::Span<const absl::Span<uint8_t>> ciphertexts,
+                   absl::Span<size_t> ciphertext_sizes, int thread_count = 1);
+
+  /// Implements the AEAD Open operation for a batch of messages.
+  ///
+  /// Opens `ciphertexts[i]` with `associated_data[i]` and the i-th nonce in
+  /// `nonces` into `plaintexts[i]`, with the same requirements on each message
+  /// as Open(), and returns its final size through `plaintext_sizes[i]`. All
+  /// spans of messages must have the same size, and `nonces` is laid out as by
+  /// SealBatch().
+  ///
+  /// \param ciphertexts The sealed ciphertexts.
+  /// \param associated_data The authenticated data for each message.
+  /// \param nonces The nonces used to seal the ciphertexts.
+  /// \param plaintexts The buffers to which each message is opened.
+  /// \param[out] plaintext_sizes The size of each opened message.
+  /// \param thread_count The number of threads among which the batch is split,
+  ///        at most 64. Threads other than the calling thread are taken from a
+  ///        pool shared by all cryptors.
+  /// \return The resulting status of the batch. If a message fails to open,
+  ///         the failure of the first such message.
+  Status OpenBatch(absl::Span<const ByteContainerView> ciphertexts,
+                   absl::Span<const ByteContainerView> associated_data,
+                   ByteContainerView nonces,
+                   absl::Span<const absl::Span<uint8_t>> plaintexts,
+                   absl::Span<size_t> plaintext_sizes, int thread_count = 1);
+
  private:
   AeadCryptor(std::unique_ptr<AeadKey> key, size_t max_message_size,
               uint64_t max_sealed_messages,
@@ -19,7 +19,9 @@
 
 #include <vector>
 
+#include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include "absl/strings/str_cat.h"
 #include "absl/types/span.h"
 #include "asylo/crypto/aead_test_vector.h"
 #include "asylo/test/util/status_matchers.h"
@@ -78,8 +80,12 @@ const char kAesGcmSivNonceHex256[] = "030000000000000000000000";
 const char kAesGcmSivCiphertextHex256[] = "c91545823cc24f17dbb0e9e807d5ec17";
 const char kAesGcmSivTagHex256[] = "b292d28ff61189e8e49f3875ef91aff7";
 
+using ::testing::HasSubstr;
 using ::testing::TestWithParam;
 
+// Number of messages sealed and opened by the batch tests.
+constexpr int kBatchSize = 8;
+
 struct AeadCryptorParam {
   std::function<StatusOr<std::unique_ptr<AeadCryptor>>(ByteContainerView)>
       factory;
@@ -129,6 +135,78 @@ TEST_P(AeadCryptorTest, OpenTest) {
             ByteContainerView(actual_plaintext));
 }
 
+TEST_P(AeadCryptorTest, BatchEndToEndTest) {
+  AeadTestVector test_vector = GetParam().test_vector;
+  std::unique_ptr<AeadCryptor> cryptor;
+  ASYLO_ASSERT_OK_AND_ASSIGN(cryptor, GetParam().factory(test_vector.key));
+
+  for (int thread_count : {1, 3}) {
+    std::vector<ByteContainerView> plaintexts(kBatchSize,
+                                              test_vector.plaintext);
+    std::vector<ByteContainerView> aads(kBatchSize, test_vector.aad);
+    std::vector<uint8_t> nonces(kBatchSize * cryptor->NonceSize());
+    std::vector<std::vector<uint8_t>> ciphertexts(
+        kBatchSize, std::vector<uint8_t>(test_vector.plaintext.size() +
+                                         cryptor->MaxSealOverhead()));
+    std::vector<absl::Span<uint8_t>> ciphertext_spans;
+    for (std::vector<uint8_t> &ciphertext : ciphertexts) {
+      ciphertext_spans.push_back(absl::MakeSpan(ciphertext));
+    }
+    std::vector<size_t> ciphertext_sizes(kBatchSize);
+    ASYLO_ASSERT_OK(cryptor->SealBatch(
+        plaintexts, aads, absl::MakeSpan(nonces), ciphertext_spans,
+        absl::MakeSpan(ciphertext_sizes), thread_count));
+
+    std::vector<ByteContainerView> sealed;
+    for (int i = 0; i < kBatchSize; ++i) {
+      EXPECT_EQ(ciphertext_sizes[i],
+                test_vector.authenticated_ciphertext.size());
+      sealed.emplace_back(ciphertexts[i].data(), ciphertext_sizes[i]);
+    }
+    std::vector<CleansingVector<uint8_t>> opened(
+        kBatchSize, CleansingVector<uint8_t>(
+                        test_vector.authenticated_ciphertext.size()));
+    std::vector<absl::Span<uint8_t>> opened_spans;
+    for (CleansingVector<uint8_t> &plaintext : opened) {
+      opened_spans.push_back(absl::MakeSpan(plaintext));
+    }
+    std::vector<size_t> opened_sizes(kBatchSize);
+    ASYLO_ASSERT_OK(cryptor->OpenBatch(sealed, aads, nonces, opened_spans,
+                                       absl::MakeSpan(opened_sizes),
+                                       thread_count));
+    for (int i = 0; i < kBatchSize; ++i) {
+      opened[i].resize(opened_sizes[i]);
+      EXPECT_EQ(ByteContainerView(test_vector.plaintext),
+                ByteContainerView(opened[i]));
+    }
+
+    // A message that fails to open is reported by its index.
+    ciphertexts[kBatchSize / 2][0] ^= 1;
+    EXPECT_THAT(cryptor->OpenBatch(sealed, aads, nonces, opened_spans,
+                                   absl::MakeSpan(opened_sizes), thread_count),
+                StatusIs(error::GoogleError::INTERNAL,
+                         HasSubstr(absl::StrCat("Message ", kBatchSize / 2))));
+  }
+}
+
+TEST_P(AeadCryptorTest, BatchSizeMismatchTest) {
+  AeadTestVector test_vector = GetParam().test_vector;
+  std::unique_ptr<AeadCryptor> cryptor;
+  ASYLO_ASSERT_OK_AND_ASSIGN(cryptor, GetParam().factory(test_vector.key));
+
+  std::vector<ByteContainerView> plaintexts(2, test_vector.plaintext);
+  std::vector<ByteContainerView> aads(1, test_vector.aad);
+  std::vector<uint8_t> nonces(2 * cryptor->NonceSize());
+  std::vector<uint8_t> ciphertext(test_vector.plaintext.size() +
+                                  cryptor->MaxSealOverhead());
+  std::vector<absl::Span<uint8_t>> ciphertexts(2, absl::MakeSpan(ciphertext));
+  std::vector<size_t> ciphertext_sizes(2);
+  EXPECT_THAT(
+      cryptor->SealBatch(plaintexts, aads, absl::MakeSpan(nonces), ciphertexts,
+                         absl::MakeSpan(ciphertext_sizes)),
+      StatusIs(error::GoogleError::INVALID_ARGUMENT));
+}
+
 INSTANTIATE_TEST_SUITE_P(
     AllTests, AeadCryptorTest,
     ::testing::Values(
@@ -144,6 +222,12 @@ INSTANTIATE_TEST_SUITE_P(
              AeadTestVector(kAesGcmPlaintextHex256, kAesGcmKeyHex256,
                             /*aad_hex=*/"", kAesGcmNonceHex256,
                             kAesGcmCiphertextHex256, kAesGcmTagHex256)}),
+        // AES-128-GCM with counter nonces.
+        AeadCryptorParam(
+            {AeadCryptor::CreateAesGcmCounterNonceCryptor,
+             AeadTestVector(kAesGcmPlaintextHex128, kAesGcmKeyHex128,
+                            kAesGcmAadHex128, kAesGcmNonceHex128,
+                            kAesGcmCiphertextHex128, kAesGcmTagHex128)}),
         // AES-256-GCM-SIV with additional authenticated data.
         AeadCryptorParam(
             {AeadCryptor::CreateAesGcmSivCryptor,
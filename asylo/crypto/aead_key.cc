@@ -20,12 +20,12 @@
 
 #include <openssl/aead.h>
 #include <memory>
+#include <utility>
 
 #include "absl/memory/memory.h"
 #include "absl/strings/str_cat.h"
 #include "asylo/crypto/algorithms.pb.h"
 #include "asylo/crypto/util/bssl_util.h"
-#include "asylo/util/cleanup.h"
 #include "asylo/util/status_macros.h"
 
 namespace asylo {
@@ -81,7 +81,7 @@ StatusOr<std::unique_ptr<AeadKey>> AeadKey::CreateAesGcmKey(
                   absl::StrCat("Invalid AES-GCM key length: ", key.size(),
                                " (must be 16 or 32 bytes)"));
   }
-  return absl::WrapUnique<AeadKey>(new AeadKey(scheme, key));
+  return Create(scheme, key);
 }
 
 StatusOr<std::unique_ptr<AeadKey>> AeadKey::CreateAesGcmSivKey(
@@ -92,7 +92,7 @@ StatusOr<std::unique_ptr<AeadKey>> AeadKey::CreateAesGcmSivKey(
                   absl::StrCat("Invalid AES-GCM-SIV key length: ", key.size(),
                                " (must be 16 or 32 bytes)"));
   }
-  return absl::WrapUnique<AeadKey>(new AeadKey(scheme, key));
+  return Create(scheme, key);
 }
 
 AeadScheme AeadKey::GetAeadScheme() const { return aead_scheme_; }
@@ -110,18 +110,7 @@ Status AeadKey::Seal(ByteContainerView plaintext,
                                " (must be ", nonce_size_, " bytes)"));
   }
 
-  EVP_AEAD_CTX context;
-  Cleanup cleanup_context([&context]() { EVP_AEAD_CTX_cleanup(&context); });
-
-  if (EVP_AEAD_CTX_init(&context, aead_, key_.data(), key_.size(),
-                        EVP_AEAD_max_tag_len(aead_),
-                        /*impl=*/nullptr) != 1) {
-    return Status(
-        error::GoogleError::INTERNAL,
-        absl::StrCat("EVP_AEAD_CTX_init failed: ", BsslLastErrorString()));
-  }
-
-  if (EVP_AEAD_CTX_seal(&context, ciphertext.data(), ciphertext_size,
+  if (EVP_AEAD_CTX_seal(context_.get(), ciphertext.data(), ciphertext_size,
                         ciphertext.size(), nonce.data(), nonce.size(),
                         plaintext.data(), plaintext.size(),
                         associated_data.data(), associated_data.size()) != 1) {
@@ -142,17 +131,7 @@ Status AeadKey::Open(ByteContainerView ciphertext,
                                " (must be ", nonce_size_, " bytes)"));
   }
 
-  EVP_AEAD_CTX context;
-  Cleanup cleanup_context([&context]() { EVP_AEAD_CTX_cleanup(&context); });
-  if (EVP_AEAD_CTX_init(&context, aead_, key_.data(), key_.size(),
-                        EVP_AEAD_max_tag_len(aead_),
-                        /*impl=*/nullptr) != 1) {
-    return Status(
-        error::GoogleError::INTERNAL,
-        absl::StrCat("EVP_AEAD_CTX_init failed: ", BsslLastErrorString()));
-  }
-
-  if (EVP_AEAD_CTX_open(&context, plaintext.data(), plaintext_size,
+  if (EVP_AEAD_CTX_open(context_.get(), plaintext.data(), plaintext_size,
                         plaintext.size(), nonce.data(), nonce.size(),
                         ciphertext.data(), ciphertext.size(),
                         associated_data.data(), associated_data.size()) != 1) {
@@ -164,10 +143,24 @@ Status AeadKey::Open(ByteContainerView ciphertext,
   return Status::OkStatus();
 }
 
-AeadKey::AeadKey(AeadScheme aead_scheme, ByteContainerView key)
+StatusOr<std::unique_ptr<AeadKey>> AeadKey::Create(AeadScheme scheme,
+                                                    ByteContainerView key) {
+  const EVP_AEAD *aead = GetEvpAead(scheme);
+  bssl::UniquePtr<EVP_AEAD_CTX> context(EVP_AEAD_CTX_new(
+      aead, key.data(), key.size(), EVP_AEAD_max_tag_len(aead)));
+  if (!context) {
+    return Status(
+        error::GoogleError::INTERNAL,
+        absl::StrCat("EVP_AEAD_CTX_new failed: ", BsslLastErrorString()));
+  }
+  return absl::WrapUnique<AeadKey>(new AeadKey(scheme, std::move(context)));
+}
+
+AeadKey::AeadKey(AeadScheme aead_scheme,
+                 bssl::UniquePtr<EVP_AEAD_CTX> context)
     : aead_(GetEvpAead(aead_scheme)),
       aead_scheme_(aead_scheme),
-      key_(key.cbegin(), key.cend()),
+      context_(std::move(context)),
       max_seal_overhead_(EVP_AEAD_max_overhead(aead_)),
       nonce_size_(EVP_AEAD_nonce_length(aead_)) {}
 
@@ -26,13 +26,17 @@
 
 #include "asylo/crypto/algorithms.pb.h"
 #include "asylo/crypto/util/byte_container_view.h"
-#include "asylo/util/cleansing_types.h"
 #include "asylo/util/status.h"
 #include "asylo/util/statusor.h"
 
 namespace asylo {
 
 // Key used for AEAD (Authenticated Encryption with Associated Data) operations.
+//
+// The key schedule is expanded once, when the AeadKey is created, and the
+// resulting context is reused by every Seal() and Open() call. The context is
+// never modified after creation, so a single AeadKey may be used to Seal() and
+// Open() from multiple threads concurrently.
 class AeadKey {
  public:
   // Creates an instance of AeadKey using |key| with AES-GCM. |key| must be
@@ -73,7 +77,11 @@ class AeadKey {
               size_t *plaintext_size);
 
  private:
-  AeadKey(AeadScheme scheme, ByteContainerView key);
+  AeadKey(AeadScheme scheme, bssl::UniquePtr<EVP_AEAD_CTX> context);
+
+  // Creates an AeadKey for |scheme| and initializes its context with |key|.
+  static StatusOr<std::unique_ptr<AeadKey>> Create(AeadScheme scheme,
+                                                   ByteContainerView key);
 
   // The object that encapsulates the AEAD algorithm.
   const EVP_AEAD *const aead_;
@@ -81,8 +89,9 @@ class AeadKey {
   // The Asylo enum representation of the AEAD algorithm used by this object.
   const AeadScheme aead_scheme_;
 
-  // The AEAD key.
-  const CleansingVector<uint8_t> key_;
+  // The AEAD context initialized with the key. BoringSSL cleanses the expanded
+  // key when the context is freed.
+  const bssl::UniquePtr<EVP_AEAD_CTX> context_;
 
   // The max size of the spatial overhead for this object's Seal() operation.
   const size_t max_seal_overhead_;
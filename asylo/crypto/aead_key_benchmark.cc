@@ -0,0 +1,120 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <openssl/aead.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "asylo/crypto/aead_key.h"
+#include "asylo/crypto/util/byte_container_view.h"
+#include "asylo/test/util/benchmark.h"
+#include "asylo/test/util/status_matchers.h"
+#include "asylo/util/cleanup.h"
+
+namespace asylo {
+namespace {
+
+// Message sizes to benchmark, from a single small record to a large block.
+constexpr size_t kMessageSizes[] = {64, 256, 1024, 4096, 16384, 65536};
+
+constexpr uint8_t kKey[32] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+                              0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10,
+                              0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18,
+                              0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20};
+constexpr char kAssociatedData[] = "aead key benchmark";
+
+// Seals |plaintext| after initializing a fresh context from |key|, which is
+// what AeadKey::Seal() did for every message before it cached its context.
+void SealWithFreshContext(const EVP_AEAD *aead, ByteContainerView key,
+                          ByteContainerView plaintext,
+                          ByteContainerView associated_data,
+                          ByteContainerView nonce,
+                          absl::Span<uint8_t> ciphertext) {
+  EVP_AEAD_CTX context;
+  Cleanup cleanup_context([&context]() { EVP_AEAD_CTX_cleanup(&context); });
+  ASSERT_EQ(EVP_AEAD_CTX_init(&context, aead, key.data(), key.size(),
+                              EVP_AEAD_max_tag_len(aead), /*impl=*/nullptr),
+            1);
+  size_t ciphertext_size;
+  ASSERT_EQ(EVP_AEAD_CTX_seal(&context, ciphertext.data(), &ciphertext_size,
+                              ciphertext.size(), nonce.data(), nonce.size(),
+                              plaintext.data(), plaintext.size(),
+                              associated_data.data(), associated_data.size()),
+            1);
+}
+
+// Compares the per-message cost of sealing and opening with |key| against
+// setting up a fresh context for every message with |aead|.
+void BenchmarkAeadKey(const char *name, const EVP_AEAD *aead, AeadKey *key) {
+  for (size_t size : kMessageSizes) {
+    std::vector<uint8_t> plaintext(size, 0xa5);
+    std::vector<uint8_t> nonce(key->NonceSize(), 0x5a);
+    std::vector<uint8_t> ciphertext(size + key->MaxSealOverhead());
+    ByteContainerView associated_data(kAssociatedData,
+                                      sizeof(kAssociatedData));
+
+    BenchmarkResult result = RunBenchmark([&] {
+      SealWithFreshContext(aead, ByteContainerView(kKey, sizeof(kKey)),
+                           plaintext, associated_data, nonce,
+                           absl::MakeSpan(ciphertext));
+    });
+    LogBenchmarkResult(absl::StrCat(name, "/SealFreshContext/", size), result,
+                       size);
+
+    size_t ciphertext_size;
+    result = RunBenchmark([&] {
+      ASYLO_EXPECT_OK(key->Seal(plaintext, associated_data, nonce,
+                                absl::MakeSpan(ciphertext), &ciphertext_size));
+    });
+    LogBenchmarkResult(absl::StrCat(name, "/Seal/", size), result, size);
+
+    ciphertext.resize(ciphertext_size);
+    std::vector<uint8_t> opened(ciphertext_size);
+    size_t opened_size;
+    result = RunBenchmark([&] {
+      ASYLO_EXPECT_OK(key->Open(ciphertext, associated_data, nonce,
+                                absl::MakeSpan(opened), &opened_size));
+    });
+    LogBenchmarkResult(absl::StrCat(name, "/Open/", size), result, size);
+    EXPECT_EQ(opened_size, size);
+  }
+}
+
+TEST(AeadKeyBenchmark, Aes256Gcm) {
+  auto key_result =
+      AeadKey::CreateAesGcmKey(ByteContainerView(kKey, sizeof(kKey)));
+  ASYLO_ASSERT_OK(key_result);
+  BenchmarkAeadKey("AES256_GCM", EVP_aead_aes_256_gcm(),
+                   key_result.ValueOrDie().get());
+}
+
+TEST(AeadKeyBenchmark, Aes256GcmSiv) {
+  auto key_result =
+      AeadKey::CreateAesGcmSivKey(ByteContainerView(kKey, sizeof(kKey)));
+  ASYLO_ASSERT_OK(key_result);
+  BenchmarkAeadKey("AES256_GCM_SIV", EVP_aead_aes_256_gcm_siv(),
+                   key_result.ValueOrDie().get());
+}
+
+}  // namespace
+}  // namespace asylo
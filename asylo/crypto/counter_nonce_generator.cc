@@ -0,0 +1,114 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/crypto/counter_nonce_generator.h"
+
+#include <openssl/rand.h>
+
+#include <cstdint>
+#include <memory>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "asylo/crypto/util/bssl_util.h"
+#include "asylo/util/status.h"
+#include "asylo/util/status_macros.h"
+
+namespace asylo {
+namespace {
+
+constexpr size_t kPrefixSize = sizeof(uint64_t);
+constexpr size_t kCounterSize = sizeof(uint32_t);
+constexpr size_t kAesGcmNonceSize = kPrefixSize + kCounterSize;
+
+// The number of distinct values of the counter field.
+constexpr uint64_t kCounterRange = UINT64_C(1) << (8 * kCounterSize);
+
+// Writes |value| to |out| in big-endian byte order.
+template <typename T>
+void StoreBigEndian(T value, uint8_t *out) {
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    out[sizeof(T) - 1 - i] = static_cast<uint8_t>(value >> (8 * i));
+  }
+}
+
+}  // namespace
+
+StatusOr<std::unique_ptr<CounterNonceGenerator>>
+CounterNonceGenerator::CreateAesGcmNonceGenerator(uint64_t max_nonces) {
+  if (max_nonces > kCounterRange) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  absl::StrCat("Maximum number of nonces ", max_nonces,
+                               " exceeds the counter range (", kCounterRange,
+                               ")"));
+  }
+  uint64_t prefix;
+  if (RAND_bytes(reinterpret_cast<uint8_t *>(&prefix), sizeof(prefix)) != 1) {
+    return Status(error::GoogleError::INTERNAL,
+                  absl::StrCat("RAND_bytes failed: ", BsslLastErrorString()));
+  }
+  return absl::WrapUnique<CounterNonceGenerator>(
+      new CounterNonceGenerator(prefix, max_nonces));
+}
+
+size_t CounterNonceGenerator::NonceSize() const { return kAesGcmNonceSize; }
+
+Status CounterNonceGenerator::NextNonce(absl::Span<uint8_t> nonce) {
+  return NextNonces(1, nonce);
+}
+
+Status CounterNonceGenerator::NextNonces(size_t count,
+                                         absl::Span<uint8_t> nonces) {
+  if (nonces.size() / kAesGcmNonceSize < count) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  absl::StrCat("Invalid vector parameter size: ", nonces.size(),
+                               " (vector size must be >= ",
+                               count * kAesGcmNonceSize, ")"));
+  }
+  uint64_t first;
+  ASYLO_RETURN_IF_ERROR(Reserve(count, &first));
+  for (size_t i = 0; i < count; ++i) {
+    WriteNonce(first + i, nonces.data() + i * kAesGcmNonceSize);
+  }
+  return Status::OkStatus();
+}
+
+CounterNonceGenerator::CounterNonceGenerator(uint64_t prefix,
+                                             uint64_t max_nonces)
+    : prefix_(prefix), max_nonces_(max_nonces), next_counter_(0) {}
+
+Status CounterNonceGenerator::Reserve(uint64_t count, uint64_t *first) {
+  uint64_t next = next_counter_.load(std::memory_order_relaxed);
+  do {
+    if (count > max_nonces_ - next) {
+      return Status(error::GoogleError::FAILED_PRECONDITION,
+                    absl::StrCat("Reached maximum number of nonces (",
+                                 max_nonces_, ")"));
+    }
+  } while (!next_counter_.compare_exchange_weak(next, next + count,
+                                                std::memory_order_relaxed));
+  *first = next;
+  return Status::OkStatus();
+}
+
+void CounterNonceGenerator::WriteNonce(uint64_t counter, uint8_t *nonce) const {
+  StoreBigEndian(prefix_, nonce);
+  StoreBigEndian(static_cast<uint32_t>(counter), nonce + kPrefixSize);
+}
+
+}  // namespace asylo
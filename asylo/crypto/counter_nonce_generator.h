@@ -0,0 +1,87 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_CRYPTO_COUNTER_NONCE_GENERATOR_H_
+#define ASYLO_CRYPTO_COUNTER_NONCE_GENERATOR_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "absl/types/span.h"
+#include "asylo/crypto/nonce_generator_interface.h"
+#include "asylo/util/status.h"
+#include "asylo/util/statusor.h"
+
+namespace asylo {
+
+// CounterNonceGenerator generates AES-GCM nonces deterministically, as a random
+// 64-bit prefix chosen at creation followed by a 32-bit big-endian counter (the
+// deterministic construction of NIST SP 800-38D, section 8.2.1). Nonces from a
+// single generator never repeat, and no randomness is drawn after creation.
+//
+// Generators used with the same key, whether concurrently or across restarts,
+// repeat each other's nonces only if their prefixes collide. The prefix is made
+// as wide as the counter allows so that this is negligible: with 2^20
+// generators per key, the probability is below 2^-25.
+//
+// A generator hands out at most a fixed number of nonces, after which
+// NextNonce() fails. Counters are reserved with atomic operations, so
+// concurrent callers never block each other.
+class CounterNonceGenerator : public NonceGeneratorInterface {
+ public:
+  // Creates a NonceGenerator compliant with the standard for AES-GCM nonces
+  // that generates at most |max_nonces| nonces. Returns a non-OK status if
+  // |max_nonces| exceeds the range of the 32-bit counter or if the random
+  // prefix could not be generated.
+  static StatusOr<std::unique_ptr<CounterNonceGenerator>>
+  CreateAesGcmNonceGenerator(uint64_t max_nonces);
+
+  // From NonceGeneratorInterface.
+
+  size_t NonceSize() const override;
+
+  Status NextNonce(absl::Span<uint8_t> nonce) override;
+
+  Status NextNonces(size_t count, absl::Span<uint8_t> nonces) override;
+
+ private:
+  CounterNonceGenerator(uint64_t prefix, uint64_t max_nonces);
+
+  // Reserves |count| consecutive counter values and returns the first of them
+  // through |first|. Returns a non-OK status, and reserves nothing, if fewer
+  // than |count| values remain.
+  Status Reserve(uint64_t count, uint64_t *first);
+
+  // Writes the nonce for |counter| to the start of |nonce|.
+  void WriteNonce(uint64_t counter, uint8_t *nonce) const;
+
+  // The fixed field shared by every nonce from this generator.
+  const uint64_t prefix_;
+
+  // The number of nonces this generator may generate.
+  const uint64_t max_nonces_;
+
+  // The counter value of the next nonce.
+  std::atomic<uint64_t> next_counter_;
+};
+
+}  // namespace asylo
+
+#endif  // ASYLO_CRYPTO_COUNTER_NONCE_GENERATOR_H_
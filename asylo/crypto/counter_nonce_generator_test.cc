@@ -0,0 +1,160 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/crypto/counter_nonce_generator.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/container/flat_hash_set.h"
+#include "absl/types/span.h"
+#include "asylo/test/util/status_matchers.h"
+
+namespace asylo {
+namespace {
+
+constexpr size_t kAesGcmNonceSize = 12;
+constexpr size_t kPrefixSize = 8;
+constexpr size_t kBadNonceSize = 11;
+constexpr uint64_t kMaxNonces = 1024;
+constexpr int kThreadCount = 8;
+
+std::unique_ptr<CounterNonceGenerator> CreateGenerator(uint64_t max_nonces) {
+  auto generator_result =
+      CounterNonceGenerator::CreateAesGcmNonceGenerator(max_nonces);
+  EXPECT_THAT(generator_result, IsOk());
+  return std::move(generator_result).ValueOrDie();
+}
+
+// Tests that NonceSize() returns the AES-GCM nonce size.
+TEST(CounterNonceGeneratorTest, NonceSize) {
+  EXPECT_EQ(CreateGenerator(kMaxNonces)->NonceSize(), kAesGcmNonceSize);
+}
+
+// Tests that consecutive nonces share a prefix and count up from zero.
+TEST(CounterNonceGeneratorTest, NoncesCountUp) {
+  std::unique_ptr<CounterNonceGenerator> nonce_generator =
+      CreateGenerator(kMaxNonces);
+  std::vector<uint8_t> first(kAesGcmNonceSize);
+  std::vector<uint8_t> second(kAesGcmNonceSize);
+  ASYLO_ASSERT_OK(nonce_generator->NextNonce(absl::MakeSpan(first)));
+  ASYLO_ASSERT_OK(nonce_generator->NextNonce(absl::MakeSpan(second)));
+
+  EXPECT_TRUE(std::equal(first.begin(), first.begin() + kPrefixSize,
+                         second.begin()));
+  EXPECT_THAT(std::vector<uint8_t>(first.begin() + kPrefixSize, first.end()),
+              testing::ElementsAre(0, 0, 0, 0));
+  EXPECT_THAT(std::vector<uint8_t>(second.begin() + kPrefixSize, second.end()),
+              testing::ElementsAre(0, 0, 0, 1));
+}
+
+// Tests that separately created generators choose different prefixes.
+TEST(CounterNonceGeneratorTest, GeneratorsHaveDistinctPrefixes) {
+  std::vector<uint8_t> first(kAesGcmNonceSize);
+  std::vector<uint8_t> second(kAesGcmNonceSize);
+  ASYLO_ASSERT_OK(
+      CreateGenerator(kMaxNonces)->NextNonce(absl::MakeSpan(first)));
+  ASYLO_ASSERT_OK(
+      CreateGenerator(kMaxNonces)->NextNonce(absl::MakeSpan(second)));
+  EXPECT_NE(first, second);
+}
+
+// Tests that a generator cannot be created for more nonces than its counter
+// can number.
+TEST(CounterNonceGeneratorTest, RejectsMaxNoncesBeyondCounterRange) {
+  ASYLO_EXPECT_OK(CounterNonceGenerator::CreateAesGcmNonceGenerator(
+      UINT64_C(1) << 32));
+  EXPECT_THAT(CounterNonceGenerator::CreateAesGcmNonceGenerator(
+                  (UINT64_C(1) << 32) + 1),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+}
+
+// Tests that NextNonces() continues the sequence of NextNonce().
+TEST(CounterNonceGeneratorTest, NextNoncesContinuesSequence) {
+  std::unique_ptr<CounterNonceGenerator> nonce_generator =
+      CreateGenerator(kMaxNonces);
+  std::vector<uint8_t> nonce(kAesGcmNonceSize);
+  ASYLO_ASSERT_OK(nonce_generator->NextNonce(absl::MakeSpan(nonce)));
+  std::vector<uint8_t> nonces(3 * kAesGcmNonceSize);
+  ASYLO_ASSERT_OK(nonce_generator->NextNonces(3, absl::MakeSpan(nonces)));
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(nonces[(i + 1) * kAesGcmNonceSize - 1], i + 1);
+  }
+}
+
+// Tests that a generator stops after generating its maximum number of nonces,
+// and that a batch which does not fit consumes nothing.
+TEST(CounterNonceGeneratorTest, EnforcesMaxNonces) {
+  std::unique_ptr<CounterNonceGenerator> nonce_generator = CreateGenerator(3);
+  std::vector<uint8_t> nonces(4 * kAesGcmNonceSize);
+  EXPECT_THAT(nonce_generator->NextNonces(4, absl::MakeSpan(nonces)),
+              StatusIs(error::GoogleError::FAILED_PRECONDITION));
+  ASYLO_EXPECT_OK(nonce_generator->NextNonces(3, absl::MakeSpan(nonces)));
+  EXPECT_THAT(nonce_generator->NextNonce(absl::MakeSpan(nonces)),
+              StatusIs(error::GoogleError::FAILED_PRECONDITION));
+}
+
+// Tests that nonces generated concurrently are unique.
+TEST(CounterNonceGeneratorTest, ConcurrentNoncesAreUnique) {
+  std::unique_ptr<CounterNonceGenerator> nonce_generator =
+      CreateGenerator(kMaxNonces);
+  std::vector<std::vector<uint8_t>> nonces(
+      kThreadCount, std::vector<uint8_t>(kMaxNonces / kThreadCount *
+                                         kAesGcmNonceSize));
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreadCount; ++t) {
+    threads.emplace_back([&nonce_generator, &nonces, t] {
+      for (size_t i = 0; i < nonces[t].size(); i += kAesGcmNonceSize) {
+        ASYLO_EXPECT_OK(nonce_generator->NextNonce(
+            absl::MakeSpan(nonces[t]).subspan(i, kAesGcmNonceSize)));
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  absl::flat_hash_set<std::string> generated_nonces;
+  for (const std::vector<uint8_t> &thread_nonces : nonces) {
+    for (size_t i = 0; i < thread_nonces.size(); i += kAesGcmNonceSize) {
+      EXPECT_TRUE(generated_nonces
+                      .emplace(thread_nonces.begin() + i,
+                               thread_nonces.begin() + i + kAesGcmNonceSize)
+                      .second);
+    }
+  }
+  EXPECT_EQ(generated_nonces.size(), kMaxNonces);
+}
+
+// Tests that NextNonce() returns a non-OK Status if it is given a nonce with
+// an invalid size.
+TEST(CounterNonceGeneratorTest, IncorrectNonceSize) {
+  std::unique_ptr<CounterNonceGenerator> nonce_generator =
+      CreateGenerator(kMaxNonces);
+  std::vector<uint8_t> nonce(kBadNonceSize);
+  EXPECT_THAT(nonce_generator->NextNonce(absl::MakeSpan(nonce)),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+}
+
+}  // namespace
+}  // namespace asylo
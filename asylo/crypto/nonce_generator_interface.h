@@ -42,6 +42,26 @@ class NonceGeneratorInterface {
   // nonce-generation was not successful. |nonce|.size() must be greater than or
   // equal to NonceSize().
   virtual Status NextNonce(absl::Span<uint8_t> nonce) = 0;
+
+  // Generates |count| new nonces and writes them consecutively to |nonces|, the
+  // i-th nonce occupying NonceSize() bytes starting at i * NonceSize(). Returns
+  // a non-OK status if nonce-generation was not successful. |nonces|.size()
+  // must be greater than or equal to |count| * NonceSize(). Implementations
+  // may override this to generate many nonces more cheaply than one at a time.
+  virtual Status NextNonces(size_t count, absl::Span<uint8_t> nonces) {
+    size_t nonce_size = NonceSize();
+    if (nonces.size() / nonce_size < count) {
+      return Status(error::GoogleError::INVALID_ARGUMENT,
+                    "Nonce buffer is too small for the requested nonces");
+    }
+    for (size_t i = 0; i < count; ++i) {
+      Status status = NextNonce(nonces.subspan(i * nonce_size, nonce_size));
+      if (!status.ok()) {
+        return status;
+      }
+    }
+    return Status::OkStatus();
+  }
 };
 
 }  // namespace asylo
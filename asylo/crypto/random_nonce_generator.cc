@@ -56,6 +56,23 @@ Status RandomNonceGenerator::NextNonce(absl::Span<uint8_t> nonce) {
   return Status::OkStatus();
 }
 
+Status RandomNonceGenerator::NextNonces(size_t count,
+                                        absl::Span<uint8_t> nonces) {
+  if (nonces.size() / nonce_size_ < count) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  absl::StrCat("Invalid vector parameter size: ", nonces.size(),
+                               " (vector size must be >= ", count * nonce_size_,
+                               ")"));
+  }
+  // Nonces are independent and uniformly random, so all of them can be drawn
+  // with a single call.
+  if (RAND_bytes(nonces.data(), count * nonce_size_) != 1) {
+    return Status(error::GoogleError::INTERNAL,
+                  absl::StrCat("RAND_bytes failed: ", BsslLastErrorString()));
+  }
+  return Status::OkStatus();
+}
+
 RandomNonceGenerator::RandomNonceGenerator(size_t size) : nonce_size_(size) {}
 
 }  // namespace asylo
@@ -42,6 +42,8 @@ class RandomNonceGenerator : public NonceGeneratorInterface {
 
   Status NextNonce(absl::Span<uint8_t> nonce) override;
 
+  Status NextNonces(size_t count, absl::Span<uint8_t> nonces) override;
+
  private:
   // Creates a RandomNonceGenerator that creates nonces of size |size|.
   RandomNonceGenerator(size_t size);
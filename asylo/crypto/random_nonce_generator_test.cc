@@ -84,5 +84,32 @@ TEST(RandomNonceGeneratorTest, RandomNonceGeneratorIncorrectNonceSize) {
               StatusIs(error::GoogleError::INVALID_ARGUMENT));
 }
 
+// Tests that NextNonces() fills every nonce in the batch, with no collisions in
+// a sampling.
+TEST(RandomNonceGeneratorTest, RandomNonceGeneratorNextNonces) {
+  std::unique_ptr<RandomNonceGenerator> nonce_generator =
+      RandomNonceGenerator::CreateAesGcmNonceGenerator();
+  std::vector<uint8_t> nonces(kNumberOfGeneratedNonces * kAesGcmNonceSize);
+  ASYLO_ASSERT_OK(nonce_generator->NextNonces(kNumberOfGeneratedNonces,
+                                              absl::MakeSpan(nonces)));
+  absl::flat_hash_set<std::string> generated_nonces;
+  for (int j = 0; j < nonces.size(); j += kNoncePartSize) {
+    EXPECT_TRUE(
+        generated_nonces
+            .emplace(nonces.cbegin() + j, nonces.cbegin() + j + kNoncePartSize)
+            .second);
+  }
+}
+
+// Tests that NextNonces() returns a non-OK Status if the buffer cannot hold
+// all of the requested nonces.
+TEST(RandomNonceGeneratorTest, RandomNonceGeneratorNextNoncesIncorrectSize) {
+  std::unique_ptr<RandomNonceGenerator> nonce_generator =
+      RandomNonceGenerator::CreateAesGcmNonceGenerator();
+  std::vector<uint8_t> nonces(2 * kAesGcmNonceSize - 1);
+  EXPECT_THAT(nonce_generator->NextNonces(2, absl::MakeSpan(nonces)),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+}
+
 }  // namespace
 }  // namespace asylo
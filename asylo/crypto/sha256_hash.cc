@@ -20,10 +20,190 @@
 
 #include <openssl/sha.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "absl/strings/str_cat.h"
 #include "asylo/crypto/util/bssl_util.h"
 #include "asylo/crypto/util/byte_container_view.h"
+#include "asylo/util/status_macros.h"
 
 namespace asylo {
+namespace {
+
+// Hashes |message| into |digest|, continuing from |prefix_context|.
+Status HashOne(const SHA256_CTX &prefix_context, ByteContainerView message,
+               uint8_t *digest) {
+  SHA256_CTX context = prefix_context;
+  SHA256_Update(&context, message.data(), message.size());
+  if (SHA256_Final(digest, &context) != 1) {
+    return Status(error::GoogleError::INTERNAL, BsslLastErrorString());
+  }
+  return Status::OkStatus();
+}
+
+#ifndef __SHA__
+
+// A portable multi-lane SHA-256, which hashes kLanes messages of equal length
+// at once with one message in each 32-bit lane of a vector. It is written with
+// compiler vector extensions rather than intrinsics, so it needs no CPU
+// feature detection, which enclave code cannot perform.
+
+// Eight 32-bit lanes fill a 256-bit vector register.
+constexpr size_t kLanes = 8;
+
+// Shorter runs of equal-length messages are hashed one at a time, since the
+// unused lanes of a group are wasted work.
+constexpr size_t kMinLaneRun = kLanes / 2;
+
+constexpr size_t kBlockSize = 64;
+constexpr size_t kLengthOffset = kBlockSize - sizeof(uint64_t);
+
+typedef uint32_t LaneWords __attribute__((vector_size(kLanes * 4)));
+
+// Rotates each lane of |x| right by |bits|. This is a macro rather than a
+// function because functions returning LaneWords have an ABI that depends on
+// whether the build enables AVX.
+#define LANE_ROTR(x, bits) (((x) >> (bits)) | ((x) << (32 - (bits))))
+
+constexpr uint32_t kInitialState[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                       0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                       0x1f83d9ab, 0x5be0cd19};
+
+constexpr uint32_t kRoundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+// Returns the number of blocks in the padded form of a |size|-byte message:
+// the message, a 0x80 byte, zeros, and the 64-bit message length in bits.
+size_t PaddedBlockCount(size_t size) {
+  return (size + 1 + sizeof(uint64_t) + kBlockSize - 1) / kBlockSize;
+}
+
+// Copies the bytes of |part|, which starts |part_offset| bytes into a message,
+// that fall in the block starting |block_offset| bytes into it to |block|.
+void CopyIntoBlock(ByteContainerView part, size_t part_offset,
+                   size_t block_offset, uint8_t *block) {
+  size_t begin = std::max(block_offset, part_offset);
+  size_t end = std::min(block_offset + kBlockSize, part_offset + part.size());
+  if (begin < end) {
+    memcpy(block + (begin - block_offset), part.data() + (begin - part_offset),
+           end - begin);
+  }
+}
+
+// Writes block |index| of the padded form of |prefix| followed by |message|
+// to |block|.
+void PaddedBlock(ByteContainerView prefix, ByteContainerView message,
+                 size_t index, uint8_t *block) {
+  size_t size = prefix.size() + message.size();
+  size_t block_offset = index * kBlockSize;
+  memset(block, 0, kBlockSize);
+  CopyIntoBlock(prefix, 0, block_offset, block);
+  CopyIntoBlock(message, prefix.size(), block_offset, block);
+  if (size >= block_offset && size < block_offset + kBlockSize) {
+    block[size - block_offset] = 0x80;
+  }
+  if (index + 1 == PaddedBlockCount(size)) {
+    uint64_t bits = static_cast<uint64_t>(size) * 8;
+    for (size_t i = 0; i < sizeof(uint64_t); ++i) {
+      block[kLengthOffset + i] =
+          static_cast<uint8_t>(bits >> (8 * (sizeof(uint64_t) - 1 - i)));
+    }
+  }
+}
+
+// Hashes |prefix| followed by each of the kLanes equal-length |messages| into
+// the matching element of |digests|. Null digests are not written.
+void HashLanes(ByteContainerView prefix,
+               const ByteContainerView *const messages[kLanes],
+               uint8_t *const digests[kLanes]) {
+  LaneWords state[8];
+  for (int i = 0; i < 8; ++i) {
+    state[i] = LaneWords{} + kInitialState[i];
+  }
+
+  uint8_t blocks[kLanes][kBlockSize];
+  size_t block_count = PaddedBlockCount(prefix.size() + messages[0]->size());
+  for (size_t index = 0; index < block_count; ++index) {
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+      PaddedBlock(prefix, *messages[lane], index, blocks[lane]);
+    }
+
+    LaneWords schedule[64];
+    for (int i = 0; i < 16; ++i) {
+      for (size_t lane = 0; lane < kLanes; ++lane) {
+        const uint8_t *word = blocks[lane] + 4 * i;
+        schedule[i][lane] = (uint32_t{word[0]} << 24) |
+                            (uint32_t{word[1]} << 16) |
+                            (uint32_t{word[2]} << 8) | uint32_t{word[3]};
+      }
+    }
+    for (int i = 16; i < 64; ++i) {
+      LaneWords s0 = LANE_ROTR(schedule[i - 15], 7) ^
+                     LANE_ROTR(schedule[i - 15], 18) ^
+                     (schedule[i - 15] >> 3);
+      LaneWords s1 = LANE_ROTR(schedule[i - 2], 17) ^
+                     LANE_ROTR(schedule[i - 2], 19) ^
+                     (schedule[i - 2] >> 10);
+      schedule[i] = schedule[i - 16] + s0 + schedule[i - 7] + s1;
+    }
+
+    LaneWords a = state[0], b = state[1], c = state[2], d = state[3];
+    LaneWords e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; ++i) {
+      LaneWords s1 = LANE_ROTR(e, 6) ^ LANE_ROTR(e, 11) ^ LANE_ROTR(e, 25);
+      LaneWords choice = (e & f) ^ (~e & g);
+      LaneWords temp1 = h + s1 + choice + kRoundConstants[i] + schedule[i];
+      LaneWords s0 = LANE_ROTR(a, 2) ^ LANE_ROTR(a, 13) ^ LANE_ROTR(a, 22);
+      LaneWords majority = (a & b) ^ (a & c) ^ (b & c);
+      h = g;
+      g = f;
+      f = e;
+      e = d + temp1;
+      d = c;
+      c = b;
+      b = a;
+      a = temp1 + s0 + majority;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  }
+
+  for (size_t lane = 0; lane < kLanes; ++lane) {
+    if (digests[lane] == nullptr) {
+      continue;
+    }
+    for (int i = 0; i < 8; ++i) {
+      uint32_t word = state[i][lane];
+      for (int j = 0; j < 4; ++j) {
+        digests[lane][4 * i + j] = static_cast<uint8_t>(word >> (24 - 8 * j));
+      }
+    }
+  }
+}
+
+#undef LANE_ROTR
+
+#endif  // __SHA__
+
+}  // namespace
 
 Sha256Hash::Sha256Hash() { Init(); }
 
@@ -51,4 +231,51 @@ Status Sha256Hash::CumulativeHash(std::vector<uint8_t> *digest) const {
   return Status::OkStatus();
 }
 
+Status Sha256Hash::HashMany(absl::Span<const ByteContainerView> messages,
+                            absl::Span<uint8_t> digests) {
+  return HashMany(ByteContainerView(nullptr, 0), messages, digests);
+}
+
+Status Sha256Hash::HashMany(ByteContainerView prefix,
+                            absl::Span<const ByteContainerView> messages,
+                            absl::Span<uint8_t> digests) {
+  if (digests.size() / SHA256_DIGEST_LENGTH < messages.size()) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  absl::StrCat("Digest buffer of ", digests.size(),
+                               " bytes is too small for ", messages.size(),
+                               " digests"));
+  }
+  SHA256_CTX prefix_context;
+  SHA256_Init(&prefix_context);
+  SHA256_Update(&prefix_context, prefix.data(), prefix.size());
+
+  size_t index = 0;
+  while (index < messages.size()) {
+    uint8_t *digest = digests.data() + index * SHA256_DIGEST_LENGTH;
+#ifndef __SHA__
+    size_t run = 1;
+    while (run < kLanes && index + run < messages.size() &&
+           messages[index + run].size() == messages[index].size()) {
+      ++run;
+    }
+    if (run >= kMinLaneRun) {
+      // Unused lanes repeat the first message and their digests are dropped.
+      const ByteContainerView *lane_messages[kLanes];
+      uint8_t *lane_digests[kLanes];
+      for (size_t lane = 0; lane < kLanes; ++lane) {
+        lane_messages[lane] = &messages[index + (lane < run ? lane : 0)];
+        lane_digests[lane] =
+            lane < run ? digest + lane * SHA256_DIGEST_LENGTH : nullptr;
+      }
+      HashLanes(prefix, lane_messages, lane_digests);
+      index += run;
+      continue;
+    }
+#endif  // __SHA__
+    ASYLO_RETURN_IF_ERROR(HashOne(prefix_context, messages[index], digest));
+    ++index;
+  }
+  return Status::OkStatus();
+}
+
 }  // namespace asylo
@@ -23,6 +23,7 @@
 
 #include <vector>
 
+#include "absl/types/span.h"
 #include "asylo/crypto/hash_interface.h"
 #include "asylo/crypto/util/byte_container_view.h"
 #include "asylo/util/status.h"
@@ -41,6 +42,22 @@ class Sha256Hash final : public HashInterface {
   void Update(ByteContainerView data) override;
   Status CumulativeHash(std::vector<uint8_t> *digest) const override;
 
+  // Computes the SHA-256 digest of each of |messages| and writes the digests
+  // consecutively to |digests|, the i-th digest occupying SHA256_DIGEST_LENGTH
+  // bytes starting at i * SHA256_DIGEST_LENGTH. |digests|.size() must be at
+  // least |messages|.size() * SHA256_DIGEST_LENGTH.
+  //
+  // Runs of messages of equal length are hashed several at a time in SIMD
+  // lanes. Builds that target the SHA extensions instead hash each message
+  // with BoringSSL, which uses those instructions and outpaces the lanes.
+  static Status HashMany(absl::Span<const ByteContainerView> messages,
+                         absl::Span<uint8_t> digests);
+
+  // As HashMany(), but hashes |prefix| followed by each of |messages|.
+  static Status HashMany(ByteContainerView prefix,
+                         absl::Span<const ByteContainerView> messages,
+                         absl::Span<uint8_t> digests);
+
  private:
   SHA256_CTX context_;
 };
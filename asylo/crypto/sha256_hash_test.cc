@@ -27,8 +27,11 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include "absl/strings/escaping.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
 #include "asylo/crypto/algorithms.pb.h"
 #include "asylo/crypto/util/byte_container_util.h"
+#include "asylo/crypto/util/byte_container_view.h"
 #include "asylo/test/util/status_matchers.h"
 
 namespace asylo {
@@ -112,5 +115,100 @@ TEST(Sha256HashTest, MultipleUpdates) {
             kResult2);
 }
 
+// Returns |count| messages of |size| bytes, each with distinct contents.
+std::vector<std::string> MakeMessages(size_t count, size_t size) {
+  std::vector<std::string> messages;
+  for (size_t i = 0; i < count; ++i) {
+    std::string message(size, '\0');
+    for (size_t j = 0; j < size; ++j) {
+      message[j] = static_cast<char>(i * 131 + j * 7);
+    }
+    messages.push_back(message);
+  }
+  return messages;
+}
+
+// Verifies that |digests| holds the SHA-256 digest of |prefix| followed by
+// each of |messages|, in order.
+void ExpectDigests(const std::string &prefix,
+                   const std::vector<std::string> &messages,
+                   const std::vector<uint8_t> &digests) {
+  ASSERT_GE(digests.size(), messages.size() * SHA256_DIGEST_LENGTH);
+  for (size_t i = 0; i < messages.size(); ++i) {
+    Sha256Hash hash;
+    hash.Update(prefix);
+    hash.Update(messages[i]);
+    std::vector<uint8_t> expected;
+    ASSERT_THAT(hash.CumulativeHash(&expected), IsOk());
+    EXPECT_EQ(std::vector<uint8_t>(
+                  digests.begin() + i * SHA256_DIGEST_LENGTH,
+                  digests.begin() + (i + 1) * SHA256_DIGEST_LENGTH),
+              expected)
+        << "Message " << i << " of " << messages[i].size() << " bytes";
+  }
+}
+
+// Verify that HashMany matches the incremental hash for a range of message
+// lengths, including those that straddle the padding boundaries.
+TEST(Sha256HashTest, HashManyEqualLengths) {
+  for (size_t size : {0, 1, 55, 56, 63, 64, 119, 120, 200, 4097}) {
+    for (size_t count : {1, 3, 4, 8, 13}) {
+      std::vector<std::string> messages = MakeMessages(count, size);
+      std::vector<ByteContainerView> views(messages.begin(), messages.end());
+      std::vector<uint8_t> digests(count * SHA256_DIGEST_LENGTH);
+      ASSERT_THAT(Sha256Hash::HashMany(views, absl::MakeSpan(digests)),
+                  IsOk());
+      ExpectDigests("", messages, digests);
+    }
+  }
+}
+
+// Verify that HashMany handles batches that mix message lengths.
+TEST(Sha256HashTest, HashManyMixedLengths) {
+  std::vector<std::string> messages;
+  for (size_t size = 0; size < 200; ++size) {
+    for (const std::string &message : MakeMessages(size % 11, size)) {
+      messages.push_back(message);
+    }
+  }
+  std::vector<ByteContainerView> views(messages.begin(), messages.end());
+  std::vector<uint8_t> digests(messages.size() * SHA256_DIGEST_LENGTH);
+  ASSERT_THAT(Sha256Hash::HashMany(views, absl::MakeSpan(digests)), IsOk());
+  ExpectDigests("", messages, digests);
+}
+
+// Verify that HashMany prepends the prefix to every message.
+TEST(Sha256HashTest, HashManyWithPrefix) {
+  for (size_t prefix_size : {1, 63, 64, 100}) {
+    std::string prefix(prefix_size, '\x01');
+    std::vector<std::string> messages = MakeMessages(10, 32);
+    messages.push_back(kSuffix);
+    std::vector<ByteContainerView> views(messages.begin(), messages.end());
+    std::vector<uint8_t> digests(messages.size() * SHA256_DIGEST_LENGTH);
+    ASSERT_THAT(
+        Sha256Hash::HashMany(prefix, views, absl::MakeSpan(digests)), IsOk());
+    ExpectDigests(prefix, messages, digests);
+  }
+}
+
+// Verify that HashMany matches the standard test vectors.
+TEST(Sha256HashTest, HashManyTestVectors) {
+  std::vector<ByteContainerView> views = {kTestVector1, kTestVector2};
+  std::vector<uint8_t> digests(2 * SHA256_DIGEST_LENGTH);
+  ASSERT_THAT(Sha256Hash::HashMany(views, absl::MakeSpan(digests)), IsOk());
+  std::string hex =
+      absl::BytesToHexString(CopyToByteContainer<std::string>(digests));
+  EXPECT_EQ(hex, absl::StrCat(kResult1, kResult2));
+}
+
+// Verify that HashMany rejects a digest buffer that is too small.
+TEST(Sha256HashTest, HashManyShortDigestBuffer) {
+  std::vector<std::string> messages = MakeMessages(4, 16);
+  std::vector<ByteContainerView> views(messages.begin(), messages.end());
+  std::vector<uint8_t> digests(4 * SHA256_DIGEST_LENGTH - 1);
+  EXPECT_THAT(Sha256Hash::HashMany(views, absl::MakeSpan(digests)),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+}
+
 }  // namespace
 }  // namespace asylo
@@ -0,0 +1,397 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/crypto/streaming_aead_cryptor.h"
+
+#include <openssl/digest.h>
+#include <openssl/hkdf.h>
+#include <openssl/rand.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "asylo/crypto/aead_key.h"
+#include "asylo/crypto/util/bssl_util.h"
+#include "asylo/util/posix_error_space.h"
+#include "asylo/util/status_macros.h"
+#include "asylo/util/worker_pool.h"
+
+namespace asylo {
+namespace experimental {
+namespace {
+
+using google::protobuf::io::FileInputStream;
+using google::protobuf::io::FileOutputStream;
+using google::protobuf::io::ZeroCopyInputStream;
+using google::protobuf::io::ZeroCopyOutputStream;
+
+// Layout of the stream header: the format version, the big-endian segment size
+// and the salt from which the stream key is derived.
+constexpr uint8_t kFormatVersion = 1;
+constexpr size_t kSegmentSizeOffset = 1;
+constexpr size_t kSaltOffset = kSegmentSizeOffset + sizeof(uint32_t);
+constexpr size_t kSaltSize = 16;
+constexpr size_t kHeaderSize = kSaltOffset + kSaltSize;
+
+// Layout of a segment nonce: zero padding, the big-endian segment index and the
+// final-segment flag.
+constexpr size_t kNonceSize = 12;
+constexpr size_t kSegmentIndexOffset = 7;
+constexpr size_t kFinalFlagOffset = 11;
+
+// Segment indices are 32 bits wide, and segments are kept small enough that a
+// few of them fit comfortably in enclave memory.
+constexpr uint64_t kMaxSegments = UINT64_C(1) << 32;
+constexpr size_t kMaxSegmentSize = static_cast<size_t>(1) << 24;
+
+// The maximum number of segments processed concurrently.
+constexpr int kMaxThreadCount = 64;
+
+constexpr size_t kAes128KeySize = 16;
+constexpr size_t kAes256KeySize = 32;
+
+// Reads from |input| until |buffer| is full or |input| ends, and returns the
+// number of bytes read.
+size_t ReadFully(ZeroCopyInputStream *input, absl::Span<uint8_t> buffer) {
+  size_t total = 0;
+  const void *data;
+  int size;
+  while (total < buffer.size() && input->Next(&data, &size)) {
+    size_t count = std::min(buffer.size() - total, static_cast<size_t>(size));
+    memcpy(buffer.data() + total, data, count);
+    total += count;
+    if (count < static_cast<size_t>(size)) {
+      input->BackUp(size - count);
+    }
+  }
+  return total;
+}
+
+// Writes all of |data| to |output|.
+Status WriteAll(ZeroCopyOutputStream *output, ByteContainerView data) {
+  size_t total = 0;
+  void *buffer;
+  int size;
+  while (total < data.size()) {
+    if (!output->Next(&buffer, &size)) {
+      return Status(error::GoogleError::INTERNAL,
+                    "Failed to write to the output stream");
+    }
+    size_t count = std::min(data.size() - total, static_cast<size_t>(size));
+    memcpy(buffer, data.data() + total, count);
+    total += count;
+    if (count < static_cast<size_t>(size)) {
+      output->BackUp(size - count);
+    }
+  }
+  return Status::OkStatus();
+}
+
+// Writes |value| to |out| in big-endian byte order.
+void StoreBigEndian32(uint32_t value, uint8_t *out) {
+  for (size_t i = 0; i < sizeof(uint32_t); ++i) {
+    out[sizeof(uint32_t) - 1 - i] = static_cast<uint8_t>(value >> (8 * i));
+  }
+}
+
+// Returns the nonce of the segment at |index|, which is the final segment of
+// its stream if |final_segment| is true.
+std::vector<uint8_t> SegmentNonce(uint64_t index, bool final_segment) {
+  std::vector<uint8_t> nonce(kNonceSize, 0);
+  StoreBigEndian32(static_cast<uint32_t>(index),
+                   nonce.data() + kSegmentIndexOffset);
+  nonce[kFinalFlagOffset] = final_segment ? 1 : 0;
+  return nonce;
+}
+
+// Returns the number of segments processed at a time for |thread_count|
+// threads.
+size_t BatchSize(int thread_count) {
+  return std::min(std::max(thread_count, 1), kMaxThreadCount);
+}
+
+// Returns the worker threads shared by the streams of all cryptors.
+WorkerPool *SegmentWorkers() {
+  static WorkerPool *workers = new WorkerPool(kMaxThreadCount - 1);
+  return workers;
+}
+
+// Runs |op| on each segment index in [0, |count|), on the calling thread and on
+// SegmentWorkers(). Returns the failure of the lowest failing index, if any.
+Status ForEachSegment(size_t count, const std::function<Status(size_t)> &op) {
+  std::vector<Status> results(count);
+  SegmentWorkers()->ParallelFor(
+      count, [&op, &results](size_t i) { results[i] = op(i); });
+  for (const Status &status : results) {
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  return Status::OkStatus();
+}
+
+// A batch of segments read ahead of processing. Reading one segment past the
+// batch tells whether the last segment of the batch ends the stream.
+class SegmentReader {
+ public:
+  SegmentReader(ZeroCopyInputStream *input, size_t segment_size,
+                int thread_count)
+      : input_(input),
+        segment_size_(segment_size),
+        batch_size_(BatchSize(thread_count)),
+        segments_(batch_size_ + 1, CleansingVector<uint8_t>(segment_size)),
+        sizes_(batch_size_ + 1),
+        count_(0),
+        done_(false) {
+    sizes_[0] = ReadFully(input_, absl::MakeSpan(segments_[0]));
+  }
+
+  // Reads the next batch of segments. Returns false once the stream is done.
+  bool NextBatch() {
+    if (done_) {
+      return false;
+    }
+    if (count_ > 0) {
+      std::swap(segments_[0], segments_[count_]);
+      sizes_[0] = sizes_[count_];
+    }
+    count_ = 0;
+    while (count_ < batch_size_ && !done_) {
+      ++count_;
+      if (sizes_[count_ - 1] < segment_size_) {
+        done_ = true;
+      } else {
+        sizes_[count_] = ReadFully(input_, absl::MakeSpan(segments_[count_]));
+        done_ = sizes_[count_] == 0;
+      }
+    }
+    return true;
+  }
+
+  // The number of segments in the current batch.
+  size_t count() const { return count_; }
+
+  // Whether the last segment of the current batch is the final segment.
+  bool done() const { return done_; }
+
+  ByteContainerView segment(size_t i) const {
+    return ByteContainerView(segments_[i].data(), sizes_[i]);
+  }
+
+ private:
+  ZeroCopyInputStream *const input_;
+  const size_t segment_size_;
+  const size_t batch_size_;
+  // Segments may hold plaintext, so they are cleansed when released.
+  std::vector<CleansingVector<uint8_t>> segments_;
+  std::vector<size_t> sizes_;
+  size_t count_;
+  bool done_;
+};
+
+// Returns the failure of a file stream that recorded errno |error| while
+// performing |operation| on |fd|.
+Status FileStreamError(int error, absl::string_view operation, int fd) {
+  return Status(static_cast<error::PosixError>(error == 0 ? EIO : error),
+                absl::StrCat("Failed to ", operation, " fd ", fd));
+}
+
+}  // namespace
+
+StatusOr<std::unique_ptr<StreamingAeadCryptor>>
+StreamingAeadCryptor::CreateAesGcmStreamingCryptor(ByteContainerView key,
+                                                   size_t segment_size) {
+  if (key.size() != kAes128KeySize && key.size() != kAes256KeySize) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  absl::StrCat("Invalid AES-GCM key length: ", key.size(),
+                               " (must be 16 or 32 bytes)"));
+  }
+  if (segment_size == 0 || segment_size > kMaxSegmentSize) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  absl::StrCat("Invalid segment size: ", segment_size,
+                               " (must be between 1 and ", kMaxSegmentSize,
+                               " bytes)"));
+  }
+  return absl::WrapUnique<StreamingAeadCryptor>(
+      new StreamingAeadCryptor(key, segment_size));
+}
+
+Status StreamingAeadCryptor::Seal(ZeroCopyInputStream *plaintext,
+                                  ByteContainerView associated_data,
+                                  ZeroCopyOutputStream *ciphertext,
+                                  int thread_count) const {
+  std::vector<uint8_t> header(kHeaderSize);
+  header[0] = kFormatVersion;
+  StoreBigEndian32(segment_size_, header.data() + kSegmentSizeOffset);
+  if (RAND_bytes(header.data() + kSaltOffset, kSaltSize) != 1) {
+    return Status(error::GoogleError::INTERNAL,
+                  absl::StrCat("RAND_bytes failed: ", BsslLastErrorString()));
+  }
+  CleansingVector<uint8_t> stream_key;
+  ASYLO_ASSIGN_OR_RETURN(stream_key, DeriveStreamKey(header));
+  std::unique_ptr<AeadKey> key;
+  ASYLO_ASSIGN_OR_RETURN(key, AeadKey::CreateAesGcmKey(stream_key));
+  ASYLO_RETURN_IF_ERROR(WriteAll(ciphertext, header));
+
+  SegmentReader reader(plaintext, segment_size_, thread_count);
+  std::vector<std::vector<uint8_t>> sealed(
+      BatchSize(thread_count),
+      std::vector<uint8_t>(segment_size_ + key->MaxSealOverhead()));
+  std::vector<size_t> sealed_sizes(sealed.size());
+  uint64_t index = 0;
+  while (reader.NextBatch()) {
+    if (reader.count() > kMaxSegments - index) {
+      return Status(error::GoogleError::OUT_OF_RANGE,
+                    absl::StrCat("Stream exceeds the maximum of ",
+                                 kMaxSegments, " segments"));
+    }
+    ASYLO_RETURN_IF_ERROR(ForEachSegment(reader.count(), [&](size_t i) {
+      bool final_segment = reader.done() && i + 1 == reader.count();
+      return key->Seal(reader.segment(i), associated_data,
+                       SegmentNonce(index + i, final_segment),
+                       absl::MakeSpan(sealed[i]), &sealed_sizes[i]);
+    }));
+    for (size_t i = 0; i < reader.count(); ++i) {
+      ASYLO_RETURN_IF_ERROR(WriteAll(
+          ciphertext, ByteContainerView(sealed[i].data(), sealed_sizes[i])));
+    }
+    index += reader.count();
+  }
+  return Status::OkStatus();
+}
+
+Status StreamingAeadCryptor::Open(ZeroCopyInputStream *ciphertext,
+                                  ByteContainerView associated_data,
+                                  ZeroCopyOutputStream *plaintext,
+                                  int thread_count) const {
+  std::vector<uint8_t> header(kHeaderSize);
+  if (ReadFully(ciphertext, absl::MakeSpan(header)) != kHeaderSize) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  "Sealed stream is too short to hold a header");
+  }
+  if (header[0] != kFormatVersion) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  absl::StrCat("Unsupported sealed stream version: ",
+                               header[0]));
+  }
+  size_t segment_size = 0;
+  for (size_t i = kSegmentSizeOffset; i < kSaltOffset; ++i) {
+    segment_size = (segment_size << 8) | header[i];
+  }
+  if (segment_size != segment_size_) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  absl::StrCat("Sealed stream segment size ", segment_size,
+                               " does not match the cryptor segment size ",
+                               segment_size_));
+  }
+  CleansingVector<uint8_t> stream_key;
+  ASYLO_ASSIGN_OR_RETURN(stream_key, DeriveStreamKey(header));
+  std::unique_ptr<AeadKey> key;
+  ASYLO_ASSIGN_OR_RETURN(key, AeadKey::CreateAesGcmKey(stream_key));
+
+  SegmentReader reader(ciphertext, segment_size_ + key->MaxSealOverhead(),
+                       thread_count);
+  std::vector<CleansingVector<uint8_t>> opened(
+      BatchSize(thread_count), CleansingVector<uint8_t>(segment_size_));
+  std::vector<size_t> opened_sizes(opened.size());
+  uint64_t index = 0;
+  while (reader.NextBatch()) {
+    if (reader.count() > kMaxSegments - index) {
+      return Status(error::GoogleError::OUT_OF_RANGE,
+                    absl::StrCat("Stream exceeds the maximum of ",
+                                 kMaxSegments, " segments"));
+    }
+    ASYLO_RETURN_IF_ERROR(ForEachSegment(reader.count(), [&](size_t i) {
+      bool final_segment = reader.done() && i + 1 == reader.count();
+      Status status = key->Open(reader.segment(i), associated_data,
+                                SegmentNonce(index + i, final_segment),
+                                absl::MakeSpan(opened[i]), &opened_sizes[i]);
+      return status.ok() ? status
+                         : status.WithPrependedContext(
+                               absl::StrCat("Segment ", index + i));
+    }));
+    for (size_t i = 0; i < reader.count(); ++i) {
+      ASYLO_RETURN_IF_ERROR(WriteAll(
+          plaintext, ByteContainerView(opened[i].data(), opened_sizes[i])));
+    }
+    index += reader.count();
+  }
+  return Status::OkStatus();
+}
+
+Status StreamingAeadCryptor::SealFile(int plaintext_fd,
+                                      ByteContainerView associated_data,
+                                      int ciphertext_fd,
+                                      int thread_count) const {
+  FileInputStream input(plaintext_fd);
+  FileOutputStream output(ciphertext_fd);
+  Status status = Seal(&input, associated_data, &output, thread_count);
+  if (input.GetErrno() != 0) {
+    return FileStreamError(input.GetErrno(), "read from", plaintext_fd);
+  }
+  if (!output.Flush()) {
+    return FileStreamError(output.GetErrno(), "write to", ciphertext_fd);
+  }
+  return status;
+}
+
+Status StreamingAeadCryptor::OpenFile(int ciphertext_fd,
+                                      ByteContainerView associated_data,
+                                      int plaintext_fd,
+                                      int thread_count) const {
+  FileInputStream input(ciphertext_fd);
+  FileOutputStream output(plaintext_fd);
+  Status status = Open(&input, associated_data, &output, thread_count);
+  if (input.GetErrno() != 0) {
+    return FileStreamError(input.GetErrno(), "read from", ciphertext_fd);
+  }
+  if (!output.Flush()) {
+    return FileStreamError(output.GetErrno(), "write to", plaintext_fd);
+  }
+  return status;
+}
+
+StreamingAeadCryptor::StreamingAeadCryptor(ByteContainerView key,
+                                           size_t segment_size)
+    : key_(key.cbegin(), key.cend()), segment_size_(segment_size) {}
+
+StatusOr<CleansingVector<uint8_t>> StreamingAeadCryptor::DeriveStreamKey(
+    ByteContainerView header) const {
+  // The salt makes each stream's key unique, and the rest of the header is
+  // bound to the key as HKDF info so that it cannot be altered.
+  CleansingVector<uint8_t> stream_key(key_.size());
+  if (HKDF(stream_key.data(), stream_key.size(), EVP_sha256(), key_.data(),
+           key_.size(), header.data() + kSaltOffset, kSaltSize, header.data(),
+           kSaltOffset) != 1) {
+    return Status(error::GoogleError::INTERNAL,
+                  absl::StrCat("HKDF failed: ", BsslLastErrorString()));
+  }
+  return stream_key;
+}
+
+}  // namespace experimental
+}  // namespace asylo
@@ -0,0 +1,123 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_CRYPTO_STREAMING_AEAD_CRYPTOR_H_
+#define ASYLO_CRYPTO_STREAMING_AEAD_CRYPTOR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include <google/protobuf/io/zero_copy_stream.h>
+#include "asylo/crypto/util/byte_container_view.h"
+#include "asylo/util/cleansing_types.h"
+#include "asylo/util/status.h"
+#include "asylo/util/statusor.h"
+
+namespace asylo {
+namespace experimental {
+
+/// A streaming AEAD cryptor that seals and opens payloads of any size with
+/// memory bounded by its segment size, rather than by the payload size.
+///
+/// A sealed stream consists of a header followed by the plaintext split into
+/// segments of `segment_size` bytes, each sealed separately with AES-GCM. The
+/// header holds a format version, the segment size and a random salt, from
+/// which a key unique to the stream is derived with HKDF-SHA256. The nonce of
+/// each segment is its index followed by a flag marking the final segment (the
+/// STREAM construction of Hoang, Reyhanitabar, Rogaway and Vizár), so
+/// segments cannot be reordered, dropped or truncated away without Open()
+/// failing.
+///
+/// Open() writes out each segment once that segment is authenticated, so if
+/// it fails part way through, the output written so far must be discarded.
+///
+/// Seal() and Open() may process up to 64 segments concurrently, on the calling
+/// thread and on a pool of worker threads shared by all cryptors, holding at
+/// most 2 * `thread_count` + 1 segments in memory at a time. This class is
+/// thread-safe.
+class StreamingAeadCryptor {
+ public:
+  /// A segment size suitable for most payloads.
+  static constexpr size_t kDefaultSegmentSize = 64 * 1024;
+
+  /// Creates a cryptor that uses AES-GCM to seal segments of `segment_size`
+  /// bytes.
+  ///
+  /// \param key The underlying key from which each stream's key is derived.
+  ///            Must be either 16 bytes or 32 bytes in size.
+  /// \param segment_size The number of plaintext bytes in each segment.
+  /// \return A pointer to the created cryptor, or a non-OK Status if creation
+  ///         failed.
+  static StatusOr<std::unique_ptr<StreamingAeadCryptor>>
+  CreateAesGcmStreamingCryptor(ByteContainerView key, size_t segment_size);
+
+  /// Reads `plaintext` to its end and writes its sealed stream to
+  /// `ciphertext`.
+  ///
+  /// \param plaintext The stream to seal.
+  /// \param associated_data The authenticated data for every segment.
+  /// \param[out] ciphertext The stream to which the sealed stream is written.
+  /// \param thread_count The number of segments sealed concurrently.
+  /// \return The resulting status of the Seal() operation.
+  Status Seal(google::protobuf::io::ZeroCopyInputStream *plaintext,
+              ByteContainerView associated_data,
+              google::protobuf::io::ZeroCopyOutputStream *ciphertext,
+              int thread_count = 1) const;
+
+  /// Reads the sealed stream `ciphertext` to its end and writes the opened
+  /// plaintext to `plaintext`.
+  ///
+  /// \param ciphertext The sealed stream.
+  /// \param associated_data The authenticated data for every segment.
+  /// \param[out] plaintext The stream to which the plaintext is written.
+  /// \param thread_count The number of segments opened concurrently.
+  /// \return The resulting status of the Open() operation.
+  Status Open(google::protobuf::io::ZeroCopyInputStream *ciphertext,
+              ByteContainerView associated_data,
+              google::protobuf::io::ZeroCopyOutputStream *plaintext,
+              int thread_count = 1) const;
+
+  /// Calls Seal() on streams reading from `plaintext_fd` and writing to
+  /// `ciphertext_fd`.
+  Status SealFile(int plaintext_fd, ByteContainerView associated_data,
+                  int ciphertext_fd, int thread_count = 1) const;
+
+  /// Calls Open() on streams reading from `ciphertext_fd` and writing to
+  /// `plaintext_fd`.
+  Status OpenFile(int ciphertext_fd, ByteContainerView associated_data,
+                  int plaintext_fd, int thread_count = 1) const;
+
+ private:
+  StreamingAeadCryptor(ByteContainerView key, size_t segment_size);
+
+  // Derives the key of the stream whose header is |header|.
+  StatusOr<CleansingVector<uint8_t>> DeriveStreamKey(
+      ByteContainerView header) const;
+
+  // The key from which each stream's key is derived.
+  const CleansingVector<uint8_t> key_;
+
+  // The number of plaintext bytes in each segment.
+  const size_t segment_size_;
+};
+
+}  // namespace experimental
+}  // namespace asylo
+
+#endif  // ASYLO_CRYPTO_STREAMING_AEAD_CRYPTOR_H_
@@ -0,0 +1,254 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/crypto/streaming_aead_cryptor.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/flags/flag.h"
+#include "absl/strings/str_cat.h"
+#include "asylo/test/util/status_matchers.h"
+#include "asylo/test/util/test_flags.h"
+#include "asylo/util/posix_error_space.h"
+#include "asylo/util/status.h"
+
+namespace asylo {
+namespace experimental {
+namespace {
+
+using google::protobuf::io::ArrayInputStream;
+using google::protobuf::io::StringOutputStream;
+using ::testing::HasSubstr;
+
+// A small segment size, so that tests cover many segments cheaply.
+constexpr size_t kSegmentSize = 64;
+constexpr size_t kTagSize = 16;
+constexpr size_t kHeaderSize = 21;
+
+// A block size for input streams that does not divide the segment size, so
+// that segments straddle the buffers returned by the stream.
+constexpr int kInputBlockSize = 23;
+
+constexpr char kAssociatedData[] = "streaming aead cryptor test";
+
+class StreamingAeadCryptorTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASYLO_ASSERT_OK_AND_ASSIGN(
+        cryptor_, StreamingAeadCryptor::CreateAesGcmStreamingCryptor(
+                      std::string(32, 'k'), kSegmentSize));
+  }
+
+  Status Seal(const std::string &plaintext, std::string *ciphertext,
+              int thread_count = 1) {
+    ArrayInputStream input(plaintext.data(), plaintext.size(),
+                           kInputBlockSize);
+    StringOutputStream output(ciphertext);
+    return cryptor_->Seal(&input, kAssociatedData, &output, thread_count);
+  }
+
+  Status Open(const std::string &ciphertext, std::string *plaintext,
+              int thread_count = 1,
+              ByteContainerView associated_data = kAssociatedData) {
+    ArrayInputStream input(ciphertext.data(), ciphertext.size(),
+                           kInputBlockSize);
+    StringOutputStream output(plaintext);
+    return cryptor_->Open(&input, associated_data, &output, thread_count);
+  }
+
+  std::unique_ptr<StreamingAeadCryptor> cryptor_;
+};
+
+std::string MakePlaintext(size_t size) {
+  std::string plaintext(size, '\0');
+  for (size_t i = 0; i < size; ++i) {
+    plaintext[i] = static_cast<char>(i * 7 + 3);
+  }
+  return plaintext;
+}
+
+// Tests that streams of various sizes around segment boundaries round-trip,
+// whether segments are processed on one thread or several.
+TEST_F(StreamingAeadCryptorTest, SealOpenRoundTrip) {
+  for (size_t size : {size_t{0}, size_t{1}, kSegmentSize - 1, kSegmentSize,
+                      kSegmentSize + 1, 9 * kSegmentSize + 7}) {
+    for (int thread_count : {1, 4}) {
+      std::string plaintext = MakePlaintext(size);
+      std::string ciphertext;
+      ASYLO_ASSERT_OK(Seal(plaintext, &ciphertext, thread_count));
+      size_t segments =
+          std::max<size_t>(1, (size + kSegmentSize - 1) / kSegmentSize);
+      EXPECT_EQ(ciphertext.size(), kHeaderSize + size + segments * kTagSize);
+
+      std::string opened;
+      ASYLO_ASSERT_OK(Open(ciphertext, &opened, 5 - thread_count));
+      EXPECT_EQ(opened, plaintext) << "size " << size;
+    }
+  }
+}
+
+// Tests that streams sealed twice differ, since each has its own key.
+TEST_F(StreamingAeadCryptorTest, StreamsHaveDistinctKeys) {
+  std::string plaintext = MakePlaintext(kSegmentSize);
+  std::string first;
+  std::string second;
+  ASYLO_ASSERT_OK(Seal(plaintext, &first));
+  ASYLO_ASSERT_OK(Seal(plaintext, &second));
+  EXPECT_NE(first.substr(kHeaderSize), second.substr(kHeaderSize));
+}
+
+// Tests that dropping the final segments of a stream is detected, even when
+// the stream is cut at a segment boundary.
+TEST_F(StreamingAeadCryptorTest, TruncationFails) {
+  std::string ciphertext;
+  ASYLO_ASSERT_OK(Seal(MakePlaintext(3 * kSegmentSize + 5), &ciphertext));
+  std::string truncated =
+      ciphertext.substr(0, kHeaderSize + 2 * (kSegmentSize + kTagSize));
+  std::string opened;
+  EXPECT_THAT(Open(truncated, &opened), StatusIs(error::GoogleError::INTERNAL,
+                                                 HasSubstr("Segment 1")));
+}
+
+// Tests that swapping two segments is detected.
+TEST_F(StreamingAeadCryptorTest, ReorderingFails) {
+  std::string ciphertext;
+  ASYLO_ASSERT_OK(Seal(MakePlaintext(3 * kSegmentSize), &ciphertext));
+  size_t sealed_segment_size = kSegmentSize + kTagSize;
+  std::string reordered = ciphertext.substr(0, kHeaderSize) +
+                          ciphertext.substr(kHeaderSize + sealed_segment_size,
+                                            sealed_segment_size) +
+                          ciphertext.substr(kHeaderSize, sealed_segment_size) +
+                          ciphertext.substr(kHeaderSize +
+                                            2 * sealed_segment_size);
+  std::string opened;
+  EXPECT_THAT(Open(reordered, &opened), StatusIs(error::GoogleError::INTERNAL,
+                                                 HasSubstr("Segment 0")));
+}
+
+// Tests that a modified segment, header or associated data is detected.
+TEST_F(StreamingAeadCryptorTest, TamperingFails) {
+  std::string ciphertext;
+  ASYLO_ASSERT_OK(Seal(MakePlaintext(4 * kSegmentSize), &ciphertext));
+  std::string opened;
+
+  std::string tampered = ciphertext;
+  tampered[kHeaderSize + 2 * (kSegmentSize + kTagSize) + 3] ^= 1;
+  EXPECT_THAT(Open(tampered, &opened, 2),
+              StatusIs(error::GoogleError::INTERNAL, HasSubstr("Segment 2")));
+
+  tampered = ciphertext;
+  tampered[kHeaderSize - 1] ^= 1;
+  EXPECT_THAT(Open(tampered, &opened), StatusIs(error::GoogleError::INTERNAL));
+
+  EXPECT_THAT(Open(ciphertext, &opened, 1, "other associated data"),
+              StatusIs(error::GoogleError::INTERNAL));
+}
+
+// Tests that a stream sealed with another segment size is rejected before any
+// segment is opened.
+TEST_F(StreamingAeadCryptorTest, SegmentSizeMismatchFails) {
+  std::string ciphertext;
+  ASYLO_ASSERT_OK(Seal(MakePlaintext(kSegmentSize), &ciphertext));
+  std::unique_ptr<StreamingAeadCryptor> other;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      other, StreamingAeadCryptor::CreateAesGcmStreamingCryptor(
+                 std::string(32, 'k'), 2 * kSegmentSize));
+  ArrayInputStream input(ciphertext.data(), ciphertext.size());
+  std::string opened;
+  StringOutputStream output(&opened);
+  EXPECT_THAT(other->Open(&input, kAssociatedData, &output),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+  EXPECT_TRUE(opened.empty());
+}
+
+// Tests that creation fails for invalid keys and segment sizes.
+TEST(StreamingAeadCryptorCreateTest, InvalidParametersFail) {
+  EXPECT_THAT(StreamingAeadCryptor::CreateAesGcmStreamingCryptor(
+                  std::string(24, 'k'), kSegmentSize),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+  EXPECT_THAT(StreamingAeadCryptor::CreateAesGcmStreamingCryptor(
+                  std::string(16, 'k'), 0),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+  EXPECT_THAT(StreamingAeadCryptor::CreateAesGcmStreamingCryptor(
+                  std::string(16, 'k'), kSegmentSize),
+              IsOk());
+}
+
+// Tests that files sealed through file descriptors open to the original.
+TEST_F(StreamingAeadCryptorTest, SealOpenFile) {
+  std::string dir = absl::GetFlag(FLAGS_test_tmpdir);
+  std::string plaintext_path = absl::StrCat(dir, "/streaming_plaintext.tmp");
+  std::string ciphertext_path = absl::StrCat(dir, "/streaming_sealed.tmp");
+  std::string opened_path = absl::StrCat(dir, "/streaming_opened.tmp");
+  std::string plaintext = MakePlaintext(20 * kSegmentSize + 11);
+
+  int plaintext_fd = open(plaintext_path.c_str(), O_RDWR | O_CREAT | O_TRUNC,
+                          S_IRUSR | S_IWUSR);
+  ASSERT_GE(plaintext_fd, 0);
+  ASSERT_EQ(write(plaintext_fd, plaintext.data(), plaintext.size()),
+            plaintext.size());
+  ASSERT_EQ(lseek(plaintext_fd, 0, SEEK_SET), 0);
+  int ciphertext_fd = open(ciphertext_path.c_str(),
+                           O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  ASSERT_GE(ciphertext_fd, 0);
+  ASYLO_ASSERT_OK(cryptor_->SealFile(plaintext_fd, kAssociatedData,
+                                     ciphertext_fd, /*thread_count=*/3));
+
+  ASSERT_EQ(lseek(ciphertext_fd, 0, SEEK_SET), 0);
+  int opened_fd = open(opened_path.c_str(), O_RDWR | O_CREAT | O_TRUNC,
+                       S_IRUSR | S_IWUSR);
+  ASSERT_GE(opened_fd, 0);
+  ASYLO_ASSERT_OK(
+      cryptor_->OpenFile(ciphertext_fd, kAssociatedData, opened_fd));
+
+  std::string opened(plaintext.size() + 1, '\0');
+  ASSERT_EQ(pread(opened_fd, &opened[0], opened.size(), 0), plaintext.size());
+  opened.resize(plaintext.size());
+  EXPECT_EQ(opened, plaintext);
+
+  close(plaintext_fd);
+  close(ciphertext_fd);
+  close(opened_fd);
+}
+
+// Tests that reading from a bad file descriptor is reported.
+TEST_F(StreamingAeadCryptorTest, SealFileBadDescriptorFails) {
+  std::string ciphertext_path =
+      absl::StrCat(absl::GetFlag(FLAGS_test_tmpdir), "/streaming_bad.tmp");
+  int ciphertext_fd = open(ciphertext_path.c_str(),
+                           O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  ASSERT_GE(ciphertext_fd, 0);
+  EXPECT_THAT(cryptor_->SealFile(-1, kAssociatedData, ciphertext_fd),
+              StatusIs(error::PosixError::P_EBADF));
+  close(ciphertext_fd);
+}
+
+}  // namespace
+}  // namespace experimental
+}  // namespace asylo
@@ -0,0 +1,82 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <fcntl.h>
+#include <openssl/rand.h>
+#include <sys/random.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "absl/strings/str_cat.h"
+#include "asylo/platform/posix/io/ctr_drbg.h"
+#include "asylo/platform/primitives/trusted_runtime.h"
+#include "asylo/platform/storage/utils/fd_closer.h"
+#include "asylo/test/util/benchmark.h"
+
+namespace asylo {
+namespace {
+
+// Request sizes typical of nonces, keys, handshake randoms, and bulk reads.
+constexpr size_t kRequestSizes[] = {12, 32, 64, 1024, 65536};
+
+// Compares reading random bytes straight from the hardware source with the
+// buffered DRBG that now serves /dev/urandom and getrandom().
+TEST(RandomBenchmark, HardwareVersusDrbg) {
+  for (size_t size : kRequestSizes) {
+    std::vector<uint8_t> buf(size);
+    LogBenchmarkResult(
+        absl::StrCat("enc_hardware_random/", size),
+        RunBenchmark([&buf] { enc_hardware_random(buf.data(), buf.size()); }),
+        size);
+    LogBenchmarkResult(
+        absl::StrCat("DrbgRandomBytes/", size),
+        RunBenchmark([&buf] { io::DrbgRandomBytes(buf.data(), buf.size()); }),
+        size);
+    LogBenchmarkResult(absl::StrCat("getrandom/", size), RunBenchmark([&buf] {
+                         getrandom(buf.data(), buf.size(), 0);
+                       }),
+                       size);
+  }
+}
+
+TEST(RandomBenchmark, DevURandom) {
+  int fd = open("/dev/urandom", O_RDONLY);
+  ASSERT_GE(fd, 0);
+  platform::storage::FdCloser fd_closer(fd);
+  for (size_t size : kRequestSizes) {
+    std::vector<uint8_t> buf(size);
+    LogBenchmarkResult(
+        absl::StrCat("read(/dev/urandom)/", size),
+        RunBenchmark([fd, &buf] { read(fd, buf.data(), buf.size()); }), size);
+  }
+}
+
+TEST(RandomBenchmark, BoringSslRandBytes) {
+  for (size_t size : kRequestSizes) {
+    std::vector<uint8_t> buf(size);
+    LogBenchmarkResult(
+        absl::StrCat("RAND_bytes/", size),
+        RunBenchmark([&buf] { RAND_bytes(buf.data(), buf.size()); }), size);
+  }
+}
+
+}  // namespace
+}  // namespace asylo
@@ -16,8 +16,10 @@
  *
  */
 
+#include <errno.h>
 #include <fcntl.h>
 #include <openssl/rand.h>
+#include <sys/random.h>
 #include <unistd.h>
 #include <algorithm>
 #include <string>
@@ -141,5 +143,31 @@ TEST(BoringSSLTest, RandomHandlerTest) {
   EXPECT_EQ(result2.length(), read_bytes);
 }
 
+TEST(GetRandomTest, RandomHandlerTest) {
+  // Cover requests served from the per-thread buffer, requests that straddle a
+  // refill, and requests generated directly into the output.
+  for (size_t read_bytes : {16, 1000, 1024, 5000, 100000}) {
+    std::string result1(read_bytes, 0);
+    std::string result2(read_bytes, 0);
+    ASSERT_EQ(getrandom(&result1[0], read_bytes, 0),
+              static_cast<ssize_t>(read_bytes));
+    ASSERT_EQ(getrandom(&result2[0], read_bytes, GRND_NONBLOCK),
+              static_cast<ssize_t>(read_bytes));
+    EXPECT_NE(result1, result2);
+    EXPECT_NE(result1, std::string(read_bytes, 0));
+  }
+  char buf[16];
+  EXPECT_EQ(getrandom(buf, sizeof(buf), ~0u), -1);
+  EXPECT_EQ(errno, EINVAL);
+}
+
+TEST(GetEntropyTest, RandomHandlerTest) {
+  char buf[257] = {};
+  EXPECT_EQ(getentropy(buf, 256), 0);
+  EXPECT_NE(std::string(buf, 256), std::string(256, 0));
+  EXPECT_EQ(getentropy(buf, sizeof(buf)), -1);
+  EXPECT_EQ(errno, EIO);
+}
+
 }  // namespace
 }  // namespace asylo
@@ -39,6 +39,7 @@
 #include "asylo/platform/core/trusted_global_state.h"
 #include "asylo/platform/posix/io/io_manager.h"
 #include "asylo/platform/posix/io/native_paths.h"
+#include "asylo/platform/posix/io/page_cache.h"
 #include "asylo/platform/posix/io/random_devices.h"
 #include "asylo/platform/posix/threading/thread_manager.h"
 #include "asylo/platform/primitives/extent.h"
@@ -47,6 +48,7 @@
 #include "asylo/platform/primitives/trusted_runtime.h"
 #include "asylo/platform/primitives/util/message.h"
 #include "asylo/platform/primitives/util/status_conversions.h"
+#include "asylo/platform/storage/secure/aead_handler.h"
 #include "asylo/util/posix_error_space.h"
 #include "asylo/util/status.h"
 #include "asylo/util/status_macros.h"
@@ -283,6 +285,22 @@ void InitializeIO(const EnclaveConfig &config) {
 
   // Set the current working directory so that relative paths can be handled.
   io_manager.SetCurrentWorkingDirectory(config.current_working_directory());
+
+  // Size the cache used to read host files mapped with mmap().
+  io::PageCache::GetInstance().SetCapacity(config.mmap_page_cache_size());
+
+  // Size the caches of decrypted blocks of secure files.
+  platform::storage::AeadHandler::GetInstance().SetBlockCacheCapacity(
+      config.secure_storage_block_cache_size());
+
+  // Set the number of threads splitting large reads and writes of secure files.
+  platform::storage::AeadHandler::GetInstance().SetCryptoThreadCount(
+      config.secure_storage_crypto_threads());
+
+  // Set the number of bytes of blocks fetched ahead of sequential reads of
+  // secure files.
+  platform::storage::AeadHandler::GetInstance().SetReadAheadLength(
+      config.secure_storage_read_ahead_size());
 }
 
 // Asylo enclave entry points.
@@ -27,6 +27,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <vector>
 
 #include "absl/memory/memory.h"
 #include "absl/synchronization/mutex.h"
@@ -144,88 +145,143 @@ std::unique_ptr<GcmCryptor> GcmCryptor::Create(
 
 bool GcmCryptor::EncryptBlock(const uint8_t *plaintext_data, uint8_t *token,
                               uint8_t *ciphertext_data) {
+  return EncryptBlocks(1, &plaintext_data, &token, &ciphertext_data);
+}
+
+bool GcmCryptor::DecryptBlock(const uint8_t *ciphertext_data,
+                              const uint8_t *token, uint8_t *plaintext_data) {
+  return DecryptBlocks(1, &ciphertext_data, &token, &plaintext_data);
+}
+
+bool GcmCryptor::EncryptBlocks(size_t count,
+                               const uint8_t *const *plaintext_data,
+                               uint8_t *const *token,
+                               uint8_t *const *ciphertext_data) {
   if (plaintext_data == nullptr || token == nullptr ||
       ciphertext_data == nullptr) {
-    LOG(ERROR) << "Invalid input to GcmCryptor::EncryptBlock.";
+    LOG(ERROR) << "Invalid input to GcmCryptor::EncryptBlocks.";
     return false;
   }
+  for (size_t idx = 0; idx < count; idx++) {
+    if (plaintext_data[idx] == nullptr || token[idx] == nullptr ||
+        ciphertext_data[idx] == nullptr) {
+      LOG(ERROR) << "Invalid input to GcmCryptor::EncryptBlocks.";
+      return false;
+    }
+  }
+  if (count == 0) {
+    return true;
+  }
 
-  absl::MutexLock lock(&mu_);
-
-  if (1 != RAND_bytes(next_token_.nonce, kNonceLength)) {
-    LOG(ERROR)
-        << "Failed to generate random nonce for GcmCryptor::EncryptBlock: "
-        << BsslLastErrorString();
+  // The blocks are sealed after the tokens are assigned, outside of the lock.
+  std::vector<Token> tokens(count);
+  std::vector<size_t> run_starts;
+  std::vector<GcmCryptorKey> run_keys;
+  if (!AssignTokens(count, tokens.data(), &run_starts, &run_keys)) {
     return false;
   }
 
-  if (key_id_counter_ % kKeyIdCycle == 0) {
-    key_id_counter_ = 0;
-
-    if (1 != RAND_bytes(next_token_.key_id, kKeyIdLength)) {
-      LOG(ERROR)
-          << "Failed to generate random token for GcmCryptor::EncryptBlock: "
-          << BsslLastErrorString();
+  const size_t max_ciphertext_length = kBlockLength + kTagLength;
+  for (size_t run = 0; run < run_keys.size(); run++) {
+    EVP_AEAD_CTX context;
+    if (!EVP_AEAD_CTX_init(
+            &context, EVP_aead_aes_256_gcm(),
+            reinterpret_cast<const uint8_t *>(run_keys[run].data()),
+            kKeyLength, kTagLength, nullptr)) {
+      LOG(ERROR) << "EVP_AEAD_CTX_init failed: " << BsslLastErrorString();
+      EVP_AEAD_CTX_cleanup(&context);
       return false;
     }
 
-    if (!GenerateDerivedGcmKey(next_token_.key_id, &next_derived_key_)) {
-      LOG(ERROR) << "Failed to derive key for GcmCryptor::EncryptBlock: "
-                 << BsslLastErrorString();
-      return false;
+    for (size_t idx = run_starts[run]; idx < run_starts[run + 1]; idx++) {
+      size_t ciphertext_length;
+      if (!EVP_AEAD_CTX_seal(&context, ciphertext_data[idx],
+                             &ciphertext_length, max_ciphertext_length,
+                             tokens[idx].nonce, kNonceLength,
+                             plaintext_data[idx], kBlockLength, nullptr, 0)) {
+        LOG(ERROR) << "EVP_AEAD_CTX_seal failed: " << BsslLastErrorString();
+        EVP_AEAD_CTX_cleanup(&context);
+        return false;
+      }
+
+      if (ciphertext_length != max_ciphertext_length) {
+        LOG(ERROR) << "EVP_AEAD_CTX_seal failed to encrypt complete plaintext, "
+                   << "expected ciphertext_length = " << max_ciphertext_length
+                   << ", encountered ciphertext_length = "
+                   << ciphertext_length;
+        EVP_AEAD_CTX_cleanup(&context);
+        return false;
+      }
+
+      memcpy(token[idx], tokens[idx].data(), kTokenLength);
     }
+
+    EVP_AEAD_CTX_cleanup(&context);
   }
 
-  // Increment the key reuse counter only if the key was successfully generated.
-  key_id_counter_++;
+  return true;
+}
 
-  EVP_AEAD_CTX context;
-  if (!EVP_AEAD_CTX_init(
-          &context, EVP_aead_aes_256_gcm(),
-          reinterpret_cast<const uint8_t *>(next_derived_key_.data()),
-          kKeyLength, kTagLength, nullptr)) {
-    LOG(ERROR) << "EVP_AEAD_CTX_init failed: " << BsslLastErrorString();
-    EVP_AEAD_CTX_cleanup(&context);
+bool GcmCryptor::EncryptRecord(const uint8_t *plaintext_data, size_t length,
+                               const uint8_t *associated_data,
+                               size_t associated_data_length, uint8_t *token,
+                               uint8_t *ciphertext_data) {
+  if (plaintext_data == nullptr || token == nullptr ||
+      ciphertext_data == nullptr ||
+      (associated_data == nullptr && associated_data_length > 0) ||
+      length > kBlockLength) {
+    LOG(ERROR) << "Invalid input to GcmCryptor::EncryptRecord.";
     return false;
   }
 
-  size_t ciphertext_length;
-  size_t max_ciphertext_length = kBlockLength + kTagLength;
-  if (!EVP_AEAD_CTX_seal(&context, ciphertext_data, &ciphertext_length,
-                         max_ciphertext_length, next_token_.nonce, kNonceLength,
-                         plaintext_data, kBlockLength, nullptr, 0)) {
-    LOG(ERROR) << "EVP_AEAD_CTX_seal failed: " << BsslLastErrorString();
-    EVP_AEAD_CTX_cleanup(&context);
+  Token record_token;
+  std::vector<size_t> run_starts;
+  std::vector<GcmCryptorKey> run_keys;
+  if (!AssignTokens(1, &record_token, &run_starts, &run_keys)) {
     return false;
   }
 
-  if (ciphertext_length != max_ciphertext_length) {
-    LOG(ERROR) << "EVP_AEAD_CTX_seal failed to encrypt complete plaintext, "
-               << "expected ciphertext_length = " << max_ciphertext_length
-               << ", encountered ciphertext_length = " << ciphertext_length;
+  EVP_AEAD_CTX context;
+  if (!EVP_AEAD_CTX_init(&context, EVP_aead_aes_256_gcm(),
+                         reinterpret_cast<const uint8_t *>(run_keys[0].data()),
+                         kKeyLength, kTagLength, nullptr)) {
+    LOG(ERROR) << "EVP_AEAD_CTX_init failed: " << BsslLastErrorString();
     EVP_AEAD_CTX_cleanup(&context);
     return false;
   }
 
-  memcpy(token, next_token_.data(), kTokenLength);
-
+  size_t ciphertext_length;
+  bool sealed = EVP_AEAD_CTX_seal(
+      &context, ciphertext_data, &ciphertext_length, length + kTagLength,
+      record_token.nonce, kNonceLength, plaintext_data, length,
+      associated_data, associated_data_length);
   EVP_AEAD_CTX_cleanup(&context);
+  if (!sealed || ciphertext_length != length + kTagLength) {
+    LOG(ERROR) << "EVP_AEAD_CTX_seal failed: " << BsslLastErrorString();
+    return false;
+  }
+
+  memcpy(token, record_token.data(), kTokenLength);
   return true;
 }
 
-bool GcmCryptor::DecryptBlock(const uint8_t *ciphertext_data,
-                              const uint8_t *token, uint8_t *plaintext_data) {
+bool GcmCryptor::DecryptRecord(const uint8_t *ciphertext_data, size_t length,
+                               const uint8_t *associated_data,
+                               size_t associated_data_length,
+                               const uint8_t *token,
+                               uint8_t *plaintext_data) const {
   if (ciphertext_data == nullptr || token == nullptr ||
-      plaintext_data == nullptr) {
-    LOG(ERROR) << "Invalid input to GcmCryptor::DecryptBlock.";
+      plaintext_data == nullptr ||
+      (associated_data == nullptr && associated_data_length > 0) ||
+      length > kBlockLength) {
+    LOG(ERROR) << "Invalid input to GcmCryptor::DecryptRecord.";
     return false;
   }
 
   const Token *tok = reinterpret_cast<const Token *>(token);
-
   GcmCryptorKey derived_key;
   if (!GenerateDerivedGcmKey(tok->key_id, &derived_key)) {
-    LOG(ERROR) << "Failed to derive key for GcmCryptor::DecryptBlock: "
+    LOG(ERROR) << "Failed to derive key for GcmCryptor::DecryptRecord: "
                << BsslLastErrorString();
     return false;
   }
@@ -240,29 +296,141 @@ bool GcmCryptor::DecryptBlock(const uint8_t *ciphertext_data,
   }
 
   size_t plaintext_length;
-  if (!EVP_AEAD_CTX_open(&context, plaintext_data, &plaintext_length,
-                         kBlockLength, tok->nonce, kNonceLength,
-                         ciphertext_data, kBlockLength + kTagLength, nullptr,
-                         0)) {
+  bool opened = EVP_AEAD_CTX_open(
+      &context, plaintext_data, &plaintext_length, length, tok->nonce,
+      kNonceLength, ciphertext_data, length + kTagLength, associated_data,
+      associated_data_length);
+  EVP_AEAD_CTX_cleanup(&context);
+  if (!opened || plaintext_length != length) {
     LOG(ERROR) << "EVP_AEAD_CTX_open failed: " << BsslLastErrorString();
-    EVP_AEAD_CTX_cleanup(&context);
     return false;
   }
 
-  if (plaintext_length != kBlockLength) {
-    LOG(ERROR) << "EVP_AEAD_CTX_open failed to decrypt complete ciphertext, "
-               << "expected plaintext_length = " << kBlockLength
-               << ", encountered plaintext_length = " << plaintext_length;
+  return true;
+}
+
+bool GcmCryptor::DecryptBlocks(size_t count,
+                               const uint8_t *const *ciphertext_data,
+                               const uint8_t *const *token,
+                               uint8_t *const *plaintext_data) const {
+  if (ciphertext_data == nullptr || token == nullptr ||
+      plaintext_data == nullptr) {
+    LOG(ERROR) << "Invalid input to GcmCryptor::DecryptBlocks.";
+    return false;
+  }
+  for (size_t idx = 0; idx < count; idx++) {
+    if (ciphertext_data[idx] == nullptr || token[idx] == nullptr ||
+        plaintext_data[idx] == nullptr) {
+      LOG(ERROR) << "Invalid input to GcmCryptor::DecryptBlocks.";
+      return false;
+    }
+  }
+
+  // The context is set up again only when the key ID changes.
+  EVP_AEAD_CTX context;
+  const uint8_t *context_key_id = nullptr;
+  for (size_t idx = 0; idx < count; idx++) {
+    const Token *tok = reinterpret_cast<const Token *>(token[idx]);
+
+    if (!context_key_id ||
+        memcmp(context_key_id, tok->key_id, kKeyIdLength) != 0) {
+      if (context_key_id) {
+        EVP_AEAD_CTX_cleanup(&context);
+        context_key_id = nullptr;
+      }
+
+      GcmCryptorKey derived_key;
+      if (!GenerateDerivedGcmKey(tok->key_id, &derived_key)) {
+        LOG(ERROR) << "Failed to derive key for GcmCryptor::DecryptBlocks: "
+                   << BsslLastErrorString();
+        return false;
+      }
+
+      if (!EVP_AEAD_CTX_init(
+              &context, EVP_aead_aes_256_gcm(),
+              reinterpret_cast<const uint8_t *>(derived_key.data()),
+              kKeyLength, kTagLength, nullptr)) {
+        LOG(ERROR) << "EVP_AEAD_CTX_init failed: " << BsslLastErrorString();
+        EVP_AEAD_CTX_cleanup(&context);
+        return false;
+      }
+      context_key_id = tok->key_id;
+    }
+
+    size_t plaintext_length;
+    if (!EVP_AEAD_CTX_open(&context, plaintext_data[idx], &plaintext_length,
+                           kBlockLength, tok->nonce, kNonceLength,
+                           ciphertext_data[idx], kBlockLength + kTagLength,
+                           nullptr, 0)) {
+      LOG(ERROR) << "EVP_AEAD_CTX_open failed: " << BsslLastErrorString();
+      EVP_AEAD_CTX_cleanup(&context);
+      return false;
+    }
+
+    if (plaintext_length != kBlockLength) {
+      LOG(ERROR) << "EVP_AEAD_CTX_open failed to decrypt complete ciphertext, "
+                 << "expected plaintext_length = " << kBlockLength
+                 << ", encountered plaintext_length = " << plaintext_length;
+      EVP_AEAD_CTX_cleanup(&context);
+      return false;
+    }
+  }
+
+  if (context_key_id) {
     EVP_AEAD_CTX_cleanup(&context);
+  }
+  return true;
+}
+
+bool GcmCryptor::AssignTokens(size_t count, Token *tokens,
+                              std::vector<size_t> *run_starts,
+                              std::vector<GcmCryptorKey> *run_keys) {
+  absl::MutexLock lock(&mu_);
+
+  std::vector<uint8_t> nonces(count * kNonceLength);
+  if (1 != RAND_bytes(nonces.data(), nonces.size())) {
+    LOG(ERROR) << "Failed to generate random nonce for GcmCryptor: "
+               << BsslLastErrorString();
     return false;
   }
 
-  EVP_AEAD_CTX_cleanup(&context);
+  for (size_t idx = 0; idx < count; idx++) {
+    if (key_id_counter_ % kKeyIdCycle == 0) {
+      key_id_counter_ = 0;
+
+      if (1 != RAND_bytes(next_token_.key_id, kKeyIdLength)) {
+        LOG(ERROR) << "Failed to generate random token for GcmCryptor: "
+                   << BsslLastErrorString();
+        return false;
+      }
+
+      if (!GenerateDerivedGcmKey(next_token_.key_id, &next_derived_key_)) {
+        LOG(ERROR) << "Failed to derive key for GcmCryptor: "
+                   << BsslLastErrorString();
+        return false;
+      }
+    }
+
+    // Blocks sharing a derived key form a run.
+    if (idx == 0 || key_id_counter_ == 0) {
+      run_starts->push_back(idx);
+      run_keys->push_back(next_derived_key_);
+    }
+
+    // Increment the key reuse counter only if the key was successfully
+    // generated.
+    key_id_counter_++;
+
+    memcpy(next_token_.nonce, nonces.data() + idx * kNonceLength,
+           kNonceLength);
+    tokens[idx] = next_token_;
+  }
+  run_starts->push_back(count);
   return true;
 }
 
 bool GcmCryptor::GenerateDerivedGcmKey(const uint8_t *key_id,
-                                       GcmCryptorKey *dk) {
+                                       GcmCryptorKey *dk) const {
   return GenerateDerivedKey(kGcmKey, key_id, dk);
 }
 
@@ -287,13 +455,14 @@ GcmCryptor *GcmCryptorRegistry::GetGcmCryptor(size_t block_length,
                                               const GcmCryptorKey &key) {
   absl::MutexLock lock(&mu_);
 
-  auto it = cryptor_registry_.find(key);
+  CryptorId id(block_length, key);
+  auto it = cryptor_registry_.find(id);
   if (it != cryptor_registry_.end()) {
     return it->second.get();
   }
 
   auto result =
-      cryptor_registry_.emplace(key, GcmCryptor::Create(block_length, key));
+      cryptor_registry_.emplace(id, GcmCryptor::Create(block_length, key));
   return result.first->second.get();
 }
 
@@ -24,6 +24,7 @@
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "absl/synchronization/mutex.h"
@@ -68,6 +69,45 @@ class GcmCryptor {
   bool DecryptBlock(const uint8_t *ciphertext_data, const uint8_t *token,
                     uint8_t *plaintext_data);
 
+  // Encrypts |count| plaintext blocks like EncryptBlock(), block i from
+  // |plaintext_data[i]| into |ciphertext_data[i]|, with its token supplied in
+  // |token[i]|. Blocks encrypted under the same derived key share its AEAD
+  // context, and nonces are generated at once for all blocks. Only token
+  // generation is serialized, so concurrent calls encrypt their blocks in
+  // parallel. Returns true on success, false if any block fails to encrypt.
+  bool EncryptBlocks(size_t count, const uint8_t *const *plaintext_data,
+                     uint8_t *const *token, uint8_t *const *ciphertext_data);
+
+  // Decrypts |count| ciphertext blocks like DecryptBlock(), block i from
+  // |ciphertext_data[i]| with |token[i]| into |plaintext_data[i]|. Consecutive
+  // blocks encrypted under the same derived key share the key derivation and
+  // its AEAD context. Returns true on success, false if any block fails to
+  // decrypt.
+  bool DecryptBlocks(size_t count, const uint8_t *const *ciphertext_data,
+                     const uint8_t *const *token,
+                     uint8_t *const *plaintext_data) const;
+
+  // Encrypts a record of |length| bytes, at most the block length of the
+  // cryptor, with an auto-generated token, and authenticates
+  // |associated_data_length| bytes of |associated_data| along with it. Returns
+  // true on success, with the ciphertext of |length| bytes followed by its
+  // kTagLength-byte integrity tag supplied in |ciphertext_data|, and the
+  // generated token supplied. Returns false otherwise.
+  bool EncryptRecord(const uint8_t *plaintext_data, size_t length,
+                     const uint8_t *associated_data,
+                     size_t associated_data_length, uint8_t *token,
+                     uint8_t *ciphertext_data);
+
+  // Decrypts a record of |length| bytes encrypted by EncryptRecord(), from
+  // |ciphertext_data| holding its ciphertext followed by the tag, using the
+  // specified token and the associated data the record was encrypted with.
+  // Returns true on success, with the decrypted plaintext supplied. Returns
+  // false otherwise.
+  bool DecryptRecord(const uint8_t *ciphertext_data, size_t length,
+                     const uint8_t *associated_data,
+                     size_t associated_data_length, const uint8_t *token,
+                     uint8_t *plaintext_data) const;
+
   // Generates auth tag, in particular CMAC, for the specified data. Returns
   // true on success, false on failure.
   bool GetAuthTag(uint8_t out[16], const uint8_t *in, size_t in_len) const;
@@ -86,7 +126,16 @@ class GcmCryptor {
 
   GcmCryptor(size_t block_length, const GcmCryptorKey &gcm_key,
              const GcmCryptorKey &cmac_key);
-  bool GenerateDerivedGcmKey(const uint8_t *key_id, GcmCryptorKey *dk);
+  bool GenerateDerivedGcmKey(const uint8_t *key_id, GcmCryptorKey *dk) const;
+
+  // Assigns tokens to |count| blocks in |tokens|. The indices at which runs of
+  // blocks sharing a key ID start are appended to |run_starts|, followed by
+  // |count|, and the derived key of each run to |run_keys|. Returns false on
+  // failure.
+  bool AssignTokens(size_t count, Token *tokens,
+                    std::vector<size_t> *run_starts,
+                    std::vector<GcmCryptorKey> *run_keys)
+      ABSL_LOCKS_EXCLUDED(mu_);
 
   const size_t kBlockLength;
   const GcmCryptorKey kGcmKey;
@@ -109,7 +158,9 @@ class GcmCryptorRegistry {
     return *instance;
   }
 
-  // Accessor to the instance of GCM cryptor associated with a given key.
+  // Accessor to the instance of GCM cryptor associated with a given key and
+  // block length. Cryptors for different block lengths under the same key are
+  // distinct instances.
   GcmCryptor *GetGcmCryptor(size_t block_length, const GcmCryptorKey &key)
       ABSL_LOCKS_EXCLUDED(mu_);
 
@@ -131,6 +182,16 @@ class GcmCryptorRegistry {
     }
   };
 
+  // Identity of a registered cryptor - the block length and the key.
+  using CryptorId = std::pair<size_t, GcmCryptorKey>;
+
+  class CryptorIdHasher {
+   public:
+    size_t operator()(const CryptorId &id) const {
+      return std::hash<size_t>()(id.first) ^ SafeBytesHasher()(id.second);
+    }
+  };
+
  private:
   GcmCryptorRegistry() = default;
   GcmCryptorRegistry(GcmCryptorRegistry const &) = delete;
@@ -140,8 +201,7 @@ class GcmCryptorRegistry {
   // primitives interface where system calls might not be available, so we use
   // std::unordered_map instead of absl::flat_hash_map to prevent unsafe system
   // calls made by absl based containers.
-  std::unordered_map<GcmCryptorKey, std::unique_ptr<GcmCryptor>,
-                     SafeBytesHasher>
+  std::unordered_map<CryptorId, std::unique_ptr<GcmCryptor>, CryptorIdHasher>
       cryptor_registry_ ABSL_GUARDED_BY(mu_);
   absl::Mutex mu_;
 };
@@ -20,6 +20,8 @@
 
 #include <openssl/rand.h>
 
+#include <vector>
+
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include "asylo/crypto/util/bytes.h"
@@ -126,6 +128,150 @@ TEST(GcmCryptorTest, DecryptAfterEncryptInPlaceReturnsOriginalTexts) {
   }
 }
 
+// Tests batch encryption across key ID cycles, with blocks decrypted both in a
+// batch and one at a time.
+TEST(GcmCryptorTest, DecryptBlocksAfterEncryptBlocksReturnsOriginalTexts) {
+  const size_t kNumBlocks = kKeyIdCycle * 2 + 17;
+  std::vector<uint8_t> plaintext(kNumBlocks * kBlockLength);
+  std::vector<uint8_t> ciphertext(kNumBlocks * (kBlockLength + kTagLength));
+  std::vector<uint8_t> tokens(kNumBlocks * kTokenLength);
+  std::vector<uint8_t> decrypted(kNumBlocks * kBlockLength);
+  std::vector<const uint8_t *> plaintext_ptrs(kNumBlocks);
+  std::vector<uint8_t *> ciphertext_ptrs(kNumBlocks);
+  std::vector<uint8_t *> token_ptrs(kNumBlocks);
+  std::vector<uint8_t *> decrypted_ptrs(kNumBlocks);
+  for (size_t i = 0; i < kNumBlocks; ++i) {
+    plaintext_ptrs[i] = plaintext.data() + i * kBlockLength;
+    ciphertext_ptrs[i] = ciphertext.data() + i * (kBlockLength + kTagLength);
+    token_ptrs[i] = tokens.data() + i * kTokenLength;
+    decrypted_ptrs[i] = decrypted.data() + i * kBlockLength;
+  }
+  GcmCryptorKey key;
+  ASSERT_EQ(RAND_bytes(key.data(), key.size()), 1);
+  auto encryptor = GcmCryptor::Create(kBlockLength, key);
+  auto decryptor = GcmCryptor::Create(kBlockLength, key);
+  ASSERT_EQ(RAND_bytes(plaintext.data(), plaintext.size()), 1);
+
+  // Start off the key ID cycle so that the batch spans three derived keys.
+  uint8_t single_ciphertext[kBlockLength + kTagLength];
+  uint8_t single_token[kTokenLength];
+  ASSERT_TRUE(encryptor->EncryptBlock(plaintext_ptrs[0], single_token,
+                                      single_ciphertext));
+  ASSERT_TRUE(encryptor->EncryptBlocks(kNumBlocks, plaintext_ptrs.data(),
+                                       token_ptrs.data(),
+                                       ciphertext_ptrs.data()));
+
+  for (size_t i = 0; i < kNumBlocks; ++i) {
+    const uint8_t *token = token_ptrs[i];
+    const uint8_t *first_token = token_ptrs[0];
+    const uint8_t *previous_token = i == 0 ? single_token : token_ptrs[i - 1];
+    EXPECT_NE(memcmp(previous_token, token, kNonceLength), 0);
+    if ((i + 1) % kKeyIdCycle == 0) {
+      EXPECT_NE(memcmp(previous_token + kNonceLength, token + kNonceLength,
+                       kKeyIdLength),
+                0);
+    } else {
+      EXPECT_EQ(memcmp(previous_token + kNonceLength, token + kNonceLength,
+                       kKeyIdLength),
+                0);
+    }
+    if (i >= kKeyIdCycle - 1) {
+      EXPECT_NE(memcmp(first_token + kNonceLength, token + kNonceLength,
+                       kKeyIdLength),
+                0);
+    }
+
+    // Verify encryption is not replaced by identity transformation.
+    EXPECT_NE(memcmp(plaintext_ptrs[i], ciphertext_ptrs[i], kBlockLength), 0);
+  }
+
+  std::vector<const uint8_t *> const_ciphertext_ptrs(ciphertext_ptrs.begin(),
+                                                     ciphertext_ptrs.end());
+  std::vector<const uint8_t *> const_token_ptrs(token_ptrs.begin(),
+                                                token_ptrs.end());
+  ASSERT_TRUE(decryptor->DecryptBlocks(kNumBlocks, const_ciphertext_ptrs.data(),
+                                       const_token_ptrs.data(),
+                                       decrypted_ptrs.data()));
+  EXPECT_EQ(memcmp(plaintext.data(), decrypted.data(), plaintext.size()), 0);
+
+  uint8_t decryptor_buffer[kBlockLength + kTagLength];
+  for (size_t i = 0; i < kNumBlocks; ++i) {
+    ASSERT_TRUE(decryptor->DecryptBlock(ciphertext_ptrs[i], token_ptrs[i],
+                                        decryptor_buffer));
+    EXPECT_EQ(memcmp(plaintext_ptrs[i], decryptor_buffer, kBlockLength), 0);
+  }
+}
+
+// Tests that batch decryption fails if any of the blocks is altered.
+TEST(GcmCryptorTest, DecryptBlocksWithAlteredCiphertextFails) {
+  const size_t kNumBlocks = 4;
+  uint8_t plaintext[kNumBlocks][kBlockLength];
+  uint8_t ciphertext[kNumBlocks][kBlockLength + kTagLength];
+  uint8_t tokens[kNumBlocks][kTokenLength];
+  uint8_t decrypted[kNumBlocks][kBlockLength];
+  const uint8_t *plaintext_ptrs[kNumBlocks];
+  uint8_t *ciphertext_ptrs[kNumBlocks];
+  uint8_t *token_ptrs[kNumBlocks];
+  uint8_t *decrypted_ptrs[kNumBlocks];
+  for (size_t i = 0; i < kNumBlocks; ++i) {
+    plaintext_ptrs[i] = plaintext[i];
+    ciphertext_ptrs[i] = ciphertext[i];
+    token_ptrs[i] = tokens[i];
+    decrypted_ptrs[i] = decrypted[i];
+  }
+  GcmCryptorKey key;
+  ASSERT_EQ(RAND_bytes(key.data(), key.size()), 1);
+  auto encryptor = GcmCryptor::Create(kBlockLength, key);
+  auto decryptor = GcmCryptor::Create(kBlockLength, key);
+  ASSERT_EQ(RAND_bytes(&plaintext[0][0], sizeof(plaintext)), 1);
+
+  ASSERT_TRUE(encryptor->EncryptBlocks(kNumBlocks, plaintext_ptrs, token_ptrs,
+                                       ciphertext_ptrs));
+
+  // Alter the ciphertext of the last block.
+  ++ciphertext[kNumBlocks - 1][0];
+
+  ASSERT_FALSE(decryptor->DecryptBlocks(kNumBlocks, ciphertext_ptrs,
+                                        token_ptrs, decrypted_ptrs));
+}
+
+// Tests encryption and decryption of records of varying lengths, up to the
+// block length, with associated data.
+TEST(GcmCryptorTest, DecryptRecordAfterEncryptRecordReturnsOriginalTexts) {
+  uint8_t plaintext[kBlockLength];
+  uint8_t ciphertext[kBlockLength + kTagLength];
+  uint8_t decrypted[kBlockLength];
+  uint8_t associated_data[kTagLength];
+  uint8_t token[kTokenLength];
+  GcmCryptorKey key;
+  ASSERT_EQ(RAND_bytes(key.data(), key.size()), 1);
+  auto encryptor = GcmCryptor::Create(kBlockLength, key);
+  auto decryptor = GcmCryptor::Create(kBlockLength, key);
+  for (size_t length = 0; length <= kBlockLength; length += 7) {
+    ASSERT_EQ(RAND_bytes(plaintext, length), 1);
+    ASSERT_EQ(RAND_bytes(associated_data, sizeof(associated_data)), 1);
+    ASSERT_TRUE(encryptor->EncryptRecord(plaintext, length, associated_data,
+                                         sizeof(associated_data), token,
+                                         ciphertext));
+    ASSERT_TRUE(decryptor->DecryptRecord(ciphertext, length, associated_data,
+                                         sizeof(associated_data), token,
+                                         decrypted));
+    EXPECT_EQ(memcmp(plaintext, decrypted, length), 0);
+
+    // The associated data is authenticated along with the record.
+    ++associated_data[0];
+    EXPECT_FALSE(decryptor->DecryptRecord(ciphertext, length, associated_data,
+                                          sizeof(associated_data), token,
+                                          decrypted));
+  }
+
+  // Records longer than the block length are rejected.
+  uint8_t long_plaintext[kBlockLength + 1] = {};
+  uint8_t long_ciphertext[kBlockLength + 1 + kTagLength];
+  EXPECT_FALSE(encryptor->EncryptRecord(long_plaintext, sizeof(long_plaintext),
+                                        nullptr, 0, token, long_ciphertext));
+}
+
 // Tests decryption with an altered key.
 TEST(GcmCryptorTest, DecryptWithAlteredKeyFails) {
   uint8_t plaintext[kBlockLength];
@@ -209,5 +355,22 @@ TEST(GcmCryptorTest, GetGcmCryptorIsConsistent) {
   EXPECT_EQ(c1, c2);
 }
 
+// Tests GCM cryptor registry returns distinct instances of GCM cryptor for
+// distinct block lengths under the same key.
+TEST(GcmCryptorTest, GetGcmCryptorIsDistinctPerBlockLength) {
+  GcmCryptorKey key;
+  ASSERT_EQ(RAND_bytes(key.data(), key.size()), 1);
+  GcmCryptor *c1 =
+      GcmCryptorRegistry::GetInstance().GetGcmCryptor(kBlockLength, key);
+  GcmCryptor *c2 =
+      GcmCryptorRegistry::GetInstance().GetGcmCryptor(kBlockLength * 32, key);
+
+  ASSERT_NE(c1, nullptr);
+  ASSERT_NE(c2, nullptr);
+  EXPECT_NE(c1, c2);
+  EXPECT_EQ(c2, GcmCryptorRegistry::GetInstance().GetGcmCryptor(
+                    kBlockLength * 32, key));
+}
+
 }  // namespace
 }  // namespace asylo
@@ -127,9 +127,13 @@ static constexpr uint64_t kInotifyReadHandler =
 static constexpr uint64_t kClockGettimeHandler =
     primitives::kSelectorHostCall + 27;
 
+// Exit handler constant for |EpollWaitInPlaceHandler|.
+static constexpr uint64_t kEpollWaitInPlaceHandler =
+    primitives::kSelectorHostCall + 28;
+
 // Assert that the largest host call handler lies in
 // [kSelectorHostCall, kSelectorRemote).
-static_assert(kOpenLogHandler < primitives::kSelectorRemote,
+static_assert(kEpollWaitInPlaceHandler < primitives::kSelectorRemote,
               "Cannot have host call handler constant spill over into "
               "|kSelectorRemote|.");
 
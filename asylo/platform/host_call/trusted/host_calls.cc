@@ -23,6 +23,7 @@
 #include <net/if.h>
 #include <netdb.h>
 #include <signal.h>
+#include <sys/mman.h>
 #include <sys/statfs.h>
 
 #include <algorithm>
@@ -461,6 +462,37 @@ int enc_untrusted_pwrite64(int fd, const void *buf, size_t count,
                                              fd, buf, count, offset);
 }
 
+int enc_untrusted_getdents64(int fd, void *dirp, unsigned int count) {
+  return EnsureInitializedAndDispatchSyscall(
+      asylo::system_call::kSYS_getdents64, fd, dirp, count);
+}
+
+void *enc_untrusted_mmap(void *addr, size_t length, int prot, int flags, int fd,
+                         off_t offset) {
+  // The enclave's PROT_* and MAP_* values match the Linux ABI, so they are
+  // passed through unchanged.
+  int64_t result = EnsureInitializedAndDispatchSyscall(
+      asylo::system_call::kSYS_mmap, reinterpret_cast<uint64_t>(addr),
+      static_cast<uint64_t>(length), static_cast<uint64_t>(prot),
+      static_cast<uint64_t>(flags), static_cast<uint64_t>(fd),
+      static_cast<uint64_t>(offset));
+  void *mapping = reinterpret_cast<void *>(result);
+  if (mapping == MAP_FAILED) {
+    return MAP_FAILED;
+  }
+  if (!TrustedPrimitives::IsOutsideEnclave(mapping, length)) {
+    TrustedPrimitives::BestEffortAbort(
+        "enc_untrusted_mmap: host mapping overlaps the enclave");
+  }
+  return mapping;
+}
+
+int enc_untrusted_munmap(void *addr, size_t length) {
+  return EnsureInitializedAndDispatchSyscall(
+      asylo::system_call::kSYS_munmap, reinterpret_cast<uint64_t>(addr),
+      static_cast<uint64_t>(length));
+}
+
 int enc_untrusted_isatty(int fd) {
   MessageWriter input;
   input.Push(fd);
@@ -1554,4 +1586,42 @@ int enc_untrusted_inotify_read(int fd, size_t count, char **serialized_events,
   return result;
 }
 
+int enc_untrusted_epoll_wait_in_place(int epfd, void *events, int maxevents,
+                                      int timeout, int batch) {
+  if (maxevents <= 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (!TrustedPrimitives::IsOutsideEnclave(
+          events, maxevents * sizeof(struct klinux_epoll_event))) {
+    errno = EFAULT;
+    return -1;
+  }
+
+  MessageWriter input;
+  input.Push<int>(epfd);
+  input.Push<uint64_t>(reinterpret_cast<uint64_t>(events));
+  input.Push<int>(maxevents);
+  input.Push<int>(timeout);
+  input.Push<int>(batch);
+  MessageReader output;
+  const auto status = ::asylo::host_call::NonSystemCallDispatcher(
+      ::asylo::host_call::kEpollWaitInPlaceHandler, &input, &output);
+  CheckStatusAndParamCount(status, output,
+                           "enc_untrusted_epoll_wait_in_place", 2);
+
+  int result = output.next<int>();
+  int klinux_errno = output.next<int>();
+  if (result == -1) {
+    errno = FromkLinuxErrorNumber(klinux_errno);
+    return -1;
+  }
+  if (result < 0 || result > maxevents) {
+    TrustedPrimitives::BestEffortAbort(
+        "enc_untrusted_epoll_wait_in_place: result found to be greater than "
+        "maxevents supplied.");
+  }
+  return result;
+}
+
 }  // extern "C"
@@ -100,6 +100,16 @@ int enc_untrusted_stat(const char *pathname, struct stat *statbuf);
 int enc_untrusted_statfs(const char *pathname, struct statfs *statbuf);
 int enc_untrusted_pread64(int fd, void *buf, size_t count, off_t offset);
 int enc_untrusted_pwrite64(int fd, const void *buf, size_t count, off_t offset);
+
+// Reads directory entries of |fd| into |dirp| in the Linux linux_dirent64
+// format. The entries come from the host and must be validated before use.
+int enc_untrusted_getdents64(int fd, void *dirp, unsigned int count);
+
+// Maps a host file into untrusted memory. The returned address, if not
+// MAP_FAILED, is verified to lie outside the enclave.
+void *enc_untrusted_mmap(void *addr, size_t length, int prot, int flags, int fd,
+                         off_t offset);
+int enc_untrusted_munmap(void *addr, size_t length);
 int enc_untrusted_wait(int *wstatus);
 int enc_untrusted_close(int fd);
 int enc_untrusted_nanosleep(const struct timespec *req, struct timespec *rem);
@@ -166,6 +176,18 @@ void enc_untrusted_openlog(const char *ident, int option, int facility);
 int enc_untrusted_inotify_read(int fd, size_t count, char **serialized_events,
                                size_t *serialized_events_len);
 
+// Waits on the host epoll instance |epfd| and has the host store the ready
+// events directly in |events|, an array of |maxevents| struct
+// klinux_epoll_event in untrusted memory, rather than copying them through the
+// host call message. The contents of |events| are untrusted and must be
+// validated by the caller. If |batch| is non-zero, after the first events
+// arrive the host keeps collecting further ready events without blocking, until
+// none remain or |events| is full. This is only appropriate for interest lists
+// in which every registration is edge-triggered, since level-triggered
+// registrations would be reported repeatedly.
+int enc_untrusted_epoll_wait_in_place(int epfd, void *events, int maxevents,
+                                      int timeout, int batch);
+
 // Calls that are not delegated to the host are defined below.
 void enc_freeaddrinfo(struct addrinfo *res);
 void enc_freeifaddrs(struct ifaddrs *ifa);
@@ -25,6 +25,7 @@
 #include <netdb.h>
 #include <pwd.h>
 #include <signal.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <syslog.h>
 #include <unistd.h>
@@ -45,6 +46,10 @@ namespace {
 
 using primitives::Extent;
 
+// Maximum number of epoll_wait() calls made by one batched
+// EpollWaitInPlaceHandler invocation.
+constexpr int kMaxEpollWaitRounds = 16;
+
 void untrusted_abort_handler(const char *message) {
   fputs(message, stderr);
   abort();
@@ -564,5 +569,34 @@ Status ClockGettimeHandler(const std::shared_ptr<primitives::Client> &client,
   return Status::OkStatus();
 }
 
+Status EpollWaitInPlaceHandler(
+    const std::shared_ptr<primitives::Client> &client, void *context,
+    primitives::MessageReader *input, primitives::MessageWriter *output) {
+  ASYLO_RETURN_IF_INCORRECT_READER_ARGUMENTS(*input, 5);
+  int epfd = input->next<int>();
+  auto *events = reinterpret_cast<struct epoll_event *>(input->next<uint64_t>());
+  int maxevents = input->next<int>();
+  int timeout = input->next<int>();
+  bool batch = input->next<int>() != 0;
+
+  int result = epoll_wait(epfd, events, maxevents, timeout);
+  int klinux_errno = errno;
+
+  // Edge-triggered registrations are only reported when new events arrive, so
+  // polling again returns events that would otherwise need another host call.
+  for (int round = 1; batch && result > 0 && result < maxevents &&
+                      round < kMaxEpollWaitRounds;
+       ++round) {
+    int more = epoll_wait(epfd, events + result, maxevents - result, 0);
+    if (more <= 0) {
+      break;
+    }
+    result += more;
+  }
+  output->Push<int>(result);
+  output->Push<int>(klinux_errno);
+  return Status::OkStatus();
+}
+
 }  // namespace host_call
 }  // namespace asylo
@@ -215,6 +215,15 @@ Status ClockGettimeHandler(const std::shared_ptr<primitives::Client> &client,
                            void *context, primitives::MessageReader *input,
                            primitives::MessageWriter *output);
 
+// Handler for host call enc_untrusted_epoll_wait_in_place(). Expects [int epfd,
+// uint64_t events, int maxevents, int timeout, int batch], where |events| is
+// the address of an array of |maxevents| struct epoll_event in untrusted memory
+// that is filled in place, and returns [int /*result*/, int /*errno*/] on the
+// MessageWriter.
+Status EpollWaitInPlaceHandler(
+    const std::shared_ptr<primitives::Client> &client, void *context,
+    primitives::MessageReader *input, primitives::MessageWriter *output);
+
 }  // namespace host_call
 }  // namespace asylo
 
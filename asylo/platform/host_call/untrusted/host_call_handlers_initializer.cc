@@ -109,6 +109,10 @@ Status AddHostCallHandlersToExitCallProvider(
   ASYLO_RETURN_IF_ERROR(exit_call_provider->RegisterExitHandler(
       kClockGettimeHandler, primitives::ExitHandler{ClockGettimeHandler}));
 
+  ASYLO_RETURN_IF_ERROR(exit_call_provider->RegisterExitHandler(
+      kEpollWaitInPlaceHandler,
+      primitives::ExitHandler{EpollWaitInPlaceHandler}));
+
   return Status::OkStatus();
 }
 
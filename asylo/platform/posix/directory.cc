@@ -0,0 +1,284 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+#include "asylo/platform/posix/io/io_manager.h"
+
+using asylo::io::IOManager;
+
+namespace {
+
+// Number of bytes of directory entries requested from the host at a time.
+constexpr size_t kBatchSize = 32 * 1024;
+
+// Layout of the Linux linux_dirent64 records returned by getdents64.
+constexpr size_t kInoOffset = 0;
+constexpr size_t kOffOffset = 8;
+constexpr size_t kReclenOffset = 16;
+constexpr size_t kTypeOffset = 18;
+constexpr size_t kNameOffset = 19;
+
+}  // namespace
+
+// An open directory stream. Entries are fetched from the host in batches of up
+// to |kBatchSize| bytes, so a directory scan costs one host call per batch
+// rather than one per entry.
+struct __dirstream {
+  int fd;
+
+  // Number of bytes of host records in |buffer|, and the offset of the next
+  // record to return.
+  size_t size;
+  size_t offset;
+
+  // Position after the last entry returned, as reported by telldir().
+  off_t position;
+
+  // Set once the host has reported the end of the directory.
+  bool end;
+
+  // Entry returned by readdir().
+  struct dirent entry;
+
+  uint8_t buffer[kBatchSize];
+};
+
+namespace {
+
+void ResetStream(DIR *dir, off_t position) {
+  dir->size = 0;
+  dir->offset = 0;
+  dir->position = position;
+  dir->end = false;
+}
+
+// Fetches the next batch of records from the host. Returns 1 if records were
+// read, 0 at the end of the directory, and -1 on error.
+int FetchBatch(DIR *dir) {
+  int result =
+      IOManager::GetInstance().GetDents64(dir->fd, dir->buffer, kBatchSize);
+  if (result < 0) {
+    return -1;
+  }
+  if (static_cast<size_t>(result) > kBatchSize) {
+    errno = EIO;
+    return -1;
+  }
+  dir->size = result;
+  dir->offset = 0;
+  dir->end = result == 0;
+  return result > 0;
+}
+
+// Decodes the record at the current offset into |entry| and advances past it.
+// The records come from the host, so their lengths and names are validated;
+// returns false and sets errno to EIO if the record is malformed.
+bool DecodeRecord(DIR *dir, struct dirent *entry) {
+  const uint8_t *record = &dir->buffer[dir->offset];
+  size_t remaining = dir->size - dir->offset;
+  uint16_t reclen = 0;
+  if (remaining > kNameOffset) {
+    memcpy(&reclen, &record[kReclenOffset], sizeof(reclen));
+  }
+  if (reclen <= kNameOffset || reclen > remaining) {
+    errno = EIO;
+    return false;
+  }
+  const char *name = reinterpret_cast<const char *>(&record[kNameOffset]);
+  size_t name_length = strnlen(name, reclen - kNameOffset);
+  if (name_length == 0 || name_length == reclen - kNameOffset ||
+      name_length >= sizeof(entry->d_name)) {
+    errno = EIO;
+    return false;
+  }
+
+  uint64_t ino;
+  int64_t off;
+  memcpy(&ino, &record[kInoOffset], sizeof(ino));
+  memcpy(&off, &record[kOffOffset], sizeof(off));
+  entry->d_ino = ino;
+  entry->d_off = off;
+  entry->d_reclen = sizeof(*entry);
+  entry->d_type = record[kTypeOffset];
+  memcpy(entry->d_name, name, name_length + 1);
+
+  dir->offset += reclen;
+  dir->position = off;
+  return true;
+}
+
+// Reads the next entry of |dir| into |entry|. Returns 1 if an entry was read,
+// 0 at the end of the directory, and -1 on error.
+int NextEntry(DIR *dir, struct dirent *entry) {
+  if (dir->offset >= dir->size) {
+    if (dir->end) {
+      return 0;
+    }
+    int result = FetchBatch(dir);
+    if (result <= 0) {
+      return result;
+    }
+  }
+  return DecodeRecord(dir, entry) ? 1 : -1;
+}
+
+DIR *NewDirStream(int fd) {
+  DIR *dir = new (std::nothrow) __dirstream;
+  if (!dir) {
+    errno = ENOMEM;
+    return nullptr;
+  }
+  dir->fd = fd;
+  ResetStream(dir, 0);
+
+  // Fetch the first batch now, which also checks that |fd| is a directory.
+  if (FetchBatch(dir) < 0) {
+    int saved_errno = errno;
+    delete dir;
+    errno = saved_errno;
+    return nullptr;
+  }
+  return dir;
+}
+
+}  // namespace
+
+extern "C" {
+
+DIR *opendir(const char *name) {
+  int fd = open(name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+  DIR *dir = NewDirStream(fd);
+  if (!dir) {
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+  }
+  return dir;
+}
+
+DIR *fdopendir(int fd) { return NewDirStream(fd); }
+
+int closedir(DIR *dirp) {
+  int result = close(dirp->fd);
+  delete dirp;
+  return result;
+}
+
+int dirfd(DIR *dirp) { return dirp->fd; }
+
+struct dirent *readdir(DIR *dirp) {
+  return NextEntry(dirp, &dirp->entry) == 1 ? &dirp->entry : nullptr;
+}
+
+int readdir_r(DIR *dirp, struct dirent *entry, struct dirent **result) {
+  int saved_errno = errno;
+  int next = NextEntry(dirp, entry);
+  if (next < 0) {
+    int error = errno;
+    errno = saved_errno;
+    *result = nullptr;
+    return error;
+  }
+  *result = next ? entry : nullptr;
+  return 0;
+}
+
+void rewinddir(DIR *dirp) {
+  lseek(dirp->fd, 0, SEEK_SET);
+  ResetStream(dirp, 0);
+}
+
+void seekdir(DIR *dirp, long int loc) {
+  lseek(dirp->fd, loc, SEEK_SET);
+  ResetStream(dirp, loc);
+}
+
+long int telldir(DIR *dirp) { return dirp->position; }
+
+int scandir(const char *dirp, struct dirent ***namelist,
+            int (*filter)(const struct dirent *),
+            int (*compar)(const struct dirent **, const struct dirent **)) {
+  DIR *dir = opendir(dirp);
+  if (!dir) {
+    return -1;
+  }
+
+  // The filter sees d_type, so callers can select entries by type without a
+  // stat() host call per entry.
+  std::vector<struct dirent *> entries;
+  int next;
+  while ((next = NextEntry(dir, &dir->entry)) == 1) {
+    if (filter && !filter(&dir->entry)) {
+      continue;
+    }
+    size_t size =
+        offsetof(struct dirent, d_name) + strlen(dir->entry.d_name) + 1;
+    auto *copy = static_cast<struct dirent *>(malloc(size));
+    if (!copy) {
+      next = -1;
+      errno = ENOMEM;
+      break;
+    }
+    memcpy(copy, &dir->entry, size);
+    copy->d_reclen = size;
+    entries.push_back(copy);
+  }
+  int saved_errno = errno;
+  closedir(dir);
+
+  struct dirent **list = nullptr;
+  if (next == 0) {
+    list = static_cast<struct dirent **>(
+        malloc(std::max<size_t>(entries.size(), 1) * sizeof(*list)));
+  }
+  if (!list) {
+    for (struct dirent *entry : entries) {
+      free(entry);
+    }
+    errno = next == 0 ? ENOMEM : saved_errno;
+    return -1;
+  }
+  std::copy(entries.begin(), entries.end(), list);
+  if (compar) {
+    qsort(list, entries.size(), sizeof(*list),
+          reinterpret_cast<int (*)(const void *, const void *)>(compar));
+  }
+  *namelist = list;
+  return entries.size();
+}
+
+int alphasort(const struct dirent **a, const struct dirent **b) {
+  return strcoll((*a)->d_name, (*b)->d_name);
+}
+
+}  // extern "C"
@@ -18,21 +18,25 @@
 
 #include <dirent.h>
 
-#include <cstdint>
 #include <cstdlib>
 
-int closedir(DIR *) { abort(); }
+// Directory functions need the IOManager, which is not part of the backend
+// agnostic runtime. These weak definitions are overridden by the full POSIX
+// runtime.
 
-DIR *opendir(const char *) { abort(); }
+__attribute__((weak)) int closedir(DIR *) { abort(); }
 
-struct dirent *readdir(DIR *) {
+__attribute__((weak)) DIR *opendir(const char *) { abort(); }
+
+__attribute__((weak)) struct dirent *readdir(DIR *) { abort(); }
+
+__attribute__((weak)) int readdir_r(DIR *, struct dirent *,
+                                    struct dirent **) {
   abort();
 }
 
-int readdir_r(DIR *, struct dirent *, struct dirent **) { abort(); }
-
-void rewinddir(DIR *) { abort(); }
+__attribute__((weak)) void rewinddir(DIR *) { abort(); }
 
-void seekdir(DIR *, int64_t) { abort(); }
+__attribute__((weak)) void seekdir(DIR *, long int) { abort(); }
 
-int64_t telldir(DIR *) { abort(); }
+__attribute__((weak)) long int telldir(DIR *) { abort(); }
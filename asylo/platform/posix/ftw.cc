@@ -0,0 +1,204 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <ftw.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+using NftwCallback = int (*)(const char *, const struct stat *, int,
+                             struct FTW *);
+
+struct DirectoryEntry {
+  std::string name;
+  unsigned char type;
+};
+
+// Reads the entries of the directory |path|, other than "." and "..", into
+// |entries|. The whole listing is read before any entry is visited so that at
+// most one directory stream is open at a time, however deep the walk.
+bool ReadEntries(const std::string &path, std::vector<DirectoryEntry> *entries) {
+  DIR *dir = opendir(path.c_str());
+  if (!dir) {
+    return false;
+  }
+  int saved_errno = errno;
+  errno = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+    entries->push_back({entry->d_name, entry->d_type});
+  }
+  bool ok = errno == 0;
+  closedir(dir);
+  if (ok) {
+    errno = saved_errno;
+  }
+  return ok;
+}
+
+class FileTreeWalker {
+ public:
+  FileTreeWalker(NftwCallback fn, int flags) : fn_(fn), flags_(flags) {}
+
+  // Walks the tree rooted at |path|, whose file name starts at offset |base|.
+  int Walk(const char *path, int base);
+
+ private:
+  // Visits |path_|, the entry at depth |level| whose type according to the
+  // listing of its parent is |type|.
+  int Visit(int level, int base, unsigned char type);
+
+  int VisitDirectory(const struct stat &sb, int level, int base);
+
+  int Report(const struct stat &sb, int typeflag, int level, int base) {
+    struct FTW ftw = {base, level};
+    return fn_(path_.c_str(), &sb, typeflag, &ftw);
+  }
+
+  bool Follow() const { return !(flags_ & FTW_PHYS); }
+
+  const NftwCallback fn_;
+  const int flags_;
+  dev_t root_device_ = 0;
+  std::string path_;
+};
+
+int FileTreeWalker::Walk(const char *path, int base) {
+  path_ = path;
+  struct stat sb = {};
+  if ((Follow() ? stat(path, &sb) : lstat(path, &sb)) != 0) {
+    if (Follow() && errno == ENOENT && lstat(path, &sb) == 0 &&
+        S_ISLNK(sb.st_mode)) {
+      return Report(sb, FTW_SLN, 0, base);
+    }
+    return -1;
+  }
+  root_device_ = sb.st_dev;
+  if (S_ISDIR(sb.st_mode)) {
+    return VisitDirectory(sb, 0, base);
+  }
+  return Report(sb, S_ISLNK(sb.st_mode) ? FTW_SL : FTW_F, 0, base);
+}
+
+int FileTreeWalker::Visit(int level, int base, unsigned char type) {
+  struct stat sb = {};
+
+  // With FTW_NOSTAT the type from the directory listing is enough to decide
+  // how to visit an entry, unless it is a link that has to be followed or
+  // FTW_MOUNT needs the device of every directory.
+  if ((flags_ & FTW_NOSTAT) && type != DT_UNKNOWN &&
+      !(type == DT_LNK && Follow()) &&
+      !(type == DT_DIR && (flags_ & FTW_MOUNT))) {
+    sb.st_mode = DTTOIF(type);
+  } else if ((Follow() ? stat(path_.c_str(), &sb)
+                       : lstat(path_.c_str(), &sb)) != 0) {
+    if (Follow() && errno == ENOENT && lstat(path_.c_str(), &sb) == 0 &&
+        S_ISLNK(sb.st_mode)) {
+      return Report(sb, FTW_SLN, level, base);
+    }
+    sb = {};
+    return Report(sb, FTW_NS, level, base);
+  }
+
+  if (S_ISDIR(sb.st_mode)) {
+    if ((flags_ & FTW_MOUNT) && sb.st_dev != root_device_) {
+      return 0;
+    }
+    return VisitDirectory(sb, level, base);
+  }
+  return Report(sb, S_ISLNK(sb.st_mode) ? FTW_SL : FTW_F, level, base);
+}
+
+int FileTreeWalker::VisitDirectory(const struct stat &sb, int level,
+                                   int base) {
+  std::vector<DirectoryEntry> entries;
+  if (!ReadEntries(path_, &entries)) {
+    return Report(sb, FTW_DNR, level, base);
+  }
+  if (!(flags_ & FTW_DEPTH)) {
+    int result = Report(sb, FTW_D, level, base);
+    if (result != 0) {
+      return result;
+    }
+  }
+
+  size_t length = path_.size();
+  for (const DirectoryEntry &entry : entries) {
+    path_.resize(length);
+    if (path_.empty() || path_.back() != '/') {
+      path_.push_back('/');
+    }
+    int child_base = path_.size();
+    path_.append(entry.name);
+    int result = Visit(level + 1, child_base, entry.type);
+    if (result != 0) {
+      return result;
+    }
+  }
+  path_.resize(length);
+
+  if (flags_ & FTW_DEPTH) {
+    return Report(sb, FTW_DP, level, base);
+  }
+  return 0;
+}
+
+}  // namespace
+
+extern "C" {
+
+int nftw(const char *path,
+         int (*fn)(const char *path, const struct stat *sb, int typeflag,
+                   struct FTW *ftwbuf),
+         int nopenfd, int flags) {
+  if (flags & FTW_CHDIR) {
+    errno = ENOSYS;
+    return -1;
+  }
+  if (!path || !*path) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  // The walk keeps only one directory open at a time, so |nopenfd| is not
+  // needed to bound the number of open descriptors.
+  static_cast<void>(nopenfd);
+
+  // The file name of the starting path begins after its last non-trailing
+  // slash.
+  const char *end = path + strlen(path);
+  while (end > path + 1 && end[-1] == '/') {
+    --end;
+  }
+  const char *name = end;
+  while (name > path && name[-1] != '/') {
+    --name;
+  }
+  return FileTreeWalker(fn, flags).Walk(path, name - path);
+}
+
+}  // extern "C"
@@ -0,0 +1,62 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_POSIX_INCLUDE_FTW_H_
+#define ASYLO_PLATFORM_POSIX_INCLUDE_FTW_H_
+
+#include <sys/stat.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Values of the typeflag argument passed to the nftw() callback.
+#define FTW_F 0    // Non-directory file
+#define FTW_D 1    // Directory
+#define FTW_DNR 2  // Directory that cannot be read
+#define FTW_NS 3   // File for which stat() failed
+#define FTW_SL 4   // Symbolic link (with FTW_PHYS)
+#define FTW_DP 5   // Directory whose children have been visited (FTW_DEPTH)
+#define FTW_SLN 6  // Symbolic link naming a nonexistent file
+
+// Flags for nftw().
+#define FTW_PHYS 1   // Do not follow symbolic links
+#define FTW_MOUNT 2  // Stay within the file system of the starting path
+#define FTW_CHDIR 4  // Unsupported
+#define FTW_DEPTH 8  // Report directories after their children
+
+// Asylo extension: do not stat entries whose type is reported by the directory
+// listing. The stat buffer passed to the callback for such entries only has
+// the file type bits of st_mode set. This avoids one host call per entry.
+#define FTW_NOSTAT 0x100
+
+struct FTW {
+  int base;   // Offset of the file name within the path
+  int level;  // Depth relative to the starting path
+};
+
+int nftw(const char *path,
+         int (*fn)(const char *path, const struct stat *sb, int typeflag,
+                   struct FTW *ftwbuf),
+         int nopenfd, int flags);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // ASYLO_PLATFORM_POSIX_INCLUDE_FTW_H_
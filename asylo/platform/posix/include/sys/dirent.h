@@ -0,0 +1,77 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+// Replaces the toolchain's <sys/dirent.h> with Linux-compatible directory
+// entries, which report the type of each entry in d_type.
+
+#ifndef ASYLO_PLATFORM_POSIX_INCLUDE_SYS_DIRENT_H_
+#define ASYLO_PLATFORM_POSIX_INCLUDE_SYS_DIRENT_H_
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Values of d_type.
+#define DT_UNKNOWN 0
+#define DT_FIFO 1
+#define DT_CHR 2
+#define DT_DIR 4
+#define DT_BLK 6
+#define DT_REG 8
+#define DT_LNK 10
+#define DT_SOCK 12
+#define DT_WHT 14
+
+// Conversions between d_type and the file type bits of st_mode.
+#define IFTODT(mode) (((mode)&0170000) >> 12)
+#define DTTOIF(dirtype) ((dirtype) << 12)
+
+typedef struct __dirstream DIR;
+
+struct dirent {
+  ino_t d_ino;              // File serial number
+  off_t d_off;              // Position to pass to seekdir() to resume after
+  unsigned short d_reclen;  // Length of this record
+  unsigned char d_type;     // Type of file, or DT_UNKNOWN
+  char d_name[256];         // Null-terminated name of entry
+};
+
+DIR *opendir(const char *name);
+DIR *fdopendir(int fd);
+int closedir(DIR *dirp);
+int dirfd(DIR *dirp);
+
+struct dirent *readdir(DIR *dirp);
+int readdir_r(DIR *dirp, struct dirent *entry, struct dirent **result);
+
+void rewinddir(DIR *dirp);
+void seekdir(DIR *dirp, long int loc);
+long int telldir(DIR *dirp);
+
+int scandir(const char *dirp, struct dirent ***namelist,
+            int (*filter)(const struct dirent *),
+            int (*compar)(const struct dirent **, const struct dirent **));
+int alphasort(const struct dirent **a, const struct dirent **b);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // ASYLO_PLATFORM_POSIX_INCLUDE_SYS_DIRENT_H_
@@ -31,6 +31,17 @@
 // IOCTL to set a key on a secure file.
 #define ENCLAVE_STORAGE_SET_KEY (ENCLAVE_STORAGE_IOCTL_TYPE | 0x00000001)
 
+// IOCTL to set a key on a secure file, and the block length of the file if it
+// is created by this request.
+#define ENCLAVE_STORAGE_SET_KEY_WITH_BLOCK_LENGTH \
+  (ENCLAVE_STORAGE_IOCTL_TYPE | 0x00000002)
+
+// IOCTL to set the number of writes to a secure file after which the digest in
+// its header is updated, 0 for updating it only on fsync and close. The
+// argument points to a uint32_t.
+#define ENCLAVE_STORAGE_SET_DIGEST_UPDATE_INTERVAL \
+  (ENCLAVE_STORAGE_IOCTL_TYPE | 0x00000003)
+
 #define TIOCGWINSZ 0x5413
 
 struct winsize {
@@ -45,6 +56,12 @@ struct key_info {
   uint8_t *data;
 } __attribute__((packed));
 
+struct key_and_block_length_info {
+  uint32_t length;
+  uint8_t *data;
+  uint32_t block_length;
+} __attribute__((packed));
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -0,0 +1,172 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/posix/io/ctr_drbg.h"
+
+#include <openssl/mem.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "asylo/platform/primitives/trusted_runtime.h"
+
+namespace asylo {
+namespace io {
+namespace {
+
+// Size of the per-thread buffer of pre-generated output. Requests of at least
+// this size bypass the buffer and are generated in place.
+constexpr size_t kBufferSize = 1024;
+
+// Per-thread generator state. Zero-initialized, so it needs no constructor.
+struct ThreadRandomState {
+  CtrDrbg drbg;
+  uint8_t buffer[kBufferSize];
+
+  // Number of unserved bytes, held at the end of |buffer|.
+  size_t available;
+
+  // Value of enc_fork_generation() when |drbg| was instantiated.
+  uint64_t fork_generation;
+  bool seeded;
+};
+
+thread_local ThreadRandomState thread_random_state;
+
+// Increments the big-endian 128-bit |counter|.
+void IncrementCounter(uint8_t *counter) {
+  for (int i = AES_BLOCK_SIZE - 1; i >= 0; --i) {
+    if (++counter[i] != 0) {
+      break;
+    }
+  }
+}
+
+// Instantiates the generator of |state| if it has not been seeded yet, or if
+// the enclave has since been restored from a fork() snapshot.
+void MaybeInstantiate(ThreadRandomState *state) {
+  uint64_t fork_generation = enc_fork_generation();
+  if (state->seeded && state->fork_generation == fork_generation) {
+    return;
+  }
+  uint8_t seed[CtrDrbg::kSeedLength];
+  enc_hardware_random_seed(seed, sizeof(seed));
+  state->drbg.Instantiate(seed);
+  OPENSSL_cleanse(seed, sizeof(seed));
+  OPENSSL_cleanse(state->buffer, sizeof(state->buffer));
+  state->available = 0;
+  state->fork_generation = fork_generation;
+  state->seeded = true;
+}
+
+void Generate(ThreadRandomState *state, uint8_t *out, size_t len) {
+  if (state->drbg.NeedsReseed()) {
+    uint8_t seed[CtrDrbg::kSeedLength];
+    enc_hardware_random_seed(seed, sizeof(seed));
+    state->drbg.Reseed(seed);
+    OPENSSL_cleanse(seed, sizeof(seed));
+  }
+  state->drbg.Generate(out, len, /*additional_input=*/nullptr);
+}
+
+// Moves up to |count| buffered bytes to |buf|, erasing them from the buffer.
+// Returns the number of bytes moved.
+size_t TakeBuffered(ThreadRandomState *state, uint8_t *buf, size_t count) {
+  size_t len = std::min(count, state->available);
+  uint8_t *start = &state->buffer[kBufferSize - state->available];
+  memcpy(buf, start, len);
+  OPENSSL_cleanse(start, len);
+  state->available -= len;
+  return len;
+}
+
+}  // namespace
+
+constexpr size_t CtrDrbg::kSeedLength;
+constexpr size_t CtrDrbg::kMaxRequestLength;
+constexpr uint64_t CtrDrbg::kReseedInterval;
+
+void CtrDrbg::Instantiate(const uint8_t *seed) {
+  static const uint8_t kZeroKey[32] = {0};
+  AES_set_encrypt_key(kZeroKey, 8 * sizeof(kZeroKey), &key_);
+  memset(counter_, 0, sizeof(counter_));
+  counter_[AES_BLOCK_SIZE - 1] = 1;
+  Update(seed);
+  reseed_counter_ = 1;
+}
+
+void CtrDrbg::Reseed(const uint8_t *seed) {
+  Update(seed);
+  reseed_counter_ = 1;
+}
+
+void CtrDrbg::Generate(uint8_t *out, size_t len,
+                       const uint8_t *additional_input) {
+  if (additional_input) {
+    Update(additional_input);
+  }
+  // Encrypting zeros in counter mode yields the raw keystream. The counter
+  // block is left at one past the last block used, i.e. at V + 1.
+  memset(out, 0, len);
+  uint8_t ecount[AES_BLOCK_SIZE];
+  unsigned int num = 0;
+  AES_ctr128_encrypt(out, out, len, &key_, counter_, ecount, &num);
+  OPENSSL_cleanse(ecount, sizeof(ecount));
+  Update(additional_input);
+  ++reseed_counter_;
+}
+
+void CtrDrbg::Update(const uint8_t *provided_data) {
+  uint8_t temp[kSeedLength] = {0};
+  uint8_t ecount[AES_BLOCK_SIZE];
+  unsigned int num = 0;
+  AES_ctr128_encrypt(temp, temp, sizeof(temp), &key_, counter_, ecount, &num);
+  if (provided_data) {
+    for (size_t i = 0; i < kSeedLength; ++i) {
+      temp[i] ^= provided_data[i];
+    }
+  }
+  AES_set_encrypt_key(temp, 256, &key_);
+
+  // V is the last block of |temp|; the next output block uses V + 1.
+  memcpy(counter_, &temp[32], AES_BLOCK_SIZE);
+  IncrementCounter(counter_);
+  OPENSSL_cleanse(temp, sizeof(temp));
+  OPENSSL_cleanse(ecount, sizeof(ecount));
+}
+
+ssize_t DrbgRandomBytes(uint8_t *buf, size_t count) {
+  ThreadRandomState *state = &thread_random_state;
+  MaybeInstantiate(state);
+
+  size_t offset = TakeBuffered(state, buf, count);
+  while (count - offset >= kBufferSize) {
+    size_t len = std::min(count - offset, CtrDrbg::kMaxRequestLength);
+    Generate(state, &buf[offset], len);
+    offset += len;
+  }
+  if (offset < count) {
+    Generate(state, state->buffer, kBufferSize);
+    state->available = kBufferSize;
+    offset += TakeBuffered(state, &buf[offset], count - offset);
+  }
+  return count;
+}
+
+}  // namespace io
+}  // namespace asylo
@@ -0,0 +1,90 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_POSIX_IO_CTR_DRBG_H_
+#define ASYLO_PLATFORM_POSIX_IO_CTR_DRBG_H_
+
+#include <openssl/aes.h>
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace asylo {
+namespace io {
+
+// A deterministic random bit generator implementing CTR_DRBG with AES-256 and
+// no derivation function, as specified in NIST SP 800-90A. The class is
+// trivially constructible so that it can live in thread-local storage; it must
+// be instantiated with Instantiate() before use.
+class CtrDrbg {
+ public:
+  // Size in bytes of the seed material consumed by Instantiate() and Reseed(),
+  // and of the optional additional input passed to Generate().
+  static constexpr size_t kSeedLength = 48;
+
+  // Maximum number of bytes produced by a single call to Generate().
+  static constexpr size_t kMaxRequestLength = 1 << 16;
+
+  // Number of calls to Generate() after which NeedsReseed() returns true. This
+  // is far below the limit allowed by SP 800-90A, bounding the output that
+  // depends on a single seed.
+  static constexpr uint64_t kReseedInterval = 1 << 16;
+
+  // Initializes the generator from |kSeedLength| bytes of |seed|.
+  void Instantiate(const uint8_t *seed);
+
+  // Mixes |kSeedLength| bytes of fresh entropy from |seed| into the state.
+  void Reseed(const uint8_t *seed);
+
+  // Returns true if the generator should be reseeded before the next call to
+  // Generate().
+  bool NeedsReseed() const { return reseed_counter_ > kReseedInterval; }
+
+  // Writes |len| bytes, at most |kMaxRequestLength|, to |out|. If
+  // |additional_input| is not null, |kSeedLength| bytes of it are mixed into
+  // the state before generating.
+  void Generate(uint8_t *out, size_t len, const uint8_t *additional_input);
+
+ private:
+  // The CTR_DRBG_Update function: replaces the key and counter with the next
+  // |kSeedLength| bytes of keystream XORed with |provided_data|, which may be
+  // null to denote all zeros.
+  void Update(const uint8_t *provided_data);
+
+  AES_KEY key_;
+
+  // The counter block for the next output block, i.e. V + 1 in the notation of
+  // SP 800-90A.
+  uint8_t counter_[AES_BLOCK_SIZE];
+
+  uint64_t reseed_counter_;
+};
+
+// Fills |buf| with |count| bytes from a DRBG private to the calling thread.
+// Small requests are served from a per-thread buffer of pre-generated output
+// which is erased as it is handed out. The generator is seeded from
+// enc_hardware_random_seed(), reseeded every |CtrDrbg::kReseedInterval|
+// refills, and discarded when the enclave is restored as the child of a
+// fork(). Returns |count|.
+ssize_t DrbgRandomBytes(uint8_t *buf, size_t count);
+
+}  // namespace io
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_POSIX_IO_CTR_DRBG_H_
@@ -0,0 +1,176 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/posix/io/ctr_drbg.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "absl/strings/escaping.h"
+#include "absl/strings/string_view.h"
+
+namespace asylo {
+namespace io {
+namespace {
+
+// Inputs and expected output of a CTR_DRBG run: Instantiate, an optional
+// Reseed, then two calls to Generate, the output of the second of which is
+// checked. Empty strings denote absent inputs.
+struct DrbgTestVector {
+  const char *entropy_input;
+  const char *personalization_string;
+  const char *entropy_input_reseed;
+  const char *additional_input_reseed;
+  const char *additional_input_1;
+  const char *additional_input_2;
+  const char *returned_bits;
+};
+
+// Vectors from the NIST CAVP CTR_DRBG test set for AES-256 with no derivation
+// function and no prediction resistance (drbgvectors_no_reseed), COUNT = 0.
+const DrbgTestVector kNoReseedVectors[] = {
+    {"df5d73faa468649edda33b5cca79b0b05600419ccb7a879ddfec9db32ee494e5531b51de"
+     "16a30f769262474c73bec010",
+     "", "", "", "", "",
+     "d1c07cd95af8a7f11012c84ce48bb8cb87189e99d40fccb1771c619bdf82ab2280b1dc2f"
+     "2581f39164f7ac0c510494b3a43c41b7db17514c87b107ae793e01c5"},
+    {"f45e9d040c1456f1c7f26e7f146469fbe3973007fe037239ad57623046e7ec52221b22ee"
+     "c208b22ac4cf4ca8d6253874",
+     "", "", "",
+     "28819bc79b92fc8790ebdc99812cdcea5c96e6feab32801ec1851b9f46e80eb6800028e6"
+     "1fbccb6ccbe42b06bf5a0864",
+     "418ca848027e1b3c84d66717e6f31bf89684d5db94cd2d579233f716ac70ab66cc7b01a6"
+     "f9ab8c7665fcc37dba4af1ad",
+     "4f11406bd303c104243441a8f828bf0293cb20ac39392061429c3f56c1f426239f8f0c68"
+     "7b69897a2c7c8c2b4fb520b62741ffdd29f038b7c82a9d00a890a3ed"},
+};
+
+// Runs through Reseed, with the entropy inputs of the vectors above. The
+// expected output was computed with OpenSSL's CTR-DRBG (AES-256-CTR, no
+// derivation function), an implementation independent of this one.
+const DrbgTestVector kReseedVectors[] = {
+    {"df5d73faa468649edda33b5cca79b0b05600419ccb7a879ddfec9db32ee494e5531b51de"
+     "16a30f769262474c73bec010",
+     "",
+     "fd85a836bba85019881e8c6bad23c9061adc75477659acaea8e4a01dfe07a1832dad1c13"
+     "6f59d70f8653ee6f9f5ada3f",
+     "", "", "",
+     "792b89f5c68621bc8b1094a59c6bed86b9b5a4202cdf26bafcd55cfd52b86e84f888eada"
+     "000d1df6ec4c00c218217a71d4ffc01023556e1d053904a9dc1e3f86"},
+    {"f45e9d040c1456f1c7f26e7f146469fbe3973007fe037239ad57623046e7ec52221b22ee"
+     "c208b22ac4cf4ca8d6253874",
+     "",
+     "fd85a836bba85019881e8c6bad23c9061adc75477659acaea8e4a01dfe07a1832dad1c13"
+     "6f59d70f8653ee6f9f5ada3f",
+     "e4bc23c5089a19d86f4119cb3fa08c0a4991e0a1def17e101e4c14d9c323460a7c2fb58e"
+     "0b086c6c57b55f56cae25bad",
+     "28819bc79b92fc8790ebdc99812cdcea5c96e6feab32801ec1851b9f46e80eb6800028e6"
+     "1fbccb6ccbe42b06bf5a0864",
+     "418ca848027e1b3c84d66717e6f31bf89684d5db94cd2d579233f716ac70ab66cc7b01a6"
+     "f9ab8c7665fcc37dba4af1ad",
+     "c49748f304992677a0e7213eb2cafcd4f795b6fd61182b3dacfa0ff86f308ed9cc5928f8"
+     "37274871e38831107029ad8d67e4e4174d1a7abebe8f2b2e2ccd66a7"},
+};
+
+std::string FromHex(absl::string_view hex) {
+  return absl::HexStringToBytes(hex);
+}
+
+// Returns the seed material for |entropy_input| and the optional |input|,
+// which without a derivation function is their XOR.
+std::vector<uint8_t> SeedMaterial(absl::string_view entropy_input,
+                                  absl::string_view input) {
+  std::string entropy = FromHex(entropy_input);
+  std::string extra = FromHex(input);
+  std::vector<uint8_t> seed(entropy.begin(), entropy.end());
+  for (size_t i = 0; i < extra.size(); ++i) {
+    seed[i] ^= static_cast<uint8_t>(extra[i]);
+  }
+  return seed;
+}
+
+// Returns the additional input for |input|, or null if it is absent.
+const uint8_t *AdditionalInput(const std::string &input) {
+  return input.empty() ? nullptr
+                       : reinterpret_cast<const uint8_t *>(input.data());
+}
+
+// Runs |vector| and returns the output of the second call to Generate().
+std::string RunVector(const DrbgTestVector &vector) {
+  std::vector<uint8_t> seed =
+      SeedMaterial(vector.entropy_input, vector.personalization_string);
+  EXPECT_EQ(seed.size(), CtrDrbg::kSeedLength);
+  CtrDrbg drbg;
+  drbg.Instantiate(seed.data());
+  if (*vector.entropy_input_reseed) {
+    std::vector<uint8_t> reseed = SeedMaterial(
+        vector.entropy_input_reseed, vector.additional_input_reseed);
+    EXPECT_EQ(reseed.size(), CtrDrbg::kSeedLength);
+    drbg.Reseed(reseed.data());
+  }
+  std::string additional_input_1 = FromHex(vector.additional_input_1);
+  std::string additional_input_2 = FromHex(vector.additional_input_2);
+  std::string out(FromHex(vector.returned_bits).size(), '\0');
+  uint8_t *out_bytes = reinterpret_cast<uint8_t *>(&out[0]);
+  drbg.Generate(out_bytes, out.size(), AdditionalInput(additional_input_1));
+  drbg.Generate(out_bytes, out.size(), AdditionalInput(additional_input_2));
+  return absl::BytesToHexString(out);
+}
+
+TEST(CtrDrbgTest, NoReseedKnownAnswers) {
+  for (const DrbgTestVector &vector : kNoReseedVectors) {
+    EXPECT_EQ(RunVector(vector), vector.returned_bits);
+  }
+}
+
+TEST(CtrDrbgTest, ReseedKnownAnswers) {
+  for (const DrbgTestVector &vector : kReseedVectors) {
+    EXPECT_EQ(RunVector(vector), vector.returned_bits);
+  }
+}
+
+// Tests that a request ending part way through a block leaves the counter one
+// past that block, so that the next request starts on a fresh block.
+TEST(CtrDrbgTest, PartialBlockKnownAnswer) {
+  DrbgTestVector vector = kNoReseedVectors[0];
+  vector.returned_bits = "7914afaecd82e6fb841fcaf148e76e35a69778e5";
+  EXPECT_EQ(RunVector(vector), vector.returned_bits);
+}
+
+// Tests that the generator asks to be reseeded once its interval is used up,
+// and that reseeding restarts the interval.
+TEST(CtrDrbgTest, NeedsReseedAfterInterval) {
+  std::vector<uint8_t> seed = SeedMaterial(kNoReseedVectors[0].entropy_input,
+                                           "");
+  CtrDrbg drbg;
+  drbg.Instantiate(seed.data());
+  uint8_t out[1];
+  for (uint64_t i = 0; i < CtrDrbg::kReseedInterval; ++i) {
+    EXPECT_FALSE(drbg.NeedsReseed());
+    drbg.Generate(out, sizeof(out), /*additional_input=*/nullptr);
+  }
+  EXPECT_TRUE(drbg.NeedsReseed());
+  drbg.Reseed(seed.data());
+  EXPECT_FALSE(drbg.NeedsReseed());
+}
+
+}  // namespace
+}  // namespace io
+}  // namespace asylo
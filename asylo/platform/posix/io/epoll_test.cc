@@ -16,10 +16,14 @@
  *
  */
 
+#include <arpa/inet.h>
+#include <netinet/in.h>
 #include <sys/epoll.h>
+#include <sys/socket.h>
 #include <unistd.h>
 #include <chrono>
 #include <thread>
+#include <vector>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
@@ -289,5 +293,56 @@ TEST_F(EpollTest, LevelTriggeredBehavior) { LevelEdgeBehaviorTest(false); }
 
 TEST_F(EpollTest, EdgeTriggeredBehavior) { LevelEdgeBehaviorTest(true); }
 
+// Registers many host sockets edge-triggered, as an event loop would, and
+// checks that each ready socket is reported exactly once even when the host
+// collects events in batches.
+TEST_F(EpollTest, EdgeTriggeredHostSocketsReportedOnce) {
+  constexpr size_t kNumSockets = 64;
+  int epfd = epoll_create(1);
+  ASSERT_NE(epfd, -1);
+  int sender = socket(AF_INET, SOCK_DGRAM, 0);
+  ASSERT_NE(sender, -1);
+  std::vector<int> sockets;
+  for (size_t i = 0; i < kNumSockets; ++i) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_NE(fd, -1);
+    sockets.push_back(fd);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(bind(fd, reinterpret_cast<struct sockaddr *>(&addr),
+                   sizeof(addr)),
+              0);
+    socklen_t addr_len = sizeof(addr);
+    ASSERT_EQ(
+        getsockname(fd, reinterpret_cast<struct sockaddr *>(&addr), &addr_len),
+        0);
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = fd;
+    ASSERT_NE(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev), -1);
+    ASSERT_EQ(sendto(sender, kTestString, strlen(kTestString), 0,
+                     reinterpret_cast<struct sockaddr *>(&addr), addr_len),
+              strlen(kTestString));
+  }
+
+  std::vector<struct epoll_event> events(2 * kNumSockets);
+  absl::flat_hash_set<int> ready_fds;
+  while (ready_fds.size() < kNumSockets) {
+    int num_events = epoll_wait(epfd, events.data(), events.size(), 1000);
+    ASSERT_GT(num_events, 0);
+    for (int i = 0; i < num_events; ++i) {
+      EXPECT_TRUE(ready_fds.insert(events[i].data.fd).second);
+    }
+  }
+  EXPECT_EQ(epoll_wait(epfd, events.data(), events.size(), 0), 0);
+
+  ASSERT_EQ(close(epfd), 0);
+  ASSERT_EQ(close(sender), 0);
+  for (int fd : sockets) {
+    ASSERT_EQ(close(fd), 0);
+  }
+}
+
 }  // namespace
 }  // namespace asylo
@@ -16,6 +16,8 @@
  *
  */
 
+#include <poll.h>
+#include <sys/epoll.h>
 #include <sys/eventfd.h>
 #include <unistd.h>
 
@@ -196,5 +198,58 @@ TEST_F(EventFdTest, MaxCounterNonBlock) {
   EXPECT_EQ(errno, EAGAIN);
 }
 
+TEST_F(EventFdTest, PollWaitsForWrite) {
+  InitializeEventFd(false, 0);
+  struct pollfd fds[1];
+  fds[0].fd = event_fd_;
+  fds[0].events = POLLIN;
+  ASSERT_EQ(poll(fds, 1, 0), 0);
+
+  std::thread worker([this] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(kSleepDur));
+    Write(kCounterStart);
+  });
+  ASSERT_EQ(poll(fds, 1, -1), 1);
+  EXPECT_TRUE(fds[0].revents & POLLIN);
+  worker.join();
+  EXPECT_EQ(Read(), kCounterStart);
+}
+
+TEST_F(EventFdTest, EpollWithPipe) {
+  InitializeEventFd(false, 0);
+  int pipe_fds[2];
+  ASSERT_EQ(pipe(pipe_fds), 0);
+  int epfd = epoll_create(1);
+  ASSERT_NE(epfd, -1);
+
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.fd = event_fd_;
+  ASSERT_EQ(epoll_ctl(epfd, EPOLL_CTL_ADD, event_fd_, &ev), 0);
+  ev.data.fd = pipe_fds[0];
+  ASSERT_EQ(epoll_ctl(epfd, EPOLL_CTL_ADD, pipe_fds[0], &ev), 0);
+
+  struct epoll_event events[2];
+  ASSERT_EQ(epoll_wait(epfd, events, 2, 0), 0);
+
+  char byte = 'a';
+  ASSERT_EQ(write(pipe_fds[1], &byte, 1), 1);
+  ASSERT_EQ(epoll_wait(epfd, events, 2, -1), 1);
+  EXPECT_EQ(events[0].data.fd, pipe_fds[0]);
+
+  std::thread worker([this] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(kSleepDur));
+    Write(1);
+  });
+  ASSERT_EQ(read(pipe_fds[0], &byte, 1), 1);
+  ASSERT_EQ(epoll_wait(epfd, events, 2, -1), 1);
+  EXPECT_EQ(events[0].data.fd, event_fd_);
+  worker.join();
+
+  EXPECT_EQ(close(epfd), 0);
+  EXPECT_EQ(close(pipe_fds[0]), 0);
+  EXPECT_EQ(close(pipe_fds[1]), 0);
+}
+
 }  // namespace
 }  // namespace asylo
@@ -0,0 +1,140 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/posix/io/host_file_mapping.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <unordered_set>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "asylo/platform/host_call/trusted/host_calls.h"
+#include "asylo/platform/posix/io/page_cache.h"
+
+namespace asylo {
+namespace io {
+namespace {
+
+uint64_t NextMappingId() {
+  static std::atomic<uint64_t> next_id(1);
+  return next_id.fetch_add(1);
+}
+
+// All live mappings, so that modifications of a file can reach its mappings.
+struct MappingRegistry {
+  absl::Mutex mu;
+  std::unordered_set<HostFileMapping *> mappings ABSL_GUARDED_BY(mu);
+  std::atomic<size_t> count{0};
+};
+
+MappingRegistry &GetRegistry() {
+  static MappingRegistry *registry = new MappingRegistry;
+  return *registry;
+}
+
+}  // namespace
+
+std::shared_ptr<HostFileMapping> HostFileMapping::Create(int host_fd,
+                                                         size_t length,
+                                                         int flags,
+                                                         off_t offset) {
+  struct stat stat_buffer;
+  if (enc_untrusted_fstat(host_fd, &stat_buffer) == -1) {
+    return nullptr;
+  }
+  size_t file_bytes = 0;
+  if (stat_buffer.st_size > offset) {
+    file_bytes =
+        std::min(length, static_cast<size_t>(stat_buffer.st_size - offset));
+  }
+
+  void *data =
+      enc_untrusted_mmap(nullptr, length, PROT_READ, flags, host_fd, offset);
+  if (data == MAP_FAILED) {
+    return nullptr;
+  }
+  return std::shared_ptr<HostFileMapping>(new HostFileMapping(
+      static_cast<uint8_t *>(data), length, offset, file_bytes, stat_buffer));
+}
+
+HostFileMapping::HostFileMapping(uint8_t *data, size_t length, off_t offset,
+                                 size_t file_bytes, const struct stat &file)
+    : data_(data),
+      length_(length),
+      offset_(offset),
+      file_bytes_(file_bytes),
+      device_(file.st_dev),
+      inode_(file.st_ino),
+      id_(NextMappingId()),
+      stale_(false) {
+  MappingRegistry &registry = GetRegistry();
+  absl::MutexLock lock(&registry.mu);
+  registry.mappings.insert(this);
+  registry.count.fetch_add(1);
+}
+
+HostFileMapping::~HostFileMapping() {
+  {
+    MappingRegistry &registry = GetRegistry();
+    absl::MutexLock lock(&registry.mu);
+    registry.mappings.erase(this);
+    registry.count.fetch_sub(1);
+  }
+  PageCache::GetInstance().Invalidate(id_);
+  enc_untrusted_munmap(data_, length_);
+}
+
+bool HostFileMapping::PRead(void *buf, size_t count, off_t offset) const {
+  if (stale_.load()) {
+    return false;
+  }
+  if (offset < offset_ || static_cast<size_t>(offset - offset_) > file_bytes_ ||
+      count > file_bytes_ - (offset - offset_)) {
+    return false;
+  }
+  PageCache::GetInstance().Read(id_, data_, file_bytes_, offset - offset_, buf,
+                                count);
+  return true;
+}
+
+void HostFileMapping::FileChanged(const struct stat *file) {
+  std::vector<uint64_t> ids;
+  {
+    MappingRegistry &registry = GetRegistry();
+    absl::MutexLock lock(&registry.mu);
+    for (HostFileMapping *mapping : registry.mappings) {
+      if (!file || (mapping->device_ == file->st_dev &&
+                    mapping->inode_ == file->st_ino)) {
+        mapping->stale_ = true;
+        ids.push_back(mapping->id_);
+      }
+    }
+  }
+  for (uint64_t id : ids) {
+    PageCache::GetInstance().Invalidate(id);
+  }
+}
+
+bool HostFileMapping::AnyExist() { return GetRegistry().count.load() > 0; }
+
+}  // namespace io
+}  // namespace asylo
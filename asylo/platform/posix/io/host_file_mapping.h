@@ -0,0 +1,106 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_POSIX_IO_HOST_FILE_MAPPING_H_
+#define ASYLO_PLATFORM_POSIX_IO_HOST_FILE_MAPPING_H_
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace asylo {
+namespace io {
+
+// A read-only mapping of part of a host file into untrusted memory, created by
+// mmap() on a file descriptor forwarded to the host.
+//
+// The mapped bytes can be read directly without leaving the enclave, but they
+// are untrusted and the host may change them at any time. PRead() copies them
+// through the trusted PageCache instead, so that the bytes of a page stay fixed
+// while it is cached. Once the enclave modifies the mapped file, PRead() stops
+// using the mapping. The host mapping is removed when the object is destroyed.
+class HostFileMapping {
+ public:
+  // Maps |length| bytes of |host_fd| starting at |offset|, which must be a
+  // multiple of the page size, using the host mmap() |flags|. Returns nullptr
+  // and sets errno on failure.
+  static std::shared_ptr<HostFileMapping> Create(int host_fd, size_t length,
+                                                 int flags, off_t offset);
+
+  ~HostFileMapping();
+
+  HostFileMapping(const HostFileMapping &) = delete;
+  HostFileMapping &operator=(const HostFileMapping &) = delete;
+
+  // Returns the address of the mapping in untrusted memory.
+  void *data() const { return data_; }
+
+  // Returns the length of the mapping.
+  size_t length() const { return length_; }
+
+  // Copies |count| bytes at file offset |offset| into |buf| through the page
+  // cache. Returns false, without copying anything, if the range is not backed
+  // by both this mapping and the file as it was when the mapping was created.
+  bool PRead(void *buf, size_t count, off_t offset) const;
+
+  // Called after the enclave modifies the file described by |file|, or an
+  // unknown file if |file| is null. Mappings of the file stop serving PRead()
+  // and their cached pages are dropped, since neither the pages nor the file
+  // size recorded at creation can be trusted to match the file any more.
+  static void FileChanged(const struct stat *file);
+
+  // Returns whether any mapping exists, so that callers can skip looking up
+  // the modified file when there is none.
+  static bool AnyExist();
+
+ private:
+  HostFileMapping(uint8_t *data, size_t length, off_t offset,
+                  size_t file_bytes, const struct stat &file);
+
+  // Untrusted address of the mapping.
+  uint8_t *const data_;
+
+  const size_t length_;
+
+  // File offset of the first mapped byte.
+  const off_t offset_;
+
+  // Number of mapped bytes that were backed by the file when the mapping was
+  // created. Reading mapped pages past the end of the file faults, so PRead()
+  // never touches them.
+  const size_t file_bytes_;
+
+  // Identifies the mapped file.
+  const dev_t device_;
+  const ino_t inode_;
+
+  // Identifies the mapping to the page cache.
+  const uint64_t id_;
+
+  // Set once the enclave has modified the mapped file.
+  std::atomic<bool> stale_;
+};
+
+}  // namespace io
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_POSIX_IO_HOST_FILE_MAPPING_H_
@@ -19,13 +19,73 @@
 
 #include <errno.h>
 #include <openssl/rand.h>
+#include <poll.h>
 #include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
 
 #include "absl/memory/memory.h"
+#include "absl/time/time.h"
 #include "asylo/platform/host_call/trusted/host_calls.h"
+#include "asylo/platform/posix/io/readiness_notifier.h"
+#include "asylo/platform/primitives/trusted_primitives.h"
+#include "asylo/platform/system_call/type_conversions/types_functions.h"
 
 namespace asylo {
 namespace io {
+namespace {
+
+// The key under which host wake pipes are registered with the host epoll
+// instance. Keys for host file descriptors are never zero.
+constexpr uint64_t kWakeKey = 0;
+
+// Marks a trusted registration for which no edge-triggered event has been
+// reported yet.
+constexpr uint64_t kNeverReported = std::numeric_limits<uint64_t>::max();
+
+// The most events collected from the host by a single host call.
+constexpr int kMaxHostEvents = 4096;
+
+// An array in untrusted memory into which the host writes ready events
+// directly. Each thread has its own, so concurrent waits do not share it.
+class HostEventBuffer {
+ public:
+  ~HostEventBuffer() {
+    if (events_) {
+      primitives::TrustedPrimitives::UntrustedLocalFree(events_);
+    }
+  }
+
+  // Returns an array with room for at least |count| events, or nullptr if
+  // untrusted memory cannot be allocated.
+  struct klinux_epoll_event *Get(int count) {
+    if (count > capacity_) {
+      void *events = primitives::TrustedPrimitives::UntrustedLocalAlloc(
+          count * sizeof(struct klinux_epoll_event));
+      if (!events) {
+        return nullptr;
+      }
+      if (events_) {
+        primitives::TrustedPrimitives::UntrustedLocalFree(events_);
+      }
+      events_ = static_cast<struct klinux_epoll_event *>(events);
+      capacity_ = count;
+    }
+    return events_;
+  }
+
+ private:
+  struct klinux_epoll_event *events_ = nullptr;
+  int capacity_ = 0;
+};
+
+thread_local HostEventBuffer host_event_buffer;
+
+}  // namespace
 
 int IOContextEpoll::EpollCtl(int op, int hostfd, struct epoll_event *event) {
   struct epoll_event event_copy;
@@ -40,7 +100,7 @@ int IOContextEpoll::EpollCtl(int op, int hostfd, struct epoll_event *event) {
         errno = EBADE;
         return -1;
       }
-    } while (key_to_data.find(key) != key_to_data.end());
+    } while (key == kWakeKey || key_to_data.find(key) != key_to_data.end());
     key_to_data[key] = event->data.u64;
     fd_to_key[hostfd] = key;
     event_copy.data.u64 = key;
@@ -64,27 +124,281 @@ int IOContextEpoll::EpollCtl(int op, int hostfd, struct epoll_event *event) {
   } else {
     return -1;
   }
+  {
+    absl::MutexLock lock(&trusted_mu_);
+    if (op == EPOLL_CTL_DEL || (event->events & EPOLLET)) {
+      level_triggered_fds_.erase(hostfd);
+    } else {
+      level_triggered_fds_.insert(hostfd);
+    }
+  }
   return enc_untrusted_epoll_ctl(host_fd_, op, hostfd, &event_copy);
 }
 
-int IOContextEpoll::EpollWait(struct epoll_event *events, int maxevents,
-                              int timeout) {
-  int ret = enc_untrusted_epoll_wait(host_fd_, events, maxevents, timeout);
+int IOContextEpoll::EpollCtlTrusted(int op, int fd,
+                                    std::shared_ptr<IOContext> context,
+                                    struct epoll_event *event) {
+  if (op != EPOLL_CTL_DEL && !event) {
+    errno = EFAULT;
+    return -1;
+  }
+  {
+    absl::MutexLock lock(&trusted_mu_);
+    auto it = trusted_.find(fd);
+    if (op == EPOLL_CTL_ADD) {
+      if (it != trusted_.end() && !it->second.context.expired()) {
+        errno = EEXIST;
+        return -1;
+      }
+      trusted_[fd] = {context, *event, kNeverReported, /*disabled=*/false};
+    } else if (op == EPOLL_CTL_MOD) {
+      if (it == trusted_.end()) {
+        errno = ENOENT;
+        return -1;
+      }
+      it->second.event = *event;
+      it->second.reported_event_count = kNeverReported;
+      it->second.disabled = false;
+    } else if (op == EPOLL_CTL_DEL) {
+      if (it == trusted_.end()) {
+        errno = ENOENT;
+        return -1;
+      }
+      trusted_.erase(it);
+      return 0;
+    } else {
+      errno = EINVAL;
+      return -1;
+    }
+  }
+  // Let threads already blocked in EpollWait pick up the new registration.
+  ReadinessNotifier::GetInstance().Notify(ReadinessKey());
+  return 0;
+}
+
+int IOContextEpoll::CollectTrustedEvents(ReadinessNotifier::Waiter *waiter,
+                                         struct epoll_event *events,
+                                         int maxevents) {
+  absl::MutexLock lock(&trusted_mu_);
+  // Register for changes to the interest list and to every stream in it
+  // before any readiness is evaluated.
+  std::vector<const void *> keys = {ReadinessKey()};
+  std::vector<std::shared_ptr<IOContext>> contexts;
+  for (auto it = trusted_.begin(); it != trusted_.end();) {
+    std::shared_ptr<IOContext> context = it->second.context.lock();
+    if (!context) {
+      it = trusted_.erase(it);
+      continue;
+    }
+    keys.push_back(context->ReadinessKey());
+    contexts.push_back(std::move(context));
+    ++it;
+  }
+  waiter->SetKeys(std::move(keys));
+
+  int count = 0;
+  auto context = contexts.begin();
+  for (auto it = trusted_.begin(); it != trusted_.end() && count < maxevents;
+       ++it, ++context) {
+    TrustedRegistration &registration = it->second;
+    if (registration.disabled) {
+      continue;
+    }
+    // The EPOLL* event bits have the same values as the corresponding POLL*
+    // bits.
+    uint32_t ready = (*context)->GetReadyEvents(
+        registration.event.events & (EPOLLIN | EPOLLOUT | EPOLLPRI));
+    if (ready == 0) {
+      continue;
+    }
+    if (registration.event.events & EPOLLET) {
+      uint64_t event_count = (*context)->EventCount();
+      if (event_count == registration.reported_event_count) {
+        continue;
+      }
+      registration.reported_event_count = event_count;
+    }
+    if (registration.event.events & EPOLLONESHOT) {
+      registration.disabled = true;
+    }
+    events[count].events = ready;
+    events[count].data = registration.event.data;
+    ++count;
+  }
+  return count;
+}
+
+bool IOContextEpoll::AddHostWakeFd(int wake_fd) {
+  absl::MutexLock lock(&trusted_mu_);
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.u64 = kWakeKey;
+  if (enc_untrusted_epoll_ctl(host_fd_, EPOLL_CTL_ADD, wake_fd, &event) ==
+      -1) {
+    return false;
+  }
+  // The wake pipe is registered without EPOLLET.
+  level_triggered_fds_.insert(wake_fd);
+  ++host_wake_fd_count_;
+  return true;
+}
+
+void IOContextEpoll::RemoveHostWakeFd(int wake_fd) {
+  absl::MutexLock lock(&trusted_mu_);
+  enc_untrusted_epoll_ctl(host_fd_, EPOLL_CTL_DEL, wake_fd, nullptr);
+  level_triggered_fds_.erase(wake_fd);
+  --host_wake_fd_count_;
+}
+
+int IOContextEpoll::HostEpollWait(struct epoll_event *events, int maxevents,
+                                  int timeout, bool *woken) {
+  *woken = false;
+  maxevents = std::min(maxevents, kMaxHostEvents);
+  struct klinux_epoll_event *host_events = host_event_buffer.Get(maxevents);
+
+  // When every host registration is edge-triggered, the host may return the
+  // results of several epoll_wait() calls at once. A descriptor can then be
+  // reported more than once, so its events are merged into a single entry.
+  bool batch = false;
+  if (host_events && maxevents > 1) {
+    absl::MutexLock lock(&trusted_mu_);
+    batch = level_triggered_fds_.empty();
+  }
+  int ret = host_events
+                ? enc_untrusted_epoll_wait_in_place(host_fd_, host_events,
+                                                    maxevents, timeout, batch)
+                : enc_untrusted_epoll_wait(host_fd_, events, maxevents,
+                                           timeout);
   if (ret == -1) {
-    // errno is set in enc_untrusted_epoll_wait.
+    // errno is set by the host call.
     return -1;
   }
-  // Convert the random bits in the data field back to the original data using
-  // the key_to_data map.
+
+  // The host writes the events directly into untrusted memory. Each one is
+  // copied into the enclave once before it is validated, and the random key in
+  // its data field is converted back to the original data using the
+  // key_to_data map, dropping the event for the host wake pipe.
+  std::unordered_map<uint64_t, int> positions;
+  int count = 0;
   for (int i = 0; i < ret; ++i) {
-    uint64_t key = events[i].data.u64;
-    if (key_to_data.find(key) == key_to_data.end()) {
+    struct epoll_event event;
+    if (host_events) {
+      struct klinux_epoll_event host_event;
+      memcpy(&host_event, &host_events[i], sizeof(host_event));
+      if (!FromkLinuxEpollEvent(&host_event, &event)) {
+        errno = EBADE;
+        return -1;
+      }
+    } else {
+      event = events[i];
+    }
+    uint64_t key = event.data.u64;
+    if (key == kWakeKey) {
+      *woken = true;
+      continue;
+    }
+    auto data = key_to_data.find(key);
+    if (data == key_to_data.end()) {
       errno = EBADE;
       return -1;
     }
-    events[i].data.u64 = key_to_data[key];
+    if (batch) {
+      auto position = positions.emplace(key, count);
+      if (!position.second) {
+        events[position.first->second].events |= event.events;
+        continue;
+      }
+    }
+    events[count].events = event.events;
+    events[count].data.u64 = data->second;
+    ++count;
+  }
+  return count;
+}
+
+int IOContextEpoll::EpollWait(struct epoll_event *events, int maxevents,
+                              int timeout) {
+  if (maxevents <= 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  bool has_trusted;
+  {
+    absl::MutexLock lock(&trusted_mu_);
+    // Another thread's host wake pipe may be registered, in which case its
+    // event must be filtered out here as well.
+    has_trusted = !trusted_.empty() || host_wake_fd_count_ > 0;
+  }
+  bool woken;
+  if (!has_trusted) {
+    return HostEpollWait(events, maxevents, timeout, &woken);
+  }
+
+  ReadinessNotifier::Waiter waiter({});
+  absl::Time deadline = timeout < 0 ? absl::InfiniteFuture()
+                                    : absl::Now() + absl::Milliseconds(timeout);
+  while (true) {
+    int count = CollectTrustedEvents(&waiter, events, maxevents);
+    bool expired = timeout == 0 || (timeout > 0 && absl::Now() >= deadline);
+
+    // Interest lists holding only trusted streams are waited on without
+    // leaving the enclave.
+    if (fd_to_key.empty()) {
+      if (count > 0 || expired) {
+        return count;
+      }
+      waiter.Wait(deadline);
+      continue;
+    }
+    if (count == maxevents) {
+      return count;
+    }
+
+    int host_timeout = 0;
+    int wake_fd = -1;
+    if (count == 0 && !expired) {
+      host_timeout =
+          timeout < 0
+              ? -1
+              : std::max<int64_t>(
+                    1, absl::ToInt64Milliseconds(deadline - absl::Now()));
+      wake_fd = waiter.BeginHostWait();
+      if (wake_fd >= 0) {
+        if (waiter.Notified()) {
+          waiter.EndHostWait();
+          continue;
+        }
+        if (!AddHostWakeFd(wake_fd)) {
+          waiter.EndHostWait();
+          wake_fd = -1;
+        }
+      }
+      if (wake_fd < 0) {
+        // Without a wake pipe, bound the host wait so that trusted streams are
+        // still rechecked periodically.
+        host_timeout = host_timeout < 0
+                           ? ReadinessNotifier::kFallbackHostWaitMs
+                           : std::min(host_timeout,
+                                      ReadinessNotifier::kFallbackHostWaitMs);
+      }
+    }
+    int ret = HostEpollWait(events + count, maxevents - count, host_timeout,
+                            &woken);
+    if (wake_fd >= 0) {
+      RemoveHostWakeFd(wake_fd);
+      waiter.EndHostWait();
+    }
+    if (ret < 0) {
+      return count > 0 ? count : -1;
+    }
+    count += ret;
+    if (count > 0 || host_timeout == 0) {
+      return count;
+    }
+    if (timeout > 0 && absl::Now() >= deadline) {
+      return 0;
+    }
   }
-  return ret;
 }
 
 int IOContextEpoll::GetHostFileDescriptor() { return host_fd_; }
@@ -19,9 +19,14 @@
 #ifndef ASYLO_PLATFORM_POSIX_IO_IO_CONTEXT_EPOLL_H_
 #define ASYLO_PLATFORM_POSIX_IO_IO_CONTEXT_EPOLL_H_
 
+#include <memory>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
+#include "absl/synchronization/mutex.h"
 #include "asylo/platform/posix/io/io_manager.h"
+#include "asylo/platform/posix/io/readiness_notifier.h"
 
 namespace asylo {
 namespace io {
@@ -32,6 +37,8 @@ class IOContextEpoll : public IOManager::IOContext {
   // It's important to note that adding dup'd file descriptors here won't work
   // the same as it would in POSIX.
   int EpollCtl(int op, int hostfd, struct epoll_event *event) override;
+  int EpollCtlTrusted(int op, int fd, std::shared_ptr<IOContext> context,
+                      struct epoll_event *event) override;
   int EpollWait(struct epoll_event *events, int maxevents,
                 int timeout) override;
   int GetHostFileDescriptor() override;
@@ -40,12 +47,52 @@ class IOContextEpoll : public IOManager::IOContext {
   int Close();
 
  private:
+  // A stream implemented inside the enclave which is part of the interest
+  // list. Its readiness is checked without leaving the enclave.
+  struct TrustedRegistration {
+    // Weak, so that closing the last descriptor for the stream still closes
+    // it. Expired registrations are dropped during EpollWait.
+    std::weak_ptr<IOContext> context;
+    struct epoll_event event;
+    // The value of IOContext::EventCount() when an edge-triggered event was
+    // last reported.
+    uint64_t reported_event_count;
+    // Set once an EPOLLONESHOT event has been reported.
+    bool disabled;
+  };
+
+  // Registers |waiter| on the trusted interest list, then appends up to
+  // |maxevents| ready events from it to |events| and returns the number
+  // appended.
+  int CollectTrustedEvents(ReadinessNotifier::Waiter *waiter,
+                           struct epoll_event *events, int maxevents);
+
+  // Adds or removes a waiter's host wake pipe to or from the host epoll
+  // instance for the duration of one host wait.
+  bool AddHostWakeFd(int wake_fd);
+  void RemoveHostWakeFd(int wake_fd);
+
+  // Waits on the host epoll instance, returning the number of events stored
+  // in |events| or -1 on failure. Sets |woken| if the host wake pipe fired.
+  int HostEpollWait(struct epoll_event *events, int maxevents, int timeout,
+                    bool *woken);
+
   // Host file descriptor implementing this stream.
   int host_fd_;
   std::unordered_map<uint64_t, uint64_t> key_to_data;
   // Manages a mapping from the host file descriptor to a random key to enable
   // updates to the above map durring deletions/modifications.
   std::unordered_map<int, uint64_t> fd_to_key;
+  absl::Mutex trusted_mu_;
+  // Host file descriptors registered without EPOLLET, including any host wake
+  // pipes. While there are none, the host may batch several epoll_wait()
+  // results into one host call.
+  std::unordered_set<int> level_triggered_fds_ ABSL_GUARDED_BY(trusted_mu_);
+  // Trusted streams in the interest list, keyed by enclave file descriptor.
+  std::unordered_map<int, TrustedRegistration> trusted_
+      ABSL_GUARDED_BY(trusted_mu_);
+  // The number of host wake pipes currently registered with |host_fd_|.
+  int host_wake_fd_count_ ABSL_GUARDED_BY(trusted_mu_) = 0;
 };
 
 }  // namespace io
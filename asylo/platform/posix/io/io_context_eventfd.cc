@@ -17,6 +17,10 @@
  */
 #include "asylo/platform/posix/io/io_context_eventfd.h"
 
+#include <poll.h>
+
+#include "asylo/platform/posix/io/readiness_notifier.h"
+
 constexpr uint64_t kMaxCounter = 0xfffffffffffffffe;
 constexpr ssize_t kCounterBufSize = sizeof(uint64_t);
 
@@ -28,7 +32,17 @@ ssize_t IOContextEventFd::Read(void *buf, size_t count) {
     errno = EINVAL;
     return -1;
   }
-  absl::MutexLock counter_mutex_lock(&counter_mutex_);
+  {
+    absl::MutexLock counter_mutex_lock(&counter_mutex_);
+    if (ReadLocked(buf) == -1) {
+      return -1;
+    }
+  }
+  ReadinessNotifier::GetInstance().Notify(ReadinessKey());
+  return kCounterBufSize;
+}
+
+ssize_t IOContextEventFd::ReadLocked(void *buf) {
   if (nonblock_ && (counter_ == 0)) {
     errno = EAGAIN;
     return -1;
@@ -43,6 +57,7 @@ ssize_t IOContextEventFd::Read(void *buf, size_t count) {
     *reinterpret_cast<uint64_t *>(buf) = counter_;
     counter_ = 0;
   }
+  ++event_count_;
   return kCounterBufSize;
 }
 
@@ -56,7 +71,17 @@ ssize_t IOContextEventFd::Write(const void *buf, size_t count) {
     errno = EINVAL;
     return -1;
   }
-  absl::MutexLock counter_mutex_lock(&counter_mutex_);
+  {
+    absl::MutexLock counter_mutex_lock(&counter_mutex_);
+    if (WriteLocked(add) == -1) {
+      return -1;
+    }
+  }
+  ReadinessNotifier::GetInstance().Notify(ReadinessKey());
+  return kCounterBufSize;
+}
+
+ssize_t IOContextEventFd::WriteLocked(uint64_t add) {
   if (nonblock_ && (counter_ + add > kMaxCounter)) {
     errno = EAGAIN;
     return -1;
@@ -65,6 +90,7 @@ ssize_t IOContextEventFd::Write(const void *buf, size_t count) {
     counter_mutex_.Await(absl::Condition(&ready));
   }
   counter_ += add;
+  ++event_count_;
   return kCounterBufSize;
 }
 
@@ -72,5 +98,22 @@ int IOContextEventFd::Close() {
   return 0;
 }
 
+int IOContextEventFd::GetReadyEvents(short events) {
+  absl::MutexLock counter_mutex_lock(&counter_mutex_);
+  int ready = 0;
+  if ((events & POLLIN) && counter_ > 0) {
+    ready |= POLLIN;
+  }
+  if ((events & POLLOUT) && counter_ < kMaxCounter) {
+    ready |= POLLOUT;
+  }
+  return ready;
+}
+
+uint64_t IOContextEventFd::EventCount() {
+  absl::MutexLock counter_mutex_lock(&counter_mutex_);
+  return event_count_;
+}
+
 }  // namespace io
 }  // namespace asylo
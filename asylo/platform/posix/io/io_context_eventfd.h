@@ -23,6 +23,7 @@
 
 #include <thread>
 
+#include "absl/base/thread_annotations.h"
 #include "absl/synchronization/mutex.h"
 #include "asylo/platform/posix/io/io_manager.h"
 
@@ -48,10 +49,19 @@ class IOContextEventFd : public IOManager::IOContext {
   ssize_t Read(void *buf, size_t count) override;
   ssize_t Write(const void *buf, size_t count) override;
   int Close() override;
+  int GetReadyEvents(short events) override;
+  uint64_t EventCount() override;
 
  private:
-  // Host file descriptor implementing this stream.
+  // Implement Read and Write once |counter_mutex_| is held.
+  ssize_t ReadLocked(void *buf) ABSL_EXCLUSIVE_LOCKS_REQUIRED(counter_mutex_);
+  ssize_t WriteLocked(uint64_t add)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(counter_mutex_);
+
+  // The eventfd counter, maintained inside the enclave.
   uint64_t counter_;
+  // The number of successful reads and writes, used for EPOLLET.
+  uint64_t event_count_ = 0;
   bool semaphore_;
   bool nonblock_;
   absl::Mutex counter_mutex_;
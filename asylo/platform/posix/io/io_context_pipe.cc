@@ -0,0 +1,345 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/posix/io/io_context_pipe.h"
+
+#include <limits.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "asylo/platform/posix/io/readiness_notifier.h"
+
+namespace asylo {
+namespace io {
+namespace {
+
+// Storage is grown in multiples of this size.
+constexpr size_t kPageSize = 4096;
+
+}  // namespace
+
+constexpr size_t PipeBuffer::kDefaultCapacity;
+constexpr size_t PipeBuffer::kMaxCapacity;
+
+ssize_t PipeBuffer::Read(void *buf, size_t count, bool nonblock) {
+  if (count == 0) {
+    return 0;
+  }
+  {
+    absl::MutexLock lock(&mu_);
+    if (size_ == 0) {
+      if (!write_end_open_) {
+        return 0;
+      }
+      if (nonblock) {
+        errno = EAGAIN;
+        return -1;
+      }
+      auto readable = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        return size_ > 0 || !write_end_open_;
+      };
+      mu_.Await(absl::Condition(&readable));
+      if (size_ == 0) {
+        return 0;
+      }
+    }
+    count = std::min(count, size_);
+    CopyOut(static_cast<uint8_t *>(buf), count);
+    bytes_read_ += count;
+  }
+  ReadinessNotifier::GetInstance().Notify(this);
+  return count;
+}
+
+ssize_t PipeBuffer::Write(const void *buf, size_t count, bool nonblock) {
+  if (count == 0) {
+    return 0;
+  }
+  const uint8_t *bytes = static_cast<const uint8_t *>(buf);
+  size_t written = 0;
+  while (written < count) {
+    {
+      absl::MutexLock lock(&mu_);
+      if (!read_end_open_) {
+        if (written > 0) {
+          break;
+        }
+        errno = EPIPE;
+        return -1;
+      }
+      // Writes of at most PIPE_BUF bytes must not be interleaved with other
+      // writes, so they wait for room for the whole write.
+      size_t needed = count <= PIPE_BUF ? count : 1;
+      if (capacity_ - size_ < needed) {
+        if (nonblock) {
+          if (written > 0) {
+            break;
+          }
+          errno = EAGAIN;
+          return -1;
+        }
+        auto writable = [this, needed]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+          return capacity_ - size_ >= needed || !read_end_open_;
+        };
+        mu_.Await(absl::Condition(&writable));
+        continue;
+      }
+      size_t chunk = std::min(count - written, capacity_ - size_);
+      CopyIn(bytes + written, chunk);
+      written += chunk;
+      bytes_written_ += chunk;
+    }
+    // Wake readers and pollers before possibly blocking for the remainder.
+    // This is done without holding |mu_|, since waking a thread blocked on
+    // the host is a host call.
+    ReadinessNotifier::GetInstance().Notify(this);
+  }
+  return written;
+}
+
+void PipeBuffer::CloseReadEnd() {
+  {
+    absl::MutexLock lock(&mu_);
+    read_end_open_ = false;
+    storage_.clear();
+    storage_.shrink_to_fit();
+    head_ = 0;
+    size_ = 0;
+  }
+  ReadinessNotifier::GetInstance().Notify(this);
+}
+
+void PipeBuffer::CloseWriteEnd() {
+  {
+    absl::MutexLock lock(&mu_);
+    write_end_open_ = false;
+  }
+  ReadinessNotifier::GetInstance().Notify(this);
+}
+
+int PipeBuffer::ReadyEvents(bool read_end, short events) {
+  absl::MutexLock lock(&mu_);
+  int ready = 0;
+  if (read_end) {
+    if ((events & POLLIN) && size_ > 0) {
+      ready |= POLLIN;
+    }
+    if (!write_end_open_) {
+      ready |= POLLHUP;
+    }
+  } else {
+    if ((events & POLLOUT) && read_end_open_ &&
+        capacity_ - size_ >= PIPE_BUF) {
+      ready |= POLLOUT;
+    }
+    if (!read_end_open_) {
+      ready |= POLLERR;
+    }
+  }
+  return ready;
+}
+
+uint64_t PipeBuffer::EventCount(bool read_end) {
+  absl::MutexLock lock(&mu_);
+  // Closing the opposite end is an event as well; fold it into the count so
+  // edge-triggered waiters observe the hang-up.
+  return read_end ? bytes_written_ + (write_end_open_ ? 0 : 1)
+                  : bytes_read_ + (read_end_open_ ? 0 : 1);
+}
+
+int PipeBuffer::GetCapacity() {
+  absl::MutexLock lock(&mu_);
+  return capacity_;
+}
+
+int PipeBuffer::SetCapacity(int64_t capacity) {
+  if (capacity < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (capacity > kMaxCapacity) {
+    errno = EPERM;
+    return -1;
+  }
+  // Linux rounds the capacity up to a whole number of pages.
+  size_t rounded =
+      std::max(kPageSize, (static_cast<size_t>(capacity) + kPageSize - 1) /
+                              kPageSize * kPageSize);
+  {
+    absl::MutexLock lock(&mu_);
+    if (rounded < size_) {
+      errno = EBUSY;
+      return -1;
+    }
+    capacity_ = rounded;
+  }
+  ReadinessNotifier::GetInstance().Notify(this);
+  return rounded;
+}
+
+size_t PipeBuffer::Size() {
+  absl::MutexLock lock(&mu_);
+  return size_;
+}
+
+void PipeBuffer::Reserve(size_t size) {
+  if (size <= storage_.size()) {
+    return;
+  }
+  size_t new_size = std::max(storage_.size(), kPageSize);
+  while (new_size < size) {
+    new_size *= 2;
+  }
+  new_size = std::min(new_size, std::max(capacity_, size));
+  std::vector<uint8_t> new_storage(new_size);
+  size_t used = size_;
+  CopyOut(new_storage.data(), used);
+  storage_.swap(new_storage);
+  head_ = 0;
+  size_ = used;
+}
+
+void PipeBuffer::CopyIn(const uint8_t *buf, size_t count) {
+  Reserve(size_ + count);
+  size_t tail = (head_ + size_) % storage_.size();
+  size_t right_count = std::min(count, storage_.size() - tail);
+  memcpy(storage_.data() + tail, buf, right_count);
+  memcpy(storage_.data(), buf + right_count, count - right_count);
+  size_ += count;
+}
+
+void PipeBuffer::CopyOut(uint8_t *buf, size_t count) {
+  if (count == 0) {
+    return;
+  }
+  size_t right_count = std::min(count, storage_.size() - head_);
+  memcpy(buf, storage_.data() + head_, right_count);
+  memcpy(buf + right_count, storage_.data(), count - right_count);
+  head_ = (head_ + count) % storage_.size();
+  size_ -= count;
+}
+
+int IOContextPipe::GetReadyEvents(short events) {
+  return buffer_->ReadyEvents(read_end_, events);
+}
+
+uint64_t IOContextPipe::EventCount() { return buffer_->EventCount(read_end_); }
+
+const void *IOContextPipe::ReadinessKey() { return buffer_.get(); }
+
+ssize_t IOContextPipe::Read(void *buf, size_t count) {
+  if (!read_end_) {
+    errno = EBADF;
+    return -1;
+  }
+  return buffer_->Read(buf, count, nonblock_);
+}
+
+ssize_t IOContextPipe::Write(const void *buf, size_t count) {
+  if (read_end_) {
+    errno = EBADF;
+    return -1;
+  }
+  return buffer_->Write(buf, count, nonblock_);
+}
+
+ssize_t IOContextPipe::Readv(const struct iovec *iov, int iovcnt) {
+  size_t total = 0;
+  for (int i = 0; i < iovcnt; ++i) {
+    total += iov[i].iov_len;
+  }
+  std::vector<uint8_t> data(total);
+  ssize_t result = Read(data.data(), data.size());
+  if (result <= 0) {
+    return result;
+  }
+  size_t offset = 0;
+  for (int i = 0; i < iovcnt && offset < result; ++i) {
+    size_t chunk = std::min(iov[i].iov_len, result - offset);
+    memcpy(iov[i].iov_base, data.data() + offset, chunk);
+    offset += chunk;
+  }
+  return result;
+}
+
+ssize_t IOContextPipe::Writev(const struct iovec *iov, int iovcnt) {
+  // Gather the vector so that small writes keep their atomicity guarantee.
+  std::vector<uint8_t> data;
+  for (int i = 0; i < iovcnt; ++i) {
+    const uint8_t *base = static_cast<const uint8_t *>(iov[i].iov_base);
+    data.insert(data.end(), base, base + iov[i].iov_len);
+  }
+  return Write(data.data(), data.size());
+}
+
+int IOContextPipe::Close() {
+  if (read_end_) {
+    buffer_->CloseReadEnd();
+  } else {
+    buffer_->CloseWriteEnd();
+  }
+  return 0;
+}
+
+int IOContextPipe::FCntl(int cmd, int64_t arg) {
+  switch (cmd) {
+    case F_GETFD:
+      return cloexec_ ? FD_CLOEXEC : 0;
+    case F_SETFD:
+      cloexec_ = arg & FD_CLOEXEC;
+      return 0;
+    case F_GETFL:
+      return (read_end_ ? O_RDONLY : O_WRONLY) | (nonblock_ ? O_NONBLOCK : 0);
+    case F_SETFL:
+      nonblock_ = arg & O_NONBLOCK;
+      return 0;
+    case F_GETPIPE_SZ:
+      return buffer_->GetCapacity();
+    case F_SETPIPE_SZ:
+      return buffer_->SetCapacity(arg);
+    default:
+      errno = EINVAL;
+      return -1;
+  }
+}
+
+int IOContextPipe::FStat(struct stat *stat_buffer) {
+  memset(stat_buffer, 0, sizeof(*stat_buffer));
+  stat_buffer->st_mode = S_IFIFO | S_IRUSR | S_IWUSR;
+  stat_buffer->st_nlink = 1;
+  stat_buffer->st_blksize = kPageSize;
+  return 0;
+}
+
+int IOContextPipe::Ioctl(int request, void *argp) {
+  if (request == FIONREAD && read_end_) {
+    *static_cast<int *>(argp) = buffer_->Size();
+    return 0;
+  }
+  errno = ENOTTY;
+  return -1;
+}
+
+}  // namespace io
+}  // namespace asylo
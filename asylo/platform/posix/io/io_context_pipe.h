@@ -0,0 +1,135 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_POSIX_IO_IO_CONTEXT_PIPE_H_
+#define ASYLO_PLATFORM_POSIX_IO_IO_CONTEXT_PIPE_H_
+
+#include <fcntl.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "asylo/platform/posix/io/io_manager.h"
+
+namespace asylo {
+namespace io {
+
+// The byte queue shared by the two ends of a pipe that lives entirely inside
+// the enclave. Storage is allocated lazily and grows up to the pipe capacity,
+// so idle pipes cost only a few bytes of enclave memory. Readiness changes of
+// either end are notified under the address of the buffer.
+class PipeBuffer {
+ public:
+  // The default capacity of a pipe, matching Linux.
+  static constexpr size_t kDefaultCapacity = 16 * 4096;
+
+  // The largest capacity which can be requested with F_SETPIPE_SZ, matching the
+  // Linux default for /proc/sys/fs/pipe-max-size.
+  static constexpr size_t kMaxCapacity = 1024 * 1024;
+
+  PipeBuffer() : capacity_(kDefaultCapacity) {}
+
+  // Reads up to |count| bytes into |buf|. Blocks while the pipe is empty and
+  // the write end is open unless |nonblock| is set.
+  ssize_t Read(void *buf, size_t count, bool nonblock) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Writes |count| bytes from |buf|. Writes of at most PIPE_BUF bytes are
+  // atomic. Blocks while the pipe is full unless |nonblock| is set.
+  ssize_t Write(const void *buf, size_t count, bool nonblock)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Marks one end of the pipe as closed.
+  void CloseReadEnd() ABSL_LOCKS_EXCLUDED(mu_);
+  void CloseWriteEnd() ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns the poll(2) events from |events| that are ready on the given end,
+  // together with POLLHUP or POLLERR when the other end has been closed.
+  int ReadyEvents(bool read_end, short events) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns a counter that increases whenever new events become available on
+  // the given end: new data for the read end, new space for the write end.
+  uint64_t EventCount(bool read_end) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Implements F_GETPIPE_SZ and F_SETPIPE_SZ.
+  int GetCapacity() ABSL_LOCKS_EXCLUDED(mu_);
+  int SetCapacity(int64_t capacity) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns the number of bytes available for reading.
+  size_t Size() ABSL_LOCKS_EXCLUDED(mu_);
+
+ private:
+  // Grows |storage_| so that it can hold at least |size| bytes.
+  void Reserve(size_t size) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Copies |count| bytes in or out of the circular buffer.
+  void CopyIn(const uint8_t *buf, size_t count)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  void CopyOut(uint8_t *buf, size_t count) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  absl::Mutex mu_;
+  std::vector<uint8_t> storage_ ABSL_GUARDED_BY(mu_);
+  size_t head_ ABSL_GUARDED_BY(mu_) = 0;
+  size_t size_ ABSL_GUARDED_BY(mu_) = 0;
+  size_t capacity_ ABSL_GUARDED_BY(mu_);
+  bool read_end_open_ ABSL_GUARDED_BY(mu_) = true;
+  bool write_end_open_ ABSL_GUARDED_BY(mu_) = true;
+  uint64_t bytes_written_ ABSL_GUARDED_BY(mu_) = 0;
+  uint64_t bytes_read_ ABSL_GUARDED_BY(mu_) = 0;
+};
+
+// IOContext implementation for one end of a pipe whose both ends stay inside
+// the enclave. Reads, writes and readiness checks never leave the enclave.
+class IOContextPipe : public IOManager::IOContext {
+ public:
+  IOContextPipe(std::shared_ptr<PipeBuffer> buffer, bool read_end, int flags)
+      : buffer_(std::move(buffer)),
+        read_end_(read_end),
+        nonblock_(flags & O_NONBLOCK),
+        cloexec_(flags & O_CLOEXEC) {}
+
+  int GetReadyEvents(short events) override;
+  uint64_t EventCount() override;
+  const void *ReadinessKey() override;
+
+ protected:
+  ssize_t Read(void *buf, size_t count) override;
+  ssize_t Write(const void *buf, size_t count) override;
+  ssize_t Readv(const struct iovec *iov, int iovcnt) override;
+  ssize_t Writev(const struct iovec *iov, int iovcnt) override;
+  int Close() override;
+  int FCntl(int cmd, int64_t arg) override;
+  int FStat(struct stat *stat_buffer) override;
+  int Ioctl(int request, void *argp) override;
+
+ private:
+  std::shared_ptr<PipeBuffer> buffer_;
+  const bool read_end_;
+  std::atomic<bool> nonblock_;
+  std::atomic<bool> cloexec_;
+};
+
+}  // namespace io
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_POSIX_IO_IO_CONTEXT_PIPE_H_
@@ -20,20 +20,29 @@
 
 #include <fcntl.h>
 #include <poll.h>
+#include <sys/mman.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <cstdint>
+#include <limits>
 #include <memory>
-#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "absl/algorithm/container.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "asylo/platform/core/trusted_global_state.h"
 #include "asylo/platform/host_call/trusted/host_calls.h"
 #include "asylo/platform/posix/io/io_context_epoll.h"
 #include "asylo/platform/posix/io/io_context_eventfd.h"
 #include "asylo/platform/posix/io/io_context_inotify.h"
+#include "asylo/platform/posix/io/io_context_pipe.h"
 #include "asylo/platform/posix/io/native_paths.h"
+#include "asylo/platform/posix/io/page_cache.h"
+#include "asylo/platform/posix/io/readiness_notifier.h"
 #include "asylo/platform/posix/io/util.h"
 #include "asylo/util/posix_error_space.h"
 #include "asylo/util/statusor.h"
@@ -268,87 +277,118 @@ int IOManager::Dup2(int oldfd, int newfd) {
   return -1;
 }
 
+namespace {
+
+// Returns whether the enclave is configured to allow fork(). A forked child
+// is restored from a snapshot of enclave memory, so a stream implemented
+// inside the enclave would no longer be shared between parent and child.
+bool ForkEnabled() {
+  StatusOr<const EnclaveConfig *> config = GetEnclaveConfig();
+  return config.ok() && config.ValueOrDie()->enable_fork();
+}
+
+}  // namespace
+
 int IOManager::Pipe(int pipefd[2], int flags) {
-  int res = enc_untrusted_pipe2(pipefd, flags);
-  if (res != -1) {
-    pipefd[0] = RegisterHostFileDescriptor(pipefd[0]);
-    pipefd[1] = RegisterHostFileDescriptor(pipefd[1]);
-    if (pipefd[0] < 0 || pipefd[1] < 0) {
-      errno = EMFILE;
-      return -1;
+  if (flags & ~(O_CLOEXEC | O_DIRECT | O_NONBLOCK)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  // Packet-mode pipes are delegated to the host, as are all pipes of an
+  // enclave that may fork, so that a parent and its child can still
+  // communicate through them.
+  if ((flags & O_DIRECT) || ForkEnabled()) {
+    int res = enc_untrusted_pipe2(pipefd, flags);
+    if (res != -1) {
+      pipefd[0] = RegisterHostFileDescriptor(pipefd[0]);
+      pipefd[1] = RegisterHostFileDescriptor(pipefd[1]);
+      if (pipefd[0] < 0 || pipefd[1] < 0) {
+        errno = EMFILE;
+        return -1;
+      }
     }
+    return res;
   }
-  return res;
+
+  // Both ends of the pipe are created inside the enclave, so transferring data
+  // through it does not require any host calls.
+  auto buffer = std::make_shared<PipeBuffer>();
+  auto read_context =
+      ::absl::make_unique<IOContextPipe>(buffer, /*read_end=*/true, flags);
+  auto write_context =
+      ::absl::make_unique<IOContextPipe>(buffer, /*read_end=*/false, flags);
+  absl::WriterMutexLock lock(&fd_table_lock_);
+  int read_fd = fd_table_.Insert(read_context.get());
+  if (read_fd < 0) {
+    errno = EMFILE;
+    return -1;
+  }
+  read_context.release();
+  int write_fd = fd_table_.Insert(write_context.get());
+  if (write_fd < 0) {
+    fd_table_.Delete(read_fd);
+    errno = EMFILE;
+    return -1;
+  }
+  write_context.release();
+  pipefd[0] = read_fd;
+  pipefd[1] = write_fd;
+  return 0;
 }
 
 int IOManager::Select(int nfds, fd_set *readfds, fd_set *writefds,
                       fd_set *exceptfds, struct timeval *timeout) {
-  if (nfds < 0) {
+  if (nfds < 0 || nfds > FD_SETSIZE) {
     errno = EINVAL;
     return -1;
   }
 
-  // Translate the fd_sets into host file descriptors.
-  fd_set host_readfds, host_writefds, host_exceptfds;
-  FD_ZERO(&host_readfds);
-  FD_ZERO(&host_writefds);
-  FD_ZERO(&host_exceptfds);
-
-  int host_nfds = 0;
+  // Translate the fd_sets into a pollfd array so that enclave-internal streams
+  // and host file descriptors are waited on together by Poll.
+  std::vector<struct pollfd> fds;
   for (int fd = 0; fd < nfds; ++fd) {
+    short events = 0;
     if (readfds && FD_ISSET(fd, readfds)) {
-      std::shared_ptr<IOContext> context = fd_table_.Get(fd);
-      if (context) {
-        int host_fd = context->GetHostFileDescriptor();
-        FD_SET(host_fd, &host_readfds);
-        host_nfds = std::max(host_nfds, host_fd + 1);
-      }
+      events |= POLLIN;
     }
     if (writefds && FD_ISSET(fd, writefds)) {
-      std::shared_ptr<IOContext> context = fd_table_.Get(fd);
-      if (context) {
-        int host_fd = context->GetHostFileDescriptor();
-        FD_SET(host_fd, &host_writefds);
-        host_nfds = std::max(host_nfds, host_fd + 1);
-      }
+      events |= POLLOUT;
     }
     if (exceptfds && FD_ISSET(fd, exceptfds)) {
-      std::shared_ptr<IOContext> context = fd_table_.Get(fd);
-      if (context) {
-        int host_fd = context->GetHostFileDescriptor();
-        FD_SET(host_fd, &host_exceptfds);
-        host_nfds = std::max(host_nfds, host_fd + 1);
-      }
+      events |= POLLPRI;
+    }
+    if (events) {
+      fds.push_back({fd, events, 0});
     }
   }
-  int ret = enc_untrusted_select(host_nfds, &host_readfds, &host_writefds,
-                                 &host_exceptfds, timeout);
 
-  // On error, errno should have been set by the host.
-  if (ret < 0) {
-    return ret;
+  int poll_timeout = -1;
+  absl::Time deadline = absl::InfiniteFuture();
+  if (timeout) {
+    if (timeout->tv_sec < 0 || timeout->tv_usec < 0) {
+      errno = EINVAL;
+      return -1;
+    }
+    // Round up to whole milliseconds and clamp, rather than overflow, very
+    // long timeouts.
+    absl::Duration duration = absl::DurationFromTimeval(*timeout);
+    deadline = absl::Now() + duration;
+    poll_timeout = static_cast<int>(std::min<int64_t>(
+        absl::ToInt64Milliseconds(absl::Ceil(duration, absl::Milliseconds(1))),
+        std::numeric_limits<int>::max()));
   }
+  int ret = Poll(fds.data(), fds.size(), poll_timeout);
 
-  // Add the returned fd_sets into an unordered set. IOManager is used in
-  // trusted contexts where system calls might not be available; avoid using
-  // absl based containers which may perform system calls.
-  std::unordered_set<int> host_readfds_set, host_writefds_set,
-      host_exceptfds_set;
-  for (int fd = 0; fd < nfds; ++fd) {
-    std::shared_ptr<IOContext> context = fd_table_.Get(fd);
-    if (context) {
-      int host_fd = context->GetHostFileDescriptor();
-      if (host_fd < 0) continue;
-      if (FD_ISSET(host_fd, &host_readfds)) {
-        host_readfds_set.insert(host_fd);
-      }
-      if (FD_ISSET(host_fd, &host_writefds)) {
-        host_writefds_set.insert(host_fd);
-      }
-      if (FD_ISSET(host_fd, &host_exceptfds)) {
-        host_exceptfds_set.insert(host_fd);
-      }
-    }
+  // Like Linux, report the time that was not slept.
+  if (timeout) {
+    *timeout = absl::ToTimeval(
+        std::max(deadline - absl::Now(), absl::ZeroDuration()));
+  }
+
+  // On error, errno should have been set by Poll.
+  if (ret < 0) {
+    return ret;
   }
 
   if (readfds) {
@@ -360,48 +400,137 @@ int IOManager::Select(int nfds, fd_set *readfds, fd_set *writefds,
   if (exceptfds) {
     FD_ZERO(exceptfds);
   }
-  // Go through the file descriptor table, if any host file descriptor is
-  // included in any of the sets, add the corresponding enclave fd to the
-  // enclave fd_set.
-  for (int fd = 0; fd < nfds; ++fd) {
-    std::shared_ptr<IOContext> context = fd_table_.Get(fd);
-    if (context) {
-      int host_fd = context->GetHostFileDescriptor();
-      if (readfds && host_readfds_set.find(host_fd) != host_readfds_set.end()) {
-        FD_SET(fd, readfds);
-      }
-      if (writefds &&
-          host_writefds_set.find(host_fd) != host_writefds_set.end()) {
-        FD_SET(fd, writefds);
-      }
-      if (exceptfds &&
-          host_exceptfds_set.find(host_fd) != host_exceptfds_set.end()) {
-        FD_SET(fd, exceptfds);
-      }
+  int count = 0;
+  for (const struct pollfd &entry : fds) {
+    if ((entry.events & POLLIN) &&
+        (entry.revents & (POLLIN | POLLHUP | POLLERR))) {
+      FD_SET(entry.fd, readfds);
+      ++count;
+    }
+    if ((entry.events & POLLOUT) && (entry.revents & (POLLOUT | POLLERR))) {
+      FD_SET(entry.fd, writefds);
+      ++count;
+    }
+    if ((entry.events & POLLPRI) && (entry.revents & POLLPRI)) {
+      FD_SET(entry.fd, exceptfds);
+      ++count;
     }
   }
-  return ret;
+  return count;
 }
 
 int IOManager::Poll(struct pollfd *fds, nfds_t nfds, int timeout) {
-  std::vector<int> enclave_fd(nfds);
+  std::vector<std::shared_ptr<IOContext>> contexts(nfds);
   {
     absl::ReaderMutexLock lock(&fd_table_lock_);
     for (int i = 0; i < nfds; ++i) {
-      enclave_fd[i] = fds[i].fd;
-      std::shared_ptr<IOContext> context = fd_table_.Get(enclave_fd[i]);
-      if (context) {
-        fds[i].fd = context->GetHostFileDescriptor();
+      contexts[i] = fd_table_.Get(fds[i].fd);
+    }
+  }
+
+  // Split the request into streams implemented inside the enclave, whose
+  // readiness is checked directly, and host file descriptors.
+  std::vector<nfds_t> trusted_index;
+  std::vector<nfds_t> host_index;
+  std::vector<struct pollfd> host_fds;
+  for (nfds_t i = 0; i < nfds; ++i) {
+    fds[i].revents = 0;
+    if (contexts[i] && contexts[i]->GetReadyEvents(0) >= 0) {
+      trusted_index.push_back(i);
+    } else {
+      host_index.push_back(i);
+      host_fds.push_back(
+          {contexts[i] ? contexts[i]->GetHostFileDescriptor() : -1,
+           fds[i].events, 0});
+    }
+  }
+
+  if (trusted_index.empty()) {
+    int ret = enc_untrusted_poll(host_fds.data(), host_fds.size(), timeout);
+    for (size_t i = 0; i < host_index.size(); ++i) {
+      fds[host_index[i]].revents = host_fds[i].revents;
+    }
+    return ret;
+  }
+
+  // The waiter is registered before the streams are first evaluated, so that
+  // no change made after an evaluation is missed.
+  std::vector<const void *> keys;
+  for (nfds_t i : trusted_index) {
+    keys.push_back(contexts[i]->ReadinessKey());
+  }
+  ReadinessNotifier::Waiter waiter(std::move(keys));
+  absl::Time deadline = timeout < 0 ? absl::InfiniteFuture()
+                                    : absl::Now() + absl::Milliseconds(timeout);
+  while (true) {
+    int ready = 0;
+    for (nfds_t i : trusted_index) {
+      fds[i].revents = contexts[i]->GetReadyEvents(fds[i].events);
+      if (fds[i].revents) {
+        ++ready;
+      }
+    }
+    bool expired = timeout == 0 || (timeout > 0 && absl::Now() >= deadline);
+
+    if (host_fds.empty()) {
+      if (ready > 0 || expired) {
+        return ready;
+      }
+      waiter.Wait(deadline);
+      continue;
+    }
+
+    // Block on the host only if nothing is ready yet, including the waiter's
+    // host wake pipe in the wait set so that trusted streams can interrupt the
+    // wait.
+    int host_timeout = 0;
+    int wake_fd = -1;
+    if (ready == 0 && !expired) {
+      host_timeout =
+          timeout < 0
+              ? -1
+              : std::max<int64_t>(
+                    1, absl::ToInt64Milliseconds(deadline - absl::Now()));
+      wake_fd = waiter.BeginHostWait();
+      if (wake_fd >= 0 && waiter.Notified()) {
+        waiter.EndHostWait();
+        continue;
+      }
+      if (wake_fd >= 0) {
+        host_fds.push_back({wake_fd, POLLIN, 0});
       } else {
-        fds[i].fd = -1;
+        // Without a wake pipe, bound the host wait so that trusted streams are
+        // still rechecked periodically.
+        host_timeout = host_timeout < 0
+                           ? ReadinessNotifier::kFallbackHostWaitMs
+                           : std::min(host_timeout,
+                                      ReadinessNotifier::kFallbackHostWaitMs);
       }
     }
+    int ret =
+        enc_untrusted_poll(host_fds.data(), host_fds.size(), host_timeout);
+    if (wake_fd >= 0) {
+      bool woken = host_fds.back().revents & POLLIN;
+      host_fds.pop_back();
+      waiter.EndHostWait();
+      if (woken && ret > 0) {
+        --ret;
+      }
+    }
+    if (ret < 0) {
+      return ret;
+    }
+    for (size_t i = 0; i < host_index.size(); ++i) {
+      fds[host_index[i]].revents = host_fds[i].revents;
+    }
+    ready += ret;
+    if (ready > 0 || host_timeout == 0) {
+      return ready;
+    }
+    if (timeout > 0 && absl::Now() >= deadline) {
+      return 0;
+    }
   }
-  int ret = enc_untrusted_poll(fds, nfds, timeout);
-  for (int i = 0; i < nfds; ++i) {
-    fds[i].fd = enclave_fd[i];
-  }
-  return ret;
 }
 
 int IOManager::EpollCreate(int size) {
@@ -430,6 +559,12 @@ int IOManager::EpollCtl(int epfd, int op, int fd, struct epoll_event *event) {
     absl::ReaderMutexLock lock(&fd_table_lock_);
     context = fd_table_.Get(fd);
   }
+  if (context && context->GetReadyEvents(0) >= 0) {
+    return CallWithContext(epfd, [op, fd, context, event](
+                                     std::shared_ptr<IOContext> epoll_context) {
+      return epoll_context->EpollCtlTrusted(op, fd, context, event);
+    });
+  }
   int hostfd = context ? context->GetHostFileDescriptor() : -1;
   if (hostfd == -1) {
     errno = EBADF;
@@ -511,6 +646,12 @@ struct ErrorValue<Type,
   static constexpr Type value = nullptr;
 };
 
+// Actions returning shared pointers indicate error with an empty pointer.
+template <typename Type>
+struct ErrorValue<std::shared_ptr<Type>> {
+  static constexpr std::nullptr_t value = nullptr;
+};
+
 }  // namespace
 
 template <typename IOAction, typename ReturnType>
@@ -1058,6 +1199,67 @@ ssize_t IOManager::RecvFrom(int sockfd, void *buf, size_t len, int flags,
   });
 }
 
+int IOManager::GetDents64(int fd, void *buf, size_t count) {
+  return CallWithContext(fd, [buf, count](std::shared_ptr<IOContext> context) {
+    return context->GetDents64(buf, count);
+  });
+}
+
+void *IOManager::Mmap(void *addr, size_t length, int prot, int flags, int fd,
+                     off_t offset) {
+  int sharing = flags & (MAP_SHARED | MAP_PRIVATE);
+  if (length == 0 || offset < 0 || offset % PageCache::kPageSize != 0 ||
+      (sharing != MAP_SHARED && sharing != MAP_PRIVATE)) {
+    errno = EINVAL;
+    return MAP_FAILED;
+  }
+  // The mapping lives in untrusted memory, so it is never writable or
+  // executable by the enclave, and it cannot be placed at a given address. A
+  // non-fixed |addr| is only a hint and is ignored.
+  if ((prot & ~PROT_READ) || (flags & MAP_FIXED)) {
+    errno = ENOSYS;
+    return MAP_FAILED;
+  }
+
+  int host_flags = flags & (MAP_SHARED | MAP_PRIVATE | MAP_NORESERVE |
+                            MAP_POPULATE);
+  std::shared_ptr<HostFileMapping> mapping = CallWithContext(
+      fd, [length, host_flags, offset](std::shared_ptr<IOContext> context) {
+        return context->Mmap(length, host_flags, offset);
+      });
+  if (!mapping) {
+    return MAP_FAILED;
+  }
+
+  absl::MutexLock lock(&mappings_lock_);
+  file_mappings_[mapping->data()] = mapping;
+  return mapping->data();
+}
+
+int IOManager::Munmap(void *addr, size_t length) {
+  std::shared_ptr<HostFileMapping> mapping;
+  {
+    absl::MutexLock lock(&mappings_lock_);
+    auto it = file_mappings_.find(addr);
+    if (it == file_mappings_.end() || length == 0 ||
+        (length + PageCache::kPageSize - 1) / PageCache::kPageSize !=
+            (it->second->length() + PageCache::kPageSize - 1) /
+                PageCache::kPageSize) {
+      errno = EINVAL;
+      return -1;
+    }
+    mapping = std::move(it->second);
+    file_mappings_.erase(it);
+  }
+  // The host mapping is removed once the last reader releases it.
+  return 0;
+}
+
+bool IOManager::IsFileMapping(const void *addr) {
+  absl::MutexLock lock(&mappings_lock_);
+  return file_mappings_.find(addr) != file_mappings_.end();
+}
+
 int IOManager::RegisterHostFileDescriptor(int host_fd) {
   absl::WriterMutexLock lock(&fd_table_lock_);
   auto context = ::absl::make_unique<IOContextNative>(host_fd);
@@ -38,11 +38,13 @@
 #include <memory>
 #include <queue>
 #include <type_traits>
+#include <unordered_map>
 
 #include "absl/base/thread_annotations.h"
 #include "absl/memory/memory.h"
 #include "absl/strings/string_view.h"
 #include "absl/synchronization/mutex.h"
+#include "asylo/platform/posix/io/host_file_mapping.h"
 #include "asylo/platform/storage/secure/enclave_storage_secure.h"
 #include "asylo/util/statusor.h"
 
@@ -65,6 +67,23 @@ class IOManager {
    public:
     virtual ~IOContext() = default;
 
+    // Returns the subset of the poll(2) |events| which are currently ready on
+    // this stream, together with any applicable POLLERR or POLLHUP. Streams
+    // implemented entirely inside the enclave override this so that they can
+    // be waited on without leaving the enclave. The default of -1 indicates
+    // that readiness must instead be queried on the host through
+    // GetHostFileDescriptor().
+    virtual int GetReadyEvents(short events) { return -1; }
+
+    // Returns a counter which increases every time new events are signaled on
+    // a stream implemented inside the enclave. Used to implement EPOLLET.
+    virtual uint64_t EventCount() { return 0; }
+
+    // Returns the key under which readiness changes of this stream are passed
+    // to ReadinessNotifier. Streams which share state, such as the two ends of
+    // a pipe, return the same key.
+    virtual const void *ReadinessKey() { return this; }
+
    protected:
     // Implements IOManager::Read.
     virtual ssize_t Read(void *buf, size_t count) = 0;
@@ -239,6 +258,15 @@ class IOManager {
       return -1;
     }
 
+    // Implements epoll_ctl for a file descriptor |fd| whose stream, |context|,
+    // is implemented inside the enclave.
+    virtual int EpollCtlTrusted(int op, int fd,
+                                std::shared_ptr<IOContext> context,
+                                struct epoll_event *event) {
+      errno = EINVAL;
+      return -1;
+    }
+
     // Implements epoll_wait.
     virtual int EpollWait(struct epoll_event *events, int maxevents,
                           int timeout) {
@@ -268,6 +296,21 @@ class IOManager {
 
     virtual int GetHostFileDescriptor() { return -1; }
 
+    // Implements getdents64. Entries are written in the Linux linux_dirent64
+    // format, as returned by the host; they are not validated.
+    virtual int GetDents64(void *buf, size_t count) {
+      errno = ENOTDIR;
+      return -1;
+    }
+
+    // Maps |length| bytes of the stream at |offset| read-only into untrusted
+    // memory for mmap(). |flags| are the mmap() flags to use on the host.
+    virtual std::shared_ptr<HostFileMapping> Mmap(size_t length, int flags,
+                                                  off_t offset) {
+      errno = ENODEV;
+      return nullptr;
+    }
+
    private:
     friend class IOManager;
   };
@@ -702,6 +745,24 @@ class IOManager {
   // Implements recvfrom(2).
   ssize_t RecvFrom(int sockfd, void *buf, size_t len, int flags,
                    struct sockaddr *src_addr, socklen_t *addrlen);
+
+  // Implements getdents64(2). The entries are untrusted and must be validated
+  // by the caller.
+  int GetDents64(int fd, void *buf, size_t count);
+
+  // Implements mmap(2) for file-backed mappings. Only read-only mappings of
+  // files forwarded to the host are supported; the returned memory lies
+  // outside the enclave. Anonymous mappings are handled by the caller.
+  void *Mmap(void *addr, size_t length, int prot, int flags, int fd,
+             off_t offset) ABSL_LOCKS_EXCLUDED(mappings_lock_);
+
+  // Implements munmap(2) for mappings created by Mmap(). Only whole mappings
+  // can be unmapped.
+  int Munmap(void *addr, size_t length) ABSL_LOCKS_EXCLUDED(mappings_lock_);
+
+  // Returns true if |addr| is the start of a mapping created by Mmap().
+  bool IsFileMapping(const void *addr) ABSL_LOCKS_EXCLUDED(mappings_lock_);
+
   // Binds an enclave file descriptor to a host file descriptor, returning an
   // enclave file descriptor which will delegate all I/O operations to the host
   // operating system.
@@ -776,6 +837,13 @@ class IOManager {
   // A mutex that locks the fd_table_.
   absl::Mutex fd_table_lock_;
 
+  // Live file-backed mappings, keyed by their address. Mappings outlive the
+  // file descriptors they were created from.
+  std::unordered_map<const void *, std::shared_ptr<HostFileMapping>>
+      file_mappings_ ABSL_GUARDED_BY(mappings_lock_);
+
+  absl::Mutex mappings_lock_;
+
   std::string current_working_directory_;
 };
 
@@ -24,6 +24,7 @@
 
 #include <fcntl.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -80,4 +81,22 @@ int enclave_stat(const char *file, struct stat *st) {
   return IOManager::GetInstance().Stat(file, st);
 }
 
+// These definitions fill in the weak file mapping hooks of mmap() and munmap()
+// in the backend agnostic runtime, which handles anonymous mappings itself.
+// They live in this always linked library because a weak reference does not
+// pull a definition out of an archive.
+
+void *enc_mmap_file(void *addr, size_t length, int prot, int flags, int fd,
+                    off_t offset) {
+  return IOManager::GetInstance().Mmap(addr, length, prot, flags, fd, offset);
+}
+
+int enc_munmap_file(void *addr, size_t length) {
+  IOManager &io_manager = IOManager::GetInstance();
+  if (!io_manager.IsFileMapping(addr)) {
+    return 1;
+  }
+  return io_manager.Munmap(addr, length);
+}
+
 }  // extern "C"
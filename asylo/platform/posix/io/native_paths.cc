@@ -19,7 +19,9 @@
 #include "asylo/platform/posix/io/native_paths.h"
 
 #include <fcntl.h>
+#include <sys/stat.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <cstring>
 
@@ -28,6 +30,30 @@
 
 namespace asylo {
 namespace io {
+namespace {
+
+// Reports a modification of a host file by the enclave to the mappings of the
+// file, if there are any, so that they stop serving reads.
+void ReportFileChanged(int host_fd) {
+  if (!HostFileMapping::AnyExist()) {
+    return;
+  }
+  struct stat stat_buffer;
+  HostFileMapping::FileChanged(
+      enc_untrusted_fstat(host_fd, &stat_buffer) == 0 ? &stat_buffer
+                                                      : nullptr);
+}
+
+void ReportFileChanged(const char *path) {
+  if (!HostFileMapping::AnyExist()) {
+    return;
+  }
+  struct stat stat_buffer;
+  HostFileMapping::FileChanged(
+      enc_untrusted_stat(path, &stat_buffer) == 0 ? &stat_buffer : nullptr);
+}
+
+}  // namespace
 
 int IOContextNative::Close() { return enc_untrusted_close(host_fd_); }
 
@@ -36,7 +62,11 @@ ssize_t IOContextNative::Read(void *buf, size_t count) {
 }
 
 ssize_t IOContextNative::Write(const void *buf, size_t count) {
-  return enc_untrusted_write(host_fd_, buf, count);
+  ssize_t result = enc_untrusted_write(host_fd_, buf, count);
+  if (result > 0) {
+    ReportFileChanged(host_fd_);
+  }
+  return result;
 }
 
 int IOContextNative::FChOwn(uid_t owner, gid_t group) {
@@ -62,7 +92,11 @@ int IOContextNative::FStatFs(struct statfs *statfs_buffer) {
 }
 
 int IOContextNative::FTruncate(off_t length) {
-  return enc_untrusted_ftruncate(host_fd_, length);
+  int result = enc_untrusted_ftruncate(host_fd_, length);
+  if (result == 0) {
+    ReportFileChanged(host_fd_);
+  }
+  return result;
 }
 
 int IOContextNative::FChMod(mode_t mode) {
@@ -106,7 +140,7 @@ ssize_t IOContextNative::Writev(const struct iovec *iov, int iovcnt) {
     copied_bytes += iov[i].iov_len;
   }
 
-  return enc_untrusted_write(host_fd_, trusted_buf.get(), total_size);
+  return Write(trusted_buf.get(), total_size);
 }
 
 ssize_t IOContextNative::Readv(const struct iovec *iov, int iovcnt) {
@@ -128,9 +162,44 @@ ssize_t IOContextNative::Readv(const struct iovec *iov, int iovcnt) {
 }
 
 ssize_t IOContextNative::PRead(void *buf, size_t count, off_t offset) {
+  std::vector<std::shared_ptr<HostFileMapping>> mappings;
+  {
+    absl::MutexLock lock(&mappings_mu_);
+    for (const auto &weak_mapping : mappings_) {
+      if (auto mapping = weak_mapping.lock()) {
+        mappings.push_back(std::move(mapping));
+      }
+    }
+  }
+  for (const auto &mapping : mappings) {
+    if (mapping->PRead(buf, count, offset)) {
+      return count;
+    }
+  }
   return enc_untrusted_pread64(host_fd_, buf, count, offset);
 }
 
+int IOContextNative::GetDents64(void *buf, size_t count) {
+  return enc_untrusted_getdents64(host_fd_, buf, count);
+}
+
+std::shared_ptr<HostFileMapping> IOContextNative::Mmap(size_t length, int flags,
+                                                       off_t offset) {
+  std::shared_ptr<HostFileMapping> mapping =
+      HostFileMapping::Create(host_fd_, length, flags, offset);
+  if (mapping) {
+    absl::MutexLock lock(&mappings_mu_);
+    mappings_.erase(
+        std::remove_if(mappings_.begin(), mappings_.end(),
+                       [](const std::weak_ptr<HostFileMapping> &weak_mapping) {
+                         return weak_mapping.expired();
+                       }),
+        mappings_.end());
+    mappings_.push_back(mapping);
+  }
+  return mapping;
+}
+
 int IOContextNative::SetSockOpt(int level, int option_name,
                                 const void *option_value,
                                 socklen_t option_len) {
@@ -203,6 +272,9 @@ std::unique_ptr<IOManager::IOContext> NativePathHandler::Open(const char *path,
     return nullptr;
   }
 
+  if (flags & O_TRUNC) {
+    ReportFileChanged(host_fd);
+  }
   return ::absl::make_unique<IOContextNative>(host_fd);
 }
 
@@ -228,7 +300,11 @@ int NativePathHandler::SymLink(const char *path1, const char *path2) {
 }
 
 int NativePathHandler::Truncate(const char *path, off_t length) {
-  return enc_untrusted_truncate(path, length);
+  int result = enc_untrusted_truncate(path, length);
+  if (result == 0) {
+    ReportFileChanged(path);
+  }
+  return result;
 }
 
 int NativePathHandler::Stat(const char *pathname, struct stat *stat_buffer) {
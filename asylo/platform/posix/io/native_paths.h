@@ -21,6 +21,12 @@
 
 #include <utime.h>
 
+#include <memory>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "asylo/platform/posix/io/host_file_mapping.h"
 #include "asylo/platform/posix/io/io_manager.h"
 
 namespace asylo {
@@ -65,10 +71,20 @@ class IOContextNative : public IOManager::IOContext {
   ssize_t RecvFrom(void *buf, size_t len, int flags, struct sockaddr *src_addr,
                    socklen_t *addrlen) override;
   int GetHostFileDescriptor() override;
+  int GetDents64(void *buf, size_t count) override;
+  std::shared_ptr<HostFileMapping> Mmap(size_t length, int flags,
+                                        off_t offset) override;
 
  private:
   // Host file descriptor implementing this stream.
   int host_fd_;
+
+  // Mappings created from this stream. PRead() serves ranges they cover
+  // through the page cache instead of exiting the enclave.
+  absl::Mutex mappings_mu_;
+  std::vector<std::weak_ptr<HostFileMapping>> mappings_
+      ABSL_GUARDED_BY(mappings_mu_);
+
   void FillIov(const char *buf, int size, const struct iovec *iov, int iovcnt);
 };
 
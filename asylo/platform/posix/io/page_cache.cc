@@ -0,0 +1,129 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/posix/io/page_cache.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace asylo {
+namespace io {
+
+constexpr size_t PageCache::kPageSize;
+constexpr size_t PageCache::kDefaultCapacity;
+
+void PageCache::SetCapacity(size_t capacity) {
+  absl::MutexLock lock(&mu_);
+  capacity_ = capacity / kPageSize * kPageSize;
+  EvictToCapacity();
+}
+
+size_t PageCache::Capacity() const {
+  absl::MutexLock lock(&mu_);
+  return capacity_;
+}
+
+size_t PageCache::Size() const {
+  absl::MutexLock lock(&mu_);
+  return lru_.size() * kPageSize;
+}
+
+void PageCache::Read(uint64_t region_id, const uint8_t *source,
+                     size_t source_length, size_t offset, void *buf,
+                     size_t count) {
+  uint8_t *out = static_cast<uint8_t *>(buf);
+  while (count > 0) {
+    size_t page = offset / kPageSize;
+    size_t page_offset = offset % kPageSize;
+    size_t len = std::min(count, kPageSize - page_offset);
+    PageKey key = {region_id, page};
+    uint64_t generation;
+    {
+      absl::MutexLock lock(&mu_);
+      if (capacity_ == 0) {
+        break;
+      }
+      auto found = index_.find(key);
+      if (found != index_.end()) {
+        lru_.splice(lru_.begin(), lru_, found->second);
+        memcpy(out, found->second->data.get() + page_offset, len);
+        out += len;
+        offset += len;
+        count -= len;
+        continue;
+      }
+      generation = generation_;
+    }
+
+    // Copy the page once, so that the bytes returned for it stay the same even
+    // if the host modifies the untrusted region. The copy from untrusted
+    // memory is made without holding |mu_|.
+    std::unique_ptr<uint8_t[]> data = CopyPage(source, source_length, page);
+    memcpy(out, data.get() + page_offset, len);
+    out += len;
+    offset += len;
+    count -= len;
+
+    absl::MutexLock lock(&mu_);
+    // A page copied before an invalidation may be out of date, and another
+    // thread may have cached the same page in the meantime.
+    if (generation_ == generation && capacity_ > 0 &&
+        index_.find(key) == index_.end()) {
+      lru_.push_front(Page{key, std::move(data)});
+      index_[key] = lru_.begin();
+      EvictToCapacity();
+    }
+  }
+  // Caching is disabled, so copy the rest directly.
+  memcpy(out, source + offset, count);
+}
+
+void PageCache::Invalidate(uint64_t region_id) {
+  absl::MutexLock lock(&mu_);
+  ++generation_;
+  for (auto it = lru_.begin(); it != lru_.end();) {
+    if (it->key.region_id == region_id) {
+      index_.erase(it->key);
+      it = lru_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+std::unique_ptr<uint8_t[]> PageCache::CopyPage(const uint8_t *source,
+                                               size_t source_length,
+                                               size_t page) {
+  // Any part of the page past the end of the region reads as zeros.
+  std::unique_ptr<uint8_t[]> data(new uint8_t[kPageSize]);
+  size_t start = page * kPageSize;
+  size_t len = std::min(kPageSize, source_length - start);
+  memcpy(data.get(), source + start, len);
+  memset(data.get() + len, 0, kPageSize - len);
+  return data;
+}
+
+void PageCache::EvictToCapacity() {
+  while (!lru_.empty() && lru_.size() * kPageSize > capacity_) {
+    index_.erase(lru_.back().key);
+    lru_.pop_back();
+  }
+}
+
+}  // namespace io
+}  // namespace asylo
@@ -0,0 +1,130 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_POSIX_IO_PAGE_CACHE_H_
+#define ASYLO_PLATFORM_POSIX_IO_PAGE_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+namespace asylo {
+namespace io {
+
+// A cache of trusted copies of pages of untrusted memory regions, used to read
+// host files mapped with mmap().
+//
+// The first read of a page copies it into enclave memory; later reads are
+// served from that copy, so the host cannot change bytes the enclave has
+// already observed while the page stays cached. When the cached pages exceed
+// the capacity, the least recently used pages are evicted.
+class PageCache {
+ public:
+  static constexpr size_t kPageSize = 4096;
+
+  // Capacity used until SetCapacity() is called.
+  static constexpr size_t kDefaultCapacity = 16 * 1024 * 1024;
+
+  // Accessor to the singleton instance.
+  static PageCache &GetInstance() {
+    static PageCache *instance = new PageCache;
+    return *instance;
+  }
+
+  // Sets the maximum number of bytes of cached pages, rounded down to a whole
+  // number of pages, evicting pages as needed. A capacity of less than a page
+  // disables caching, and reads copy directly from untrusted memory.
+  void SetCapacity(size_t capacity) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns the current capacity in bytes.
+  size_t Capacity() const ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns the number of bytes of pages currently cached.
+  size_t Size() const ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Copies |count| bytes at |offset| of the untrusted region |source|, of
+  // |source_length| bytes, into |buf|. The range must lie within the region.
+  // Pages are keyed by |region_id|, which must uniquely identify the region
+  // until Invalidate() is called for it.
+  void Read(uint64_t region_id, const uint8_t *source, size_t source_length,
+            size_t offset, void *buf, size_t count) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Drops all cached pages of |region_id|.
+  void Invalidate(uint64_t region_id) ABSL_LOCKS_EXCLUDED(mu_);
+
+ private:
+  struct PageKey {
+    uint64_t region_id;
+    size_t page;
+
+    bool operator==(const PageKey &other) const {
+      return region_id == other.region_id && page == other.page;
+    }
+  };
+
+  struct PageKeyHash {
+    size_t operator()(const PageKey &key) const {
+      return std::hash<uint64_t>()(key.region_id * 0x9e3779b97f4a7c15ull ^
+                                   key.page);
+    }
+  };
+
+  struct Page {
+    PageKey key;
+    std::unique_ptr<uint8_t[]> data;
+  };
+
+  PageCache() : capacity_(kDefaultCapacity) {}
+  PageCache(PageCache const &) = delete;
+  void operator=(PageCache const &) = delete;
+
+  // Returns a trusted copy of |page| of the untrusted region |source|, of
+  // |source_length| bytes.
+  static std::unique_ptr<uint8_t[]> CopyPage(const uint8_t *source,
+                                             size_t source_length, size_t page);
+
+  // Evicts least recently used pages until the cache fits its capacity.
+  void EvictToCapacity() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  mutable absl::Mutex mu_;
+
+  size_t capacity_ ABSL_GUARDED_BY(mu_);
+
+  // Incremented by every Invalidate(), so that a page copied concurrently with
+  // an invalidation is not cached.
+  uint64_t generation_ ABSL_GUARDED_BY(mu_) = 0;
+
+  // Cached pages, most recently used first.
+  std::list<Page> lru_ ABSL_GUARDED_BY(mu_);
+
+  // Index of |lru_|. This is used in the trusted runtime where system calls
+  // might not be available, so std::unordered_map is used instead of
+  // absl::flat_hash_map.
+  std::unordered_map<PageKey, std::list<Page>::iterator, PageKeyHash> index_
+      ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace io
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_POSIX_IO_PAGE_CACHE_H_
@@ -24,7 +24,7 @@
 #include <sys/sysmacros.h>
 
 #include "absl/memory/memory.h"
-#include "asylo/platform/primitives/trusted_runtime.h"
+#include "asylo/platform/posix/io/ctr_drbg.h"
 
 namespace asylo {
 namespace {
@@ -58,8 +58,9 @@ int GetStat(struct stat *stat_buffer, bool is_urandom) {
 }  // namespace
 
 ssize_t RandomIOContext::Read(void *buf, size_t count) {
-  // Delegate to architecture-specific implementation to generate random numbers
-  return enc_hardware_random(reinterpret_cast<uint8_t *>(buf), count);
+  // Serve reads from the per-thread DRBG, which is seeded from the
+  // architecture-specific hardware entropy source.
+  return io::DrbgRandomBytes(reinterpret_cast<uint8_t *>(buf), count);
 }
 
 ssize_t RandomIOContext::Write(const void *buf, size_t count) {
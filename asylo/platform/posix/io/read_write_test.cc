@@ -41,6 +41,7 @@ namespace {
 
 constexpr size_t kKeyLength = 32;
 constexpr size_t kBlockLength = 128;
+constexpr size_t kLargeBlockLength = 4096;
 
 const char *kUntrustedTestText = "Lorem ipsum dolor sit amet...\n";
 const char *kSecureTestText =
@@ -175,5 +176,53 @@ TEST_F(ReadWriteTest, ReadWriteSecureTest) {
   EXPECT_EQ(close(fd), 0);
 }
 
+TEST_F(ReadWriteTest, ReadWriteSecureLargeBlockTest) {
+  // Generate secure key.
+  CleansingVector<uint8_t> secure_key;
+  secure_key.resize(kKeyLength);
+  ASSERT_EQ(RAND_bytes(secure_key.data(), secure_key.size()), 1)
+      << "RAND_bytes() failed";
+
+  struct key_and_block_length_info ioctl_param;
+  ioctl_param.length = secure_key.size();
+  ioctl_param.data = secure_key.data();
+  ioctl_param.block_length = kLargeBlockLength;
+
+  // Check that we can create a file with large blocks.
+  int fd = open(test_file_.get(), O_CREAT | O_RDWR | O_SECURE, 0644);
+  ASSERT_GE(fd, 0);
+
+  EXPECT_EQ(
+      ioctl(fd, ENCLAVE_STORAGE_SET_KEY_WITH_BLOCK_LENGTH, &ioctl_param), 0);
+
+  // Check that writing to the file succeeds.
+  size_t rc = write(fd, kSecureTestText, strlen(kSecureTestText));
+  EXPECT_EQ(rc, strlen(kSecureTestText));
+
+  // Check that closing the file succeeds.
+  EXPECT_EQ(close(fd), 0);
+
+  // Check that we can reopen the file for reading, with the block length read
+  // from the file.
+  struct key_info key_param;
+  key_param.length = secure_key.size();
+  key_param.data = secure_key.data();
+  fd = open(test_file_.get(), O_RDONLY | O_SECURE);
+  ASSERT_GE(fd, 0);
+
+  EXPECT_EQ(ioctl(fd, ENCLAVE_STORAGE_SET_KEY, &key_param), 0);
+
+  // Check that we can read back what we wrote.
+  char buf[1024];
+  rc = read(fd, buf, strlen(kSecureTestText));
+  ASSERT_LT(rc, sizeof(buf));
+  EXPECT_EQ(rc, strlen(kSecureTestText));
+  buf[rc] = '\0';
+  EXPECT_EQ(strncmp(buf, kSecureTestText, kBlockLength), 0);
+
+  // Check that closing the file succeeds.
+  EXPECT_EQ(close(fd), 0);
+}
+
 }  // namespace
 }  // namespace asylo
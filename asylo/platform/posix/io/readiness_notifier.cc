@@ -0,0 +1,184 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/posix/io/readiness_notifier.h"
+
+#include <fcntl.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+#include "asylo/platform/host_call/trusted/host_calls.h"
+
+namespace asylo {
+namespace io {
+
+constexpr int ReadinessNotifier::kFallbackHostWaitMs;
+
+ReadinessNotifier::Waiter::Waiter(std::vector<const void *> keys)
+    : notifier_(&ReadinessNotifier::GetInstance()) {
+  absl::MutexLock lock(&notifier_->mu_);
+  keys_ = std::move(keys);
+  notifier_->Register(this, keys_);
+  notifier_->waiter_count_.fetch_add(1);
+}
+
+ReadinessNotifier::Waiter::~Waiter() {
+  if (host_wake_fds_[0] >= 0) {
+    EndHostWait();
+  }
+  absl::MutexLock lock(&notifier_->mu_);
+  notifier_->Unregister(this, keys_);
+  notifier_->waiter_count_.fetch_sub(1);
+}
+
+void ReadinessNotifier::Waiter::SetKeys(std::vector<const void *> keys) {
+  absl::MutexLock lock(&notifier_->mu_);
+  notifier_->Unregister(this, keys_);
+  keys_ = std::move(keys);
+  notifier_->Register(this, keys_);
+}
+
+bool ReadinessNotifier::Waiter::Notified() {
+  absl::MutexLock lock(&notifier_->mu_);
+  return notified_;
+}
+
+bool ReadinessNotifier::Waiter::Wait(absl::Time deadline) {
+  absl::MutexLock lock(&notifier_->mu_);
+  while (!notified_) {
+    if (changed_.WaitWithDeadline(&notifier_->mu_, deadline)) {
+      break;
+    }
+  }
+  bool notified = notified_;
+  notified_ = false;
+  return notified;
+}
+
+int ReadinessNotifier::Waiter::BeginHostWait() {
+  std::array<int, 2> fds = {-1, -1};
+  {
+    absl::MutexLock lock(&notifier_->mu_);
+    if (!notifier_->idle_host_pipes_.empty()) {
+      fds = notifier_->idle_host_pipes_.back();
+      notifier_->idle_host_pipes_.pop_back();
+    }
+  }
+  if (fds[0] < 0 &&
+      enc_untrusted_pipe2(fds.data(), O_NONBLOCK | O_CLOEXEC) == -1) {
+    return -1;
+  }
+  absl::MutexLock lock(&notifier_->mu_);
+  host_wake_fds_ = fds;
+  wake_sent_ = false;
+  return fds[0];
+}
+
+void ReadinessNotifier::Waiter::EndHostWait() {
+  std::array<int, 2> fds;
+  bool wake_sent;
+  {
+    absl::MutexLock lock(&notifier_->mu_);
+    // Detach the pipe first so that no further Notify() writes to it, then
+    // wait for writes already under way.
+    fds = host_wake_fds_;
+    host_wake_fds_ = {-1, -1};
+    auto written = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(notifier_->mu_) {
+      return pending_writes_ == 0;
+    };
+    notifier_->mu_.Await(absl::Condition(&written));
+    wake_sent = wake_sent_;
+    notified_ = false;
+  }
+  if (fds[0] < 0) {
+    return;
+  }
+  if (wake_sent) {
+    // The pipe is owned by this waiter, so every pending byte was written for
+    // it and the pipe is empty again once they are read.
+    uint8_t buf[16];
+    while (enc_untrusted_read(fds[0], buf, sizeof(buf)) > 0) {
+    }
+  }
+  absl::MutexLock lock(&notifier_->mu_);
+  notifier_->idle_host_pipes_.push_back(fds);
+}
+
+void ReadinessNotifier::Register(Waiter *waiter,
+                                 const std::vector<const void *> &keys) {
+  for (const void *key : keys) {
+    waiters_.emplace(key, waiter);
+  }
+}
+
+void ReadinessNotifier::Unregister(Waiter *waiter,
+                                   const std::vector<const void *> &keys) {
+  for (const void *key : keys) {
+    auto range = waiters_.equal_range(key);
+    auto it = std::find_if(
+        range.first, range.second,
+        [waiter](const std::pair<const void *const, Waiter *> &entry) {
+          return entry.second == waiter;
+        });
+    if (it != range.second) {
+      waiters_.erase(it);
+    }
+  }
+}
+
+void ReadinessNotifier::Notify(const void *key) {
+  // A waiter registers before it evaluates the readiness of its streams, and
+  // the state change being notified is made before this load, so a waiter
+  // which is missed here observes the change when it evaluates its streams.
+  if (waiter_count_.load() == 0) {
+    return;
+  }
+  std::vector<std::pair<Waiter *, int>> host_wakes;
+  {
+    absl::MutexLock lock(&mu_);
+    auto range = waiters_.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+      Waiter *waiter = it->second;
+      waiter->notified_ = true;
+      waiter->changed_.Signal();
+      if (waiter->host_wake_fds_[1] >= 0 && !waiter->wake_sent_) {
+        waiter->wake_sent_ = true;
+        ++waiter->pending_writes_;
+        host_wakes.emplace_back(waiter, waiter->host_wake_fds_[1]);
+      }
+    }
+  }
+  if (host_wakes.empty()) {
+    return;
+  }
+  // Host writes are made without holding |mu_|. The waiter cannot release its
+  // pipe until the pending write count drops back to zero.
+  for (const auto &wake : host_wakes) {
+    uint8_t byte = 0;
+    enc_untrusted_write(wake.second, &byte, sizeof(byte));
+  }
+  absl::MutexLock lock(&mu_);
+  for (const auto &wake : host_wakes) {
+    --wake.first->pending_writes_;
+  }
+}
+
+}  // namespace io
+}  // namespace asylo
@@ -0,0 +1,143 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_POSIX_IO_READINESS_NOTIFIER_H_
+#define ASYLO_PLATFORM_POSIX_IO_READINESS_NOTIFIER_H_
+
+#include <array>
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace asylo {
+namespace io {
+
+// Wakes threads blocked in poll(), select() or epoll_wait() when the readiness
+// of a stream implemented inside the enclave (a trusted pipe or an eventfd)
+// may have changed.
+//
+// Each blocked call registers a Waiter listing the readiness keys of the
+// streams it is interested in (see IOContext::ReadinessKey()). A waiter is
+// registered before it first evaluates its streams, so a change notified
+// after that evaluation is never lost. Notify() only wakes the waiters
+// registered on the affected key. Waits on trusted streams alone never leave
+// the enclave. Waits that also include host file descriptors block on the
+// host and add the read end of a host "wake" pipe owned by the waiter to their
+// host wait set.
+class ReadinessNotifier {
+ public:
+  // The longest a host wait may block before trusted streams are rechecked
+  // when no host wake pipe is available.
+  static constexpr int kFallbackHostWaitMs = 10;
+
+  // The registration of one thread waiting on a set of trusted streams. It is
+  // registered on construction and unregistered on destruction.
+  class Waiter {
+   public:
+    // Registers a waiter on the streams with the readiness keys |keys|.
+    explicit Waiter(std::vector<const void *> keys);
+    ~Waiter();
+
+    Waiter(const Waiter &) = delete;
+    Waiter &operator=(const Waiter &) = delete;
+
+    // Replaces the readiness keys this waiter is registered on. Callers must
+    // evaluate the readiness of the new streams after this call.
+    void SetKeys(std::vector<const void *> keys);
+
+    // Returns whether one of the streams has been notified since the waiter
+    // last blocked.
+    bool Notified();
+
+    // Blocks until one of the streams is notified or until |deadline| passes,
+    // and clears the notification. Returns true if a stream was notified.
+    bool Wait(absl::Time deadline);
+
+    // Returns the read end of a host pipe, owned by this waiter until
+    // EndHostWait(), which becomes readable when one of the streams is
+    // notified. Returns -1 if no host pipe is available. Callers must check
+    // Notified() after this call and before blocking on the host.
+    int BeginHostWait();
+
+    // Releases the host pipe returned by BeginHostWait(), discarding any
+    // pending wake-up, and clears the notification.
+    void EndHostWait();
+
+   private:
+    friend class ReadinessNotifier;
+
+    ReadinessNotifier *const notifier_;
+
+    std::vector<const void *> keys_ ABSL_GUARDED_BY(notifier_->mu_);
+    bool notified_ ABSL_GUARDED_BY(notifier_->mu_) = false;
+    absl::CondVar changed_;
+
+    // The host pipe held between BeginHostWait() and EndHostWait().
+    std::array<int, 2> host_wake_fds_ ABSL_GUARDED_BY(notifier_->mu_) = {-1,
+                                                                         -1};
+    // Set once a wake-up byte has been sent for the current host wait.
+    bool wake_sent_ ABSL_GUARDED_BY(notifier_->mu_) = false;
+    // The number of Notify() calls currently writing to the host pipe.
+    int pending_writes_ ABSL_GUARDED_BY(notifier_->mu_) = 0;
+  };
+
+  // Accessor to the singleton instance.
+  static ReadinessNotifier &GetInstance() {
+    static ReadinessNotifier *instance = new ReadinessNotifier;
+    return *instance;
+  }
+
+  // Records that the readiness of the streams with readiness key |key| may
+  // have changed and wakes the threads waiting on them.
+  void Notify(const void *key) ABSL_LOCKS_EXCLUDED(mu_);
+
+ private:
+  ReadinessNotifier() : waiter_count_(0) {}
+  ReadinessNotifier(ReadinessNotifier const &) = delete;
+  void operator=(ReadinessNotifier const &) = delete;
+
+  // Adds or removes the registrations of |waiter| on each of |keys|.
+  void Register(Waiter *waiter, const std::vector<const void *> &keys)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  void Unregister(Waiter *waiter, const std::vector<const void *> &keys)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  absl::Mutex mu_;
+
+  // The number of registered waiters. Lets Notify() return without locking
+  // |mu_| while no thread is waiting.
+  std::atomic<int> waiter_count_;
+
+  // Registered waiters, keyed by readiness key.
+  std::unordered_multimap<const void *, Waiter *> waiters_
+      ABSL_GUARDED_BY(mu_);
+
+  // Drained host wake pipes which are not held by any waiter. They are reused
+  // rather than closed, so a host wait costs no extra host calls once the pool
+  // holds a pipe per concurrently blocked thread.
+  std::vector<std::array<int, 2>> idle_host_pipes_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace io
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_POSIX_IO_READINESS_NOTIFIER_H_
@@ -43,6 +43,10 @@ ssize_t IOContextSecure::Read(void *buf, size_t count) {
   return platform::storage::secure_read(host_fd_, buf, count);
 }
 
+ssize_t IOContextSecure::PRead(void *buf, size_t count, off_t offset) {
+  return platform::storage::secure_pread(host_fd_, buf, count, offset);
+}
+
 ssize_t IOContextSecure::Write(const void *buf, size_t count) {
   return platform::storage::secure_write(host_fd_, buf, count);
 }
@@ -51,7 +55,9 @@ int IOContextSecure::LSeek(off_t offset, int whence) {
   return platform::storage::secure_lseek(host_fd_, offset, whence);
 }
 
-int IOContextSecure::FSync() { return enc_untrusted_fsync(host_fd_); }
+int IOContextSecure::FSync() {
+  return platform::storage::secure_fsync(host_fd_);
+}
 
 int IOContextSecure::FStat(struct stat *st) {
   return platform::storage::secure_fstat(host_fd_, st);
@@ -66,6 +72,17 @@ int IOContextSecure::Ioctl(int request, void *argp) {
       return AeadHandler::GetInstance().SetMasterKey(
           host_fd_, ioctl_param->data, ioctl_param->length);
     }
+    case ENCLAVE_STORAGE_SET_KEY_WITH_BLOCK_LENGTH: {
+      struct key_and_block_length_info *ioctl_param =
+          reinterpret_cast<struct key_and_block_length_info *>(argp);
+      return AeadHandler::GetInstance().SetMasterKey(
+          host_fd_, ioctl_param->data, ioctl_param->length,
+          ioctl_param->block_length);
+    }
+    case ENCLAVE_STORAGE_SET_DIGEST_UPDATE_INTERVAL: {
+      return AeadHandler::GetInstance().SetDigestUpdateInterval(
+          host_fd_, *reinterpret_cast<uint32_t *>(argp));
+    }
     default:
       errno = ENOSYS;
   }
@@ -73,5 +90,49 @@ int IOContextSecure::Ioctl(int request, void *argp) {
   return -1;
 }
 
+ssize_t IOContextSecureLog::Read(void *buf, size_t count) {
+  return log_->Read(buf, count);
+}
+
+ssize_t IOContextSecureLog::Write(const void *buf, size_t count) {
+  return log_->Append(buf, count);
+}
+
+int IOContextSecureLog::Close() { return log_->Close(); }
+
+int IOContextSecureLog::LSeek(off_t offset, int whence) {
+  return log_->Seek(offset, whence);
+}
+
+int IOContextSecureLog::FSync() { return log_->Sync(); }
+
+int IOContextSecureLog::FStat(struct stat *st) {
+  int ret = enc_untrusted_fstat(log_->host_fd(), st);
+  if (ret == 0) {
+    // Rewrite to the length of the data in the log, which is only known once
+    // the key is set.
+    off_t size = log_->GetSize();
+    if (size == -1) {
+      return -1;
+    }
+    st->st_size = size;
+  }
+  return ret;
+}
+
+int IOContextSecureLog::Isatty() {
+  return enc_untrusted_isatty(log_->host_fd());
+}
+
+int IOContextSecureLog::Ioctl(int request, void *argp) {
+  if (request == ENCLAVE_STORAGE_SET_KEY) {
+    struct key_info *ioctl_param = reinterpret_cast<struct key_info *>(argp);
+    return log_->SetMasterKey(ioctl_param->data, ioctl_param->length);
+  }
+
+  errno = ENOSYS;
+  return -1;
+}
+
 }  // namespace io
 }  // namespace asylo
@@ -19,17 +19,61 @@
 #ifndef ASYLO_PLATFORM_POSIX_IO_SECURE_PATHS_H_
 #define ASYLO_PLATFORM_POSIX_IO_SECURE_PATHS_H_
 
+#include <fcntl.h>
+
+#include <memory>
+#include <utility>
+
 #include "asylo/platform/posix/io/io_manager.h"
+#include "asylo/platform/storage/secure/secure_log.h"
 
 namespace asylo {
 namespace io {
 
+// IOContext implementation wrapping an append-only log managed by the secure
+// I/O layer.
+class IOContextSecureLog : public IOManager::IOContext {
+ public:
+  // Factory method to create an instance of the class.
+  static std::unique_ptr<IOManager::IOContext> Create(const char *path,
+                                                      int flags, mode_t mode) {
+    std::unique_ptr<platform::storage::SecureLog> log =
+        platform::storage::SecureLog::Open(path, flags, mode);
+    if (!log) {
+      return nullptr;
+    }
+    return std::unique_ptr<IOManager::IOContext>(
+        new IOContextSecureLog(std::move(log)));
+  }
+
+ protected:
+  ssize_t Read(void *buf, size_t count) override;
+  ssize_t Write(const void *buf, size_t count) override;
+  int Close() override;
+  int LSeek(off_t offset, int whence) override;
+  int FSync() override;
+  int FStat(struct stat *st) override;
+  int Isatty() override;
+  int Ioctl(int request, void *argp) override;
+
+ private:
+  explicit IOContextSecureLog(std::unique_ptr<platform::storage::SecureLog> log)
+      : log_(std::move(log)) {}
+
+  std::unique_ptr<platform::storage::SecureLog> log_;
+};
+
 // IOContext implementation wrapping a stream managed by the secure I/O layer.
 class IOContextSecure : public IOManager::IOContext {
  public:
-  // Factory method to create an instance of the class.
+  // Factory method to create an instance of the class. A file opened with
+  // O_APPEND is handled as a secure log by IOContextSecureLog.
   static std::unique_ptr<IOManager::IOContext> Create(const char *path,
                                                       int flags, mode_t mode) {
+    if (flags & O_APPEND) {
+      return IOContextSecureLog::Create(path, flags, mode);
+    }
+
     int host_fd = platform::storage::secure_open(path, flags, mode);
     if (host_fd == -1) {
       return nullptr;
@@ -39,6 +83,7 @@ class IOContextSecure : public IOManager::IOContext {
 
  protected:
   ssize_t Read(void *buf, size_t count) override;
+  ssize_t PRead(void *buf, size_t count, off_t offset) override;
   ssize_t Write(const void *buf, size_t count) override;
   int Close() override;
   int LSeek(off_t offset, int whence) override;
@@ -31,8 +31,18 @@ constexpr size_t kPageSize = 4096;
 
 extern "C" {
 
+// Implemented by the POSIX runtime for mappings of host files. The references
+// are weak, so that enclaves without it support anonymous mappings only.
+// enc_munmap_file() returns 1 if |addr| is not a file mapping.
+void *enc_mmap_file(void *addr, size_t length, int prot, int flags, int fd,
+                    off_t offset) __attribute__((weak));
+int enc_munmap_file(void *addr, size_t length) __attribute__((weak));
+
 void *mmap(void *addr, size_t length, int prot, int flags, int fd,
            off_t offset) {
+  if (!(flags & MAP_ANONYMOUS) && enc_mmap_file) {
+    return enc_mmap_file(addr, length, prot, flags, fd, offset);
+  }
   if (addr || prot != (PROT_READ | PROT_WRITE) ||
       flags != (MAP_ANONYMOUS | MAP_PRIVATE) || fd != -1 || offset != 0) {
     errno = ENOSYS;
@@ -48,6 +58,12 @@ void *mmap(void *addr, size_t length, int prot, int flags, int fd,
 }
 
 int munmap(void *addr, size_t length) {
+  if (enc_munmap_file) {
+    int result = enc_munmap_file(addr, length);
+    if (result <= 0) {
+      return result;
+    }
+  }
   free(addr);
   return 0;
 }
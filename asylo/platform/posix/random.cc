@@ -0,0 +1,56 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <errno.h>
+#include <sys/random.h>
+
+#include <cstdint>
+
+#include "asylo/platform/posix/io/ctr_drbg.h"
+
+using asylo::io::DrbgRandomBytes;
+
+namespace {
+
+// Largest request served by getentropy(3).
+constexpr size_t kMaxGetEntropyLength = 256;
+
+}  // namespace
+
+extern "C" {
+
+// The enclave DRBG is seeded on first use and never blocks, so GRND_NONBLOCK
+// and GRND_RANDOM do not change the behavior of getrandom().
+ssize_t getrandom(void *buf, size_t buflen, unsigned int flags) {
+  if (flags & ~(GRND_NONBLOCK | GRND_RANDOM)) {
+    errno = EINVAL;
+    return -1;
+  }
+  return DrbgRandomBytes(static_cast<uint8_t *>(buf), buflen);
+}
+
+int getentropy(void *buffer, size_t length) {
+  if (length > kMaxGetEntropyLength) {
+    errno = EIO;
+    return -1;
+  }
+  DrbgRandomBytes(static_cast<uint8_t *>(buffer), length);
+  return 0;
+}
+
+}  // extern "C"
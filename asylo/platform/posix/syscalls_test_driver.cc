@@ -1144,6 +1144,25 @@ TEST_F(SyscallsTest, Mmap) {
   EXPECT_THAT(RunSyscallInsideEnclave("mmap", "", nullptr), IsOk());
 }
 
+// Tests that a host file can be mapped read-only, read through the mapping and
+// through pread(), and unmapped.
+TEST_F(SyscallsTest, MmapFile) {
+  EXPECT_THAT(
+      RunSyscallInsideEnclave(
+          "mmap_file", absl::GetFlag(FLAGS_test_tmpdir) + "/mmap_file",
+          nullptr),
+      IsOk());
+}
+
+// Tests opendir(), readdir(), scandir() and nftw() on a directory holding more
+// entries than are fetched from the host at once.
+TEST_F(SyscallsTest, Readdir) {
+  EXPECT_THAT(RunSyscallInsideEnclave(
+                  "readdir", absl::GetFlag(FLAGS_test_tmpdir) + "/readdir",
+                  nullptr),
+              IsOk());
+}
+
 TEST_F(SyscallsTest, Itimer) {
   EXPECT_THAT(RunSyscallInsideEnclave("itimer", "", nullptr), IsOk());
 }
@@ -16,8 +16,10 @@
  *
  */
 
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <ftw.h>
 #include <ifaddrs.h>
 #include <net/if.h>
 #include <openssl/rand.h>
@@ -25,6 +27,7 @@
 #include <regex.h>
 #include <sched.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
@@ -162,6 +165,10 @@ class SyscallsEnclave : public EnclaveTestCase {
       return RunTruncateTest(test_input.path_name());
     } else if (test_input.test_target() == "mmap") {
       return RunMmapTest();
+    } else if (test_input.test_target() == "mmap_file") {
+      return RunMmapFileTest(test_input.path_name());
+    } else if (test_input.test_target() == "readdir") {
+      return RunReaddirTest(test_input.path_name());
     } else if (test_input.test_target() == "itimer") {
       return RunItimerTest();
     } else if (test_input.test_target() == "rename") {
@@ -1447,6 +1454,153 @@ class SyscallsEnclave : public EnclaveTestCase {
     return Status::OkStatus();
   }
 
+  Status RunMmapFileTest(const std::string &path) {
+    // Write a file spanning several pages, with a partial last page.
+    std::string contents(3 * 4096 + 100, '\0');
+    for (size_t i = 0; i < contents.size(); ++i) {
+      contents[i] = static_cast<char>(i * 7);
+    }
+    int fd;
+    ASYLO_ASSIGN_OR_RETURN(fd, OpenFile(path, O_CREAT | O_RDWR, 0644));
+    platform::storage::FdCloser fd_closer(fd);
+    if (write(fd, contents.data(), contents.size()) != contents.size()) {
+      return Status(static_cast<error::PosixError>(errno), "write failed");
+    }
+
+    if (mmap(nullptr, contents.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+             0) != MAP_FAILED ||
+        errno != ENOSYS) {
+      return Status(error::GoogleError::INTERNAL,
+                    "mmap(PROT_WRITE) of a file should fail with ENOSYS");
+    }
+    if (mmap(nullptr, contents.size(), PROT_READ, MAP_PRIVATE, fd, 100) !=
+            MAP_FAILED ||
+        errno != EINVAL) {
+      return Status(error::GoogleError::INTERNAL,
+                    "mmap() at an unaligned offset should fail with EINVAL");
+    }
+
+    void *ptr = mmap(nullptr, contents.size(), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (ptr == MAP_FAILED) {
+      return Status(static_cast<error::PosixError>(errno),
+                    "mmap() of a file failed");
+    }
+    if (memcmp(ptr, contents.data(), contents.size()) != 0) {
+      return Status(error::GoogleError::INTERNAL,
+                    "Mapped file does not match its contents");
+    }
+
+    // Reads covered by the mapping, including one spanning pages, are served
+    // through the page cache.
+    for (off_t offset : {0, 4000, 3 * 4096}) {
+      char buf[200];
+      size_t count = std::min(sizeof(buf), contents.size() - offset);
+      if (pread(fd, buf, count, offset) != count ||
+          memcmp(buf, &contents[offset], count) != 0) {
+        return Status(error::GoogleError::INTERNAL,
+                      absl::StrCat("pread() at ", offset,
+                                   " does not match the file"));
+      }
+    }
+
+    // A write through the descriptor drops the cached pages, so later reads
+    // observe the new contents.
+    const char kUpdate[] = "updated";
+    char updated[sizeof(kUpdate)];
+    if (lseek(fd, 0, SEEK_SET) != 0 ||
+        write(fd, kUpdate, sizeof(kUpdate)) != sizeof(kUpdate) ||
+        pread(fd, updated, sizeof(updated), 0) != sizeof(updated) ||
+        memcmp(updated, kUpdate, sizeof(kUpdate)) != 0) {
+      return Status(error::GoogleError::INTERNAL,
+                    "pread() after write() does not see the new contents");
+    }
+
+    if (munmap(ptr, contents.size()) != 0) {
+      return Status(static_cast<error::PosixError>(errno),
+                    "munmap() of a file mapping failed");
+    }
+    return Status::OkStatus();
+  }
+
+  Status RunReaddirTest(const std::string &path) {
+    // Create more entries than fit in a single batch from the host.
+    constexpr int kNumFiles = 2000;
+    if (mkdir(path.c_str(), 0755) != 0 ||
+        mkdir((path + "/subdir").c_str(), 0755) != 0) {
+      return Status(static_cast<error::PosixError>(errno), "mkdir failed");
+    }
+    for (int i = 0; i < kNumFiles; ++i) {
+      int fd;
+      ASYLO_ASSIGN_OR_RETURN(
+          fd, OpenFile(absl::StrCat(path, "/file_", i), O_CREAT | O_RDWR, 0644));
+      close(fd);
+    }
+
+    DIR *dir = opendir(path.c_str());
+    if (!dir) {
+      return Status(static_cast<error::PosixError>(errno), "opendir failed");
+    }
+    int num_files = 0;
+    int num_dirs = 0;
+    errno = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+      if (entry->d_type == DT_REG) {
+        ++num_files;
+      } else if (entry->d_type == DT_DIR) {
+        ++num_dirs;
+      }
+    }
+    int readdir_errno = errno;
+    closedir(dir);
+    if (readdir_errno != 0) {
+      return Status(static_cast<error::PosixError>(readdir_errno),
+                    "readdir failed");
+    }
+    // The directories are ".", ".." and "subdir".
+    if (num_files != kNumFiles || num_dirs != 3) {
+      return Status(error::GoogleError::INTERNAL,
+                    absl::StrCat("readdir returned ", num_files, " files and ",
+                                 num_dirs, " directories"));
+    }
+
+    if (opendir((path + "/file_0").c_str()) != nullptr || errno != ENOTDIR) {
+      return Status(error::GoogleError::INTERNAL,
+                    "opendir() of a file should fail with ENOTDIR");
+    }
+
+    struct dirent **names;
+    int num_names = scandir(
+        path.c_str(), &names,
+        [](const struct dirent *entry) {
+          return entry->d_type == DT_DIR && entry->d_name[0] != '.' ? 1 : 0;
+        },
+        alphasort);
+    if (num_names != 1 || strcmp(names[0]->d_name, "subdir") != 0) {
+      return Status(error::GoogleError::INTERNAL,
+                    "scandir() did not select the subdirectory");
+    }
+    free(names[0]);
+    free(names);
+
+    static int num_visited;
+    num_visited = 0;
+    if (nftw(path.c_str(),
+             [](const char *path, const struct stat *sb, int typeflag,
+                struct FTW *ftwbuf) {
+               ++num_visited;
+               return typeflag == FTW_F || typeflag == FTW_D ? 0 : -1;
+             },
+             1, FTW_PHYS | FTW_NOSTAT) != 0) {
+      return Status(error::GoogleError::INTERNAL, "nftw() failed");
+    }
+    if (num_visited != kNumFiles + 2) {
+      return Status(error::GoogleError::INTERNAL,
+                    absl::StrCat("nftw() visited ", num_visited, " entries"));
+    }
+    return Status::OkStatus();
+  }
+
   Status RunItimerTest() {
     itimerval timer_val;
     timer_val.it_interval.tv_sec = 100;
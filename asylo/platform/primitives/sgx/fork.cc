@@ -109,7 +109,12 @@ int Restore(const char *snapshot_layout, size_t snapshot_layout_len,
   status = RestoreForFork(snapshot_layout, snapshot_layout_len);
   int ret = status_serializer.Serialize(status);
 
-  if (!status.ok()) {
+  if (status.ok()) {
+    // The restored memory is a copy of the parent's. Advance the fork
+    // generation so per-thread state derived from it, such as buffered random
+    // bytes, is discarded rather than shared with the parent.
+    enc_advance_fork_generation();
+  } else {
     // Delete instance of the global memory pool singleton freeing all memory
     // held by the pool.
     delete UntrustedCacheMalloc::Instance();
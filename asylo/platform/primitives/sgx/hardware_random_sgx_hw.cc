@@ -37,6 +37,27 @@ static void rdrand64(void *out) {
   abort();
 }
 
+static void rdseed64(void *out) {
+  // RDSEED may fail repeatedly while the entropy conditioner refills, which
+  // takes longer when many threads seed at once. Back off exponentially between
+  // attempts, up to |kMaxSeedBackoff| pauses, so that an attempt budget of
+  // |kSeedRetries| spans several seconds of contention before giving up.
+  constexpr int kSeedRetries = 1 << 16;
+  constexpr int kMaxSeedBackoff = 1 << 12;
+  int backoff = 1;
+  for (int i = 0; i < kSeedRetries; ++i) {
+    if (_rdseed64_step(static_cast<unsigned long long *>(out))) {
+      return;
+    }
+    for (int j = 0; j < backoff; ++j) {
+      _mm_pause();
+    }
+    backoff = std::min(2 * backoff, kMaxSeedBackoff);
+  }
+
+  abort();
+}
+
 static uint64_t rdrand64() {
   uint64_t temp;
   rdrand64(&temp);
@@ -89,3 +110,13 @@ extern "C" ssize_t enc_hardware_random(uint8_t *buf, size_t count) {
 
   return count;
 }
+
+// Fills given buffer with seed values generated with the rdseed instruction.
+extern "C" ssize_t enc_hardware_random_seed(uint8_t *buf, size_t count) {
+  for (size_t offset = 0; offset < count; offset += sizeof(uint64_t)) {
+    uint64_t temp;
+    rdseed64(&temp);
+    memcpy(&buf[offset], &temp, std::min(count - offset, sizeof(temp)));
+  }
+  return count;
+}
@@ -39,3 +39,9 @@ extern "C" ssize_t enc_hardware_random(uint8_t *buf, size_t count) {
   std::generate(&buf[0], &buf[count], ::rand);
   return count;
 }
+
+// The simulation backend has no separate seed source, so seed requests are
+// served by enc_hardware_random() as well.
+extern "C" ssize_t enc_hardware_random_seed(uint8_t *buf, size_t count) {
+  return enc_hardware_random(buf, count);
+}
@@ -22,6 +22,8 @@
 #include <stdlib.h>
 #include <sys/types.h>
 
+#include <atomic>
+
 #include "include/sgx_thread.h"
 #include "include/sgx_trts.h"
 
@@ -36,6 +38,9 @@ size_t heap_max_size = 0;
 // Current size of the heap in bytes.
 size_t heap_size = 0;
 
+// Number of times this enclave has been restored as the child of a fork().
+std::atomic<uint64_t> fork_generation(0);
+
 }  // namespace
 
 extern "C" {
@@ -93,6 +98,10 @@ void enc_unblock_entries() { sgx_unblock_entries(); }
 
 void enc_reject_entries() { sgx_reject_entries(); }
 
+uint64_t enc_fork_generation() { return fork_generation.load(); }
+
+void enc_advance_fork_generation() { fork_generation.fetch_add(1); }
+
 void enc_get_memory_layout(struct EnclaveMemoryLayout *enclave_memory_layout) {
   if (!enclave_memory_layout) return;
   struct SgxMemoryLayout memory_layout;
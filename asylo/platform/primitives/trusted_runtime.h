@@ -41,6 +41,10 @@ extern "C" {
 
 ssize_t enc_hardware_random(uint8_t *buf, size_t count);
 
+// Fills |buf| with |count| bytes from the hardware entropy source, suitable for
+// seeding a deterministic random bit generator. Returns |count| on success.
+ssize_t enc_hardware_random_seed(uint8_t *buf, size_t count);
+
 // Registers a signal handler on the host.
 int enc_register_signal(int signum, const sigset_t mask, int flags);
 
@@ -125,6 +129,14 @@ void enc_get_memory_layout(struct EnclaveMemoryLayout *enclave_memory_layout);
 // Returns the number of total active enclave entries.
 int active_entry_count();
 
+// Returns a counter which is advanced each time the enclave is restored as the
+// child of a fork(). State that must not be shared between a parent and a child
+// enclave, such as buffered random output, compares it to detect a fork.
+uint64_t enc_fork_generation();
+
+// Advances the counter returned by enc_fork_generation().
+void enc_advance_fork_generation();
+
 // Returns the number of total entries blocked from entering the enclave.
 int blocked_entry_count();
 
@@ -23,8 +23,12 @@
 // IO syscall interface constants.
 #include <fcntl.h>
 
+#include <algorithm>
+#include <cstddef>
+#include <functional>
 #include <iomanip>
 #include <memory>
+#include <vector>
 
 #include "absl/strings/escaping.h"
 #include "absl/synchronization/mutex.h"
@@ -49,6 +53,32 @@ bool IsPathNameValid(const char *path_name) {
 
 bool is_transient_error(int err) { return (err == EAGAIN) || (err == EINTR); }
 
+// Upper bound on the number of bytes read from the host at once when collecting
+// integrity metadata of a file being opened.
+constexpr size_t kMetadataReadLength = 1 << 20;
+
+// Number of bytes of plaintext transferred at once when importing or exporting
+// a file. A multiple of every block length.
+constexpr size_t kBulkTransferLength = 1 << 20;
+
+// Version of the file format recorded in the file data digest. Version 1 files
+// keep their AD tree in a file next to them. Version 2 files record the block
+// length in the file header, which starts with kFileHeaderMagic.
+constexpr uint32_t kFileFormatVersion = 2;
+
+// Version of the file format of files with the legacy file header.
+constexpr uint32_t kLegacyHeaderFormatVersion = 1;
+
+// Magic string at the start of the file header of version 2 files.
+constexpr char kFileHeaderMagic[kFileHeaderMagicLength] = {
+    'A', 'S', 'Y', 'L', 'O', 'S', 'F', '2'};
+
+// Returns whether |block_length| can be used as the block length of a file.
+bool IsBlockLengthValid(size_t block_length) {
+  return block_length >= kMinBlockLength && block_length <= kMaxBlockLength &&
+         (block_length & (block_length - 1)) == 0;
+}
+
 // Returns -1 on failure, or min(|len|, bytes to EOF) on success.
 ssize_t read_all(int fd, void *buf, size_t len) {
   size_t bytes_to_read = len;
@@ -101,9 +131,49 @@ ssize_t write_all(int fd, const void *buf, size_t len) {
   return offset;
 }
 
+// Returns -1 on failure, or min(|len|, bytes to EOF) on success.
+ssize_t pread_all(int fd, void *buf, size_t len, off_t offset) {
+  size_t bytes_read_total = 0;
+  while (bytes_read_total < len) {
+    ssize_t bytes_read;
+    do {
+      bytes_read = enc_untrusted_pread64(
+          fd, static_cast<uint8_t *>(buf) + bytes_read_total,
+          len - bytes_read_total, offset + bytes_read_total);
+    } while ((bytes_read == -1) && is_transient_error(errno));
+    if (bytes_read == -1) {
+      return -1;
+    }
+    if (bytes_read == 0) {
+      break;
+    }
+    bytes_read_total += bytes_read;
+  }
+  return bytes_read_total;
+}
+
+// Returns false on failure.
+bool pwrite_all(int fd, const void *buf, size_t len, off_t offset) {
+  size_t bytes_written_total = 0;
+  while (bytes_written_total < len) {
+    ssize_t bytes_written;
+    do {
+      bytes_written = enc_untrusted_pwrite64(
+          fd, static_cast<const uint8_t *>(buf) + bytes_written_total,
+          len - bytes_written_total, offset + bytes_written_total);
+    } while ((bytes_written == -1) && is_transient_error(errno));
+    if (bytes_written <= 0) {
+      return false;
+    }
+    bytes_written_total += bytes_written;
+  }
+  return true;
+}
+
 // Returns offset to the plaintext buffer associated with the |block_index| of
 // a full block.
-const uint8_t *GetPlaintextBuffer(size_t first_partial_block_bytes_count,
+const uint8_t *GetPlaintextBuffer(size_t block_length,
+                                  size_t first_partial_block_bytes_count,
                                   int64_t block_index, const void *buf) {
   const uint8_t *plaintext_data = reinterpret_cast<const uint8_t *>(buf);
   if (first_partial_block_bytes_count > 0) {
@@ -111,53 +181,129 @@ const uint8_t *GetPlaintextBuffer(size_t first_partial_block_bytes_count,
       plaintext_data += first_partial_block_bytes_count;
     }
     if (block_index > 1) {
-      plaintext_data += (block_index - 1) * kBlockLength;
+      plaintext_data += (block_index - 1) * block_length;
     }
   } else {
-    plaintext_data += block_index * kBlockLength;
+    plaintext_data += block_index * block_length;
   }
 
   return plaintext_data;
 }
 
-uint8_t *GetPlaintextBuffer(size_t first_partial_block_bytes_count,
+uint8_t *GetPlaintextBuffer(size_t block_length,
+                            size_t first_partial_block_bytes_count,
                             int64_t block_index, void *buf) {
   return const_cast<uint8_t *>(
-      GetPlaintextBuffer(first_partial_block_bytes_count, block_index,
-                         const_cast<const void *>(buf)));
+      GetPlaintextBuffer(block_length, first_partial_block_bytes_count,
+                         block_index, const_cast<const void *>(buf)));
 }
 
-}  // namespace
+std::string DigestToHexString(const FileDigest &digest) {
+  return absl::BytesToHexString(absl::string_view(
+      reinterpret_cast<const char *>(digest.data()), digest.size()));
+}
+
+// Calls |process| on consecutive ranges of the |count| blocks of |block_length|
+// bytes that together cover all blocks, on the calling thread and up to
+// |thread_count| - 1 threads of |workers|. Returns false if processing any of
+// the ranges fails.
+bool ProcessBlocks(size_t count, size_t block_length, size_t thread_count,
+                   WorkerPool *workers,
+                   const std::function<bool(size_t, size_t)> &process) {
+  if (count == 0) {
+    return true;
+  }
+
+  thread_count = std::min(thread_count,
+                          count * block_length / kMinCryptoThreadBytes);
+  if (thread_count <= 1) {
+    return process(0, count);
+  }
+
+  std::unique_ptr<bool[]> results(new bool[thread_count]);
+  workers->ParallelFor(thread_count, [&](size_t idx) {
+    results[idx] = process(count * idx / thread_count,
+                           count * (idx + 1) / thread_count);
+  });
+  return std::all_of(results.get(), results.get() + thread_count,
+                     [](bool result) { return result; });
+}
 
-using Tag = UnsafeBytes<kTagLength>;
-using Token = UnsafeBytes<kTokenLength>;
-using Block = UnsafeBytes<kBlockLength>;
-using Ciphertext = UnsafeBytes<kCipherBlockLength>;
-using SecureBlock = UnsafeBytes<kSecureBlockLength>;
+}  // namespace
 
 using TagView = ByteContainerView;
 using TokenView = ByteContainerView;
-using BlockView = ByteContainerView;
 using CiphertextView = ByteContainerView;
-using SecureBlockView = ByteContainerView;
 
-AeadHandler::AeadHandler()
-    : offset_translator_(OffsetTranslator::Create(
-          sizeof(FileHeader), kBlockLength, kSecureBlockLength)) {}
+void AeadHandler::FileControl::SetLayout(uint32_t version, size_t length) {
+  format_version = version;
+  block_length = length;
+  offset_translator = OffsetTranslator::Create(header_length(), block_length,
+                                               secure_block_length());
+  journal = absl::make_unique<UndoJournal>(path + kUndoJournalFileSuffix,
+                                           secure_block_length());
+  block_cache = absl::make_unique<BlockCache>(
+      block_length, block_cache_capacity / block_length);
+  const uint64_t read_ahead_blocks =
+      std::min(read_ahead_length, block_cache_capacity / 2) / block_length;
+  if (read_ahead_blocks > 0) {
+    read_ahead = absl::make_unique<ReadAhead>(
+        read_ahead_blocks, [this](uint64_t first_block, uint64_t count) {
+          AeadHandler::GetInstance().PrefetchBlocks(this, first_block, count);
+        });
+  }
+}
+
+AeadHandler::FileControl::~FileControl() {
+  // The worker thread of the read-ahead uses the file control, and is stopped
+  // first.
+  read_ahead.reset();
+  if (read_ahead_fd != -1) {
+    enc_untrusted_close(read_ahead_fd);
+  }
+  if (host_fd != -1) {
+    enc_untrusted_close(host_fd);
+  }
+}
 
-bool AeadHandler::Deserialize(FileControl *file_ctrl) {
+bool AeadHandler::FileControl::OpenHostFd() {
+  if (host_fd == -1) {
+    host_fd = enc_untrusted_open(path.c_str(), O_RDWR);
+    if (host_fd == -1) {
+      LOG(ERROR) << "Failed to open file for updating its header, path="
+                 << path << ", errno = " << errno;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool AeadHandler::FileControl::Commit(const FileHash &file_hash) {
+  committed_leaf_count = ad->LeafCount();
+  pending_writes = 0;
+  return journal->Reset(file_hash.data());
+}
+
+size_t AeadHandler::FileControl::header_length() const {
+  return format_version >= kFileFormatVersion ? sizeof(FileHeader)
+                                              : sizeof(LegacyFileHeader);
+}
+
+bool AeadHandler::Deserialize(FileControl *file_ctrl,
+                              size_t new_file_block_length) {
   if (!file_ctrl) {
     errno = EINVAL;
     return false;
   }
   file_ctrl->mu.AssertHeld();
 
-  const GcmCryptor *cryptor = GetGcmCryptor(*file_ctrl);
-  if (!cryptor) {
-    return false;
-  }
-
   if (file_ctrl->is_new) {
+    file_ctrl->SetLayout(kFileFormatVersion, new_file_block_length);
+    const GcmCryptor *cryptor = GetGcmCryptor(*file_ctrl);
+    if (!cryptor) {
+      return false;
+    }
+
     if (!UpdateDigest(file_ctrl, *cryptor)) {
       LOG(ERROR) << "Failed to update header on a new file, path="
                  << file_ctrl->path << ", errno = " << errno;
@@ -180,78 +326,225 @@ bool AeadHandler::Deserialize(FileControl *file_ctrl) {
 
   FdCloser fd_closer(fd, &enc_untrusted_close);
 
-  // Read the header with digest.
+  // Read the header with digest. Files created before the block length was
+  // recorded in the header have a shorter header without the magic string,
+  // in which case the read extends into the first block and the cursor is
+  // moved back to the end of the header.
   FileHeader file_header;
   ssize_t bytes_read = read_all(fd, file_header.data(), sizeof(FileHeader));
-  if (bytes_read != sizeof(FileHeader)) {
+  if (bytes_read == sizeof(FileHeader) &&
+      memcmp(file_header.magic, kFileHeaderMagic, kFileHeaderMagicLength) ==
+          0) {
+    if (!IsBlockLengthValid(file_header.block_length)) {
+      LOG(ERROR) << "Invalid block length in the file header, block_length = "
+                 << file_header.block_length;
+      return false;
+    }
+    file_ctrl->SetLayout(kFileFormatVersion, file_header.block_length);
+  } else if (bytes_read >= static_cast<ssize_t>(sizeof(LegacyFileHeader))) {
+    LegacyFileHeader legacy_header;
+    std::copy_n(file_header.data(), sizeof(LegacyFileHeader),
+                legacy_header.data());
+    file_header.file_hash = legacy_header.file_hash;
+    file_header.file_size = legacy_header.file_size;
+    file_ctrl->SetLayout(kLegacyHeaderFormatVersion, kDefaultBlockLength);
+    if (enc_untrusted_lseek(fd, sizeof(LegacyFileHeader), SEEK_SET) == -1) {
+      LOG(ERROR) << "Failed lseek to the end of the file header, path = "
+                 << file_ctrl->path;
+      return false;
+    }
+  } else {
     LOG(ERROR) << "Failed to read the file header, bytes read = " << bytes_read;
     return false;
   }
 
+  // Return the blocks overwritten after the last digest update to the state
+  // the header identifies, in case the file was not closed after they were
+  // written.
+  bool restored;
+  if (!UndoJournal::Recover(file_ctrl->path + kUndoJournalFileSuffix,
+                            file_ctrl->secure_block_length(),
+                            file_header.file_hash.data(), file_ctrl->path,
+                            file_ctrl->header_length(), &restored)) {
+    LOG(ERROR) << "Failed to recover the file from its undo journal, path = "
+               << file_ctrl->path;
+    return false;
+  }
+  if (restored) {
+    VLOG(2) << "Restored blocks from the undo journal, path = "
+            << file_ctrl->path;
+  }
+
+  const GcmCryptor *cryptor = GetGcmCryptor(*file_ctrl);
+  if (!cryptor) {
+    return false;
+  }
+
+  // Attach to the persisted Merkle tree if the file hash validates its root and
+  // leaf count. Tree nodes are then read and verified against the root only as
+  // blocks are accessed, so the cost of opening the file does not depend on its
+  // size. Otherwise, the tree file is missing or out of date, for instance
+  // after a crash, or the file is in the legacy format, and the tree is rebuilt
+  // from the auth tags of all blocks.
+  if (file_ctrl->ad->Load()) {
+    FileDigest tree_root;
+    FileHash tree_hash;
+    if (file_ctrl->ad->CurrentRoot(&tree_root) &&
+        GetFileHash(*cryptor, tree_root, file_header.file_size,
+                    file_ctrl->ad->LeafCount(), file_ctrl->format_version,
+                    file_ctrl->block_length, &tree_hash) &&
+        tree_hash == file_header.file_hash) {
+      file_ctrl->logical_size = file_header.file_size;
+      return file_ctrl->Commit(file_header.file_hash);
+    }
+    VLOG(2) << "Persisted Merkle tree does not match the file, rebuilding it, "
+               "path = "
+            << file_ctrl->path;
+    file_ctrl->ad->Reset();
+  }
+
   // In order to validate the integrity metadata and the file size have to first
   // collect integrity metadata across the file using the initially untrusted
   // value of the file size - then validation of the hash of the file digest
   // confirms validity of both the file size and the integrity metadata.
+  const size_t block_length = file_ctrl->block_length;
+  const size_t secure_block_length = file_ctrl->secure_block_length();
   const int64_t blocks_count =
-      (file_header.file_size + kBlockLength - 1) / kBlockLength;
-  Tag tag;
-  for (int64_t block_index = 0; block_index < blocks_count; block_index++) {
-    off_t offset = enc_untrusted_lseek(fd, kBlockLength, SEEK_CUR);
-    if (offset == -1) {
-      LOG(ERROR)
-          << "Failed lseek past block when collecting integrity metadata.";
-      return false;
-    }
-
-    bytes_read = read_all(fd, tag.data(), kTagLength);
-    if (bytes_read != kTagLength) {
+      (file_header.file_size + block_length - 1) / block_length;
+
+  // Blocks are read in large sequential batches, and the auth tags are taken
+  // from the batch in memory, rather than seeking to and reading each auth tag
+  // separately. The ciphertext is read along with the tags, which costs far
+  // less than the per-block host calls it avoids.
+  const int64_t blocks_per_read =
+      std::max<int64_t>(kMetadataReadLength / secure_block_length, 1);
+  std::vector<uint8_t> buffer(std::min(blocks_count, blocks_per_read) *
+                              secure_block_length);
+  for (int64_t block_index = 0; block_index < blocks_count;) {
+    const int64_t blocks_to_read =
+        std::min(blocks_count - block_index, blocks_per_read);
+    const size_t bytes_to_read = blocks_to_read * secure_block_length;
+    bytes_read = read_all(fd, buffer.data(), bytes_to_read);
+    if (bytes_read != bytes_to_read) {
       LOG(ERROR) << "Failed to read integrity metadata, bytes_read="
                  << bytes_read;
       return false;
     }
 
-    std::string tag_string(reinterpret_cast<char *>(tag.data()), kTagLength);
-    VLOG(2) << "Adding auth tag as leaf to rebuild Merkle tree: "
-            << absl::BytesToHexString(tag_string);
-    file_ctrl->ad->AddLeaf(tag_string);
-
-    offset = enc_untrusted_lseek(fd, kTokenLength, SEEK_CUR);
-    if (offset == -1) {
-      LOG(ERROR)
-          << "Failed lseek past token when collecting integrity metadata.";
-      return false;
+    for (int64_t idx = 0; idx < blocks_to_read; idx++) {
+      const uint8_t *tag =
+          buffer.data() + idx * secure_block_length + block_length;
+      file_ctrl->ad->AddLeaf(
+          std::string(reinterpret_cast<const char *>(tag), kTagLength));
     }
+    block_index += blocks_to_read;
   }
 
-  VLOG(2) << "Pushed block auth tags on initialization.";
+  VLOG(2) << "Pushed block auth tags on initialization, blocks_count = "
+          << blocks_count;
 
-  // Prepare file data digest.
-  DataDigest data_digest;
-  std::copy_n(
-      reinterpret_cast<const uint8_t *>(file_ctrl->ad->CurrentRoot().data()),
-      kRootHashLength, data_digest.data());
-  data_digest.file_size = file_header.file_size;
+  FileDigest root;
+  if (!file_ctrl->ad->CurrentRoot(&root)) {
+    LOG(ERROR) << "Failed to compute the AD root, path = " << file_ctrl->path;
+    return false;
+  }
 
-  // Validate AD root and the file size.
+  // Validate AD root, the file size and the blocks count.
   FileHash new_hash;
-  if (!cryptor->GetAuthTag(new_hash.data(), data_digest.data(),
-                           sizeof(DataDigest))) {
-    LOG(ERROR) << "Failed to generate CMAC for integrity verification, root="
-               << file_ctrl->ad->CurrentRoot();
+  if (!GetFileHash(*cryptor, root, file_header.file_size,
+                   file_ctrl->ad->LeafCount(), file_ctrl->format_version,
+                   block_length, &new_hash)) {
     return false;
   }
 
+  bool is_legacy_format = false;
+  if (new_hash != file_header.file_hash &&
+      file_ctrl->format_version == kLegacyHeaderFormatVersion) {
+    // Validate the file against the digest of the legacy format.
+    LegacyDataDigest legacy_digest;
+    std::copy_n(root.data(), kRootHashLength, legacy_digest.data());
+    legacy_digest.file_size = file_header.file_size;
+    if (!cryptor->GetAuthTag(new_hash.data(), legacy_digest.data(),
+                             sizeof(LegacyDataDigest))) {
+      LOG(ERROR) << "Failed to generate CMAC for integrity verification, root="
+                 << DigestToHexString(root);
+      return false;
+    }
+
+    is_legacy_format = true;
+  }
+
   if (new_hash != file_header.file_hash) {
     LOG(ERROR) << "Failure validating integrity root for file "
-               << file_ctrl->path << ", current root: "
-               << absl::BytesToHexString(file_ctrl->ad->CurrentRoot());
+               << file_ctrl->path
+               << ", current root: " << DigestToHexString(root);
     return false;
   }
 
   file_ctrl->logical_size = file_header.file_size;
+  if (!file_ctrl->Commit(file_header.file_hash)) {
+    return false;
+  }
+
+  // Persist the rebuilt tree so that the next open can attach to it, and
+  // migrate a legacy file by rewriting its header with the digest of format
+  // version 1. The header keeps its legacy layout, since the file blocks are
+  // not relocated.
+  // Neither is required to access the file in this session, so a failure, for
+  // instance because the file is read-only, is not fatal.
+  if (!file_ctrl->ad->Flush()) {
+    LOG(WARNING) << "Failed to persist the Merkle tree, path = "
+                 << file_ctrl->path;
+  }
+  if (is_legacy_format) {
+    VLOG(2) << "Migrating file from the legacy format, path = "
+            << file_ctrl->path;
+    if (!UpdateDigest(file_ctrl, *cryptor)) {
+      LOG(WARNING) << "Failed to migrate file from the legacy format, path = "
+                   << file_ctrl->path;
+    }
+  }
+
   return true;
 }
 
+bool AeadHandler::GetFileHash(const GcmCryptor &cryptor,
+                              const FileDigest &root, size_t file_size,
+                              uint64_t leaf_count, uint32_t format_version,
+                              size_t block_length, FileHash *file_hash) const {
+  // Prepare file data digest.
+  DataDigest data_digest;
+  std::copy_n(root.data(), kRootHashLength, data_digest.data());
+  data_digest.file_size = file_size;
+  data_digest.leaf_count = leaf_count;
+  data_digest.format_version = format_version;
+  data_digest.block_length = block_length;
+
+  // The digest of format version 1 ends before the block length.
+  const size_t digest_length = (format_version >= kFileFormatVersion)
+                                   ? sizeof(DataDigest)
+                                   : offsetof(DataDigest, block_length);
+  if (!cryptor.GetAuthTag(file_hash->data(), data_digest.data(),
+                          digest_length)) {
+    LOG(ERROR) << "Failed to generate CMAC, root = "
+               << DigestToHexString(root);
+    return false;
+  }
+
+  return true;
+}
+
+AeadHandler::FdMapShard &AeadHandler::GetFdMapShard(int fd) {
+  return fd_map_shards_[static_cast<unsigned int>(fd) % kFdMapShardCount];
+}
+
+std::shared_ptr<AeadHandler::FileControl> AeadHandler::GetFileControl(int fd) {
+  FdMapShard &shard = GetFdMapShard(fd);
+  absl::ReaderMutexLock shard_lock(&shard.mu);
+  auto entry = shard.fmap.find(fd);
+  return entry == shard.fmap.end() ? nullptr : entry->second;
+}
+
 bool AeadHandler::InitializeFile(int fd, const char *path_name,
                                  bool is_new_file) {
   if (!IsPathNameValid(path_name)) {
@@ -262,9 +555,11 @@ bool AeadHandler::InitializeFile(int fd, const char *path_name,
   }
 
   absl::MutexLock global_lock(&mu_);
+  FdMapShard &shard = GetFdMapShard(fd);
+  absl::MutexLock shard_lock(&shard.mu);
 
-  auto fd_it = fmap_.find(fd);
-  if (fd_it != fmap_.end()) {
+  auto fd_it = shard.fmap.find(fd);
+  if (fd_it != shard.fmap.end()) {
     LOG(ERROR) << "Attempt made to initialize already initialized file, fd="
                << fd << ", path_name = " << path_name
                << ", is_new_file = " << is_new_file;
@@ -277,27 +572,40 @@ bool AeadHandler::InitializeFile(int fd, const char *path_name,
   auto path_it = opened_files_.find(path_name);
   std::shared_ptr<FileControl> file_ctrl =
       (path_it == opened_files_.end())
-          ? std::make_shared<FileControl>(path_name, is_new_file)
+          ? std::make_shared<FileControl>(path_name, is_new_file,
+                                          block_cache_capacity_,
+                                          crypto_thread_count_,
+                                          read_ahead_length_)
           : path_it->second;
-  fmap_.emplace(fd, file_ctrl);
+  shard.fmap.emplace(fd, file_ctrl);
   opened_files_.emplace(path_name, file_ctrl);
 
   return true;
 }
 
-bool AeadHandler::RetrieveLogicalOffset(int fd, off_t *logical_offset) const {
+bool AeadHandler::RetrieveLogicalOffset(int fd, const FileControl &file_ctrl,
+                                        off_t *logical_offset) const {
+  file_ctrl.mu.AssertReaderHeld();
   if (fd < 0) {
     errno = EINVAL;
     return false;
   }
 
+  if (!file_ctrl.is_deserialized) {
+    LOG(ERROR) << "Attempt made to access a file before setting the key, fd = "
+               << fd;
+    errno = EACCES;
+    return false;
+  }
+
   off_t physical_offset = enc_untrusted_lseek(fd, 0, SEEK_CUR);
   if (physical_offset == -1) {
     LOG(ERROR) << "Failed to retrieve SEEK_CUR offset on descriptor: " << fd;
     return false;
   }
 
-  *logical_offset = offset_translator_->PhysicalToLogical(physical_offset);
+  *logical_offset =
+      file_ctrl.offset_translator->PhysicalToLogical(physical_offset);
   if (*logical_offset == OffsetTranslator::kInvalidOffset) {
     LOG(ERROR) << "The file is corrupted, fd = " << fd;
     return false;
@@ -306,15 +614,34 @@ bool AeadHandler::RetrieveLogicalOffset(int fd, off_t *logical_offset) const {
   return true;
 }
 
-GcmCryptor *AeadHandler::GetGcmCryptor(const FileControl &file_ctrl) const {
+bool AeadHandler::InitializeCursor(int fd,
+                                   const FileControl &file_ctrl) const {
   file_ctrl.mu.AssertHeld();
+  off_t physical_offset = enc_untrusted_lseek(fd, 0, SEEK_CUR);
+  if (physical_offset == -1) {
+    LOG(ERROR) << "Failed to retrieve SEEK_CUR offset on descriptor: " << fd;
+    return false;
+  }
+
+  if (physical_offset == 0 &&
+      enc_untrusted_lseek(fd, file_ctrl.header_length(), SEEK_SET) == -1) {
+    LOG(ERROR) << "Failed to initialize cursor to the logical offset of 0, fd="
+               << fd;
+    return false;
+  }
+
+  return true;
+}
+
+GcmCryptor *AeadHandler::GetGcmCryptor(const FileControl &file_ctrl) const {
+  file_ctrl.mu.AssertReaderHeld();
   if (!file_ctrl.master_key) {
     LOG(ERROR) << "Master key has not been set, path = " << file_ctrl.path;
     return nullptr;
   }
 
   GcmCryptor *cryptor = GcmCryptorRegistry::GetInstance().GetGcmCryptor(
-      kBlockLength, *file_ctrl.master_key);
+      file_ctrl.block_length, *file_ctrl.master_key);
   if (!cryptor) {
     LOG(ERROR) << "Unable to instantiate GCM cryptor.";
   }
@@ -328,33 +655,136 @@ ssize_t AeadHandler::DecryptAndVerify(int fd, void *buf, size_t count) {
     return -1;
   }
 
+  std::shared_ptr<FileControl> file_ctrl = GetFileControl(fd);
+  if (!file_ctrl) {
+    LOG(ERROR) << "Attempt made to read from an unopened file, fd = " << fd;
+    errno = ENOENT;
+    return -1;
+  }
+
+  // The cursor of |fd| is moved, hence the file lock is taken exclusively.
+  absl::MutexLock lock(&file_ctrl->mu);
+
   off_t logical_offset;
-  if (!RetrieveLogicalOffset(fd, &logical_offset)) {
+  if (!RetrieveLogicalOffset(fd, *file_ctrl, &logical_offset)) {
     return -1;
   }
 
-  std::shared_ptr<FileControl> file_ctrl;
-  {
-    absl::MutexLock global_lock(&mu_);
+  ssize_t read_count =
+      DecryptAndVerifyInternal(fd, buf, count, *file_ctrl, logical_offset);
+  if (read_count <= 0) {
+    return read_count;
+  }
+  RecordRead(*file_ctrl, logical_offset, read_count);
 
-    auto entry = fmap_.find(fd);
-    if (entry == fmap_.end()) {
-      LOG(ERROR) << "Attempt made to read from an unopened file, fd = " << fd;
-      errno = ENOENT;
-      return -1;
+  // Move cursor to the position of the end of the read range.
+  const off_t new_cur_physical_offset =
+      file_ctrl->offset_translator->LogicalToPhysical(logical_offset +
+                                                      read_count);
+  if (enc_untrusted_lseek(fd, new_cur_physical_offset, SEEK_SET) == -1) {
+    LOG(ERROR) << "Failed lseek to the end of read range.";
+    return -1;
+  }
+
+  return read_count;
+}
+
+ssize_t AeadHandler::DecryptAndVerify(int fd, void *buf, size_t count,
+                                      off_t offset) {
+  if (!buf || offset < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  std::shared_ptr<FileControl> file_ctrl = GetFileControl(fd);
+  if (!file_ctrl) {
+    LOG(ERROR) << "Attempt made to read from an unopened file, fd = " << fd;
+    errno = ENOENT;
+    return -1;
+  }
+
+  // Positional reads leave the cursor of |fd| as is, and share the file lock
+  // with each other.
+  absl::ReaderMutexLock lock(&file_ctrl->mu);
+
+  if (!file_ctrl->is_deserialized) {
+    LOG(ERROR) << "Attempt made to access a file before setting the key, fd = "
+               << fd;
+    errno = EACCES;
+    return -1;
+  }
+
+  ssize_t read_count =
+      DecryptAndVerifyInternal(fd, buf, count, *file_ctrl, offset);
+  if (read_count > 0) {
+    RecordRead(*file_ctrl, offset, read_count);
+  }
+  return read_count;
+}
+
+void AeadHandler::RecordRead(const FileControl &file_ctrl,
+                             off_t logical_offset, size_t read_count) const {
+  if (!file_ctrl.read_ahead) {
+    return;
+  }
+  const uint64_t first_block = logical_offset / file_ctrl.block_length;
+  const uint64_t last_block =
+      (logical_offset + read_count - 1) / file_ctrl.block_length;
+  file_ctrl.read_ahead->RecordRead(first_block, last_block - first_block + 1);
+}
+
+void AeadHandler::PrefetchBlocks(FileControl *file_ctrl, uint64_t first_block,
+                                 uint64_t count) {
+  // Writes to the file wait for the fetch, and update the cache after it, so
+  // that the cache never holds stale blocks.
+  absl::ReaderMutexLock lock(&file_ctrl->mu);
+  if (!file_ctrl->is_deserialized) {
+    return;
+  }
+
+  // Only the worker thread uses the descriptor until the file control is
+  // destroyed.
+  if (file_ctrl->read_ahead_fd == -1) {
+    file_ctrl->read_ahead_fd =
+        enc_untrusted_open(file_ctrl->path.c_str(), O_RDONLY);
+    if (file_ctrl->read_ahead_fd == -1) {
+      LOG(WARNING) << "Failed to open file for read-ahead, path = "
+                   << file_ctrl->path << ", errno = " << errno;
+      return;
     }
+  }
 
-    file_ctrl = entry->second;
+  // Skip the blocks already cached at the ends of the range, and blocks past
+  // the end of the file.
+  const size_t block_length = file_ctrl->block_length;
+  const uint64_t blocks_in_file =
+      (file_ctrl->logical_size + block_length - 1) / block_length;
+  uint64_t end_block = std::min(first_block + count, blocks_in_file);
+  while (first_block < end_block &&
+         file_ctrl->block_cache->Contains(first_block)) {
+    first_block++;
+  }
+  while (first_block < end_block &&
+         file_ctrl->block_cache->Contains(end_block - 1)) {
+    end_block--;
+  }
+  if (first_block == end_block) {
+    return;
   }
 
-  absl::MutexLock lock(&file_ctrl->mu);
-  return DecryptAndVerifyInternal(fd, buf, count, *file_ctrl, logical_offset);
+  // Reading the blocks verifies them and puts them in the cache.
+  std::vector<uint8_t> buffer((end_block - first_block) * block_length);
+  if (DecryptAndVerifyInternal(file_ctrl->read_ahead_fd, buffer.data(),
+                               buffer.size(), *file_ctrl,
+                               first_block * block_length) < 0) {
+    VLOG(2) << "Read-ahead failed, path = " << file_ctrl->path;
+  }
 }
 
 ssize_t AeadHandler::DecryptAndVerifyInternal(int fd, void *buf, size_t count,
                                               const FileControl &file_ctrl,
                                               off_t logical_offset) const {
-  file_ctrl.mu.AssertHeld();
+  file_ctrl.mu.AssertReaderHeld();
   if (count == 0) {
     return 0;
   }
@@ -369,165 +799,183 @@ ssize_t AeadHandler::DecryptAndVerifyInternal(int fd, void *buf, size_t count,
     count = file_ctrl.logical_size - logical_offset;
   }
 
+  const size_t block_length = file_ctrl.block_length;
+  const size_t cipher_block_length = block_length + kTagLength;
+  const size_t secure_block_length = file_ctrl.secure_block_length();
+
   // Determine data breakdown into logical blocks.
   size_t first_partial_block_bytes_count;
   size_t last_partial_block_bytes_count;
   size_t full_inclusive_blocks_bytes_count;
-  offset_translator_->ReduceLogicalRangeToFullLogicalBlocks(
+  file_ctrl.offset_translator->ReduceLogicalRangeToFullLogicalBlocks(
       logical_offset, count, &first_partial_block_bytes_count,
       &last_partial_block_bytes_count, &full_inclusive_blocks_bytes_count);
 
+  // Offset of the range in its first block. Note that the first partial block
+  // bytes count is less than the rest of the first block when the range ends
+  // in the same block.
+  const size_t first_block_offset = logical_offset % block_length;
+
+  const off_t first_logical_block_offset = logical_offset - first_block_offset;
+  const uint64_t first_block_index = first_logical_block_offset / block_length;
+  const int64_t blocks_count = full_inclusive_blocks_bytes_count / block_length;
+  const size_t physical_bytes_count = blocks_count * secure_block_length;
+
+  // Bounce blocks for reading partial blocks at the ends of the full range.
+  std::vector<uint8_t> first_bounce_block(block_length);
+  std::vector<uint8_t> last_bounce_block(block_length);
+
+  // Determine the target of each block depending on whether it is at the end
+  // of the full range - bounce block or the supplied buffer. A cached block
+  // holds verified plaintext, and is copied to its target without being read
+  // from the host.
+  std::vector<uint8_t *> targets(blocks_count);
+  std::vector<bool> cached(blocks_count);
+  bool all_blocks_cached = true;
+  for (int64_t block_index = 0; block_index < blocks_count; block_index++) {
+    if (block_index == 0 && first_partial_block_bytes_count > 0) {
+      targets[block_index] = first_bounce_block.data();
+    } else if (block_index == blocks_count - 1 &&
+               last_partial_block_bytes_count > 0) {
+      targets[block_index] = last_bounce_block.data();
+    } else {
+      targets[block_index] = GetPlaintextBuffer(
+          block_length, first_partial_block_bytes_count, block_index, buf);
+    }
+    cached[block_index] = file_ctrl.block_cache->Get(
+        first_block_index + block_index, targets[block_index]);
+    all_blocks_cached = all_blocks_cached && cached[block_index];
+  }
+
   // Use single read buffer to minimize the number of read calls to the host.
+  // The range is read at its offset, leaving the cursor of |fd| as is.
   std::vector<uint8_t> buffer;
-  const size_t physical_bytes_count =
-      (full_inclusive_blocks_bytes_count / kBlockLength) * kSecureBlockLength;
-  buffer.resize(physical_bytes_count);
-
-  // Move cursor to the first full block to read.
-  const off_t first_logical_block_offset =
-      (first_partial_block_bytes_count > 0)
-          ? (logical_offset + first_partial_block_bytes_count - kBlockLength)
-          : logical_offset;
-  const off_t first_physical_block_offset =
-      offset_translator_->LogicalToPhysical(first_logical_block_offset);
-  if (first_partial_block_bytes_count > 0) {
-    off_t offset =
-        enc_untrusted_lseek(fd, first_physical_block_offset, SEEK_SET);
-    if (offset == -1) {
-      LOG(ERROR)
-          << "Failed lseek to the fist block offset when reading file data.";
+  ssize_t bytes_read = physical_bytes_count;
+  if (!all_blocks_cached) {
+    buffer.resize(physical_bytes_count);
+
+    // Perform the read. Read may have been requested beyond EOF - cannot
+    // require that bytes_read is equal to physical_bytes_count. The read was
+    // not requested at EOF - checked this above.
+    bytes_read = pread_all(
+        fd, buffer.data(), physical_bytes_count,
+        file_ctrl.offset_translator->LogicalToPhysical(
+            first_logical_block_offset));
+    if (bytes_read <= 0) {
+      LOG(ERROR) << "Cannot verify data - data has not been read, fd = " << fd;
       return -1;
     }
   }
 
-  // Perform the read. Read may have been requested beyond EOF - cannot require
-  // that bytes_read is equal to physical_bytes_count. The read was not
-  // requested at EOF - checked this above.
-  ssize_t bytes_read =
-      enc_untrusted_read(fd, buffer.data(), physical_bytes_count);
-  if (bytes_read <= 0) {
-    LOG(ERROR) << "Cannot verify data - data has not been read, fd = " << fd;
-    return -1;
-  }
-
   // Process only complete blocks read, since need per-block metadata to decrypt
   // the block.
-  bytes_read = (bytes_read / kSecureBlockLength) * kSecureBlockLength;
+  bytes_read = (bytes_read / secure_block_length) * secure_block_length;
   if (bytes_read == 0) {
     LOG(ERROR) << "Cannot verify data - data has not been read, fd = " << fd;
     return -1;
   }
 
-  // Move cursor to the position of the end of the read range.
-  off_t new_cur_logical_offset = logical_offset + count;
-  if (bytes_read != physical_bytes_count) {
-    int64_t blocks_not_read =
-        (physical_bytes_count - bytes_read) / kSecureBlockLength;
-    if (last_partial_block_bytes_count > 0) {
-      new_cur_logical_offset -= last_partial_block_bytes_count;
-      blocks_not_read--;
-    }
-    new_cur_logical_offset -= blocks_not_read * kBlockLength;
-  }
-  const off_t new_cur_physical_offset =
-      offset_translator_->LogicalToPhysical(new_cur_logical_offset);
-  off_t offset = enc_untrusted_lseek(fd, new_cur_physical_offset, SEEK_SET);
-  if (offset == -1) {
-    LOG(ERROR) << "Failed lseek to the end of read range.";
-    return -1;
-  }
-
   GcmCryptor *cryptor = GetGcmCryptor(file_ctrl);
   if (!cryptor) {
     return -1;
   }
 
-  // Cycle through blocks.
-  const int64_t blocks_read = bytes_read / kSecureBlockLength;
-  const int64_t blocks_read_max = physical_bytes_count / kSecureBlockLength;
-  const off_t first_block_index =
-      (first_physical_block_offset - sizeof(FileHeader)) / kSecureBlockLength;
-  size_t read_count = 0;
-  for (int64_t block_index = 0; block_index < blocks_read; block_index++) {
-    const size_t merkle_block_idx = first_block_index + block_index + 1;
-
-    uint8_t *plaintext_data =
-        GetPlaintextBuffer(first_partial_block_bytes_count, block_index, buf);
-
-    // Detect full blocks that belong to sparse regions in the file - no need to
-    // decrypt.
-    if (file_ctrl.ad->LeafHash(merkle_block_idx) == file_ctrl.zero_hash) {
-      VLOG(2) << "A sparse region block detected.";
-      memset(plaintext_data, 0, kBlockLength);
-      read_count += kBlockLength;
-      continue;
-    }
-
-    CiphertextView ciphertext(buffer.data() + block_index * kSecureBlockLength,
-                              kCipherBlockLength);
-    VLOG(2) << "Ciphertext read: "
-            << absl::BytesToHexString(absl::string_view(
-                   reinterpret_cast<const char *>(ciphertext.data()),
-                   kCipherBlockLength));
+  // Blocks to decrypt, along with their tokens and decryption targets.
+  std::vector<uint64_t> decrypt_indices;
+  std::vector<const uint8_t *> decrypt_ciphertexts;
+  std::vector<const uint8_t *> decrypt_tokens;
+  std::vector<uint8_t *> decrypt_targets;
 
-    TagView tag(buffer.data() + block_index * kSecureBlockLength + kBlockLength,
-                kTagLength);
-    VLOG(2) << "Auth tag read: "
-            << absl::BytesToHexString(absl::string_view(
-                   reinterpret_cast<const char *>(tag.data()), kTagLength));
-
-    TokenView token(
-        buffer.data() + block_index * kSecureBlockLength + kCipherBlockLength,
-        kTokenLength);
-    VLOG(2) << "Token read: "
-            << absl::BytesToHexString(absl::string_view(
-                   reinterpret_cast<const char *>(token.data()), kTokenLength));
-
-    // Note: Verifying integrity tag will be replaced with integrity
-    // verification against AD root if/when AD tree will be stored in a file
-    // (i.e. if/when optimizing integrity assurance for large files).
-    if (file_ctrl.ad->LeafHash(merkle_block_idx) !=
-        file_ctrl.ad->LeafHash(std::string(
-            reinterpret_cast<const char *>(tag.data()), kTagLength))) {
-      LOG(ERROR) << "Integrity verification failed, fd = " << fd;
-      return -1;
+  // Cycle through blocks, verifying the blocks to decrypt. Concurrent readers
+  // share the file lock, and take turns at the AD.
+  const int64_t blocks_read = bytes_read / secure_block_length;
+  {
+    absl::MutexLock ad_lock(&file_ctrl.ad_mu);
+    for (int64_t block_index = 0; block_index < blocks_read; block_index++) {
+      if (cached[block_index]) {
+        continue;
+      }
+
+      const size_t merkle_block_idx = first_block_index + block_index + 1;
+      uint8_t *decrypt_target = targets[block_index];
+
+      // Detect blocks that belong to sparse regions in the file - no need to
+      // decrypt.
+      if (file_ctrl.ad->LeafHash(merkle_block_idx) == file_ctrl.zero_hash) {
+        VLOG(2) << "A sparse region block detected.";
+        memset(decrypt_target, 0, block_length);
+        continue;
+      }
+
+      const uint8_t *secure_block =
+          buffer.data() + block_index * secure_block_length;
+      CiphertextView ciphertext(secure_block, cipher_block_length);
+      VLOG(2) << "Ciphertext read: "
+              << absl::BytesToHexString(absl::string_view(
+                     reinterpret_cast<const char *>(ciphertext.data()),
+                     cipher_block_length));
+
+      TagView tag(secure_block + block_length, kTagLength);
+      VLOG(2) << "Auth tag read: "
+              << absl::BytesToHexString(absl::string_view(
+                     reinterpret_cast<const char *>(tag.data()), kTagLength));
+
+      TokenView token(secure_block + cipher_block_length, kTokenLength);
+      VLOG(2) << "Token read: "
+              << absl::BytesToHexString(absl::string_view(
+                     reinterpret_cast<const char *>(token.data()),
+                     kTokenLength));
+
+      // The leaf hash is verified against the AD root, which is authenticated
+      // by the file hash.
+      if (file_ctrl.ad->LeafHash(merkle_block_idx) !=
+          file_ctrl.ad->LeafHash(std::string(
+              reinterpret_cast<const char *>(tag.data()), kTagLength))) {
+        LOG(ERROR) << "Integrity verification failed, fd = " << fd;
+        return -1;
+      }
+
+      decrypt_indices.push_back(first_block_index + block_index);
+      decrypt_ciphertexts.push_back(ciphertext.data());
+      decrypt_tokens.push_back(token.data());
+      decrypt_targets.push_back(decrypt_target);
     }
+  }
 
-    // Bounce block for reading partial blocks at the ends of the full range.
-    Block bounce_block;
-    // Target for decryption - bounce block or the supplied buffer.
-    uint8_t *decrypt_target;
-    // Determine the target depending on whether the read block is at the end of
-    // the full range.
-    if ((block_index == 0 && first_partial_block_bytes_count > 0) ||
-        (block_index == blocks_read_max - 1 &&
-         last_partial_block_bytes_count > 0)) {
-      decrypt_target = bounce_block.data();
-    } else {
-      decrypt_target = plaintext_data;
-    }
+  // Decrypt the verified blocks.
+  if (!ProcessBlocks(
+          decrypt_indices.size(), block_length, file_ctrl.crypto_thread_count,
+          &crypto_workers_, [&](size_t begin, size_t end) {
+            return cryptor->DecryptBlocks(
+                end - begin, decrypt_ciphertexts.data() + begin,
+                decrypt_tokens.data() + begin, decrypt_targets.data() + begin);
+          })) {
+    LOG(ERROR) << "Decryption failed, fd = " << fd;
+    return -1;
+  }
 
-    // Decrypt the block.
-    if (!cryptor->DecryptBlock(ciphertext.data(), token.data(),
-                               decrypt_target)) {
-      LOG(ERROR) << "Decryption failed, fd = " << fd;
-      return -1;
-    }
+  // Keep the verified plaintext for later accesses to the blocks.
+  for (size_t idx = 0; idx < decrypt_indices.size(); idx++) {
+    file_ctrl.block_cache->Put(decrypt_indices[idx], decrypt_targets[idx]);
+  }
 
-    // Copy content from the bounce buffer, if used. Increment the count of read
-    // bytes.
+  // Copy content from the bounce blocks, if used. Count the read bytes.
+  size_t read_count = 0;
+  for (int64_t block_index = 0; block_index < blocks_read; block_index++) {
+    uint8_t *plaintext_data =
+        GetPlaintextBuffer(block_length, first_partial_block_bytes_count,
+                           block_index, buf);
     if (block_index == 0 && first_partial_block_bytes_count > 0) {
-      std::copy_n(
-          bounce_block.begin() + kBlockLength - first_partial_block_bytes_count,
-          first_partial_block_bytes_count, plaintext_data);
+      std::copy_n(first_bounce_block.begin() + first_block_offset,
+                  first_partial_block_bytes_count, plaintext_data);
       read_count += first_partial_block_bytes_count;
-    } else if (block_index == blocks_read_max - 1 &&
+    } else if (block_index == blocks_count - 1 &&
                last_partial_block_bytes_count > 0) {
-      std::copy_n(bounce_block.begin(), last_partial_block_bytes_count,
+      std::copy_n(last_bounce_block.begin(), last_partial_block_bytes_count,
                   plaintext_data);
       read_count += last_partial_block_bytes_count;
     } else {
-      read_count += kBlockLength;
+      read_count += block_length;
     }
   }
 
@@ -544,62 +992,118 @@ bool AeadHandler::UpdateDigest(FileControl *file_ctrl,
   }
   file_ctrl->mu.AssertHeld();
 
-  int fd = enc_untrusted_open(file_ctrl->path.c_str(), O_WRONLY);
-  if (fd == -1) {
-    LOG(ERROR) << "Failed to open file to save data digest, path="
-               << file_ctrl->path << ", errno = " << errno;
+  // The descriptor is kept open for the following updates, so that updating
+  // the header costs a single host call.
+  if (!file_ctrl->OpenHostFd()) {
     return false;
   }
 
-  FdCloser fd_closer(fd, &enc_untrusted_close);
-
-  std::string root = file_ctrl->ad->CurrentRoot();
-  if (root.size() != kRootHashLength) {
-    LOG(ERROR) << "Unexpected size of root hash encountered, size="
-               << root.size();
+  FileDigest root;
+  if (!file_ctrl->ad->CurrentRoot(&root)) {
+    LOG(ERROR) << "Failed to compute the AD root, path = " << file_ctrl->path;
     return false;
   }
-
-  // Prepare file data digest.
-  DataDigest data_digest;
-  std::copy_n(reinterpret_cast<const uint8_t *>(root.data()), kRootHashLength,
-              data_digest.data());
-  data_digest.file_size = file_ctrl->logical_size;
-
   FileHeader header;
-  if (!cryptor.GetAuthTag(header.data(), data_digest.data(),
-                          sizeof(DataDigest))) {
-    LOG(ERROR) << "Failed to generate CMAC, root = " << root;
+  std::copy_n(kFileHeaderMagic, kFileHeaderMagicLength, header.magic);
+  if (!GetFileHash(cryptor, root, file_ctrl->logical_size,
+                   file_ctrl->ad->LeafCount(), file_ctrl->format_version,
+                   file_ctrl->block_length, &header.file_hash)) {
     return false;
   }
   header.file_size = file_ctrl->logical_size;
+  header.block_length = file_ctrl->block_length;
+
+  // Files with the legacy header keep its layout.
+  const size_t header_length = file_ctrl->header_length();
+  const uint8_t *header_data = header.data();
+  LegacyFileHeader legacy_header;
+  if (header_length == sizeof(LegacyFileHeader)) {
+    legacy_header.file_hash = header.file_hash;
+    legacy_header.file_size = header.file_size;
+    header_data = legacy_header.data();
+  }
 
   VLOG(2) << "Updating the digest for file: " << file_ctrl->path
-          << ", root hash: " << absl::BytesToHexString(root);
-  ssize_t bytes_written = write_all(fd, header.data(), sizeof(FileHeader));
-  if (bytes_written != sizeof(FileHeader)) {
+          << ", root hash: " << DigestToHexString(root);
+  if (!pwrite_all(file_ctrl->host_fd, header_data, header_length, 0)) {
     LOG(ERROR) << "Failed to write full digest to file, path="
-               << file_ctrl->path << ", bytes written = " << bytes_written;
+               << file_ctrl->path << ", errno = " << errno;
     return false;
   }
 
-  if (!fd_closer.reset()) {
-    LOG(ERROR) << "Failed to close the file after digest update, path="
-               << file_ctrl->path;
+  return file_ctrl->Commit(header.file_hash);
+}
+
+bool AeadHandler::CommitPendingWrites(FileControl *file_ctrl) const {
+  file_ctrl->mu.AssertHeld();
+  if (file_ctrl->pending_writes == 0) {
+    return true;
+  }
+
+  const GcmCryptor *cryptor = GetGcmCryptor(*file_ctrl);
+  if (!cryptor) {
     return false;
   }
 
-  return true;
+  return UpdateDigest(file_ctrl, *cryptor);
+}
+
+bool AeadHandler::RecordCommittedBlocks(FileControl *file_ctrl,
+                                        uint64_t first_block_index,
+                                        uint64_t blocks_count) const {
+  file_ctrl->mu.AssertHeld();
+
+  // Blocks past the committed ones are not covered by the header, and blocks
+  // recorded earlier in the interval already have their committed images in
+  // the journal.
+  uint64_t begin = first_block_index;
+  uint64_t end = std::min(first_block_index + blocks_count,
+                          file_ctrl->committed_leaf_count);
+  while (begin < end && file_ctrl->journal->IsRecorded(begin)) {
+    begin++;
+  }
+  while (end > begin && file_ctrl->journal->IsRecorded(end - 1)) {
+    end--;
+  }
+  if (begin >= end) {
+    return true;
+  }
+
+  if (!file_ctrl->OpenHostFd()) {
+    return false;
+  }
+
+  // Blocks in a sparse region may be missing from the end of the file, and
+  // read as zeros.
+  const size_t secure_block_length = file_ctrl->secure_block_length();
+  std::vector<uint8_t> blocks((end - begin) * secure_block_length);
+  ssize_t bytes_read =
+      pread_all(file_ctrl->host_fd, blocks.data(), blocks.size(),
+                file_ctrl->header_length() + begin * secure_block_length);
+  if (bytes_read == -1) {
+    LOG(ERROR) << "Failed to read blocks to journal, path=" << file_ctrl->path
+               << ", errno = " << errno;
+    return false;
+  }
+  std::fill(blocks.begin() + bytes_read, blocks.end(), 0);
+
+  return file_ctrl->journal->Record(begin, blocks.data(), end - begin);
 }
 
 bool AeadHandler::ReadFullBlock(const FileControl &file_ctrl,
-                                off_t logical_offset, Block *block) const {
-  file_ctrl.mu.AssertHeld();
-  if (logical_offset < 0 || logical_offset % kBlockLength != 0) {
+                                off_t logical_offset, uint8_t *block) const {
+  file_ctrl.mu.AssertReaderHeld();
+  const size_t block_length = file_ctrl.block_length;
+  if (logical_offset < 0 || logical_offset % block_length != 0) {
     errno = EINVAL;
     return false;
   }
 
+  // A cached block is read without host calls.
+  if (file_ctrl.block_cache->Get(logical_offset / block_length, block)) {
+    return true;
+  }
+
   int fd = enc_untrusted_open(file_ctrl.path.c_str(), O_RDONLY);
   if (fd == -1) {
     LOG(ERROR) << "Failed to open file to read a block, path=" << file_ctrl.path
@@ -609,21 +1113,14 @@ bool AeadHandler::ReadFullBlock(const FileControl &file_ctrl,
 
   FdCloser fd_closer(fd, &enc_untrusted_close);
 
-  off_t physical_offset = offset_translator_->LogicalToPhysical(logical_offset);
-  off_t offset = enc_untrusted_lseek(fd, physical_offset, SEEK_SET);
-  if (offset == -1) {
-    LOG(ERROR) << "Failed lseek when reading a full block.";
-    return false;
-  }
-
-  ssize_t bytes_read = DecryptAndVerifyInternal(fd, block->data(), kBlockLength,
+  ssize_t bytes_read = DecryptAndVerifyInternal(fd, block, block_length,
                                                 file_ctrl, logical_offset);
   if (bytes_read == -1) {
     return -1;
   }
 
-  if (bytes_read < kBlockLength) {
-    memset(block->data() + bytes_read, 0, kBlockLength - bytes_read);
+  if (bytes_read < block_length) {
+    memset(block + bytes_read, 0, block_length - bytes_read);
   }
 
   return true;
@@ -635,63 +1132,80 @@ ssize_t AeadHandler::EncryptAndPersist(int fd, const void *buf, size_t count) {
     return -1;
   }
 
-  off_t logical_offset;
-  if (!RetrieveLogicalOffset(fd, &logical_offset)) {
+  std::shared_ptr<FileControl> file_ctrl = GetFileControl(fd);
+  if (!file_ctrl) {
+    LOG(ERROR) << "Attempt made to write to an unopened file, fd = " << fd;
+    errno = ENOENT;
     return -1;
   }
 
-  std::shared_ptr<FileControl> file_ctrl;
-  {
-    absl::MutexLock global_lock(&mu_);
+  if (count == 0) {
+    return 0;
+  }
 
-    auto entry = fmap_.find(fd);
-    if (entry == fmap_.end()) {
-      LOG(ERROR) << "Attempt made to write to an unopened file, fd = " << fd;
-      errno = ENOENT;
-      return -1;
-    }
+  absl::MutexLock lock(&file_ctrl->mu);
 
-    file_ctrl = entry->second;
+  off_t logical_offset;
+  if (!RetrieveLogicalOffset(fd, *file_ctrl, &logical_offset)) {
+    return -1;
   }
 
-  if (count == 0) {
-    return 0;
+  // Unless the digest is updated on every write, the write is journaled.
+  if (EncryptAndPersistInternal(
+          fd, buf, count, file_ctrl.get(), logical_offset,
+          /*journal=*/file_ctrl->digest_update_interval != 1) == -1 ||
+      !CountWrite(file_ctrl.get())) {
+    return -1;
   }
+  return count;
+}
 
-  absl::MutexLock lock(&file_ctrl->mu);
+ssize_t AeadHandler::EncryptAndPersistInternal(int fd, const void *buf,
+                                               size_t count,
+                                               FileControl *file_ctrl,
+                                               off_t logical_offset,
+                                               bool journal) const {
+  file_ctrl->mu.AssertHeld();
+  const size_t block_length = file_ctrl->block_length;
+  const size_t cipher_block_length = block_length + kTagLength;
+  const size_t secure_block_length = file_ctrl->secure_block_length();
 
   // Determine data breakdown into logical blocks.
   size_t first_partial_block_bytes_count;
   size_t last_partial_block_bytes_count;
   size_t full_inclusive_blocks_bytes_count;
-  offset_translator_->ReduceLogicalRangeToFullLogicalBlocks(
+  file_ctrl->offset_translator->ReduceLogicalRangeToFullLogicalBlocks(
       logical_offset, count, &first_partial_block_bytes_count,
       &last_partial_block_bytes_count, &full_inclusive_blocks_bytes_count);
 
+  // Offset of the range in its first block. Note that the first partial block
+  // bytes count is less than the rest of the first block when the range ends
+  // in the same block.
+  const size_t first_block_offset = logical_offset % block_length;
+  const off_t first_logical_block_offset = logical_offset - first_block_offset;
+
   // Bounce block for writing the first partial block in the range, if any.
-  Block first_block;
+  std::vector<uint8_t> first_block(block_length);
   if (first_partial_block_bytes_count > 0) {
-    if (!ReadFullBlock(
-            *file_ctrl,
-            logical_offset + first_partial_block_bytes_count - kBlockLength,
-            &first_block)) {
+    if (!ReadFullBlock(*file_ctrl, first_logical_block_offset,
+                       first_block.data())) {
       LOG(ERROR)
           << "failed to read the first misaligned block when writing, fd = "
           << fd;
       return -1;
     }
 
-    std::copy_n(
-        reinterpret_cast<const uint8_t *>(buf), first_partial_block_bytes_count,
-        first_block.data() + kBlockLength - first_partial_block_bytes_count);
+    std::copy_n(reinterpret_cast<const uint8_t *>(buf),
+                first_partial_block_bytes_count,
+                first_block.data() + first_block_offset);
   }
 
   // Bounce block for writing the last partial block in the range, if any.
-  Block last_block;
+  std::vector<uint8_t> last_block(block_length);
   if (last_partial_block_bytes_count > 0) {
     if (!ReadFullBlock(*file_ctrl,
                        logical_offset + count - last_partial_block_bytes_count,
-                       &last_block)) {
+                       last_block.data())) {
       LOG(ERROR)
           << "failed to read the last misaligned block when writing, fd = "
           << fd;
@@ -703,19 +1217,16 @@ ssize_t AeadHandler::EncryptAndPersist(int fd, const void *buf, size_t count) {
                 last_partial_block_bytes_count, last_block.data());
   }
 
-  const off_t first_logical_block_offset =
-      (first_partial_block_bytes_count > 0)
-          ? (logical_offset + first_partial_block_bytes_count - kBlockLength)
-          : logical_offset;
   const off_t first_physical_block_offset =
-      offset_translator_->LogicalToPhysical(first_logical_block_offset);
+      file_ctrl->offset_translator->LogicalToPhysical(
+          first_logical_block_offset);
   const int64_t eof_block_index = file_ctrl->ad->LeafCount();
   int64_t start_block_to_write = 0;
   if (first_physical_block_offset > file_ctrl->physical_size()) {
     // Append leafs to the Merkle Tree to account for sparse region blocks.
     int64_t sparse_blocks_count =
         (first_physical_block_offset - file_ctrl->physical_size()) /
-        kSecureBlockLength;
+        secure_block_length;
     for (int64_t idx = 0; idx < sparse_blocks_count; idx++) {
       VLOG(2) << "Adding an empty auth tag to AD for a block "
                  "from a sparse region: "
@@ -726,7 +1237,7 @@ ssize_t AeadHandler::EncryptAndPersist(int fd, const void *buf, size_t count) {
   } else {
     int64_t blocks_to_eof =
         (file_ctrl->physical_size() - first_physical_block_offset) /
-        kSecureBlockLength;
+        secure_block_length;
     start_block_to_write = eof_block_index - blocks_to_eof;
   }
 
@@ -740,15 +1251,18 @@ ssize_t AeadHandler::EncryptAndPersist(int fd, const void *buf, size_t count) {
   // Use single write buffer to minimize the number of write calls to the host.
   std::vector<uint8_t> buffer;
   const int64_t blocks_to_write =
-      full_inclusive_blocks_bytes_count / kBlockLength;
-  const size_t physical_bytes_count = blocks_to_write * kSecureBlockLength;
+      full_inclusive_blocks_bytes_count / block_length;
+  const size_t physical_bytes_count = blocks_to_write * secure_block_length;
   buffer.resize(physical_bytes_count);
 
-  // Cycle through blocks.
-  std::vector<Tag> tags;
+  // Cycle through blocks, collecting the blocks to encrypt.
+  std::vector<const uint8_t *> plaintext_blocks;
+  std::vector<uint8_t *> ciphertexts;
+  std::vector<uint8_t *> tokens;
   for (int64_t block_index = 0; block_index < blocks_to_write; block_index++) {
     const uint8_t *plaintext_data =
-        GetPlaintextBuffer(first_partial_block_bytes_count, block_index, buf);
+        GetPlaintextBuffer(block_length, first_partial_block_bytes_count,
+                           block_index, buf);
 
     // Source for encryption - bounce block or the supplied buffer.
     const uint8_t *encrypt_source;
@@ -762,34 +1276,53 @@ ssize_t AeadHandler::EncryptAndPersist(int fd, const void *buf, size_t count) {
     } else {
       encrypt_source = plaintext_data;
     }
+    plaintext_blocks.push_back(encrypt_source);
+
+    uint8_t *ciphertext = buffer.data() + block_index * secure_block_length;
+    ciphertexts.push_back(ciphertext);
+    tokens.push_back(ciphertext + cipher_block_length);
+  }
+
+  // Encrypt the blocks.
+  if (!ProcessBlocks(blocks_to_write, block_length,
+                     file_ctrl->crypto_thread_count, &crypto_workers_,
+                     [&](size_t begin, size_t end) {
+                       return cryptor->EncryptBlocks(
+                           end - begin, plaintext_blocks.data() + begin,
+                           tokens.data() + begin, ciphertexts.data() + begin);
+                     })) {
+    LOG(ERROR) << "Encryption failed, fd = " << fd;
+    return -1;
+  }
 
-    Ciphertext *ciphertext =
-        Ciphertext::Place(&buffer, block_index * kSecureBlockLength);
-    Token *token = Token::Place(
-        &buffer, block_index * kSecureBlockLength + kCipherBlockLength);
-
-    // Encrypt the block.
-    if (!cryptor->EncryptBlock(encrypt_source, token->data(),
-                               ciphertext->data())) {
-      LOG(ERROR) << "Encryption failed, fd = " << fd;
-      return -1;
-    }
+  // Auth tags of the written blocks, stored consecutively.
+  std::vector<uint8_t> tags(blocks_to_write * kTagLength);
+  for (int64_t block_index = 0; block_index < blocks_to_write; block_index++) {
+    const uint8_t *ciphertext = ciphertexts[block_index];
     VLOG(2) << "Ciphertext generated: "
             << absl::BytesToHexString(absl::string_view(
-                   reinterpret_cast<const char *>(ciphertext->data()),
-                   kBlockLength));
+                   reinterpret_cast<const char *>(ciphertext), block_length));
     VLOG(2) << "Token generated: "
             << absl::BytesToHexString(absl::string_view(
-                   reinterpret_cast<const char *>(token->data()),
+                   reinterpret_cast<const char *>(tokens[block_index]),
                    kTokenLength));
 
-    TagView tag(ciphertext->data() + kBlockLength, kTagLength);
-    tags.push_back(tag);
+    TagView tag(ciphertext + block_length, kTagLength);
+    std::copy_n(tag.data(), kTagLength,
+                tags.data() + block_index * kTagLength);
     VLOG(2) << "Auth tag generated: "
             << absl::BytesToHexString(absl::string_view(
                    reinterpret_cast<const char *>(tag.data()), kTagLength));
   }
 
+  // The committed images of the blocks about to be overwritten are journaled
+  // first, so that the file can be returned to the state its header
+  // identifies.
+  if (journal && !RecordCommittedBlocks(file_ctrl, start_block_to_write,
+                                        blocks_to_write)) {
+    return -1;
+  }
+
   // Move cursor to the first full block to write.
   if (first_partial_block_bytes_count > 0) {
     off_t offset =
@@ -817,10 +1350,10 @@ ssize_t AeadHandler::EncryptAndPersist(int fd, const void *buf, size_t count) {
   }
 
   // Move cursor to the position of the end of the write range.
-  if (last_partial_block_bytes_count > 0) {
+  if ((logical_offset + count) % block_length != 0) {
     off_t new_cur_logical_offset = logical_offset + count;
     off_t new_cur_physical_offset =
-        offset_translator_->LogicalToPhysical(new_cur_logical_offset);
+        file_ctrl->offset_translator->LogicalToPhysical(new_cur_logical_offset);
     off_t offset = enc_untrusted_lseek(fd, new_cur_physical_offset, SEEK_SET);
     if (offset == -1) {
       LOG(ERROR)
@@ -829,84 +1362,309 @@ ssize_t AeadHandler::EncryptAndPersist(int fd, const void *buf, size_t count) {
     }
   }
 
-  for (int64_t idx = 0; idx < tags.size(); idx++) {
-    std::string tag_string(reinterpret_cast<char *>(tags[idx].data()),
-                           kTagLength);
-    int64_t block_index = start_block_to_write + idx;
-    if (block_index < eof_block_index) {
-      VLOG(2) << "Updating auth tag on AD: "
-              << absl::BytesToHexString(tag_string);
-      file_ctrl->ad->UpdateLeaf(block_index + 1, tag_string);
-    } else {
-      VLOG(2) << "Appending auth tag to AD: "
-              << absl::BytesToHexString(tag_string);
-      file_ctrl->ad->AddLeaf(tag_string);
-    }
+  for (int64_t idx = 0; idx < blocks_to_write; idx++) {
+    file_ctrl->block_cache->Put(start_block_to_write + idx,
+                                plaintext_blocks[idx]);
   }
 
-  file_ctrl->logical_size = logical_offset + count;
-
-  if (!UpdateDigest(file_ctrl.get(), *cryptor)) {
+  // Update the AD leaves of the written blocks, appending the blocks past the
+  // EOF, in a single batch.
+  VLOG(2) << "Updating auth tags on AD, first block = " << start_block_to_write
+          << ", blocks_count = " << blocks_to_write
+          << ", blocks_appended = "
+          << std::max<int64_t>(
+                 start_block_to_write + blocks_to_write - eof_block_index, 0);
+  if (!file_ctrl->ad->UpdateLeaves(start_block_to_write + 1, tags.data(),
+                                   kTagLength, blocks_to_write)) {
+    LOG(ERROR) << "Failed to update auth tags on AD, fd = " << fd;
     return -1;
   }
 
+  file_ctrl->logical_size =
+      std::max<size_t>(file_ctrl->logical_size, logical_offset + count);
+
   VLOG(2) << "Wrote data to file, bytes_written = " << bytes_written;
 
   return count;
 }
 
+bool AeadHandler::CountWrite(FileControl *file_ctrl) const {
+  file_ctrl->mu.AssertHeld();
+  file_ctrl->pending_writes++;
+  if (file_ctrl->digest_update_interval == 0 ||
+      file_ctrl->pending_writes < file_ctrl->digest_update_interval) {
+    return true;
+  }
+
+  const GcmCryptor *cryptor = GetGcmCryptor(*file_ctrl);
+  return cryptor && UpdateDigest(file_ctrl, *cryptor);
+}
+
+ssize_t AeadHandler::ImportFromHost(int fd, int host_fd) {
+  std::shared_ptr<FileControl> file_ctrl = GetFileControl(fd);
+  if (!file_ctrl) {
+    LOG(ERROR) << "Attempt made to import to an unopened file, fd = " << fd;
+    errno = ENOENT;
+    return -1;
+  }
+
+  absl::MutexLock lock(&file_ctrl->mu);
+
+  off_t logical_offset;
+  if (!RetrieveLogicalOffset(fd, *file_ctrl, &logical_offset)) {
+    return -1;
+  }
+
+  // The contents are written in large chunks, each encrypted on up to the
+  // crypto threads of the file. The digest is updated once, as for a single
+  // write, so the chunks are journaled as they may overwrite committed blocks.
+  std::vector<uint8_t> buffer(kBulkTransferLength);
+  size_t imported = 0;
+  while (true) {
+    ssize_t bytes_read = read_all(host_fd, buffer.data(), buffer.size());
+    if (bytes_read == -1) {
+      LOG(ERROR) << "Failed to read the host file to import, fd = " << fd
+                 << ", errno = " << errno;
+      return -1;
+    }
+    if (bytes_read == 0) {
+      break;
+    }
+    if (EncryptAndPersistInternal(fd, buffer.data(), bytes_read,
+                                  file_ctrl.get(), logical_offset + imported,
+                                  /*journal=*/true) == -1) {
+      return -1;
+    }
+    imported += bytes_read;
+    if (static_cast<size_t>(bytes_read) < buffer.size()) {
+      break;
+    }
+  }
+
+  if (imported > 0 && !CountWrite(file_ctrl.get())) {
+    return -1;
+  }
+  VLOG(2) << "Imported data to file, bytes = " << imported << ", fd = " << fd;
+  return imported;
+}
+
+ssize_t AeadHandler::ExportToHost(int fd, int host_fd) {
+  std::shared_ptr<FileControl> file_ctrl = GetFileControl(fd);
+  if (!file_ctrl) {
+    LOG(ERROR) << "Attempt made to export from an unopened file, fd = " << fd;
+    errno = ENOENT;
+    return -1;
+  }
+
+  // The cursor of |fd| is moved, hence the file lock is taken exclusively.
+  absl::MutexLock lock(&file_ctrl->mu);
+
+  off_t logical_offset;
+  if (!RetrieveLogicalOffset(fd, *file_ctrl, &logical_offset)) {
+    return -1;
+  }
+
+  // Every chunk is verified before it leaves the enclave.
+  std::vector<uint8_t> buffer(kBulkTransferLength);
+  size_t exported = 0;
+  while (true) {
+    ssize_t read_count =
+        DecryptAndVerifyInternal(fd, buffer.data(), buffer.size(), *file_ctrl,
+                                 logical_offset + exported);
+    if (read_count == -1) {
+      return -1;
+    }
+    if (read_count == 0) {
+      break;
+    }
+    if (write_all(host_fd, buffer.data(), read_count) != read_count) {
+      LOG(ERROR) << "Failed to write the exported data to the host file, fd = "
+                 << fd << ", errno = " << errno;
+      return -1;
+    }
+    exported += read_count;
+  }
+
+  const off_t new_cur_physical_offset =
+      file_ctrl->offset_translator->LogicalToPhysical(logical_offset +
+                                                      exported);
+  if (enc_untrusted_lseek(fd, new_cur_physical_offset, SEEK_SET) == -1) {
+    LOG(ERROR) << "Failed lseek to the end of exported range.";
+    return -1;
+  }
+  VLOG(2) << "Exported data from file, bytes = " << exported << ", fd = "
+          << fd;
+  return exported;
+}
+
 bool AeadHandler::FinalizeFile(int fd) {
+  if (fd < 0) {
+    errno = EINVAL;
+    return false;
+  }
+
+  std::shared_ptr<FileControl> file_ctrl;
+  {
+    absl::MutexLock global_lock(&mu_);
+    FdMapShard &shard = GetFdMapShard(fd);
+    absl::MutexLock shard_lock(&shard.mu);
+
+    auto entry = shard.fmap.find(fd);
+    if (entry == shard.fmap.end()) {
+      LOG(ERROR) << "Attempt made to finalize uninitialized file, fd = " << fd;
+      errno = ENOENT;
+      return false;
+    }
+
+    // Do not need to wait until the file is no longer operated on - shared_ptr
+    // taken by the operator will keep file_ctrl alive and allow it to take and
+    // release the lock on its own schedule. Removal from the maps here will not
+    // impact that ability.
+
+    VLOG(2) << "Finalizing secure file, fd = " << fd
+            << ", pathname = " << entry->second->path;
+    file_ctrl = entry->second;
+    opened_files_.erase(entry->second->path);
+    shard.fmap.erase(entry);
+  }
+
+  absl::MutexLock lock(&file_ctrl->mu);
+  if (!file_ctrl->is_deserialized) {
+    return true;
+  }
+
+  // Update the digest for writes made since the last update. If this fails,
+  // the next open returns the file to its state as of the last update.
+  if (!CommitPendingWrites(file_ctrl.get())) {
+    LOG(ERROR) << "Failed to update the digest of a file being closed, path = "
+               << file_ctrl->path;
+    return false;
+  }
+
+  // Persist the AD tree nodes updated by writes, so that the file can be
+  // reopened without rebuilding the tree. The file data remains verifiable if
+  // this fails, since the tree is then rebuilt on the next open.
+  if (!file_ctrl->ad->Flush()) {
+    LOG(WARNING) << "Failed to persist the Merkle tree, path = "
+                 << file_ctrl->path;
+  }
+
+  return true;
+}
+
+void AeadHandler::SetBlockCacheCapacity(size_t capacity) {
   absl::MutexLock global_lock(&mu_);
+  block_cache_capacity_ = capacity;
+}
 
-  if (fd < 0) {
+void AeadHandler::SetCryptoThreadCount(size_t count) {
+  absl::MutexLock global_lock(&mu_);
+  crypto_thread_count_ =
+      std::min(std::max<size_t>(count, 1), kMaxCryptoThreadCount);
+}
+
+void AeadHandler::SetReadAheadLength(size_t length) {
+  absl::MutexLock global_lock(&mu_);
+  read_ahead_length_ = length;
+}
+
+bool AeadHandler::GetBlockCacheStats(int fd, uint64_t *hits,
+                                     uint64_t *misses) {
+  if (!hits || !misses) {
     errno = EINVAL;
     return false;
   }
 
-  auto entry = fmap_.find(fd);
-  if (entry == fmap_.end()) {
-    LOG(ERROR) << "Attempt made to finalize uninitialized file, fd = " << fd;
+  std::shared_ptr<FileControl> file_ctrl = GetFileControl(fd);
+  if (!file_ctrl) {
+    LOG(ERROR) << "Attempt made to query an unopened file, fd = " << fd;
     errno = ENOENT;
     return false;
   }
 
-  // Do not need to wait until the file is no longer operated on - shared_ptr
-  // taken by the operator will keep file_ctrl alive and allow it to take and
-  // release the lock on its own schedule. Removal from the maps here will not
-  // impact that ability.
-
-  VLOG(2) << "Finalizing secure file, fd = " << fd
-          << ", pathname = " << entry->second->path;
-  opened_files_.erase(entry->second->path);
-  fmap_.erase(entry);
+  absl::MutexLock lock(&file_ctrl->mu);
+  if (!file_ctrl->block_cache) {
+    *hits = 0;
+    *misses = 0;
+    return true;
+  }
 
+  *hits = file_ctrl->block_cache->hits();
+  *misses = file_ctrl->block_cache->misses();
   return true;
 }
 
+int AeadHandler::SetDigestUpdateInterval(int fd, uint32_t interval) {
+  std::shared_ptr<FileControl> file_ctrl = GetFileControl(fd);
+  if (!file_ctrl) {
+    LOG(ERROR) << "Attempt made to configure an unopened file, fd = " << fd;
+    errno = ENOENT;
+    return -1;
+  }
+
+  absl::MutexLock lock(&file_ctrl->mu);
+  file_ctrl->digest_update_interval = interval;
+  if (file_ctrl->is_deserialized && interval != 0 &&
+      file_ctrl->pending_writes >= interval &&
+      !CommitPendingWrites(file_ctrl.get())) {
+    return -1;
+  }
+
+  return 0;
+}
+
+bool AeadHandler::SyncFile(int fd) {
+  std::shared_ptr<FileControl> file_ctrl = GetFileControl(fd);
+  if (!file_ctrl) {
+    LOG(ERROR) << "Attempt made to sync an unopened file, fd = " << fd;
+    errno = ENOENT;
+    return false;
+  }
+
+  absl::MutexLock lock(&file_ctrl->mu);
+  if (!file_ctrl->is_deserialized || file_ctrl->pending_writes == 0) {
+    return true;
+  }
+
+  // The data has to be durable before the header that covers it.
+  if (enc_untrusted_fsync(fd) == -1) {
+    LOG(ERROR) << "Failed to sync file data, fd = " << fd
+               << ", errno = " << errno;
+    return false;
+  }
+
+  return CommitPendingWrites(file_ctrl.get());
+}
+
 // Note: questionable whether to allow setting the key only on newly opened
 // files, and only if not set yet - arguably, such intelligence may need to
 // reside outside of AeadHandler on the side of the IOCTL client. If not done
 // correctly by the client, IO ops will simply fail, as intended.
 int AeadHandler::SetMasterKey(int fd, const uint8_t *key_data,
                               uint32_t key_length) {
+  return SetMasterKey(fd, key_data, key_length, kDefaultBlockLength);
+}
+
+int AeadHandler::SetMasterKey(int fd, const uint8_t *key_data,
+                              uint32_t key_length, size_t block_length) {
   if (!key_data || key_length != kKeyLength) {
     LOG(ERROR) << "Attempt made to set an invalid key.";
     errno = EINVAL;
     return -1;
   }
 
-  std::shared_ptr<FileControl> file_ctrl;
-  {
-    absl::MutexLock global_lock(&mu_);
-
-    auto entry = fmap_.find(fd);
-    if (entry == fmap_.end()) {
-      LOG(ERROR) << "Attempt made to set key on an unopened file, fd = " << fd;
-      errno = ENOENT;
-      return -1;
-    }
+  if (!IsBlockLengthValid(block_length)) {
+    LOG(ERROR) << "Attempt made to set an invalid block length, block_length = "
+               << block_length;
+    errno = EINVAL;
+    return -1;
+  }
 
-    file_ctrl = entry->second;
+  std::shared_ptr<FileControl> file_ctrl = GetFileControl(fd);
+  if (!file_ctrl) {
+    LOG(ERROR) << "Attempt made to set key on an unopened file, fd = " << fd;
+    errno = ENOENT;
+    return -1;
   }
 
   absl::MutexLock lock(&file_ctrl->mu);
@@ -918,35 +1676,87 @@ int AeadHandler::SetMasterKey(int fd, const uint8_t *key_data,
       return -1;
     }
 
-    return 0;
+    return InitializeCursor(fd, *file_ctrl) ? 0 : -1;
   }
 
   file_ctrl->master_key =
       absl::make_unique<GcmCryptorKey>(key_data, key_length);
-  if (!Deserialize(file_ctrl.get())) {
+  if (!Deserialize(file_ctrl.get(), block_length)) {
     LOG(ERROR) << "Failed to deserialize integrity metadata for file, path="
                << file_ctrl->path;
     return -1;
   }
 
   file_ctrl->is_deserialized = true;
-  return 0;
+
+  // The file header length is known only now, so the cursor of a freshly
+  // opened descriptor is moved past the header here rather than on open.
+  return InitializeCursor(fd, *file_ctrl) ? 0 : -1;
 }
 
-const OffsetTranslator &AeadHandler::GetOffsetTranslator() const {
-  return *offset_translator_;
+off_t AeadHandler::SeekFile(int fd, off_t offset, int whence) {
+  std::shared_ptr<FileControl> file_ctrl = GetFileControl(fd);
+  if (!file_ctrl) {
+    LOG(ERROR) << "Attempt made to seek in an unopened file, fd = " << fd;
+    errno = ENOENT;
+    return -1;
+  }
+
+  // The file layout is used and the cursor is moved under the file lock, so
+  // that neither changes in between.
+  absl::MutexLock lock(&file_ctrl->mu);
+  if (!file_ctrl->is_deserialized) {
+    LOG(ERROR) << "Attempt made to seek in a file before setting the key, fd = "
+               << fd;
+    errno = EACCES;
+    return -1;
+  }
+
+  // The net logical offset to which lseek has been requested.
+  off_t logical_offset;
+  switch (whence) {
+    case SEEK_SET: {
+      logical_offset = offset;
+    } break;
+    case SEEK_CUR: {
+      off_t logical_cur_offset;
+      if (!RetrieveLogicalOffset(fd, *file_ctrl, &logical_cur_offset)) {
+        return -1;
+      }
+      logical_offset = logical_cur_offset + offset;
+    } break;
+    case SEEK_END: {
+      logical_offset = file_ctrl->logical_size + offset;
+    } break;
+    default: {
+      errno = EINVAL;
+      return -1;
+    }
+  }
+
+  // The net physical offset that corresponds to the requested logical offset.
+  off_t physical_offset =
+      file_ctrl->offset_translator->LogicalToPhysical(logical_offset);
+  physical_offset = enc_untrusted_lseek(fd, physical_offset, SEEK_SET);
+  if (physical_offset == -1) {
+    LOG(ERROR) << "enclave_lseek failed, fd = " << fd
+               << ", offset = " << offset;
+    return -1;
+  }
+  return file_ctrl->offset_translator->PhysicalToLogical(physical_offset);
 }
 
 off_t AeadHandler::GetLogicalFileSize(int fd) {
-  absl::MutexLock global_lock(&mu_);
-  auto entry = fmap_.find(fd);
-  if (entry == fmap_.end()) {
+  std::shared_ptr<FileControl> file_ctrl = GetFileControl(fd);
+  if (!file_ctrl) {
     LOG(ERROR)
         << "Attempt made to get logical file size on an unopened file, fd = "
         << fd;
     return -1;
   }
-  return entry->second->logical_size;
+
+  absl::ReaderMutexLock lock(&file_ctrl->mu);
+  return file_ctrl->logical_size;
 }
 
 }  // namespace storage
@@ -26,12 +26,16 @@
 #include <unordered_map>
 
 #include "absl/base/attributes.h"
+#include "absl/memory/memory.h"
 #include "absl/synchronization/mutex.h"
 #include "asylo/crypto/util/bytes.h"
 #include "asylo/platform/crypto/gcmlib/gcm_cryptor.h"
-#include "asylo/platform/storage/secure/authenticated_dictionary.h"
-#include "asylo/platform/storage/secure/ctmmt_authenticated_dictionary.h"
+#include "asylo/platform/storage/secure/block_cache.h"
+#include "asylo/platform/storage/secure/persisted_authenticated_dictionary.h"
+#include "asylo/platform/storage/secure/read_ahead.h"
+#include "asylo/platform/storage/secure/undo_journal.h"
 #include "asylo/platform/storage/utils/offset_translator.h"
+#include "asylo/util/worker_pool.h"
 
 namespace asylo {
 namespace platform {
@@ -43,9 +47,14 @@ using crypto::gcmlib::kKeyLength;
 using crypto::gcmlib::kTagLength;
 using crypto::gcmlib::kTokenLength;
 
-// Length of file blocks to encrypt/decrypt.
-constexpr size_t kBlockLength = 128;
-using Block = UnsafeBytes<kBlockLength>;
+// Length of file blocks to encrypt/decrypt, unless a different block length is
+// selected when a file is created.
+constexpr size_t kDefaultBlockLength = 128;
+
+// Bounds of the block length that can be selected for a file. The block length
+// is expected to be a power of 2.
+constexpr size_t kMinBlockLength = 128;
+constexpr size_t kMaxBlockLength = 64 * 1024;
 
 // Length of the file digest (of the AD root).
 constexpr int64_t kRootHashLength = 32;
@@ -53,11 +62,39 @@ constexpr int64_t kRootHashLength = 32;
 // Length of the hash of the file digest (of the AD root).
 constexpr int64_t kFileHashLength = 16;
 
+// Number of writes after which the digest in the file header is updated, unless
+// a different interval is selected for a file. Updating the digest on every
+// write keeps the header current at all times.
+constexpr uint32_t kDefaultDigestUpdateInterval = 1;
+
+// Maximum number of bytes of plaintext blocks cached for each open file, unless
+// a different capacity is set.
+constexpr size_t kDefaultBlockCacheCapacity = 1024 * 1024;
+
+// Number of threads that encrypt or decrypt the blocks of a single read or
+// write, unless a different number is set. Blocks are processed on the calling
+// thread only.
+constexpr size_t kDefaultCryptoThreadCount = 1;
+
+// Upper bound on the number of threads that encrypt or decrypt the blocks of a
+// single read or write.
+constexpr size_t kMaxCryptoThreadCount = 64;
+
+// Minimum number of bytes of blocks processed by each thread when the blocks of
+// a read or write are split across threads.
+constexpr size_t kMinCryptoThreadBytes = 256 * 1024;
+
+// Maximum number of bytes of blocks fetched ahead of sequential reads of each
+// open file, unless a different length is set. Read-ahead is disabled.
+constexpr size_t kDefaultReadAheadLength = 0;
+
+// Length of the magic string identifying the file header format.
+constexpr size_t kFileHeaderMagicLength = 8;
+
 // Constants for the secure block structure - the secure block consists of
 // the ciphertext of the same length as the original plaintext, followed by the
 // integrity tag, followed by the encryption token.
-constexpr size_t kCipherBlockLength = kBlockLength + kTagLength;
-constexpr size_t kSecureBlockLength = kCipherBlockLength + kTokenLength;
+constexpr size_t kBlockMetadataLength = kTagLength + kTokenLength;
 
 using FileHash = UnsafeBytes<kFileHashLength>;
 using FileDigest = UnsafeBytes<kRootHashLength>;
@@ -89,28 +126,114 @@ class AeadHandler {
   ssize_t DecryptAndVerify(int fd, void *buf, size_t count)
       ABSL_LOCKS_EXCLUDED(mu_);
 
+  // Similar to DecryptAndVerify, but reads at the logical |offset| and does not
+  // move the cursor of |fd|. Reads of this kind from a file run concurrently
+  // with each other, and are serialized only with writes to the file.
+  ssize_t DecryptAndVerify(int fd, void *buf, size_t count, off_t offset)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
   // Encrypts data and generates integrity metadata for it in memory, writes
   // encrypted data to disk, returns the size of data written, or -1 on failure.
   ssize_t EncryptAndPersist(int fd, const void *buf, size_t count)
       ABSL_LOCKS_EXCLUDED(mu_);
 
+  // Writes the contents of the host file |host_fd| from its cursor to its end
+  // at the cursor of |fd|, in large chunks encrypted on up to the crypto
+  // threads of the file, and moves both cursors past the contents. The digest
+  // in the file header is updated as for a single write of the contents.
+  // Returns the number of bytes imported, or -1 on failure.
+  ssize_t ImportFromHost(int fd, int host_fd) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Writes the verified plaintext of the file of |fd| from its cursor to its
+  // end to the host file |host_fd| at its cursor, in large chunks, and moves
+  // both cursors past the contents. Returns the number of bytes exported, or -1
+  // on failure. Data that fails verification is not exported.
+  ssize_t ExportToHost(int fd, int host_fd) ABSL_LOCKS_EXCLUDED(mu_);
+
   // Frees resources used to assure integrity of an opened file, persists
   // integrity metadata to a designated location on disk, returns false on
   // failure. Does not modify the state of the file descriptor.
   bool FinalizeFile(int fd) ABSL_LOCKS_EXCLUDED(mu_);
 
-  // Sets the master key for a newly opened file.
+  // Sets the master key for a newly opened file. A file created by this call
+  // uses blocks of kDefaultBlockLength bytes.
   int SetMasterKey(int fd, const uint8_t *key_data, uint32_t key_length)
       ABSL_LOCKS_EXCLUDED(mu_);
 
+  // Sets the master key for a newly opened file. A file created by this call
+  // uses blocks of |block_length| bytes, which must be a power of 2 between
+  // kMinBlockLength and kMaxBlockLength. The block length of an existing file
+  // is read from its header, and |block_length| is ignored.
+  int SetMasterKey(int fd, const uint8_t *key_data, uint32_t key_length,
+                   size_t block_length) ABSL_LOCKS_EXCLUDED(mu_);
+
   // Returns the logical file size, or -1 on failure.
   off_t GetLogicalFileSize(int fd) ABSL_LOCKS_EXCLUDED(mu_);
 
-  const OffsetTranslator &GetOffsetTranslator() const;
+  // Sets the number of writes to a file after which the digest in its header is
+  // updated, for all descriptors of the file. An |interval| of 0 defers the
+  // update until the file is synced or closed. Writes pending a digest update
+  // are committed if they reach the new interval. Returns 0 on success, or -1
+  // on failure.
+  //
+  // Until its digest is updated, the header of a file identifies the state of
+  // the file before the pending writes, and the blocks those writes overwrite
+  // are recorded in an undo journal next to the file. If the enclave goes away
+  // before the update, the next open restores the recorded blocks, and the file
+  // verifies as of its last update. Blocks are journaled without syncing the
+  // journal, so the guarantee extends to a power loss only if the host storage
+  // persists writes in order; SyncFile() makes the current state durable.
+  int SetDigestUpdateInterval(int fd, uint32_t interval)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Updates the digest in the file header if any writes are pending a digest
+  // update, after syncing the data they wrote, so that syncing the file
+  // afterwards makes the current state durable. Returns false on failure.
+  bool SyncFile(int fd) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Sets the maximum number of bytes of plaintext blocks cached for each file
+  // opened afterwards, rounded down to a whole number of blocks of the file. A
+  // capacity of less than a block disables the cache.
+  void SetBlockCacheCapacity(size_t capacity) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Retrieves the number of block lookups in the cache of the file of |fd|
+  // that found the block cached (|hits|) and that did not (|misses|). Returns
+  // false on failure.
+  bool GetBlockCacheStats(int fd, uint64_t *hits, uint64_t *misses)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Sets the maximum number of threads that encrypt or decrypt the blocks of a
+  // single read or write of files opened afterwards. The additional threads
+  // come from a pool shared by all files, and each processes at least
+  // kMinCryptoThreadBytes of blocks. The blocks are processed on the calling
+  // thread if a thread cannot be created. A |count| of 0 is treated as 1, and a
+  // |count| above kMaxCryptoThreadCount as kMaxCryptoThreadCount.
+  void SetCryptoThreadCount(size_t count) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Sets the maximum number of bytes of blocks fetched ahead of sequential
+  // reads of files opened afterwards, rounded down to a whole number of blocks
+  // of the file. Blocks are fetched, verified and put in the block cache on a
+  // worker thread of each file, started on the first sequential read. The
+  // read-ahead is limited to half of the block cache capacity, so that fetched
+  // blocks do not evict each other. A |length| of less than a block disables
+  // read-ahead.
+  //
+  // Fetched blocks are looked up in the block cache of the file, and are
+  // counted as misses when fetched.
+  void SetReadAheadLength(size_t length) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Moves the cursor of |fd| to the logical |offset| relative to |whence|, one
+  // of SEEK_SET, SEEK_CUR and SEEK_END, translating it to the file layout of
+  // |fd|. Returns the resulting logical offset, or -1 on failure, including
+  // when the master key of |fd| has not been set.
+  off_t SeekFile(int fd, off_t offset, int whence) ABSL_LOCKS_EXCLUDED(mu_);
 
  private:
   // Structure represents the file header layout.
   struct FileHeader {
+    // Identifies the header format, kFileHeaderMagic.
+    char magic[kFileHeaderMagicLength];
+
     // Hash of the DataDigest.
     FileHash file_hash;
 
@@ -118,7 +241,25 @@ class AeadHandler {
     // FileHash.
     size_t file_size;
 
+    // Length of the file blocks - is incorporated into DataDigest and is
+    // protected by FileHash.
+    uint32_t block_length;
+
     // Returns the address of the FileHeader instance.
+    uint8_t *data() { return reinterpret_cast<uint8_t *>(magic); }
+  } ABSL_ATTRIBUTE_PACKED;
+
+  // Structure represents the file header layout of files created before the
+  // block length became selectable. Such files use blocks of
+  // kDefaultBlockLength bytes.
+  struct LegacyFileHeader {
+    // Hash of the DataDigest or the LegacyDataDigest.
+    FileHash file_hash;
+
+    // Logical file size.
+    size_t file_size;
+
+    // Returns the address of the LegacyFileHeader instance.
     uint8_t *data() { return file_hash.data(); }
   } ABSL_ATTRIBUTE_PACKED;
 
@@ -131,84 +272,259 @@ class AeadHandler {
     // Logical file size.
     size_t file_size;
 
+    // Number of blocks covered by the AD digest.
+    uint64_t leaf_count;
+
+    // Version of the file format. Distinguishes the digest from the one of
+    // the legacy format.
+    uint32_t format_version;
+
+    // Length of the file blocks. Not covered by the digest of files in format
+    // version 1.
+    uint32_t block_length;
+
     // Returns the address of the DataDigest instance.
     uint8_t *data() { return file_digest.data(); }
   } ABSL_ATTRIBUTE_PACKED;
 
+  // Structure represents the file data digest of the legacy file format, used
+  // before the AD tree was persisted along with the file. Files in the legacy
+  // format are migrated to the current format when opened.
+  struct LegacyDataDigest {
+    // AD digest of the file data.
+    FileDigest file_digest;
+
+    // Logical file size.
+    size_t file_size;
+
+    // Returns the address of the LegacyDataDigest instance.
+    uint8_t *data() { return file_digest.data(); }
+  } ABSL_ATTRIBUTE_PACKED;
+
   // File (data set) control structure for an opened file.
   struct FileControl {
     const std::string path;
     size_t logical_size;
     bool is_new;
     bool is_deserialized;
-    std::unique_ptr<AuthenticatedDictionary> ad;
+    std::unique_ptr<PersistedAuthenticatedDictionary> ad;
     std::string zero_hash;
     std::unique_ptr<GcmCryptorKey> master_key;
 
-    // Mutex for protecting FileControl instance.
+    // Layout of the file, set when the file is deserialized.
+    uint32_t format_version;
+    size_t block_length;
+    std::unique_ptr<OffsetTranslator> offset_translator;
+
+    // Cache of plaintext blocks of up to |block_cache_capacity| bytes, created
+    // when the layout is set.
+    const size_t block_cache_capacity;
+    std::unique_ptr<BlockCache> block_cache;
+
+    // Maximum number of threads that encrypt or decrypt the blocks of a single
+    // read or write.
+    const size_t crypto_thread_count;
+
+    // Read-ahead of up to |read_ahead_length| bytes of blocks, created when the
+    // layout is set unless disabled, and the descriptor its worker thread
+    // reads the file with, opened on first use by the worker thread.
+    const size_t read_ahead_length;
+    std::unique_ptr<ReadAhead> read_ahead;
+    int read_ahead_fd;
+
+    // Number of writes after which the digest in the file header is updated,
+    // or 0 to update it only when the file is synced or closed.
+    uint32_t digest_update_interval;
+
+    // Number of writes since the digest in the file header was last updated.
+    uint32_t pending_writes;
+
+    // Number of blocks covered by the digest in the file header.
+    uint64_t committed_leaf_count;
+
+    // Undo journal of the blocks overwritten since the digest in the file
+    // header was last updated, created when the layout is set.
+    std::unique_ptr<UndoJournal> journal;
+
+    // Descriptor used for updating the file header and reading committed
+    // blocks, opened on first use.
+    int host_fd;
+
+    // Mutex for protecting FileControl instance. Held in shared mode by reads
+    // that leave the cursor as is, and exclusively otherwise.
     absl::Mutex mu;
 
-    FileControl(const char *path_name, bool is_new_file)
+    // Mutex serializing the accesses to |ad| made while |mu| is held in shared
+    // mode, since looking up the AD updates its caches. Not needed while |mu|
+    // is held exclusively.
+    mutable absl::Mutex ad_mu;
+
+    FileControl(const char *path_name, bool is_new_file,
+                size_t cache_capacity, size_t crypto_threads,
+                size_t read_ahead_bytes)
         : path(path_name),
           logical_size(0),
           is_new(is_new_file),
           is_deserialized(false),
-          ad(absl::make_unique<CTMMTAuthenticatedDictionary>()) {
+          ad(absl::make_unique<PersistedAuthenticatedDictionary>(
+              path + kMerkleTreeFileSuffix)),
+          format_version(0),
+          block_length(0),
+          block_cache_capacity(cache_capacity),
+          crypto_thread_count(crypto_threads),
+          read_ahead_length(read_ahead_bytes),
+          read_ahead_fd(-1),
+          digest_update_interval(kDefaultDigestUpdateInterval),
+          pending_writes(0),
+          committed_leaf_count(0),
+          host_fd(-1) {
       UnsafeBytes<kTagLength> tag;
       memset(tag.data(), 0, kTagLength);
       std::string tag_string(reinterpret_cast<char *>(tag.data()), kTagLength);
       zero_hash = ad->LeafHash(tag_string);
     }
 
+    ~FileControl();
+
+    // Opens |host_fd|, if not open yet. Returns false on failure.
+    bool OpenHostFd();
+
+    // Records the state identified by |file_hash|, with the current leaf count,
+    // as the state covered by the file header, and starts a new interval of
+    // the undo journal. Returns false on failure.
+    bool Commit(const FileHash &file_hash);
+
+    // Sets the layout of the file to that of |version| with blocks of
+    // |length| bytes.
+    void SetLayout(uint32_t version, size_t length);
+
+    // Returns the length of the file header, which depends on the version.
+    size_t header_length() const;
+
+    size_t secure_block_length() const {
+      return block_length + kBlockMetadataLength;
+    }
+
     // NOTE: The physical_size is on block granularity because the block
     // metadata is placed after the block data, hence, only full blocks are
     // written - there are no partial blocks.
     size_t physical_size() {
-      return sizeof(FileHeader) + ad->LeafCount() * kSecureBlockLength;
+      return header_length() + ad->LeafCount() * secure_block_length();
     }
   };
 
-  AeadHandler();
+  AeadHandler() = default;
   AeadHandler(AeadHandler const &) = delete;
   void operator=(AeadHandler const &) = delete;
 
-  // Loads and validates integrity metadata, returns false on failure.
-  bool Deserialize(FileControl *file_ctrl)
+  // Loads and validates integrity metadata, returns false on failure. A new
+  // file is laid out with blocks of |new_file_block_length| bytes.
+  bool Deserialize(FileControl *file_ctrl, size_t new_file_block_length)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl->mu);
 
-  // Retrieves logical cursor offset associated with a file descriptor |fd|.
-  // Returns false on failure.
-  bool RetrieveLogicalOffset(int fd, off_t *logical_offset) const;
+  // Retrieves logical cursor offset associated with a file descriptor |fd| of
+  // a deserialized file. Returns false on failure.
+  bool RetrieveLogicalOffset(int fd, const FileControl &file_ctrl,
+                             off_t *logical_offset) const
+      ABSL_SHARED_LOCKS_REQUIRED(file_ctrl.mu);
+
+  // Moves the cursor of a file descriptor |fd| that has not been positioned yet
+  // to the logical offset of 0. Returns false on failure.
+  bool InitializeCursor(int fd, const FileControl &file_ctrl) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl.mu);
+
+  // Computes the hash of the file data digest over the AD |root| for a file in
+  // format |format_version| with blocks of |block_length| bytes, returns false
+  // on failure.
+  bool GetFileHash(const GcmCryptor &cryptor, const FileDigest &root,
+                   size_t file_size, uint64_t leaf_count,
+                   uint32_t format_version, size_t block_length,
+                   FileHash *file_hash) const;
 
   // Updates digest of the file data in the secure file header.
   bool UpdateDigest(FileControl *file_ctrl, const GcmCryptor &cryptor) const
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl->mu);
 
+  // Updates the digest in the file header if any writes are pending a digest
+  // update. Returns false on failure.
+  bool CommitPendingWrites(FileControl *file_ctrl) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl->mu);
+
+  // Records the committed images of the |blocks_count| blocks starting at
+  // |first_block_index| in the undo journal before they are overwritten.
+  // Returns false on failure.
+  bool RecordCommittedBlocks(FileControl *file_ctrl, uint64_t first_block_index,
+                             uint64_t blocks_count) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl->mu);
+
   // Returns an instance of GcmCryptor associated with a file, or nullptr if was
   // not able to retrieve. The caller does not own the instance.
   GcmCryptor *GetGcmCryptor(const FileControl &file_ctrl) const
-      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl.mu);
+      ABSL_SHARED_LOCKS_REQUIRED(file_ctrl.mu);
 
   // Similar to DecryptAndVerify, but is called by internal implementation, and
-  // as such does not take a file lock. The cursor associated with the file
-  // descriptor |fd| is expected to be at the position of |logical_offset|.
+  // as such does not take a file lock. Reads at |logical_offset| of the file
+  // descriptor |fd|, and does not move its cursor.
   ssize_t DecryptAndVerifyInternal(int fd, void *buf, size_t count,
                                    const FileControl &file_ctrl,
                                    off_t logical_offset) const
-      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl.mu);
+      ABSL_SHARED_LOCKS_REQUIRED(file_ctrl.mu);
+
+  // Similar to EncryptAndPersist, but is called by internal implementation, and
+  // as such does not take a file lock, and does not update the digest in the
+  // file header. Writes at |logical_offset| of the file descriptor |fd|, and
+  // moves its cursor past the written range. With |journal|, the committed
+  // images of the overwritten blocks are journaled first.
+  ssize_t EncryptAndPersistInternal(int fd, const void *buf, size_t count,
+                                    FileControl *file_ctrl,
+                                    off_t logical_offset, bool journal) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl->mu);
+
+  // Counts a write to a file, and updates the digest in the file header once
+  // the digest update interval is reached. Returns false on failure.
+  bool CountWrite(FileControl *file_ctrl) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl->mu);
 
   // Reads a single full block of a file at a specified logical offset. Returns
   // false on failure.
   bool ReadFullBlock(const FileControl &file_ctrl, off_t logical_offset,
-                     Block *block) const
-      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl.mu);
+                     uint8_t *block) const
+      ABSL_SHARED_LOCKS_REQUIRED(file_ctrl.mu);
+
+  // Records a read of |read_count| bytes at |logical_offset| of a file for its
+  // read-ahead, if enabled.
+  void RecordRead(const FileControl &file_ctrl, off_t logical_offset,
+                  size_t read_count) const;
+
+  // Fetches the |count| blocks starting at |first_block| of a file that are not
+  // cached yet into its block cache. Called by the worker thread of the
+  // read-ahead of the file.
+  void PrefetchBlocks(FileControl *file_ctrl, uint64_t first_block,
+                      uint64_t count) ABSL_LOCKS_EXCLUDED(file_ctrl->mu);
+
+  // Number of shards of the map of file controls keyed on file descriptors.
+  static constexpr size_t kFdMapShardCount = 16;
+
+  // Shard of the map of file (data set) controls for opened files keyed on int
+  // identity of files. Lookups take the lock of their shard in shared mode, so
+  // they contend neither with each other nor with opening and closing files
+  // mapped to other shards. Avoid using absl based containers which may perform
+  // system calls, as this class is expected to be used in trusted primitives
+  // layer where system calls might not be available.
+  struct FdMapShard {
+    absl::Mutex mu;
+    std::unordered_map<int, std::shared_ptr<FileControl>> fmap
+        ABSL_GUARDED_BY(mu);
+  };
 
-  // Map of file (data set) controls for opened files keyed on int identity of
-  // files. Avoid using absl based containers which may perform system calls, as
-  // this class is expected to be used in trusted primitives layer where
-  // system calls might not be available.
-  std::unordered_map<int, std::shared_ptr<FileControl>> fmap_
-      ABSL_GUARDED_BY(mu_);
+  // Returns the shard of the map of file controls that holds |fd|.
+  FdMapShard &GetFdMapShard(int fd);
+
+  // Returns the file control of the file opened as |fd|, or nullptr if |fd| is
+  // unknown.
+  std::shared_ptr<FileControl> GetFileControl(int fd);
+
+  FdMapShard fd_map_shards_[kFdMapShardCount];
 
   // Map of file (data set) controls for opened files keyed on string paths of
   // files. Avoid using absl based containers which may perform system calls, as
@@ -217,10 +533,23 @@ class AeadHandler {
   std::unordered_map<std::string, std::shared_ptr<FileControl>> opened_files_
       ABSL_GUARDED_BY(mu_);
 
-  // An instance that performs operations on untrusted file offset.
-  std::unique_ptr<OffsetTranslator> offset_translator_;
+  // Capacity of the block cache of files opened afterwards, in bytes.
+  size_t block_cache_capacity_ ABSL_GUARDED_BY(mu_) =
+      kDefaultBlockCacheCapacity;
+
+  // Maximum number of crypto threads of files opened afterwards.
+  size_t crypto_thread_count_ ABSL_GUARDED_BY(mu_) = kDefaultCryptoThreadCount;
+
+  // Read-ahead length of files opened afterwards, in bytes.
+  size_t read_ahead_length_ ABSL_GUARDED_BY(mu_) = kDefaultReadAheadLength;
+
+  // Threads that encrypt and decrypt blocks alongside the thread of a read or
+  // write, reused across reads and writes of all files.
+  mutable WorkerPool crypto_workers_{kMaxCryptoThreadCount - 1};
 
-  // Mutex for protecting map members of the class.
+  // Mutex for protecting |opened_files_| and the settings applied to files
+  // opened afterwards. Taken before the lock of a shard of the map of file
+  // controls.
   absl::Mutex mu_;
 };
 
@@ -19,12 +19,23 @@
 #ifndef ASYLO_PLATFORM_STORAGE_SECURE_AUTHENTICATED_DICTIONARY_H_
 #define ASYLO_PLATFORM_STORAGE_SECURE_AUTHENTICATED_DICTIONARY_H_
 
+#include <stdint.h>
+
 #include <string>
 
+#include "asylo/crypto/util/bytes.h"
+
 namespace asylo {
 namespace platform {
 namespace storage {
 
+// Length of the hashes of the leaves and nodes of an Authenticated Dictionary.
+constexpr size_t kDigestLength = 32;
+
+// Hash of a leaf or node, or digest of a data set, of an Authenticated
+// Dictionary.
+using Digest = UnsafeBytes<kDigestLength>;
+
 // Generic abstract interface for operating on an Authenticated Dictionary. An
 // Authenticated Dictionary for a data set divided into blocks is a data
 // structure that holds block hashes, maintains block hashes on block
@@ -52,6 +63,10 @@ class AuthenticatedDictionary {
   // empty string if the tree is empty.
   virtual std::string CurrentRoot() = 0;
 
+  // Updates the current root of the tree and stores it in |root|. Returns false
+  // on failure.
+  virtual bool CurrentRoot(Digest *root) = 0;
+
   // Returns the |leaf|th leaf hash in the tree. Indexing starts from 1.
   virtual std::string LeafHash(size_t leaf) const = 0;
 
@@ -61,6 +76,15 @@ class AuthenticatedDictionary {
   // Updates the |leaf|th leaf in the tree. Indexing starts from 1. Returns
   // false if update fails.
   virtual bool UpdateLeaf(size_t leaf, const std::string &data) = 0;
+
+  // Updates the |count| leaves starting at the |first_leaf|th leaf with the
+  // data of |data_length| bytes each found consecutively at |data|, adding the
+  // leaves beyond the end of the tree. Indexing starts from 1, and the range
+  // may start at most one leaf past the end of the tree. Interior nodes above
+  // the updated leaves are recomputed once for the whole range, rather than
+  // once per leaf. Returns false if update fails.
+  virtual bool UpdateLeaves(size_t first_leaf, const uint8_t *data,
+                            size_t data_length, size_t count) = 0;
 };
 
 }  // namespace storage
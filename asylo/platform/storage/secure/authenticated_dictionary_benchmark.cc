@@ -0,0 +1,97 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <openssl/rand.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "absl/strings/str_cat.h"
+#include "asylo/platform/storage/secure/ctmmt_authenticated_dictionary.h"
+#include "asylo/test/util/benchmark.h"
+
+namespace asylo {
+namespace platform {
+namespace storage {
+namespace {
+
+// Number of leaves of the benchmarked tree, that of a 16 MiB file of 128-byte
+// blocks.
+constexpr size_t kLeafCount = 1 << 17;
+
+// Length of leaf data, that of an auth tag.
+constexpr size_t kLeafDataLength = 16;
+
+// Numbers of consecutive leaves updated at once, as by writes of 128-byte
+// blocks from a single block up to 512 KiB.
+constexpr size_t kUpdateLeafCounts[] = {1, 8, 64, 512, 4096};
+
+// Compares updating consecutive leaves of a tree and computing the new root
+// leaf by leaf with updating the same leaves in a single batch.
+TEST(AuthenticatedDictionaryBenchmark, PerLeafVersusBatchUpdate) {
+  std::vector<uint8_t> data(kLeafCount * kLeafDataLength);
+  ASSERT_EQ(RAND_bytes(data.data(), data.size()), 1);
+  CTMMTAuthenticatedDictionary ad;
+  ASSERT_TRUE(ad.UpdateLeaves(1, data.data(), kLeafDataLength, kLeafCount));
+  Digest root;
+  ASSERT_TRUE(ad.CurrentRoot(&root));
+
+  for (size_t count : kUpdateLeafCounts) {
+    // Each iteration updates the next range of leaves, wrapping around. The
+    // leaf count is a multiple of the range length.
+    size_t first_leaf = 1;
+    auto next_range = [&first_leaf, count] {
+      size_t leaf = first_leaf;
+      first_leaf = (first_leaf - 1 + count) % kLeafCount + 1;
+      return leaf;
+    };
+
+    LogBenchmarkResult(
+        absl::StrCat("UpdateLeaf/", count), RunBenchmark([&] {
+          const size_t leaf = next_range();
+          for (size_t idx = 0; idx < count; idx++) {
+            const uint8_t *leaf_data =
+                data.data() + ((leaf - 1 + idx) * kLeafDataLength);
+            ad.UpdateLeaf(
+                leaf + idx,
+                std::string(reinterpret_cast<const char *>(leaf_data),
+                            kLeafDataLength));
+            ad.CurrentRoot();
+          }
+        }),
+        count * kLeafDataLength);
+
+    first_leaf = 1;
+    LogBenchmarkResult(
+        absl::StrCat("UpdateLeaves/", count), RunBenchmark([&] {
+          const size_t leaf = next_range();
+          ad.UpdateLeaves(leaf,
+                          data.data() + (leaf - 1) * kLeafDataLength,
+                          kLeafDataLength, count);
+          ad.CurrentRoot(&root);
+        }),
+        count * kLeafDataLength);
+  }
+}
+
+}  // namespace
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
@@ -0,0 +1,87 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/storage/secure/block_cache.h"
+
+#include <string.h>
+
+#include <iterator>
+#include <utility>
+
+namespace asylo {
+namespace platform {
+namespace storage {
+
+BlockCache::BlockCache(size_t block_length, size_t capacity)
+    : block_length_(block_length), capacity_(capacity), hits_(0), misses_(0) {}
+
+bool BlockCache::Contains(uint64_t block_index) const {
+  absl::MutexLock lock(&mu_);
+  return index_.find(block_index) != index_.end();
+}
+
+bool BlockCache::Get(uint64_t block_index, uint8_t *plaintext) {
+  absl::MutexLock lock(&mu_);
+  auto found = index_.find(block_index);
+  if (found == index_.end()) {
+    misses_++;
+    return false;
+  }
+
+  hits_++;
+  lru_.splice(lru_.begin(), lru_, found->second);
+  memcpy(plaintext, found->second->data.get(), block_length_);
+  return true;
+}
+
+void BlockCache::Put(uint64_t block_index, const uint8_t *plaintext) {
+  if (capacity_ == 0) {
+    return;
+  }
+
+  absl::MutexLock lock(&mu_);
+  auto found = index_.find(block_index);
+  if (found != index_.end()) {
+    lru_.splice(lru_.begin(), lru_, found->second);
+  } else if (lru_.size() < capacity_) {
+    std::unique_ptr<uint8_t[]> data(new uint8_t[block_length_]);
+    lru_.push_front(Block{block_index, std::move(data)});
+    index_[block_index] = lru_.begin();
+  } else {
+    // Reuse the buffer of the least recently used block.
+    index_.erase(lru_.back().index);
+    lru_.splice(lru_.begin(), lru_, std::prev(lru_.end()));
+    lru_.front().index = block_index;
+    index_[block_index] = lru_.begin();
+  }
+  memcpy(lru_.front().data.get(), plaintext, block_length_);
+}
+
+uint64_t BlockCache::hits() const {
+  absl::MutexLock lock(&mu_);
+  return hits_;
+}
+
+uint64_t BlockCache::misses() const {
+  absl::MutexLock lock(&mu_);
+  return misses_;
+}
+
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
@@ -0,0 +1,102 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_STORAGE_SECURE_BLOCK_CACHE_H_
+#define ASYLO_PLATFORM_STORAGE_SECURE_BLOCK_CACHE_H_
+
+#include <stdint.h>
+
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+namespace asylo {
+namespace platform {
+namespace storage {
+
+// Cache of the plaintext of verified blocks of a secure file, kept in enclave
+// memory. A cached block is the trusted contents of the block, so serving it
+// needs neither a host call nor decryption and verification. Blocks are
+// evicted in least-recently-used order once the cache holds |capacity| blocks.
+//
+// The cache is write-through: the owner of the cache is expected to put the
+// plaintext of every block it writes to the file once the block has been
+// written, so that cached blocks never differ from the file.
+//
+// The class is thread-safe, so that concurrent readers of a file can share its
+// cache.
+class BlockCache {
+ public:
+  // Creates a cache of up to |capacity| blocks of |block_length| bytes. A
+  // capacity of 0 disables the cache.
+  BlockCache(size_t block_length, size_t capacity);
+
+  BlockCache(const BlockCache &) = delete;
+  BlockCache &operator=(const BlockCache &) = delete;
+
+  // Returns whether block |block_index| is cached, without counting a lookup.
+  bool Contains(uint64_t block_index) const ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Copies the plaintext of block |block_index| to |plaintext| and marks the
+  // block most recently used. Returns false if the block is not cached. Counts
+  // a hit or a miss.
+  bool Get(uint64_t block_index, uint8_t *plaintext) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Caches |plaintext|, the contents of block |block_index|, replacing any
+  // cached contents of the block.
+  void Put(uint64_t block_index, const uint8_t *plaintext)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Number of lookups that found the block cached.
+  uint64_t hits() const ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Number of lookups that did not find the block cached.
+  uint64_t misses() const ABSL_LOCKS_EXCLUDED(mu_);
+
+ private:
+  struct Block {
+    uint64_t index;
+    std::unique_ptr<uint8_t[]> data;
+  };
+
+  const size_t block_length_;
+  const size_t capacity_;
+
+  mutable absl::Mutex mu_;
+
+  // Cached blocks, most recently used first.
+  std::list<Block> lru_ ABSL_GUARDED_BY(mu_);
+
+  // Index of |lru_| keyed on block index. Avoid using absl based containers
+  // which may perform system calls, as this class is expected to be used in
+  // trusted primitives layer where system calls might not be available.
+  std::unordered_map<uint64_t, std::list<Block>::iterator> index_
+      ABSL_GUARDED_BY(mu_);
+
+  uint64_t hits_ ABSL_GUARDED_BY(mu_);
+  uint64_t misses_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_STORAGE_SECURE_BLOCK_CACHE_H_
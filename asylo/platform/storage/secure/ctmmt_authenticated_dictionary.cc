@@ -18,16 +18,134 @@
 
 #include "asylo/platform/storage/secure/ctmmt_authenticated_dictionary.h"
 
-#include "absl/memory/memory.h"
-#include <merkletree/merkle_tree.h>
+#include <algorithm>
+
+#include "asylo/platform/storage/secure/merkle_tree_hash.h"
 
 namespace asylo {
 namespace platform {
 namespace storage {
 
+CTMMTAuthenticatedDictionary::CTMMTAuthenticatedDictionary()
+    : levels_(1), root_(EmptyMerkleRoot()) {}
+
+size_t CTMMTAuthenticatedDictionary::AddLeaf(const std::string &data) {
+  SetLeafHash(LeafCount(),
+              HashMerkleLeaf(reinterpret_cast<const uint8_t *>(data.data()),
+                             data.size()));
+  return LeafCount();
+}
+
+size_t CTMMTAuthenticatedDictionary::AddLeafHash(const std::string &hash) {
+  SetLeafHash(LeafCount(),
+              Digest(reinterpret_cast<const uint8_t *>(hash.data()),
+                     hash.size()));
+  return LeafCount();
+}
+
+std::string CTMMTAuthenticatedDictionary::CurrentRoot() {
+  UpdateInteriorNodes();
+  return std::string(reinterpret_cast<const char *>(root_.data()),
+                     root_.size());
+}
+
+bool CTMMTAuthenticatedDictionary::CurrentRoot(Digest *root) {
+  UpdateInteriorNodes();
+  *root = root_;
+  return true;
+}
+
+std::string CTMMTAuthenticatedDictionary::LeafHash(size_t leaf) const {
+  if (leaf == 0 || leaf > LeafCount()) {
+    return "";
+  }
+  const Digest &hash = levels_[0][leaf - 1];
+  return std::string(reinterpret_cast<const char *>(hash.data()), hash.size());
+}
+
+std::string CTMMTAuthenticatedDictionary::LeafHash(
+    const std::string &data) const {
+  Digest hash = HashMerkleLeaf(reinterpret_cast<const uint8_t *>(data.data()),
+                               data.size());
+  return std::string(reinterpret_cast<const char *>(hash.data()), hash.size());
+}
+
 bool CTMMTAuthenticatedDictionary::UpdateLeaf(size_t leaf,
                                               const std::string &data) {
-  return mtree_->UpdateLeafHash(leaf, mtree_->LeafHash(data));
+  if (leaf == 0 || leaf > LeafCount()) {
+    return false;
+  }
+  SetLeafHash(leaf - 1,
+              HashMerkleLeaf(reinterpret_cast<const uint8_t *>(data.data()),
+                             data.size()));
+  return true;
+}
+
+bool CTMMTAuthenticatedDictionary::UpdateLeaves(size_t first_leaf,
+                                                const uint8_t *data,
+                                                size_t data_length,
+                                                size_t count) {
+  if (first_leaf == 0 || first_leaf > LeafCount() + 1) {
+    return false;
+  }
+  std::vector<Digest> hashes;
+  if (!HashMerkleLeaves(data, data_length, count, &hashes)) {
+    return false;
+  }
+  for (size_t idx = 0; idx < count; idx++) {
+    SetLeafHash(first_leaf - 1 + idx, hashes[idx]);
+  }
+  return true;
+}
+
+void CTMMTAuthenticatedDictionary::SetLeafHash(uint64_t index,
+                                               const Digest &hash) {
+  if (index == levels_[0].size()) {
+    levels_[0].push_back(hash);
+  } else {
+    levels_[0][index] = hash;
+  }
+  dirty_leaves_.push_back(index);
+}
+
+void CTMMTAuthenticatedDictionary::UpdateInteriorNodes() {
+  if (dirty_leaves_.empty()) {
+    return;
+  }
+
+  // Recompute the ancestors of the dirty leaves level by level, so that every
+  // dirty node is recomputed once, and before it is combined with its sibling.
+  std::vector<uint64_t> indices;
+  indices.swap(dirty_leaves_);
+  std::sort(indices.begin(), indices.end());
+  indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+  size_t level = 0;
+  for (; levels_[level].size() > 1; level++) {
+    if (levels_.size() == level + 1) {
+      levels_.emplace_back();
+    }
+    const std::vector<Digest> &nodes = levels_[level];
+    std::vector<Digest> &parent_nodes = levels_[level + 1];
+    parent_nodes.resize((nodes.size() + 1) / 2);
+
+    std::vector<uint64_t> parents;
+    for (uint64_t index : indices) {
+      const uint64_t parent = index >> 1;
+      if (!parents.empty() && parents.back() == parent) {
+        continue;
+      }
+      parents.push_back(parent);
+
+      const uint64_t left = parent << 1;
+      parent_nodes[parent] =
+          (left + 1 < nodes.size())
+              ? HashMerkleChildren(nodes[left], nodes[left + 1])
+              : nodes[left];
+    }
+    indices.swap(parents);
+  }
+
+  root_ = levels_[level][0];
 }
 
 }  // namespace storage
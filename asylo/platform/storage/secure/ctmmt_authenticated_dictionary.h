@@ -19,46 +19,64 @@
 #ifndef ASYLO_PLATFORM_STORAGE_SECURE_CTMMT_AUTHENTICATED_DICTIONARY_H_
 #define ASYLO_PLATFORM_STORAGE_SECURE_CTMMT_AUTHENTICATED_DICTIONARY_H_
 
-#include "absl/memory/memory.h"
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
 #include "asylo/platform/storage/secure/authenticated_dictionary.h"
-#include <merkletree/merkle_tree.h>
 
 namespace asylo {
 namespace platform {
 namespace storage {
 
-// Authenticated Dictionary implementation backed by Certificate Transparency
-// Mutable Merkle Tree.
+// Authenticated Dictionary implementation backed by an in-memory Merkle tree,
+// the mutable variant of the Certificate Transparency (RFC 6962) Merkle tree.
+//
+// All nodes of the tree are kept in memory. Leaf updates and additions mark the
+// leaves dirty, and the interior nodes above dirty leaves are recomputed when
+// the root is next computed, level by level, so that a node shared by the paths
+// of many updated leaves is hashed once.
 class CTMMTAuthenticatedDictionary : public AuthenticatedDictionary {
  public:
-  CTMMTAuthenticatedDictionary()
-      : mtree_(absl::make_unique<MutableMerkleTree>(
-            absl::make_unique<Sha256Hasher>())) {}
+  CTMMTAuthenticatedDictionary();
 
-  size_t LeafCount() const final { return mtree_->LeafCount(); }
+  size_t LeafCount() const final { return levels_[0].size(); }
 
-  size_t AddLeaf(const std::string &data) final {
-    return mtree_->AddLeaf(data);
-  }
+  size_t AddLeaf(const std::string &data) final;
 
-  size_t AddLeafHash(const std::string &hash) final {
-    return mtree_->AddLeafHash(hash);
-  }
+  size_t AddLeafHash(const std::string &hash) final;
 
-  std::string CurrentRoot() final { return mtree_->CurrentRoot(); }
+  std::string CurrentRoot() final;
 
-  std::string LeafHash(size_t leaf) const final {
-    return mtree_->LeafHash(leaf);
-  }
+  bool CurrentRoot(Digest *root) final;
 
-  std::string LeafHash(const std::string &data) const final {
-    return mtree_->LeafHash(data);
-  }
+  std::string LeafHash(size_t leaf) const final;
+
+  std::string LeafHash(const std::string &data) const final;
 
   bool UpdateLeaf(size_t leaf, const std::string &data) final;
 
+  bool UpdateLeaves(size_t first_leaf, const uint8_t *data, size_t data_length,
+                    size_t count) final;
+
  private:
-  std::unique_ptr<MutableMerkleTree> mtree_;
+  // Sets the hash of leaf |index|, which is at most one past the last leaf.
+  void SetLeafHash(uint64_t index, const Digest &hash);
+
+  // Recomputes the interior nodes above the dirty leaves and updates the root.
+  void UpdateInteriorNodes();
+
+  // Nodes of the tree by level. Leaves are at level 0, and the root is the only
+  // node of the top level once interior nodes are up to date. A node without a
+  // right sibling is promoted to the next level as is.
+  std::vector<std::vector<Digest>> levels_;
+
+  // Indices of leaves updated or added since the root was last computed, in
+  // order of update.
+  std::vector<uint64_t> dirty_leaves_;
+
+  Digest root_;
 };
 
 }  // namespace storage
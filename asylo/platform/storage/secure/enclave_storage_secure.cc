@@ -59,13 +59,8 @@ int secure_open(const char *pathname, int flags, ...) {
 
   FdCloser fd_closer(fd, &enc_untrusted_close);
 
-  // Set cursor to the logical offset of 0.
-  if (secure_lseek(fd, 0, SEEK_SET) == -1) {
-    LOG(ERROR) << "Failed to initialize cursor to the logical offset of 0, fd="
-               << fd;
-    return -1;
-  }
-
+  // The cursor is set to the logical offset of 0 when the key is set, once the
+  // length of the file header is known.
   if (!AeadHandler::GetInstance().InitializeFile(fd, pathname, is_new_file)) {
     LOG(ERROR) << "Failed to initialize secure handling of file: " << pathname;
     return -1;
@@ -79,56 +74,39 @@ ssize_t secure_read(int fd, void *buf, size_t count) {
   return AeadHandler::GetInstance().DecryptAndVerify(fd, buf, count);
 }
 
+ssize_t secure_pread(int fd, void *buf, size_t count, off_t offset) {
+  return AeadHandler::GetInstance().DecryptAndVerify(fd, buf, count, offset);
+}
+
 ssize_t secure_write(int fd, const void *buf, size_t count) {
   return AeadHandler::GetInstance().EncryptAndPersist(fd, buf, count);
 }
 
+ssize_t secure_import(int fd, int host_fd) {
+  return AeadHandler::GetInstance().ImportFromHost(fd, host_fd);
+}
+
+ssize_t secure_export(int fd, int host_fd) {
+  return AeadHandler::GetInstance().ExportToHost(fd, host_fd);
+}
+
 int secure_close(int fd) {
   bool finalize_result = AeadHandler::GetInstance().FinalizeFile(fd);
   return (finalize_result && enc_untrusted_close(fd) == 0) ? 0 : -1;
 }
 
-off_t secure_lseek(int fd, off_t offset, int whence) {
-  if (offset < 0) {
+int secure_fsync(int fd) {
+  if (!AeadHandler::GetInstance().SyncFile(fd)) {
     return -1;
   }
+  return enc_untrusted_fsync(fd);
+}
 
-  const OffsetTranslator &offset_translator =
-      AeadHandler::GetInstance().GetOffsetTranslator();
-
-  // The net logical offset to which lseek has been requested.
-  off_t logical_offset;
-  switch (whence) {
-    case SEEK_SET: {
-      logical_offset = offset;
-    } break;
-    case SEEK_CUR: {
-      off_t physical_cur_offset = enc_untrusted_lseek(fd, 0, SEEK_CUR);
-      if (physical_cur_offset == -1) {
-        LOG(ERROR) << "Failed to retrieve cursor offset on descriptor: " << fd;
-        return -1;
-      }
-      off_t logical_cur_offset =
-          offset_translator.PhysicalToLogical(physical_cur_offset);
-      logical_offset = logical_cur_offset + offset;
-    } break;
-    case SEEK_END: {
-      off_t logical_eof_offset =
-          AeadHandler::GetInstance().GetLogicalFileSize(fd);
-      logical_offset = logical_eof_offset + offset;
-    } break;
-    default: logical_offset = 0;  // Satisfy -Wmaybe-uninitialized
-  }
-
-  // The net physical offset that corresponds to the requested logical offset.
-  off_t physical_offset = offset_translator.LogicalToPhysical(logical_offset);
-  physical_offset = enc_untrusted_lseek(fd, physical_offset, SEEK_SET);
-  if (physical_offset == -1) {
-    LOG(ERROR) << "enclave_lseek failed, fd = " << fd
-               << ", offset = " << offset;
+off_t secure_lseek(int fd, off_t offset, int whence) {
+  if (offset < 0) {
     return -1;
   }
-  return offset_translator.PhysicalToLogical(physical_offset);
+  return AeadHandler::GetInstance().SeekFile(fd, offset, whence);
 }
 
 int secure_fstat(int fd, struct stat *st) {
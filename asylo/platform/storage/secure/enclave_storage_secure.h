@@ -39,12 +39,31 @@ int secure_open(const char *pathname, int flags, ...);
 // responsibility to explicitly set file offset on error as the client desires.
 ssize_t secure_read(int fd, void *buf, size_t count);
 
+// Reads at the logical |offset| without moving the file offset. Concurrent
+// calls on a file do not serialize with each other.
+ssize_t secure_pread(int fd, void *buf, size_t count, off_t offset);
+
 // Note: POSIX leaves file offset on error undefined - thus, it is the client's
 // responsibility to explicitly set file offset on error as the client desires.
 ssize_t secure_write(int fd, const void *buf, size_t count);
 
+// Writes the contents of the host file |host_fd| (a descriptor of the host,
+// such as one returned by enc_untrusted_open) from its file offset to its end
+// at the file offset of |fd|, in a single streaming pass of large writes.
+// Returns the number of bytes imported, or -1 on failure.
+ssize_t secure_import(int fd, int host_fd);
+
+// Writes the verified contents of |fd| from its file offset to its end to the
+// host file |host_fd| at its file offset, in a single streaming pass of large
+// reads. Returns the number of bytes exported, or -1 on failure.
+ssize_t secure_export(int fd, int host_fd);
+
 int secure_close(int fd);
 
+// Makes the current state of the file durable, including the digest of writes
+// whose digest update has been deferred.
+int secure_fsync(int fd);
+
 off_t secure_lseek(int fd, off_t offset, int whence);
 
 // |st->st_size| will be set to logical file size on success.
@@ -24,14 +24,22 @@
 #include <fcntl.h>
 #include <openssl/rand.h>
 
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include "absl/base/macros.h"
 #include "absl/flags/flag.h"
+#include "absl/strings/escaping.h"
 #include "absl/strings/str_cat.h"
 #include "asylo/util/logging.h"
 #include "asylo/platform/host_call/trusted/host_calls.h"
 #include "asylo/platform/storage/secure/aead_handler.h"
+#include "asylo/platform/storage/secure/ctmmt_authenticated_dictionary.h"
+#include "asylo/platform/storage/secure/persisted_authenticated_dictionary.h"
 #include "asylo/platform/storage/utils/fd_closer.h"
 #include "asylo/test/util/status_matchers.h"
 #include "asylo/test/util/test_flags.h"
@@ -41,22 +49,75 @@
 namespace asylo {
 namespace {
 
+using platform::crypto::gcmlib::GcmCryptor;
+using platform::crypto::gcmlib::GcmCryptorKey;
+using platform::crypto::gcmlib::GcmCryptorRegistry;
 using platform::crypto::gcmlib::kKeyLength;
+using platform::crypto::gcmlib::kTagLength;
 using platform::storage::AeadHandler;
-using platform::storage::kBlockLength;
-using platform::storage::kCipherBlockLength;
+using platform::storage::AuthenticatedDictionary;
+using platform::storage::CTMMTAuthenticatedDictionary;
+using platform::storage::Digest;
+using platform::storage::FileHash;
+using platform::storage::kBlockMetadataLength;
+using platform::storage::kDefaultBlockCacheCapacity;
+using platform::storage::kDefaultBlockLength;
+using platform::storage::kDefaultCryptoThreadCount;
+using platform::storage::kDefaultReadAheadLength;
 using platform::storage::kFileHashLength;
+using platform::storage::kFileHeaderMagicLength;
+using platform::storage::kMerkleTreeFileSuffix;
+using platform::storage::kMinCryptoThreadBytes;
+using platform::storage::kUndoJournalFileSuffix;
+using platform::storage::PersistedAuthenticatedDictionary;
 using platform::storage::secure_close;
+using platform::storage::secure_fsync;
+using platform::storage::secure_export;
 using platform::storage::secure_fstat;
 using platform::storage::secure_lseek;
+using platform::storage::secure_import;
 using platform::storage::secure_open;
+using platform::storage::secure_pread;
 using platform::storage::secure_read;
 using platform::storage::secure_write;
 using ::testing::Not;
 
 constexpr size_t kMaxTestBufLen = 1000;
+constexpr size_t kBlockLength = kDefaultBlockLength;
+constexpr size_t kCipherBlockLength = kBlockLength + kTagLength;
+constexpr size_t kSecureBlockLength = kBlockLength + kBlockMetadataLength;
+constexpr size_t kLargeBlockLength = 4096;
 constexpr char kTamperData[] = "Exceedingly rare string";
 
+// Reads the raw contents of the file at |path| into |contents|.
+bool ReadRawFile(const std::string &path, std::vector<uint8_t> *contents) {
+  struct stat st;
+  if (enc_untrusted_stat(path.c_str(), &st) != 0) {
+    return false;
+  }
+  int fd = enc_untrusted_open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  platform::storage::FdCloser fd_closer(fd, &enc_untrusted_close);
+  contents->resize(st.st_size);
+  return enc_untrusted_read(fd, contents->data(), contents->size()) ==
+         contents->size();
+}
+
+// Replaces the contents of the file at |path| with |contents|.
+bool WriteRawFile(const std::string &path,
+                  const std::vector<uint8_t> &contents) {
+  int fd = enc_untrusted_open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                              S_IRUSR | S_IWUSR);
+  if (fd < 0) {
+    return false;
+  }
+  platform::storage::FdCloser fd_closer(fd, &enc_untrusted_close);
+  return enc_untrusted_write(fd, contents.data(), contents.size()) ==
+         contents.size();
+}
+
 class EnclaveStorageSecureTest : public ::testing::Test,
                                  public ::testing::WithParamInterface<size_t> {
  protected:
@@ -65,8 +126,16 @@ class EnclaveStorageSecureTest : public ::testing::Test,
   Status OpenWriteClose(off_t offset);
   Status OpenReadVerifyClose(off_t offset, size_t bytes_expected);
 
-  const int64_t kFileHeaderLength = kFileHashLength + sizeof(size_t);
+  const int64_t kFileHeaderLength = kFileHeaderMagicLength + kFileHashLength +
+                                    sizeof(size_t) + sizeof(uint32_t);
+  const int64_t kLegacyFileHeaderLength = kFileHashLength + sizeof(size_t);
   const std::string &GetPath() const { return path_; }
+  std::string GetMerkleTreePath() const {
+    return absl::StrCat(path_, kMerkleTreeFileSuffix);
+  }
+  std::string GetUndoJournalPath() const {
+    return absl::StrCat(path_, kUndoJournalFileSuffix);
+  }
   const void *GetWriteBuffer() const {
     return reinterpret_cast<const void *>(write_buffer_);
   }
@@ -78,6 +147,10 @@ class EnclaveStorageSecureTest : public ::testing::Test,
     return AeadHandler::GetInstance().SetMasterKey(fd, key_.data(),
                                                    key_.size());
   }
+  int EmulateSetKeyIoctl(int fd, size_t block_length) const {
+    return AeadHandler::GetInstance().SetMasterKey(fd, key_.data(), key_.size(),
+                                                   block_length);
+  }
 
   size_t test_buf_len_;
   std::string path_;
@@ -100,6 +173,8 @@ void EnclaveStorageSecureTest::PrepareTest() {
   // occasionally the test is executed on the same (virtual) machine.
   LOG(INFO) << "Cleaning up test file if present, path = " << path_;
   remove(path_.c_str());
+  remove(GetMerkleTreePath().c_str());
+  remove(GetUndoJournalPath().c_str());
 
   // Generate the test key.
   key_.resize(kKeyLength);
@@ -330,6 +405,695 @@ TEST_P(EnclaveStorageSecureTest, ReopenReadWriteSuccess) {
   EXPECT_THAT(OpenReadVerifyClose(0, test_buf_len_), IsOk());
 }
 
+TEST_P(EnclaveStorageSecureTest, ReopenLargeFileSuccess) {
+  // Large enough for the integrity metadata to be collected in several reads
+  // when the file is reopened.
+  constexpr size_t kLargeFileLength = 5 * (1 << 20) / 2;
+  std::vector<uint8_t> data(kLargeFileLength);
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<uint8_t>(i * 31 + i / kBlockLength);
+  }
+
+  int fd = secure_open(GetPath().c_str(), O_WRONLY | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  EXPECT_EQ(secure_write(fd, data.data(), data.size()), data.size());
+  EXPECT_EQ(secure_close(fd), 0);
+
+  fd = secure_open(GetPath().c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  std::vector<uint8_t> read_data(data.size());
+  for (size_t offset = 0; offset < read_data.size();) {
+    size_t count = std::min(test_buf_len_, read_data.size() - offset);
+    ssize_t bytes_read = secure_read(fd, read_data.data() + offset, count);
+    ASSERT_GT(bytes_read, 0);
+    offset += bytes_read;
+  }
+  EXPECT_EQ(read_data, data);
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
+TEST_P(EnclaveStorageSecureTest, MissingMerkleTreeFileSuccess) {
+  EXPECT_THAT(OpenWriteClose(0), IsOk());
+  EXPECT_EQ(enc_untrusted_access(GetMerkleTreePath().c_str(), F_OK), 0);
+
+  // The tree is rebuilt from the file and persisted again.
+  ASSERT_EQ(remove(GetMerkleTreePath().c_str()), 0);
+  EXPECT_THAT(OpenReadVerifyClose(0, test_buf_len_), IsOk());
+  EXPECT_EQ(enc_untrusted_access(GetMerkleTreePath().c_str(), F_OK), 0);
+  EXPECT_THAT(OpenReadVerifyClose(0, test_buf_len_), IsOk());
+}
+
+TEST_P(EnclaveStorageSecureTest, AuthenticatedDictionaryBatchUpdateSuccess) {
+  // Leaves updated in a batch in the middle of the tree and past its end, with
+  // the same batch applied to trees of both implementations and leaf by leaf.
+  constexpr size_t kInitialLeafCount = 1000;
+  constexpr size_t kFirstLeaf = 377;
+  constexpr size_t kBatchLeafCount = 1024;
+  const size_t data_length = test_buf_len_;
+  std::vector<uint8_t> data((kInitialLeafCount + kBatchLeafCount) *
+                            data_length);
+  ASSERT_EQ(RAND_bytes(data.data(), data.size()), 1);
+  const uint8_t *batch_data = data.data() + kInitialLeafCount * data_length;
+
+  CTMMTAuthenticatedDictionary per_leaf_ad;
+  CTMMTAuthenticatedDictionary batch_ad;
+  PersistedAuthenticatedDictionary persisted_ad(GetMerkleTreePath());
+  for (AuthenticatedDictionary *ad :
+       std::vector<AuthenticatedDictionary *>{&per_leaf_ad, &batch_ad,
+                                              &persisted_ad}) {
+    ASSERT_TRUE(ad->UpdateLeaves(1, data.data(), data_length,
+                                 kInitialLeafCount));
+    EXPECT_EQ(ad->LeafCount(), kInitialLeafCount);
+  }
+  EXPECT_EQ(batch_ad.CurrentRoot(), persisted_ad.CurrentRoot());
+
+  for (size_t idx = 0; idx < kBatchLeafCount; idx++) {
+    std::string leaf_data(
+        reinterpret_cast<const char *>(batch_data + idx * data_length),
+        data_length);
+    if (kFirstLeaf + idx <= per_leaf_ad.LeafCount()) {
+      ASSERT_TRUE(per_leaf_ad.UpdateLeaf(kFirstLeaf + idx, leaf_data));
+    } else {
+      per_leaf_ad.AddLeaf(leaf_data);
+    }
+  }
+  ASSERT_TRUE(batch_ad.UpdateLeaves(kFirstLeaf, batch_data, data_length,
+                                    kBatchLeafCount));
+  ASSERT_TRUE(persisted_ad.UpdateLeaves(kFirstLeaf, batch_data, data_length,
+                                        kBatchLeafCount));
+
+  Digest per_leaf_root;
+  Digest batch_root;
+  Digest persisted_root;
+  ASSERT_TRUE(per_leaf_ad.CurrentRoot(&per_leaf_root));
+  ASSERT_TRUE(batch_ad.CurrentRoot(&batch_root));
+  ASSERT_TRUE(persisted_ad.CurrentRoot(&persisted_root));
+  EXPECT_EQ(batch_ad.LeafCount(), kFirstLeaf - 1 + kBatchLeafCount);
+  EXPECT_EQ(per_leaf_ad.LeafCount(), batch_ad.LeafCount());
+  EXPECT_EQ(persisted_ad.LeafCount(), batch_ad.LeafCount());
+  EXPECT_EQ(batch_root, per_leaf_root);
+  EXPECT_EQ(batch_root, persisted_root);
+  EXPECT_EQ(batch_ad.CurrentRoot(),
+            std::string(reinterpret_cast<const char *>(batch_root.data()),
+                        batch_root.size()));
+  for (size_t leaf = 1; leaf <= batch_ad.LeafCount(); leaf++) {
+    EXPECT_EQ(batch_ad.LeafHash(leaf), per_leaf_ad.LeafHash(leaf));
+  }
+
+  // A batch may not start past the end of the tree.
+  EXPECT_FALSE(batch_ad.UpdateLeaves(batch_ad.LeafCount() + 2, batch_data,
+                                     data_length, 1));
+  EXPECT_FALSE(batch_ad.UpdateLeaves(0, batch_data, data_length, 1));
+}
+
+TEST_P(EnclaveStorageSecureTest, AuthenticatedDictionaryRfc6962RootsSuccess) {
+  // Merkle Tree Hashes of the first 1 to 8 leaves of the RFC 6962 test vectors
+  // of the Certificate Transparency project.
+  const std::vector<std::string> kLeaves = {
+      "",
+      absl::HexStringToBytes("00"),
+      absl::HexStringToBytes("10"),
+      absl::HexStringToBytes("2021"),
+      absl::HexStringToBytes("3031"),
+      absl::HexStringToBytes("40414243"),
+      absl::HexStringToBytes("5051525354555657"),
+      absl::HexStringToBytes("606162636465666768696a6b6c6d6e6f")};
+  const std::vector<std::string> kRoots = {
+      "6e340b9cffb37a989ca544e6bb780a2c78901d3fb33738768511a30617afa01d",
+      "fac54203e7cc696cf0dfcb42c92a1d9dbaf70ad9e621f4bd8d98662f00e3c125",
+      "aeb6bcfe274b70a14fb067a5e5578264db0fa9b51af5e0ba159158f329e06e77",
+      "d37ee418976dd95753c1c73862b9398fa2a2cf9b4ff0fdfe8b30cd95209614b7",
+      "4e3bbb1f7b478dcfe71fb631631519a3bca12c9aefca1612bfce4c13a86264d4",
+      "76e67dadbcdf1e10e1b74ddc608abd2f98dfb16fbce75277b5232a127f2087ef",
+      "ddb89be403809e325750d3d263cd78929c2942b7942a34b77e122c9594a74c8c",
+      "5dc9da79a70659a9ad559cb701ded9a2ab9d823aad2f4960cfe370eff4604328"};
+
+  CTMMTAuthenticatedDictionary ad;
+  PersistedAuthenticatedDictionary persisted_ad(GetMerkleTreePath());
+  EXPECT_EQ(absl::BytesToHexString(ad.CurrentRoot()),
+            "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+  for (size_t idx = 0; idx < kLeaves.size(); idx++) {
+    ad.AddLeaf(kLeaves[idx]);
+    persisted_ad.AddLeaf(kLeaves[idx]);
+    EXPECT_EQ(absl::BytesToHexString(ad.CurrentRoot()), kRoots[idx]);
+    EXPECT_EQ(absl::BytesToHexString(persisted_ad.CurrentRoot()), kRoots[idx]);
+  }
+
+  // A larger tree with leaves updated and added in a batch. The roots are the
+  // Merkle Tree Hashes of RFC 6962, section 2.1, over the same leaves.
+  constexpr size_t kLeafLength = 16;
+  auto leaf_data = [](size_t leaf, int seed) {
+    std::string data(kLeafLength, '\0');
+    for (size_t idx = 0; idx < kLeafLength; idx++) {
+      data[idx] = static_cast<char>(leaf * seed + idx);
+    }
+    return data;
+  };
+  CTMMTAuthenticatedDictionary large_ad;
+  for (size_t leaf = 0; leaf < 1000; leaf++) {
+    large_ad.AddLeaf(leaf_data(leaf, 31));
+  }
+  EXPECT_EQ(absl::BytesToHexString(large_ad.CurrentRoot()),
+            "ddd1230e49640d6c7ee2c5d4777cf0c17310a7b04cd5e9abb4b3e39639000ab4");
+  std::string batch;
+  for (size_t leaf = 100; leaf < 200; leaf++) {
+    batch += leaf_data(leaf, 7);
+  }
+  ASSERT_TRUE(large_ad.UpdateLeaves(
+      101, reinterpret_cast<const uint8_t *>(batch.data()), kLeafLength, 100));
+  batch.clear();
+  for (size_t leaf = 1000; leaf < 1025; leaf++) {
+    batch += leaf_data(leaf, 7);
+  }
+  ASSERT_TRUE(large_ad.UpdateLeaves(
+      1001, reinterpret_cast<const uint8_t *>(batch.data()), kLeafLength, 25));
+  EXPECT_EQ(absl::BytesToHexString(large_ad.CurrentRoot()),
+            "5c61de0eda04099f1c4a41e045256db5c1db4c819d25a3964aaceeca3653de1e");
+}
+
+TEST_P(EnclaveStorageSecureTest, AuthenticatedDictionaryBoundedCacheSuccess) {
+  // A tree with several times more nodes than are kept in memory, read in
+  // full and then updated and extended after most of its nodes were evicted.
+  constexpr size_t kMaxCachedNodes =
+      PersistedAuthenticatedDictionary::kMaxCachedNodes;
+  constexpr size_t kLeafCount = 2 * kMaxCachedNodes + 77;
+  constexpr size_t kLeafLength = 16;
+  // Verifying a leaf after the cache is trimmed adds at most one window of
+  // leaves and the path above it.
+  constexpr size_t kMaxVerifiedNodes = 1024;
+  std::vector<uint8_t> data(kLeafCount * kLeafLength);
+  ASSERT_EQ(RAND_bytes(data.data(), data.size()), 1);
+  auto leaf_data = [&data](size_t leaf) {
+    return std::string(
+        reinterpret_cast<const char *>(data.data() + (leaf - 1) * kLeafLength),
+        kLeafLength);
+  };
+
+  // Updated nodes are kept until they are written.
+  PersistedAuthenticatedDictionary writer(GetMerkleTreePath());
+  ASSERT_TRUE(writer.UpdateLeaves(1, data.data(), kLeafLength, kLeafCount));
+  const std::string root = writer.CurrentRoot();
+  ASSERT_FALSE(root.empty());
+  EXPECT_GT(writer.CachedNodeCount(), kMaxCachedNodes);
+  ASSERT_TRUE(writer.Flush());
+  EXPECT_LE(writer.CachedNodeCount(), kMaxCachedNodes);
+
+  PersistedAuthenticatedDictionary reader(GetMerkleTreePath());
+  ASSERT_TRUE(reader.Load());
+  EXPECT_EQ(reader.CurrentRoot(), root);
+  for (size_t leaf = 1; leaf <= kLeafCount; leaf++) {
+    ASSERT_EQ(reader.LeafHash(leaf), reader.LeafHash(leaf_data(leaf)));
+    ASSERT_LE(reader.CachedNodeCount(), kMaxCachedNodes + kMaxVerifiedNodes);
+  }
+
+  // Updates of evicted leaves, and additions, give the same roots as on a tree
+  // that has not evicted them.
+  constexpr size_t kBatchLeafCount = 3;
+  std::vector<uint8_t> batch(kBatchLeafCount * kLeafLength, 0x5a);
+  for (PersistedAuthenticatedDictionary *ad : {&writer, &reader}) {
+    ASSERT_TRUE(ad->UpdateLeaf(1, "first"));
+    ASSERT_TRUE(ad->UpdateLeaf(kLeafCount / 2, "middle"));
+    ASSERT_TRUE(ad->UpdateLeaves(kLeafCount, batch.data(), kLeafLength,
+                                 kBatchLeafCount));
+  }
+  const std::string updated_root = writer.CurrentRoot();
+  ASSERT_FALSE(updated_root.empty());
+  EXPECT_EQ(reader.CurrentRoot(), updated_root);
+  ASSERT_TRUE(reader.Flush());
+
+  PersistedAuthenticatedDictionary reloaded(GetMerkleTreePath());
+  ASSERT_TRUE(reloaded.Load());
+  EXPECT_EQ(reloaded.CurrentRoot(), updated_root);
+  EXPECT_EQ(reloaded.LeafHash(1), reloaded.LeafHash("first"));
+  EXPECT_EQ(reloaded.LeafHash(kLeafCount / 2), reloaded.LeafHash("middle"));
+  EXPECT_EQ(reloaded.LeafHash(2), reloaded.LeafHash(leaf_data(2)));
+}
+
+TEST_P(EnclaveStorageSecureTest, LegacyFormatMigrationSuccess) {
+  EXPECT_THAT(OpenWriteClose(0), IsOk());
+
+  // Convert the file to the legacy format, which has no Merkle tree file, has
+  // a file header without the magic string and the block length, and computes
+  // the file hash over the AD root and the file size only.
+  ASSERT_EQ(remove(GetMerkleTreePath().c_str()), 0);
+  int fd = enc_untrusted_open(GetPath().c_str(), O_RDWR);
+  ASSERT_GE(fd, 0);
+  const size_t blocks_count = (test_buf_len_ + kBlockLength - 1) / kBlockLength;
+  std::vector<uint8_t> contents(kFileHeaderLength +
+                                blocks_count * kSecureBlockLength);
+  ASSERT_EQ(enc_untrusted_read(fd, contents.data(), contents.size()),
+            contents.size());
+  ASSERT_EQ(enc_untrusted_close(fd), 0) << strerror(errno);
+
+  std::vector<uint8_t> legacy_contents(kLegacyFileHeaderLength);
+  legacy_contents.insert(legacy_contents.end(),
+                         contents.begin() + kFileHeaderLength, contents.end());
+  std::copy_n(contents.begin() + kFileHeaderMagicLength + kFileHashLength,
+              sizeof(size_t), legacy_contents.begin() + kFileHashLength);
+
+  CTMMTAuthenticatedDictionary ad;
+  for (size_t block = 0; block < blocks_count; block++) {
+    const uint8_t *tag = legacy_contents.data() + kLegacyFileHeaderLength +
+                         block * kSecureBlockLength + kBlockLength;
+    ad.AddLeaf(std::string(reinterpret_cast<const char *>(tag), kTagLength));
+  }
+  std::string legacy_digest = ad.CurrentRoot();
+  legacy_digest.append(
+      reinterpret_cast<const char *>(legacy_contents.data() + kFileHashLength),
+      sizeof(size_t));
+
+  GcmCryptor *cryptor = GcmCryptorRegistry::GetInstance().GetGcmCryptor(
+      kBlockLength, GcmCryptorKey(key_.data(), key_.size()));
+  ASSERT_NE(cryptor, nullptr);
+  FileHash legacy_hash;
+  ASSERT_TRUE(cryptor->GetAuthTag(
+      legacy_hash.data(),
+      reinterpret_cast<const uint8_t *>(legacy_digest.data()),
+      legacy_digest.size()));
+  std::copy_n(legacy_hash.data(), kFileHashLength, legacy_contents.begin());
+
+  fd = enc_untrusted_open(GetPath().c_str(), O_WRONLY | O_TRUNC);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(
+      enc_untrusted_write(fd, legacy_contents.data(), legacy_contents.size()),
+      legacy_contents.size());
+  ASSERT_EQ(enc_untrusted_close(fd), 0) << strerror(errno);
+
+  // The file is migrated to the current digest when opened, keeping its
+  // layout.
+  EXPECT_THAT(OpenReadVerifyClose(0, test_buf_len_), IsOk());
+  EXPECT_EQ(enc_untrusted_access(GetMerkleTreePath().c_str(), F_OK), 0);
+
+  FileHash file_hash;
+  fd = enc_untrusted_open(GetPath().c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(enc_untrusted_read(fd, file_hash.data(), kFileHashLength),
+            kFileHashLength);
+  ASSERT_EQ(enc_untrusted_close(fd), 0) << strerror(errno);
+  EXPECT_NE(file_hash, legacy_hash);
+
+  EXPECT_THAT(OpenReadVerifyClose(0, test_buf_len_), IsOk());
+
+  // Files in the legacy layout remain writable.
+  EXPECT_THAT(OpenWriteClose(test_buf_len_), IsOk());
+  EXPECT_THAT(OpenReadVerifyClose(test_buf_len_, test_buf_len_), IsOk());
+}
+
+TEST_P(EnclaveStorageSecureTest, LargeBlockLengthSuccess) {
+  // Open for write, selecting the block length of the new file.
+  int fd = secure_open(GetPath().c_str(), O_WRONLY | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd, kLargeBlockLength), 0);
+  EXPECT_EQ(secure_write(fd, GetWriteBuffer(), test_buf_len_), test_buf_len_);
+  EXPECT_EQ(secure_lseek(fd, kLargeBlockLength - test_buf_len_ / 2, SEEK_SET),
+            kLargeBlockLength - test_buf_len_ / 2);
+  EXPECT_EQ(secure_write(fd, GetWriteBuffer(), test_buf_len_), test_buf_len_);
+  EXPECT_EQ(secure_close(fd), 0);
+
+  // The file consists of the header and two blocks of the selected length.
+  struct stat st;
+  ASSERT_EQ(enc_untrusted_stat(GetPath().c_str(), &st), 0);
+  EXPECT_EQ(st.st_size,
+            kFileHeaderLength + 2 * (kLargeBlockLength + kBlockMetadataLength));
+
+  // The block length is read from the file header on open.
+  EXPECT_THAT(OpenReadVerifyClose(0, test_buf_len_), IsOk());
+  EXPECT_THAT(OpenReadVerifyClose(kLargeBlockLength - test_buf_len_ / 2,
+                                  test_buf_len_),
+              IsOk());
+
+  fd = secure_open(GetPath().c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  EXPECT_EQ(secure_lseek(fd, 0, SEEK_END),
+            kLargeBlockLength + test_buf_len_ / 2);
+  EXPECT_EQ(secure_lseek(fd, test_buf_len_, SEEK_SET), test_buf_len_);
+  EXPECT_EQ(secure_read(fd, GetReadBuffer(), test_buf_len_), test_buf_len_);
+  EXPECT_EQ(memcmp(GetReadBuffer(), GetZeroBuffer(), test_buf_len_), 0);
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
+TEST_P(EnclaveStorageSecureTest, DeferredDigestUpdateSuccess) {
+  int fd = secure_open(GetPath().c_str(), O_WRONLY | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  ASSERT_EQ(AeadHandler::GetInstance().SetDigestUpdateInterval(fd, 0), 0);
+
+  std::vector<uint8_t> initial_contents;
+  ASSERT_TRUE(ReadRawFile(GetPath(), &initial_contents));
+  ASSERT_EQ(initial_contents.size(), kFileHeaderLength);
+
+  // The header is not updated by writes until the file is synced.
+  EXPECT_EQ(secure_write(fd, GetWriteBuffer(), test_buf_len_), test_buf_len_);
+  EXPECT_EQ(secure_write(fd, GetWriteBuffer(), test_buf_len_), test_buf_len_);
+  std::vector<uint8_t> contents;
+  ASSERT_TRUE(ReadRawFile(GetPath(), &contents));
+  EXPECT_TRUE(std::equal(initial_contents.begin(), initial_contents.end(),
+                         contents.begin()));
+
+  EXPECT_EQ(secure_fsync(fd), 0);
+  ASSERT_TRUE(ReadRawFile(GetPath(), &contents));
+  EXPECT_FALSE(std::equal(initial_contents.begin(), initial_contents.end(),
+                          contents.begin()));
+
+  // Writes pending a digest update are committed on close.
+  EXPECT_EQ(secure_lseek(fd, 0, SEEK_SET), 0);
+  EXPECT_EQ(secure_write(fd, GetZeroBuffer(), test_buf_len_), test_buf_len_);
+  EXPECT_EQ(secure_close(fd), 0);
+
+  EXPECT_THAT(OpenReadVerifyClose(test_buf_len_, test_buf_len_), IsOk());
+  fd = secure_open(GetPath().c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  EXPECT_EQ(secure_read(fd, GetReadBuffer(), test_buf_len_), test_buf_len_);
+  EXPECT_EQ(memcmp(GetReadBuffer(), GetZeroBuffer(), test_buf_len_), 0);
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
+TEST_P(EnclaveStorageSecureTest, DeferredDigestUpdateRecoverySuccess) {
+  EXPECT_THAT(OpenWriteClose(0), IsOk());
+
+  // Overwrite and extend the file without updating the digest, and capture
+  // the file and its journal as they would be left if the enclave went away
+  // before the file was closed.
+  int fd = secure_open(GetPath().c_str(), O_RDWR);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  ASSERT_EQ(AeadHandler::GetInstance().SetDigestUpdateInterval(fd, 0), 0);
+  EXPECT_EQ(secure_lseek(fd, test_buf_len_ / 2, SEEK_SET), test_buf_len_ / 2);
+  EXPECT_EQ(secure_write(fd, GetZeroBuffer(), test_buf_len_), test_buf_len_);
+  EXPECT_EQ(secure_write(fd, GetZeroBuffer(), test_buf_len_), test_buf_len_);
+
+  std::vector<uint8_t> contents;
+  std::vector<uint8_t> journal_contents;
+  ASSERT_TRUE(ReadRawFile(GetPath(), &contents));
+  ASSERT_TRUE(ReadRawFile(GetUndoJournalPath(), &journal_contents));
+  EXPECT_GT(journal_contents.size(), 0);
+  EXPECT_EQ(secure_close(fd), 0);
+
+  // The file is restored to its state as of the last digest update, and the
+  // journal is emptied.
+  ASSERT_TRUE(WriteRawFile(GetPath(), contents));
+  ASSERT_TRUE(WriteRawFile(GetUndoJournalPath(), journal_contents));
+  EXPECT_THAT(OpenReadVerifyClose(0, test_buf_len_), IsOk());
+  ASSERT_TRUE(ReadRawFile(GetUndoJournalPath(), &journal_contents));
+  EXPECT_EQ(journal_contents.size(), 0);
+
+  fd = secure_open(GetPath().c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  EXPECT_EQ(secure_lseek(fd, 0, SEEK_END), test_buf_len_);
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
+TEST_P(EnclaveStorageSecureTest, StaleUndoJournalSuccess) {
+  EXPECT_THAT(OpenWriteClose(0), IsOk());
+
+  // A journal that does not belong to the state of the file is discarded.
+  std::vector<uint8_t> journal_contents(kTamperData,
+                                        kTamperData + sizeof(kTamperData));
+  journal_contents.resize(kSecureBlockLength * 2);
+  ASSERT_TRUE(WriteRawFile(GetUndoJournalPath(), journal_contents));
+  EXPECT_THAT(OpenReadVerifyClose(0, test_buf_len_), IsOk());
+  ASSERT_TRUE(ReadRawFile(GetUndoJournalPath(), &journal_contents));
+  EXPECT_EQ(journal_contents.size(), 0);
+}
+
+TEST_P(EnclaveStorageSecureTest, BlockCacheSuccess) {
+  EXPECT_THAT(OpenWriteClose(0), IsOk());
+  const uint64_t blocks_count =
+      (test_buf_len_ + kBlockLength - 1) / kBlockLength;
+
+  int fd = secure_open(GetPath().c_str(), O_RDWR);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+
+  // Blocks are read from the file when first accessed, and from the cache
+  // afterwards.
+  uint64_t hits;
+  uint64_t misses;
+  EXPECT_EQ(secure_read(fd, GetReadBuffer(), test_buf_len_), test_buf_len_);
+  ASSERT_TRUE(
+      AeadHandler::GetInstance().GetBlockCacheStats(fd, &hits, &misses));
+  EXPECT_EQ(hits, 0);
+  EXPECT_EQ(misses, blocks_count);
+
+  EXPECT_EQ(secure_lseek(fd, 0, SEEK_SET), 0);
+  memset(GetReadBuffer(), 0, test_buf_len_);
+  EXPECT_EQ(secure_read(fd, GetReadBuffer(), test_buf_len_), test_buf_len_);
+  EXPECT_EQ(memcmp(GetWriteBuffer(), GetReadBuffer(), test_buf_len_), 0);
+  ASSERT_TRUE(
+      AeadHandler::GetInstance().GetBlockCacheStats(fd, &hits, &misses));
+  EXPECT_EQ(hits, blocks_count);
+  EXPECT_EQ(misses, blocks_count);
+
+  // Misaligned writes take the rest of the block from the cache, and update
+  // the cached block.
+  EXPECT_EQ(secure_lseek(fd, 1, SEEK_SET), 1);
+  EXPECT_EQ(secure_write(fd, GetZeroBuffer(), 1), 1);
+  ASSERT_TRUE(
+      AeadHandler::GetInstance().GetBlockCacheStats(fd, &hits, &misses));
+  EXPECT_EQ(hits, blocks_count + 1);
+  EXPECT_EQ(misses, blocks_count);
+  EXPECT_EQ(secure_close(fd), 0);
+
+  fd = secure_open(GetPath().c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  EXPECT_EQ(secure_read(fd, GetReadBuffer(), test_buf_len_), test_buf_len_);
+  EXPECT_EQ(read_buffer_[0], write_buffer_[0]);
+  EXPECT_EQ(read_buffer_[1], 0);
+  EXPECT_EQ(memcmp(write_buffer_ + 2, read_buffer_ + 2, test_buf_len_ - 2), 0);
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
+TEST_P(EnclaveStorageSecureTest, BlockCacheDisabledSuccess) {
+  AeadHandler::GetInstance().SetBlockCacheCapacity(0);
+  EXPECT_THAT(OpenWriteClose(0), IsOk());
+
+  int fd = secure_open(GetPath().c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  for (int pass = 0; pass < 2; pass++) {
+    EXPECT_EQ(secure_lseek(fd, 0, SEEK_SET), 0);
+    EXPECT_EQ(secure_read(fd, GetReadBuffer(), test_buf_len_), test_buf_len_);
+    EXPECT_EQ(memcmp(GetWriteBuffer(), GetReadBuffer(), test_buf_len_), 0);
+  }
+  uint64_t hits;
+  uint64_t misses;
+  ASSERT_TRUE(
+      AeadHandler::GetInstance().GetBlockCacheStats(fd, &hits, &misses));
+  EXPECT_EQ(hits, 0);
+  EXPECT_EQ(secure_close(fd), 0);
+
+  AeadHandler::GetInstance().SetBlockCacheCapacity(kDefaultBlockCacheCapacity);
+}
+
+TEST_P(EnclaveStorageSecureTest, CryptoThreadsSuccess) {
+  // Large enough for the blocks of a read or write to be split across threads.
+  // Starts and ends in the middle of a block.
+  constexpr size_t kDataLength = 4 * kMinCryptoThreadBytes + 1;
+  constexpr off_t kDataOffset = kBlockLength / 2;
+  std::vector<uint8_t> data(kDataLength);
+  ASSERT_EQ(RAND_bytes(data.data(), data.size()), 1);
+
+  // The cache is disabled, so that the blocks are decrypted on every read.
+  AeadHandler::GetInstance().SetBlockCacheCapacity(0);
+  AeadHandler::GetInstance().SetCryptoThreadCount(4);
+
+  int fd = secure_open(GetPath().c_str(), O_RDWR | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  EXPECT_EQ(secure_lseek(fd, kDataOffset, SEEK_SET), kDataOffset);
+  EXPECT_EQ(secure_write(fd, data.data(), data.size()), data.size());
+
+  std::vector<uint8_t> read_data(data.size());
+  EXPECT_EQ(secure_lseek(fd, kDataOffset, SEEK_SET), kDataOffset);
+  EXPECT_EQ(secure_read(fd, read_data.data(), read_data.size()),
+            read_data.size());
+  EXPECT_EQ(read_data, data);
+  EXPECT_EQ(secure_close(fd), 0);
+
+  // The file is read on the calling thread only after reopening.
+  AeadHandler::GetInstance().SetCryptoThreadCount(kDefaultCryptoThreadCount);
+  fd = secure_open(GetPath().c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  std::fill(read_data.begin(), read_data.end(), 0);
+  EXPECT_EQ(secure_lseek(fd, kDataOffset, SEEK_SET), kDataOffset);
+  EXPECT_EQ(secure_read(fd, read_data.data(), read_data.size()),
+            read_data.size());
+  EXPECT_EQ(read_data, data);
+  EXPECT_EQ(secure_close(fd), 0);
+
+  AeadHandler::GetInstance().SetBlockCacheCapacity(kDefaultBlockCacheCapacity);
+}
+
+TEST_P(EnclaveStorageSecureTest, ReadAheadSuccess) {
+  constexpr uint64_t kWindowBlocks = 16;
+  constexpr size_t kDataLength = 4 * kWindowBlocks * kBlockLength;
+  std::vector<uint8_t> data(kDataLength);
+  ASSERT_EQ(RAND_bytes(data.data(), data.size()), 1);
+
+  int fd = secure_open(GetPath().c_str(), O_RDWR | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  EXPECT_EQ(secure_write(fd, data.data(), data.size()), data.size());
+  EXPECT_EQ(secure_close(fd), 0);
+
+  AeadHandler::GetInstance().SetReadAheadLength(kWindowBlocks * kBlockLength);
+  fd = secure_open(GetPath().c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+
+  // The second of two sequential reads schedules the blocks that follow, which
+  // are fetched in the background.
+  std::vector<uint8_t> read_data(data.size());
+  uint8_t *target = read_data.data();
+  for (int block = 0; block < 2; block++, target += kBlockLength) {
+    EXPECT_EQ(secure_read(fd, target, kBlockLength), kBlockLength);
+  }
+  uint64_t hits;
+  uint64_t misses;
+  for (int attempt = 0; attempt < 10000; attempt++) {
+    ASSERT_TRUE(
+        AeadHandler::GetInstance().GetBlockCacheStats(fd, &hits, &misses));
+    if (misses >= 2 + kWindowBlocks) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(hits, 0);
+  EXPECT_EQ(misses, 2 + kWindowBlocks);
+
+  // The next reads find the fetched blocks cached.
+  for (uint64_t block = 0; block < kWindowBlocks;
+       block++, target += kBlockLength) {
+    EXPECT_EQ(secure_read(fd, target, kBlockLength), kBlockLength);
+  }
+  ASSERT_TRUE(
+      AeadHandler::GetInstance().GetBlockCacheStats(fd, &hits, &misses));
+  EXPECT_EQ(hits, kWindowBlocks);
+
+  // The rest of the file reads as written while blocks are fetched ahead.
+  const size_t rest = read_data.data() + read_data.size() - target;
+  EXPECT_EQ(secure_read(fd, target, rest), rest);
+  EXPECT_EQ(read_data, data);
+  EXPECT_EQ(secure_close(fd), 0);
+
+  AeadHandler::GetInstance().SetReadAheadLength(kDefaultReadAheadLength);
+}
+
+TEST_P(EnclaveStorageSecureTest, ImportExportSuccess) {
+  // Spans several chunks of the transfer, and starts in the middle of a block.
+  constexpr size_t kDataLength = (2 << 20) + 300;
+  constexpr char kPrefix[] = "head";
+  std::vector<uint8_t> data(kDataLength);
+  ASSERT_EQ(RAND_bytes(data.data(), data.size()), 1);
+  const std::string import_path = absl::StrCat(GetPath(), ".import");
+  const std::string export_path = absl::StrCat(GetPath(), ".export");
+  ASSERT_TRUE(WriteRawFile(import_path, data));
+
+  int fd = secure_open(GetPath().c_str(), O_RDWR | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  EXPECT_EQ(secure_write(fd, kPrefix, sizeof(kPrefix)), sizeof(kPrefix));
+  int host_fd = enc_untrusted_open(import_path.c_str(), O_RDONLY);
+  ASSERT_GE(host_fd, 0);
+  EXPECT_EQ(secure_import(fd, host_fd), data.size());
+  EXPECT_EQ(enc_untrusted_close(host_fd), 0);
+  EXPECT_EQ(secure_lseek(fd, 0, SEEK_CUR), sizeof(kPrefix) + data.size());
+  EXPECT_EQ(secure_close(fd), 0);
+
+  std::vector<uint8_t> expected(kPrefix, kPrefix + sizeof(kPrefix));
+  expected.insert(expected.end(), data.begin(), data.end());
+  fd = secure_open(GetPath().c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  host_fd = enc_untrusted_open(export_path.c_str(),
+                               O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  ASSERT_GE(host_fd, 0);
+  EXPECT_EQ(secure_export(fd, host_fd), expected.size());
+  EXPECT_EQ(enc_untrusted_close(host_fd), 0);
+  EXPECT_EQ(secure_close(fd), 0);
+  std::vector<uint8_t> exported;
+  ASSERT_TRUE(ReadRawFile(export_path, &exported));
+  EXPECT_EQ(exported, expected);
+
+  // Tampered data is not exported.
+  std::vector<uint8_t> contents;
+  ASSERT_TRUE(ReadRawFile(GetPath(), &contents));
+  contents[contents.size() / 2] ^= 1;
+  ASSERT_TRUE(WriteRawFile(GetPath(), contents));
+  fd = secure_open(GetPath().c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  host_fd = enc_untrusted_open(export_path.c_str(),
+                               O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  ASSERT_GE(host_fd, 0);
+  EXPECT_EQ(secure_export(fd, host_fd), -1);
+  EXPECT_EQ(enc_untrusted_close(host_fd), 0);
+  EXPECT_EQ(secure_close(fd), 0);
+
+  remove(import_path.c_str());
+  remove(export_path.c_str());
+}
+
+TEST_P(EnclaveStorageSecureTest, PositionalReadSuccess) {
+  constexpr size_t kDataLength = 64 * kBlockLength;
+  constexpr int kThreadCount = 4;
+  std::vector<uint8_t> data(kDataLength);
+  ASSERT_EQ(RAND_bytes(data.data(), data.size()), 1);
+
+  int fd = secure_open(GetPath().c_str(), O_RDWR | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  EXPECT_EQ(secure_write(fd, data.data(), data.size()), data.size());
+  EXPECT_EQ(secure_lseek(fd, kBlockLength / 2, SEEK_SET), kBlockLength / 2);
+
+  // Each thread reads misaligned ranges of its own across the file, and past
+  // its end.
+  std::vector<std::thread> threads;
+  for (int thread_index = 0; thread_index < kThreadCount; thread_index++) {
+    threads.emplace_back([fd, thread_index, &data] {
+      for (size_t offset = thread_index * 7; offset < kDataLength;
+           offset += kDataLength / 16 + 3) {
+        std::vector<uint8_t> read_data(kBlockLength * 3);
+        size_t expected_length =
+            std::min(read_data.size(), kDataLength - offset);
+        EXPECT_EQ(secure_pread(fd, read_data.data(), read_data.size(), offset),
+                  expected_length);
+        EXPECT_TRUE(std::equal(data.begin() + offset,
+                               data.begin() + offset + expected_length,
+                               read_data.begin()));
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  // Positional reads leave the cursor as is.
+  EXPECT_EQ(secure_lseek(fd, 0, SEEK_CUR), kBlockLength / 2);
+  std::vector<uint8_t> read_data(kBlockLength);
+  EXPECT_EQ(secure_read(fd, read_data.data(), read_data.size()),
+            read_data.size());
+  EXPECT_TRUE(std::equal(read_data.begin(), read_data.end(),
+                         data.begin() + kBlockLength / 2));
+  EXPECT_EQ(secure_pread(fd, read_data.data(), read_data.size(), kDataLength),
+            0);
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
 TEST_P(EnclaveStorageSecureTest, RedundantIoctlSuccess) {
   // Open for write.
   int fd = secure_open(GetPath().c_str(), O_WRONLY | O_CREAT,
@@ -546,10 +1310,34 @@ TEST_P(EnclaveStorageSecureTest, ReadWriteAuthTagsModified) {
             0);
   ASSERT_EQ(enc_untrusted_fsync(fd), 0) << strerror(errno);
   ASSERT_EQ(enc_untrusted_close(fd), 0) << strerror(errno);
+
+  // With the Merkle tree file in place, auth tags are verified as blocks are
+  // read.
+  EXPECT_THAT(OpenReadVerifyClose(0, test_buf_len_),
+              StatusIs(error::GoogleError::INTERNAL, "Secure read failed."));
+
+  // Without it, all auth tags are verified when the file is opened.
+  ASSERT_EQ(remove(GetMerkleTreePath().c_str()), 0);
   EXPECT_THAT(OpenReadVerifyClose(0, test_buf_len_),
               StatusIs(error::GoogleError::INTERNAL, "Set master Key failed."));
 }
 
+TEST_P(EnclaveStorageSecureTest, MerkleTreeNodesModified) {
+  EXPECT_THAT(OpenWriteClose(0), IsOk());
+
+  // Modify the Merkle tree nodes following the tree file header - form of
+  // tampering.
+  int fd = enc_untrusted_open(GetMerkleTreePath().c_str(), O_WRONLY);
+  ASSERT_GE(fd, 0);
+  EXPECT_GT(enc_untrusted_lseek(fd, 64, SEEK_SET), 0);
+  EXPECT_GT(enc_untrusted_write(fd, kTamperData, ABSL_ARRAYSIZE(kTamperData)),
+            0);
+  ASSERT_EQ(enc_untrusted_fsync(fd), 0) << strerror(errno);
+  ASSERT_EQ(enc_untrusted_close(fd), 0) << strerror(errno);
+  EXPECT_THAT(OpenReadVerifyClose(0, test_buf_len_),
+              StatusIs(error::GoogleError::INTERNAL, "Secure read failed."));
+}
+
 TEST_P(EnclaveStorageSecureTest, ReadWriteTokensModified) {
   EXPECT_THAT(OpenWriteClose(0), IsOk());
 
@@ -591,6 +1379,20 @@ TEST_P(EnclaveStorageSecureTest, KeyNotSetFailure) {
   EXPECT_EQ(secure_close(fd), 0);
 }
 
+TEST_P(EnclaveStorageSecureTest, InvalidBlockLengthFailure) {
+  int fd = secure_open(GetPath().c_str(), O_WRONLY | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+
+  for (size_t block_length : {0, 64, 3000, 128 * 1024}) {
+    EXPECT_EQ(EmulateSetKeyIoctl(fd, block_length), -1);
+    EXPECT_EQ(errno, EINVAL);
+  }
+  EXPECT_EQ(secure_write(fd, GetWriteBuffer(), test_buf_len_), -1);
+
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
 TEST_P(EnclaveStorageSecureTest, RedundantIoctlFailure) {
   // Open for write.
   int fd = secure_open(GetPath().c_str(), O_WRONLY | O_CREAT,
@@ -0,0 +1,93 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/storage/secure/merkle_tree_hash.h"
+
+#include <openssl/sha.h>
+
+#include "absl/types/span.h"
+#include "asylo/crypto/sha256_hash.h"
+#include "asylo/crypto/util/byte_container_view.h"
+#include "asylo/util/logging.h"
+#include "asylo/util/status.h"
+
+namespace asylo {
+namespace platform {
+namespace storage {
+namespace {
+
+constexpr uint8_t kLeafPrefix = 0;
+
+}  // namespace
+
+Digest HashMerkleLeaf(const uint8_t *data, size_t size) {
+  Digest hash;
+  SHA256_CTX context;
+  SHA256_Init(&context);
+  SHA256_Update(&context, &kLeafPrefix, sizeof(kLeafPrefix));
+  SHA256_Update(&context, data, size);
+  SHA256_Final(hash.data(), &context);
+  return hash;
+}
+
+bool HashMerkleLeaves(const uint8_t *data, size_t size, size_t count,
+                      std::vector<Digest> *hashes) {
+  std::vector<ByteContainerView> leaves;
+  leaves.reserve(count);
+  for (size_t idx = 0; idx < count; idx++) {
+    leaves.emplace_back(data + idx * size, size);
+  }
+  std::vector<uint8_t> digests(count * kDigestLength);
+  Status status = Sha256Hash::HashMany(
+      ByteContainerView(&kLeafPrefix, sizeof(kLeafPrefix)), leaves,
+      absl::MakeSpan(digests));
+  if (!status.ok()) {
+    LOG(ERROR) << "Failed to hash Merkle tree leaves: " << status;
+    return false;
+  }
+  hashes->clear();
+  hashes->reserve(count);
+  for (size_t idx = 0; idx < count; idx++) {
+    hashes->emplace_back(digests.data() + idx * kDigestLength, kDigestLength);
+  }
+  return true;
+}
+
+Digest HashMerkleChildren(const Digest &left, const Digest &right) {
+  constexpr uint8_t kNodePrefix = 1;
+  Digest hash;
+  SHA256_CTX context;
+  SHA256_Init(&context);
+  SHA256_Update(&context, &kNodePrefix, sizeof(kNodePrefix));
+  SHA256_Update(&context, left.data(), left.size());
+  SHA256_Update(&context, right.data(), right.size());
+  SHA256_Final(hash.data(), &context);
+  return hash;
+}
+
+Digest EmptyMerkleRoot() {
+  Digest hash;
+  SHA256_CTX context;
+  SHA256_Init(&context);
+  SHA256_Final(hash.data(), &context);
+  return hash;
+}
+
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
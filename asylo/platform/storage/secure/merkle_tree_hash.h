@@ -0,0 +1,55 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_STORAGE_SECURE_MERKLE_TREE_HASH_H_
+#define ASYLO_PLATFORM_STORAGE_SECURE_MERKLE_TREE_HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "asylo/platform/storage/secure/authenticated_dictionary.h"
+
+namespace asylo {
+namespace platform {
+namespace storage {
+
+// SHA-256 hashes of the RFC 6962 Merkle tree, shared by the Authenticated
+// Dictionary implementations so that they yield the same roots.
+
+// Returns the hash of a leaf holding the |size| bytes at |data|.
+Digest HashMerkleLeaf(const uint8_t *data, size_t size);
+
+// Stores in |hashes| the hashes of |count| leaves of |size| bytes each, stored
+// contiguously at |data|. Equal-size leaves are hashed several at a time, so
+// this is faster than calling HashMerkleLeaf on each. Returns false on error.
+bool HashMerkleLeaves(const uint8_t *data, size_t size, size_t count,
+                      std::vector<Digest> *hashes);
+
+// Returns the hash of an interior node with children |left| and |right|.
+Digest HashMerkleChildren(const Digest &left, const Digest &right);
+
+// Returns the root of an empty tree, the hash of an empty string.
+Digest EmptyMerkleRoot();
+
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_STORAGE_SECURE_MERKLE_TREE_HASH_H_
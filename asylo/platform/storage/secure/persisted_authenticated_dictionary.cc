@@ -0,0 +1,687 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/storage/secure/persisted_authenticated_dictionary.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "absl/base/attributes.h"
+#include "asylo/platform/host_call/trusted/host_calls.h"
+#include "asylo/platform/storage/secure/merkle_tree_hash.h"
+#include "asylo/platform/storage/utils/fd_closer.h"
+#include "asylo/util/logging.h"
+
+namespace asylo {
+namespace platform {
+namespace storage {
+namespace {
+
+// Identifies a file of Merkle tree nodes and the version of its layout.
+constexpr char kTreeFileMagic[8] = {'A', 'S', 'Y', 'L', 'O', 'M', 'T', '1'};
+
+// Height of the subtree whose leaves are read and verified together when a leaf
+// is verified. The leaves of such a subtree are stored contiguously, so reading
+// them takes a single host call, and sequential access reads nodes once per
+// 2^kVerifyWindowHeight leaves rather than once per leaf.
+constexpr int kVerifyWindowHeight = 8;
+
+// Maximum number of clean nodes written between two dirty nodes on flush, so
+// that both are written by a single host call.
+constexpr uint64_t kMaxFlushGap = 64;
+
+// Upper bound on the number of bytes written to the host at once on flush.
+constexpr size_t kMaxFlushWriteLength = 1 << 20;
+
+// Upper bound on the leaf count accepted from a file header, which keeps node
+// positions within range.
+constexpr uint64_t kMaxLeafCount = uint64_t{1} << 48;
+
+// Header of a file of Merkle tree nodes. The nodes follow the header.
+struct TreeFileHeader {
+  char magic[sizeof(kTreeFileMagic)];
+  uint64_t leaf_count;
+  uint8_t root[kNodeHashLength];
+} ABSL_ATTRIBUTE_PACKED;
+
+constexpr off_t kNodesOffset = sizeof(TreeFileHeader);
+
+bool is_transient_error(int err) { return (err == EAGAIN) || (err == EINTR); }
+
+// Returns false on failure or if fewer than |len| bytes could be read.
+bool pread_all(int fd, void *buf, size_t len, off_t offset) {
+  size_t bytes_read_total = 0;
+  while (bytes_read_total < len) {
+    int bytes_read;
+    do {
+      bytes_read = enc_untrusted_pread64(
+          fd, static_cast<uint8_t *>(buf) + bytes_read_total,
+          len - bytes_read_total, offset + bytes_read_total);
+    } while ((bytes_read == -1) && is_transient_error(errno));
+    if (bytes_read <= 0) {
+      return false;
+    }
+    bytes_read_total += bytes_read;
+  }
+  return true;
+}
+
+// Returns false on failure.
+bool pwrite_all(int fd, const void *buf, size_t len, off_t offset) {
+  size_t bytes_written_total = 0;
+  while (bytes_written_total < len) {
+    int bytes_written;
+    do {
+      bytes_written = enc_untrusted_pwrite64(
+          fd, static_cast<const uint8_t *>(buf) + bytes_written_total,
+          len - bytes_written_total, offset + bytes_written_total);
+    } while ((bytes_written == -1) && is_transient_error(errno));
+    if (bytes_written <= 0) {
+      return false;
+    }
+    bytes_written_total += bytes_written;
+  }
+  return true;
+}
+
+}  // namespace
+
+constexpr size_t PersistedAuthenticatedDictionary::kMaxCachedNodes;
+constexpr int PersistedAuthenticatedDictionary::kPinnedLevels;
+
+PersistedAuthenticatedDictionary::PersistedAuthenticatedDictionary(
+    std::string path)
+    : path_(std::move(path)),
+      leaf_count_(0),
+      committed_leaf_count_(0),
+      root_(EmptyMerkleRoot()),
+      rewrite_file_(true),
+      read_fd_(-1) {}
+
+PersistedAuthenticatedDictionary::~PersistedAuthenticatedDictionary() {
+  if (read_fd_ != -1) {
+    enc_untrusted_close(read_fd_);
+  }
+}
+
+uint64_t PersistedAuthenticatedDictionary::NodePosition(int level,
+                                                        uint64_t index) {
+  return (index << (level + 1)) + ((uint64_t{1} << level) - 1);
+}
+
+uint64_t PersistedAuthenticatedDictionary::LevelLength(int level,
+                                                       uint64_t leaf_count) {
+  return leaf_count == 0 ? 0 : ((leaf_count - 1) >> level) + 1;
+}
+
+int PersistedAuthenticatedDictionary::RootLevel(uint64_t leaf_count) {
+  int level = 0;
+  while (LevelLength(level, leaf_count) > 1) {
+    level++;
+  }
+  return level;
+}
+
+int PersistedAuthenticatedDictionary::PositionLevel(uint64_t position) {
+  // The position of a node at level L ends in exactly L one bits.
+  int level = 0;
+  while (position & 1) {
+    position >>= 1;
+    level++;
+  }
+  return level;
+}
+
+const PersistedAuthenticatedDictionary::NodeHash *
+PersistedAuthenticatedDictionary::FindNode(uint64_t position) const {
+  auto node = nodes_.find(position);
+  if (node == nodes_.end()) {
+    return nullptr;
+  }
+  if (node->second.lru_entry != lru_.end()) {
+    lru_.splice(lru_.begin(), lru_, node->second.lru_entry);
+  }
+  return &node->second.hash;
+}
+
+void PersistedAuthenticatedDictionary::StoreNode(uint64_t position,
+                                                 const NodeHash &hash,
+                                                 bool dirty) const {
+  auto node = nodes_.find(position);
+  if (node == nodes_.end()) {
+    CachedNode cached;
+    cached.hash = hash;
+    if (dirty) {
+      cached.lru_entry = lru_.end();
+    } else {
+      lru_.push_front(position);
+      cached.lru_entry = lru_.begin();
+    }
+    nodes_.emplace(position, cached);
+    return;
+  }
+
+  // A clean node stored again holds the same hash, and leaves a dirty node
+  // dirty.
+  if (!dirty) {
+    FindNode(position);
+    return;
+  }
+  node->second.hash = hash;
+  if (node->second.lru_entry != lru_.end()) {
+    lru_.erase(node->second.lru_entry);
+    node->second.lru_entry = lru_.end();
+  }
+}
+
+void PersistedAuthenticatedDictionary::TrimCache() const {
+  if (nodes_.size() <= kMaxCachedNodes) {
+    return;
+  }
+
+  // Pinned nodes met at the tail of the list are moved to its head, so each
+  // node is visited at most once.
+  const int first_pinned_level =
+      RootLevel(committed_leaf_count_) - kPinnedLevels + 1;
+  size_t remaining = lru_.size();
+  while (nodes_.size() > kMaxCachedNodes && remaining > 0) {
+    remaining--;
+    const uint64_t position = lru_.back();
+    if (PositionLevel(position) >= first_pinned_level) {
+      lru_.splice(lru_.begin(), lru_, std::prev(lru_.end()));
+      continue;
+    }
+    nodes_.erase(position);
+    lru_.pop_back();
+  }
+}
+
+size_t PersistedAuthenticatedDictionary::AddLeaf(const std::string &data) {
+  pending_leaves_[leaf_count_] =
+      HashMerkleLeaf(reinterpret_cast<const uint8_t *>(data.data()),
+                     data.size());
+  return ++leaf_count_;
+}
+
+size_t PersistedAuthenticatedDictionary::AddLeafHash(const std::string &hash) {
+  pending_leaves_[leaf_count_] =
+      NodeHash(reinterpret_cast<const uint8_t *>(hash.data()), hash.size());
+  return ++leaf_count_;
+}
+
+std::string PersistedAuthenticatedDictionary::CurrentRoot() {
+  if (!ApplyPendingLeaves()) {
+    return "";
+  }
+  return std::string(reinterpret_cast<const char *>(root_.data()),
+                     root_.size());
+}
+
+bool PersistedAuthenticatedDictionary::CurrentRoot(Digest *root) {
+  if (!ApplyPendingLeaves()) {
+    return false;
+  }
+  *root = root_;
+  return true;
+}
+
+std::string PersistedAuthenticatedDictionary::LeafHash(size_t leaf) const {
+  if (leaf == 0 || leaf > leaf_count_) {
+    return "";
+  }
+
+  const uint64_t index = leaf - 1;
+  const NodeHash *hash;
+  auto pending = pending_leaves_.find(index);
+  if (pending != pending_leaves_.end()) {
+    hash = &pending->second;
+  } else {
+    TrimCache();
+    if (!VerifyLeaf(index)) {
+      LOG(ERROR) << "Failed to verify Merkle tree leaf " << index
+                 << ", path = " << path_;
+      return "";
+    }
+    hash = FindNode(NodePosition(0, index));
+  }
+  return std::string(reinterpret_cast<const char *>(hash->data()),
+                     hash->size());
+}
+
+std::string PersistedAuthenticatedDictionary::LeafHash(
+    const std::string &data) const {
+  NodeHash hash = HashMerkleLeaf(reinterpret_cast<const uint8_t *>(data.data()),
+                                 data.size());
+  return std::string(reinterpret_cast<const char *>(hash.data()), hash.size());
+}
+
+bool PersistedAuthenticatedDictionary::UpdateLeaf(size_t leaf,
+                                                  const std::string &data) {
+  if (leaf == 0 || leaf > leaf_count_) {
+    return false;
+  }
+  pending_leaves_[leaf - 1] =
+      HashMerkleLeaf(reinterpret_cast<const uint8_t *>(data.data()),
+                     data.size());
+  return true;
+}
+
+bool PersistedAuthenticatedDictionary::UpdateLeaves(size_t first_leaf,
+                                                    const uint8_t *data,
+                                                    size_t data_length,
+                                                    size_t count) {
+  if (first_leaf == 0 || first_leaf > leaf_count_ + 1) {
+    return false;
+  }
+  std::vector<NodeHash> hashes;
+  if (!HashMerkleLeaves(data, data_length, count, &hashes)) {
+    return false;
+  }
+  for (size_t idx = 0; idx < count; idx++) {
+    pending_leaves_[first_leaf - 1 + idx] = hashes[idx];
+  }
+  leaf_count_ = std::max<uint64_t>(leaf_count_, first_leaf - 1 + count);
+  return true;
+}
+
+bool PersistedAuthenticatedDictionary::Load() {
+  Reset();
+  if (!OpenForReading()) {
+    return false;
+  }
+
+  TreeFileHeader header;
+  if (!pread_all(read_fd_, &header, sizeof(header), 0)) {
+    LOG(ERROR) << "Failed to read Merkle tree file header, path = " << path_;
+    return false;
+  }
+  if (memcmp(header.magic, kTreeFileMagic, sizeof(kTreeFileMagic)) != 0 ||
+      header.leaf_count > kMaxLeafCount) {
+    LOG(ERROR) << "Malformed Merkle tree file header, path = " << path_;
+    return false;
+  }
+
+  leaf_count_ = header.leaf_count;
+  committed_leaf_count_ = header.leaf_count;
+  root_ = NodeHash(header.root, kNodeHashLength);
+  rewrite_file_ = false;
+  return true;
+}
+
+void PersistedAuthenticatedDictionary::Reset() {
+  leaf_count_ = 0;
+  committed_leaf_count_ = 0;
+  root_ = EmptyMerkleRoot();
+  pending_leaves_.clear();
+  nodes_.clear();
+  lru_.clear();
+  dirty_nodes_.clear();
+  rewrite_file_ = true;
+}
+
+bool PersistedAuthenticatedDictionary::Flush() {
+  if (!ApplyPendingLeaves()) {
+    return false;
+  }
+  if (dirty_nodes_.empty() && !rewrite_file_) {
+    return true;
+  }
+
+  int flags = O_WRONLY | O_CREAT;
+  if (rewrite_file_) {
+    flags |= O_TRUNC;
+  }
+  int fd = enc_untrusted_open(path_.c_str(), flags, S_IRUSR | S_IWUSR);
+  if (fd == -1) {
+    LOG(ERROR) << "Failed to open Merkle tree file for writing, path = "
+               << path_ << ", errno = " << errno;
+    return false;
+  }
+
+  FdCloser fd_closer(fd, &enc_untrusted_close);
+
+  // Write dirty nodes in runs of consecutive positions. Short gaps between
+  // dirty nodes are filled with cached clean nodes, which costs fewer host
+  // calls than writing the runs on both sides of the gap separately.
+  std::vector<uint64_t> positions(dirty_nodes_.begin(), dirty_nodes_.end());
+  std::sort(positions.begin(), positions.end());
+  std::vector<uint8_t> buffer;
+  for (size_t idx = 0; idx < positions.size();) {
+    const uint64_t first = positions[idx];
+    uint64_t last = first;
+    buffer.clear();
+    const NodeHash &first_node = nodes_.find(first)->second.hash;
+    buffer.insert(buffer.end(), first_node.begin(), first_node.end());
+    for (idx++; idx < positions.size() && buffer.size() < kMaxFlushWriteLength;
+         idx++) {
+      const uint64_t next = positions[idx];
+      if (next - last > kMaxFlushGap + 1) {
+        break;
+      }
+      std::vector<const NodeHash *> run;
+      for (uint64_t position = last + 1; position <= next; position++) {
+        auto node = nodes_.find(position);
+        if (node == nodes_.end()) {
+          break;
+        }
+        run.push_back(&node->second.hash);
+      }
+      if (run.size() != next - last) {
+        break;
+      }
+      for (const NodeHash *node : run) {
+        buffer.insert(buffer.end(), node->begin(), node->end());
+      }
+      last = next;
+    }
+
+    if (!pwrite_all(fd, buffer.data(), buffer.size(),
+                    kNodesOffset + first * kNodeHashLength)) {
+      LOG(ERROR) << "Failed to write Merkle tree nodes, path = " << path_
+                 << ", errno = " << errno;
+      return false;
+    }
+  }
+
+  // The header is written last, so that it never refers to nodes that have not
+  // been written.
+  TreeFileHeader header;
+  memcpy(header.magic, kTreeFileMagic, sizeof(kTreeFileMagic));
+  header.leaf_count = committed_leaf_count_;
+  memcpy(header.root, root_.data(), kNodeHashLength);
+  if (!pwrite_all(fd, &header, sizeof(header), 0)) {
+    LOG(ERROR) << "Failed to write Merkle tree file header, path = " << path_
+               << ", errno = " << errno;
+    return false;
+  }
+
+  if (!fd_closer.reset()) {
+    LOG(ERROR) << "Failed to close Merkle tree file after flush, path = "
+               << path_;
+    return false;
+  }
+
+  // The written nodes may be evicted from now on.
+  for (uint64_t position : dirty_nodes_) {
+    CachedNode &node = nodes_.find(position)->second;
+    lru_.push_front(position);
+    node.lru_entry = lru_.begin();
+  }
+  dirty_nodes_.clear();
+  rewrite_file_ = false;
+  TrimCache();
+  return true;
+}
+
+bool PersistedAuthenticatedDictionary::OpenForReading() const {
+  if (read_fd_ != -1) {
+    return true;
+  }
+  read_fd_ = enc_untrusted_open(path_.c_str(), O_RDONLY);
+  if (read_fd_ == -1) {
+    VLOG(2) << "Failed to open Merkle tree file, path = " << path_
+            << ", errno = " << errno;
+    return false;
+  }
+  return true;
+}
+
+bool PersistedAuthenticatedDictionary::ReadNodes(uint64_t position,
+                                                 size_t count,
+                                                 NodeHash *nodes) const {
+  if (!OpenForReading()) {
+    return false;
+  }
+  static_assert(sizeof(NodeHash) == kNodeHashLength,
+                "Nodes must be stored without padding");
+  if (!pread_all(read_fd_, nodes, count * kNodeHashLength,
+                 kNodesOffset + position * kNodeHashLength)) {
+    LOG(ERROR) << "Failed to read Merkle tree nodes, path = " << path_
+               << ", position = " << position << ", count = " << count;
+    return false;
+  }
+  return true;
+}
+
+bool PersistedAuthenticatedDictionary::VerifyLeaf(uint64_t index) const {
+  if (FindNode(NodePosition(0, index))) {
+    return true;
+  }
+
+  const uint64_t leaf_count = committed_leaf_count_;
+  const int root_level = RootLevel(leaf_count);
+  const int window_level = std::min(kVerifyWindowHeight, root_level);
+
+  // Nodes read or computed during verification. They are cached only once the
+  // path to the root checks out.
+  std::unordered_map<uint64_t, NodeHash> verified;
+
+  // Read all leaves of the subtree rooted at |window_level| that holds the
+  // leaf. Interior nodes of the subtree are stored in between the leaves and
+  // are read along with them, but are recomputed rather than trusted.
+  const uint64_t first_leaf = (index >> window_level) << window_level;
+  const uint64_t end_leaf =
+      std::min(first_leaf + (uint64_t{1} << window_level), leaf_count);
+  const size_t span = 2 * (end_leaf - first_leaf) - 1;
+  std::vector<NodeHash> window(span);
+  if (!ReadNodes(NodePosition(0, first_leaf), span, window.data())) {
+    return false;
+  }
+
+  // Cached nodes are used in place of the ones read, since the file does not
+  // hold updates that have not been flushed yet.
+  std::vector<NodeHash> level_nodes;
+  for (uint64_t leaf = first_leaf; leaf < end_leaf; leaf++) {
+    const uint64_t position = NodePosition(0, leaf);
+    const NodeHash *cached = FindNode(position);
+    level_nodes.push_back(
+        cached ? *cached : window[position - NodePosition(0, first_leaf)]);
+    verified.emplace(position, level_nodes.back());
+  }
+
+  // Compute the subtree root. The subtree either is complete or ends at the
+  // last leaf, so a node has a right sibling exactly when it is not the last
+  // node of its level in the subtree.
+  uint64_t first_index = first_leaf;
+  for (int level = 0; level < window_level; level++) {
+    std::vector<NodeHash> parents;
+    for (size_t idx = 0; idx < level_nodes.size(); idx += 2) {
+      parents.push_back(idx + 1 < level_nodes.size()
+                            ? HashMerkleChildren(level_nodes[idx],
+                                                 level_nodes[idx + 1])
+                            : level_nodes[idx]);
+      verified.emplace(NodePosition(level + 1, (first_index + idx) >> 1),
+                       parents.back());
+    }
+    first_index >>= 1;
+    level_nodes.swap(parents);
+  }
+
+  if (!VerifyAncestors(window_level, index >> window_level,
+                       level_nodes.front(), &verified)) {
+    return false;
+  }
+  for (const auto &node : verified) {
+    StoreNode(node.first, node.second, /*dirty=*/false);
+  }
+  return true;
+}
+
+bool PersistedAuthenticatedDictionary::VerifyNode(int level,
+                                                  uint64_t index) const {
+  const uint64_t position = NodePosition(level, index);
+  if (FindNode(position)) {
+    return true;
+  }
+  NodeHash node;
+  if (!ReadNodes(position, 1, &node)) {
+    return false;
+  }
+  std::unordered_map<uint64_t, NodeHash> verified;
+  verified.emplace(position, node);
+  if (!VerifyAncestors(level, index, node, &verified)) {
+    return false;
+  }
+  for (const auto &entry : verified) {
+    StoreNode(entry.first, entry.second, /*dirty=*/false);
+  }
+  return true;
+}
+
+bool PersistedAuthenticatedDictionary::VerifyPath(uint64_t index) const {
+  if (!VerifyLeaf(index)) {
+    return false;
+  }
+
+  // Nodes verified along with the leaf may have been evicted since, while the
+  // leaf itself was kept.
+  const int root_level = RootLevel(committed_leaf_count_);
+  for (int level = 0; level < root_level; level++) {
+    const uint64_t length = LevelLength(level, committed_leaf_count_);
+    const uint64_t node_index = index >> level;
+    if (!VerifyNode(level, node_index) ||
+        ((node_index ^ 1) < length && !VerifyNode(level, node_index ^ 1))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool PersistedAuthenticatedDictionary::VerifyAncestors(
+    int level, uint64_t index, NodeHash node,
+    std::unordered_map<uint64_t, NodeHash> *verified) const {
+  const uint64_t leaf_count = committed_leaf_count_;
+  const int root_level = RootLevel(leaf_count);
+
+  // Walk up to the root, or to the first node that has been verified before.
+  for (;; level++, index >>= 1) {
+    if (level == root_level) {
+      return node == root_;
+    }
+
+    const NodeHash *cached = FindNode(NodePosition(level, index));
+    if (cached) {
+      return *cached == node;
+    }
+
+    const uint64_t sibling_index = index ^ 1;
+    if (sibling_index < LevelLength(level, leaf_count)) {
+      const uint64_t sibling_position = NodePosition(level, sibling_index);
+      NodeHash sibling;
+      const NodeHash *cached_sibling = FindNode(sibling_position);
+      if (cached_sibling) {
+        sibling = *cached_sibling;
+      } else {
+        if (!ReadNodes(sibling_position, 1, &sibling)) {
+          return false;
+        }
+        verified->emplace(sibling_position, sibling);
+      }
+      node = (index & 1) ? HashMerkleChildren(sibling, node)
+                         : HashMerkleChildren(node, sibling);
+    }
+    verified->emplace(NodePosition(level + 1, index >> 1), node);
+  }
+}
+
+bool PersistedAuthenticatedDictionary::ApplyPendingLeaves() {
+  if (pending_leaves_.empty()) {
+    return true;
+  }
+
+  // Nodes of the committed tree that are combined with the updated ones must
+  // be verified first. Verifying the path of an updated leaf verifies the
+  // siblings along it, and verifying the path of the last committed leaf
+  // verifies the nodes that the paths of any added leaves are combined with.
+  // Nothing is evicted until the update is complete.
+  for (const auto &entry : pending_leaves_) {
+    if (entry.first >= committed_leaf_count_) {
+      break;
+    }
+    if (!VerifyPath(entry.first)) {
+      LOG(ERROR) << "Failed to verify Merkle tree leaf " << entry.first
+                 << " before update, path = " << path_;
+      return false;
+    }
+  }
+  if (leaf_count_ > committed_leaf_count_ && committed_leaf_count_ > 0 &&
+      !VerifyPath(committed_leaf_count_ - 1)) {
+    LOG(ERROR) << "Failed to verify the last Merkle tree leaf before adding "
+                  "leaves, path = "
+               << path_;
+    return false;
+  }
+
+  std::vector<uint64_t> indices;
+  indices.reserve(pending_leaves_.size());
+  for (const auto &entry : pending_leaves_) {
+    const uint64_t position = NodePosition(0, entry.first);
+    StoreNode(position, entry.second, /*dirty=*/true);
+    dirty_nodes_.insert(position);
+    indices.push_back(entry.first);
+  }
+
+  // Recompute the ancestors of the updated leaves level by level, so that every
+  // updated node is recomputed before it is combined with its sibling.
+  const int root_level = RootLevel(leaf_count_);
+  for (int level = 0; level < root_level; level++) {
+    const uint64_t length = LevelLength(level, leaf_count_);
+    std::vector<uint64_t> parents;
+    for (uint64_t index : indices) {
+      const uint64_t parent = index >> 1;
+      if (!parents.empty() && parents.back() == parent) {
+        continue;
+      }
+      parents.push_back(parent);
+
+      const NodeHash *left = FindNode(NodePosition(level, parent << 1));
+      const bool has_right = (parent << 1) + 1 < length;
+      const NodeHash *right =
+          has_right ? FindNode(NodePosition(level, (parent << 1) + 1))
+                    : nullptr;
+      if (!left || (has_right && !right)) {
+        LOG(ERROR) << "Merkle tree node missing when updating the tree, path = "
+                   << path_;
+        return false;
+      }
+      const uint64_t position = NodePosition(level + 1, parent);
+      StoreNode(position, right ? HashMerkleChildren(*left, *right) : *left,
+                /*dirty=*/true);
+      dirty_nodes_.insert(position);
+    }
+    indices.swap(parents);
+  }
+
+  root_ = *FindNode(NodePosition(root_level, 0));
+  committed_leaf_count_ = leaf_count_;
+  pending_leaves_.clear();
+  TrimCache();
+  return true;
+}
+
+
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
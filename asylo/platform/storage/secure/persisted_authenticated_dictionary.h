@@ -0,0 +1,238 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_STORAGE_SECURE_PERSISTED_AUTHENTICATED_DICTIONARY_H_
+#define ASYLO_PLATFORM_STORAGE_SECURE_PERSISTED_AUTHENTICATED_DICTIONARY_H_
+
+#include <stdint.h>
+
+#include <list>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "asylo/crypto/util/bytes.h"
+#include "asylo/platform/storage/secure/authenticated_dictionary.h"
+
+namespace asylo {
+namespace platform {
+namespace storage {
+
+// Suffix appended to the path of a secure file to form the path of the file
+// that holds its Merkle tree nodes.
+constexpr char kMerkleTreeFileSuffix[] = ".mtree";
+
+// Length of a Merkle tree node (SHA-256 digest).
+constexpr size_t kNodeHashLength = kDigestLength;
+
+// Authenticated Dictionary implementation backed by a Merkle tree whose nodes
+// are persisted in a file, so that a tree can be attached to without hashing
+// all of its leaves.
+//
+// The tree is the RFC 6962 Merkle tree built by CTMMTAuthenticatedDictionary,
+// and yields the same roots. Nodes are stored in the in-order ("flat tree")
+// layout, in which the position of a node depends only on its level and index
+// and not on the size of the tree, so that growing the tree never moves
+// existing nodes. The file contents are untrusted: after Load() the root is
+// trusted only once the caller has authenticated it, and individual nodes are
+// read and verified against the root lazily, along the path of each leaf that
+// is accessed. Verified nodes are kept in memory, so later accesses verify
+// only the part of the path that has not been verified yet.
+//
+// The nodes kept in memory are bounded by kMaxCachedNodes, so that memory use
+// does not grow with the size of the file. Nodes in the top kPinnedLevels
+// levels of the tree are always kept. Other nodes are evicted in least
+// recently used order, except for updated nodes, which are kept until Flush()
+// writes them.
+//
+// Leaf updates and additions are buffered and applied when the root is next
+// computed. Updated nodes are written to the file by Flush().
+//
+// The class is not thread-safe; callers must serialize access, including to
+// const methods, which may read and cache nodes.
+class PersistedAuthenticatedDictionary : public AuthenticatedDictionary {
+ public:
+  // Number of nodes kept in memory beyond which clean nodes are evicted.
+  static constexpr size_t kMaxCachedNodes = 1 << 15;
+
+  // Number of levels at the top of the tree whose nodes are never evicted.
+  static constexpr int kPinnedLevels = 10;
+
+  // Creates an empty tree persisted at |path|. The file is not accessed until
+  // Load() or Flush() is called.
+  explicit PersistedAuthenticatedDictionary(std::string path);
+
+  ~PersistedAuthenticatedDictionary() override;
+
+  PersistedAuthenticatedDictionary(const PersistedAuthenticatedDictionary &) =
+      delete;
+  PersistedAuthenticatedDictionary &operator=(
+      const PersistedAuthenticatedDictionary &) = delete;
+
+  size_t LeafCount() const final { return leaf_count_; }
+
+  size_t AddLeaf(const std::string &data) final;
+
+  size_t AddLeafHash(const std::string &hash) final;
+
+  // Returns an empty string if pending updates cannot be applied because nodes
+  // needed to compute the root fail verification or cannot be read.
+  std::string CurrentRoot() final;
+
+  // Fails if pending updates cannot be applied.
+  bool CurrentRoot(Digest *root) final;
+
+  // Returns an empty string if the leaf is out of range, or if its hash cannot
+  // be read or fails verification against the root.
+  std::string LeafHash(size_t leaf) const final;
+
+  std::string LeafHash(const std::string &data) const final;
+
+  bool UpdateLeaf(size_t leaf, const std::string &data) final;
+
+  bool UpdateLeaves(size_t first_leaf, const uint8_t *data, size_t data_length,
+                    size_t count) final;
+
+  // Attaches to the tree persisted in the file: reads the leaf count and the
+  // root from the file header, without reading any nodes. Returns false if the
+  // file does not exist or does not hold a tree. The root is read from
+  // untrusted storage, and the caller must authenticate CurrentRoot() and
+  // LeafCount() before relying on the tree.
+  bool Load();
+
+  // Discards the state of the tree and leaves it empty. The next Flush()
+  // rewrites the file from scratch.
+  void Reset();
+
+  // Writes the nodes updated since the last flush, followed by the header with
+  // the current root. Returns false on failure.
+  bool Flush();
+
+  // Returns the number of nodes kept in memory.
+  size_t CachedNodeCount() const { return nodes_.size(); }
+
+ private:
+  using NodeHash = Digest;
+
+  // A verified node kept in memory.
+  struct CachedNode {
+    NodeHash hash;
+
+    // Entry of the node in |lru_|, or |lru_|.end() if the node is dirty.
+    std::list<uint64_t>::iterator lru_entry;
+  };
+
+  // Returns the position of node |index| at tree level |level| in the file,
+  // counted in nodes. Leaves are at level 0.
+  static uint64_t NodePosition(int level, uint64_t index);
+
+  // Returns the number of nodes at |level| of a tree with |leaf_count| leaves.
+  static uint64_t LevelLength(int level, uint64_t leaf_count);
+
+  // Returns the level of the root of a tree with |leaf_count| leaves.
+  static int RootLevel(uint64_t leaf_count);
+
+  // Returns the level of the node at |position|.
+  static int PositionLevel(uint64_t position);
+
+  // Returns the cached node at |position| and marks it as most recently used,
+  // or returns nullptr if the node is not cached.
+  const NodeHash *FindNode(uint64_t position) const;
+
+  // Caches |hash| as the node at |position|. A clean node may be evicted by
+  // TrimCache(), a dirty one is kept until it has been flushed.
+  void StoreNode(uint64_t position, const NodeHash &hash, bool dirty) const;
+
+  // Evicts clean nodes below the pinned levels, least recently used first,
+  // until at most kMaxCachedNodes nodes are cached or only nodes that may not
+  // be evicted are left.
+  void TrimCache() const;
+
+  // Verifies the hash of leaf |index| of the committed tree against the root,
+  // caching the leaf and the nodes verified along with it. Returns false if
+  // the nodes cannot be read or verification fails.
+  bool VerifyLeaf(uint64_t index) const;
+
+  // Verifies node |index| at |level| of the committed tree against the root,
+  // reading it from the file unless it is cached, and caches it along with the
+  // nodes verified with it. Returns false if the nodes cannot be read or
+  // verification fails.
+  bool VerifyNode(int level, uint64_t index) const;
+
+  // Verifies leaf |index| of the committed tree and makes sure that every node
+  // on its path to the root, and the sibling of every such node, is cached.
+  // These are the nodes that an update of the leaf, or an addition of leaves
+  // after it, is computed from.
+  bool VerifyPath(uint64_t index) const;
+
+  // Checks that |node|, node |index| at |level| of the committed tree, leads
+  // to the root or to a cached ancestor, reading uncached siblings from the
+  // file. Adds the nodes read or computed along the way to |verified|.
+  bool VerifyAncestors(int level, uint64_t index, NodeHash node,
+                       std::unordered_map<uint64_t, NodeHash> *verified) const;
+
+  // Opens the file for reading, if not open yet. Returns false on failure.
+  bool OpenForReading() const;
+
+  // Reads |count| nodes starting at |position| from the file into |nodes|.
+  bool ReadNodes(uint64_t position, size_t count, NodeHash *nodes) const;
+
+  // Applies pending leaf hashes and recomputes their ancestors. Returns false
+  // if any node needed for the computation cannot be verified.
+  bool ApplyPendingLeaves();
+
+  const std::string path_;
+
+  // Number of leaves, including pending additions.
+  uint64_t leaf_count_;
+
+  // Number of leaves and root of the tree without pending updates. All cached
+  // nodes belong to this tree.
+  uint64_t committed_leaf_count_;
+  NodeHash root_;
+
+  // Leaf hashes added or updated since the root was last computed, keyed on
+  // leaf index.
+  std::map<uint64_t, NodeHash> pending_leaves_;
+
+  // Verified nodes of the committed tree keyed on their position. Avoid using
+  // absl based containers which may perform system calls, as this class is
+  // expected to be used in trusted primitives layer where system calls might
+  // not be available.
+  mutable std::unordered_map<uint64_t, CachedNode> nodes_;
+
+  // Positions of the clean cached nodes, most recently used first.
+  mutable std::list<uint64_t> lru_;
+
+  // Positions of cached nodes that have not been written to the file yet.
+  std::unordered_set<uint64_t> dirty_nodes_;
+
+  // Whether the file no longer holds a prefix of this tree and has to be
+  // rewritten from scratch on the next flush.
+  bool rewrite_file_;
+
+  // Descriptor used for reading nodes, opened on first use.
+  mutable int read_fd_;
+};
+
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_STORAGE_SECURE_PERSISTED_AUTHENTICATED_DICTIONARY_H_
@@ -0,0 +1,125 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/storage/secure/read_ahead.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "asylo/util/logging.h"
+
+namespace asylo {
+namespace platform {
+namespace storage {
+
+ReadAhead::ReadAhead(uint64_t window, FetchCallback fetch)
+    : window_(window),
+      fetch_(std::move(fetch)),
+      has_last_block_(false),
+      last_block_(0),
+      scheduled_end_(0),
+      pending_begin_(0),
+      pending_end_(0),
+      worker_started_(false),
+      worker_failed_(false),
+      stopping_(false) {}
+
+ReadAhead::~ReadAhead() {
+  bool joined;
+  {
+    absl::MutexLock lock(&mu_);
+    stopping_ = true;
+    joined = worker_started_;
+  }
+  if (joined) {
+    pthread_join(worker_, nullptr);
+  }
+}
+
+void ReadAhead::RecordRead(uint64_t first_block, uint64_t count) {
+  if (window_ == 0 || count == 0) {
+    return;
+  }
+
+  absl::MutexLock lock(&mu_);
+  const uint64_t last_block = first_block + count - 1;
+  const bool sequential =
+      has_last_block_ &&
+      (first_block == last_block_ || first_block == last_block_ + 1);
+  has_last_block_ = true;
+  last_block_ = last_block;
+  if (!sequential) {
+    scheduled_end_ = 0;
+    pending_begin_ = pending_end_ = 0;
+    return;
+  }
+
+  // Keep the window ahead of the reads, scheduling blocks in batches.
+  if (worker_failed_ || scheduled_end_ > last_block + window_ / 2) {
+    return;
+  }
+  const uint64_t begin = std::max(scheduled_end_, last_block + 1);
+  const uint64_t end = last_block + 1 + window_;
+  if (pending_end_ != begin) {
+    pending_begin_ = begin;
+  }
+  pending_end_ = end;
+  scheduled_end_ = end;
+
+  if (!worker_started_) {
+    worker_started_ =
+        pthread_create(&worker_, nullptr, &ReadAhead::RunWorker, this) == 0;
+    if (!worker_started_) {
+      LOG(WARNING) << "Failed to start the read-ahead thread, read-ahead is "
+                      "disabled.";
+      worker_failed_ = true;
+      pending_begin_ = pending_end_ = 0;
+    }
+  }
+}
+
+void *ReadAhead::RunWorker(void *arg) {
+  static_cast<ReadAhead *>(arg)->Run();
+  return nullptr;
+}
+
+bool ReadAhead::HasWork() const {
+  return stopping_ || pending_begin_ < pending_end_;
+}
+
+void ReadAhead::Run() {
+  while (true) {
+    uint64_t begin;
+    uint64_t end;
+    {
+      absl::MutexLock lock(&mu_);
+      mu_.Await(absl::Condition(this, &ReadAhead::HasWork));
+      if (stopping_) {
+        return;
+      }
+      begin = pending_begin_;
+      end = pending_end_;
+      pending_begin_ = pending_end_ = 0;
+    }
+    fetch_(begin, end - begin);
+  }
+}
+
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
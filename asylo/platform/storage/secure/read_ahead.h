@@ -0,0 +1,109 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_STORAGE_SECURE_READ_AHEAD_H_
+#define ASYLO_PLATFORM_STORAGE_SECURE_READ_AHEAD_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <functional>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+namespace asylo {
+namespace platform {
+namespace storage {
+
+// Detects sequential reads of a secure file, and fetches the blocks that follow
+// them ahead of time on a worker thread. The fetched blocks are expected to be
+// verified and put in the block cache of the file, so that the reads reaching
+// them neither exit the enclave nor decrypt.
+//
+// A read is sequential if it starts in the block the previous read ended in, or
+// in the next block. From the second read of a sequential run on, the blocks
+// following the last block read are fetched up to |window| blocks ahead, in
+// batches scheduled whenever less than half of the window is left ahead of the
+// reads. A read that is not sequential ends the run, and drops the blocks
+// scheduled but not fetched yet.
+//
+// The class is thread-safe.
+class ReadAhead {
+ public:
+  // Callback fetching the |count| blocks starting at |first_block|, run on the
+  // worker thread.
+  using FetchCallback =
+      std::function<void(uint64_t first_block, uint64_t count)>;
+
+  // Creates a read-ahead of up to |window| blocks that calls |fetch| to fetch
+  // blocks. The worker thread is created when blocks are first scheduled. A
+  // |window| of 0 disables read-ahead.
+  ReadAhead(uint64_t window, FetchCallback fetch);
+
+  // Stops the worker thread, waiting for a fetch in progress to complete.
+  ~ReadAhead() ABSL_LOCKS_EXCLUDED(mu_);
+
+  ReadAhead(const ReadAhead &) = delete;
+  ReadAhead &operator=(const ReadAhead &) = delete;
+
+  // Records a read of the |count| blocks starting at |first_block|, and
+  // schedules the blocks that follow if the read is sequential. Does not wait
+  // for the blocks to be fetched.
+  void RecordRead(uint64_t first_block, uint64_t count)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+ private:
+  // Entry point of the worker thread.
+  static void *RunWorker(void *arg);
+
+  // Returns whether the worker thread has blocks to fetch or is to stop.
+  bool HasWork() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Fetches the scheduled blocks until the read-ahead is stopped.
+  void Run() ABSL_LOCKS_EXCLUDED(mu_);
+
+  const uint64_t window_;
+  const FetchCallback fetch_;
+
+  absl::Mutex mu_;
+
+  // Last block of the previous read, if any.
+  bool has_last_block_ ABSL_GUARDED_BY(mu_);
+  uint64_t last_block_ ABSL_GUARDED_BY(mu_);
+
+  // End of the blocks scheduled for the current sequential run, or 0 if none.
+  uint64_t scheduled_end_ ABSL_GUARDED_BY(mu_);
+
+  // Blocks scheduled but not taken by the worker thread yet.
+  uint64_t pending_begin_ ABSL_GUARDED_BY(mu_);
+  uint64_t pending_end_ ABSL_GUARDED_BY(mu_);
+
+  // State of the worker thread. Read-ahead stays off if the worker thread
+  // cannot be created.
+  bool worker_started_ ABSL_GUARDED_BY(mu_);
+  bool worker_failed_ ABSL_GUARDED_BY(mu_);
+  bool stopping_ ABSL_GUARDED_BY(mu_);
+  pthread_t worker_;
+};
+
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_STORAGE_SECURE_READ_AHEAD_H_
@@ -0,0 +1,1538 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/storage/secure/secure_kv_store.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <openssl/rand.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "absl/base/attributes.h"
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "asylo/platform/host_call/trusted/host_calls.h"
+#include "asylo/platform/storage/secure/merkle_tree_hash.h"
+#include "asylo/util/logging.h"
+
+namespace asylo {
+namespace platform {
+namespace storage {
+
+using crypto::gcmlib::GcmCryptor;
+using crypto::gcmlib::GcmCryptorKey;
+using crypto::gcmlib::GcmCryptorRegistry;
+using crypto::gcmlib::kKeyLength;
+using crypto::gcmlib::kTagLength;
+using crypto::gcmlib::kTokenLength;
+
+namespace {
+
+// Identifies the manifest of a secure key-value store and the version of the
+// layout of the store.
+constexpr char kManifestMagic[8] = {'A', 'S', 'Y', 'L', 'O', 'K', 'V', '1'};
+
+// Maximum length of the data sealed in a single record. A data block is sealed
+// in a single record, and the index of a segment and the manifest in as many
+// records as they need.
+constexpr size_t kMaxKvRecordLength = 64 * 1024;
+
+// Maximum length of the manifest file. The length of the file is reported by
+// the host, so it is checked before the file is read into the enclave.
+constexpr size_t kMaxManifestFileLength = 16 * 1024 * 1024;
+
+// Number of bytes of sealed blocks buffered before they are written to the
+// host when writing a segment.
+constexpr size_t kSegmentWriteBufferLength = 256 * 1024;
+
+// Approximate memory overhead of a memtable entry beyond its key and value.
+constexpr size_t kMemEntryOverhead = 64;
+
+// Upper bound on the number of hash functions of a bloom filter.
+constexpr uint32_t kMaxBloomHashCount = 30;
+
+// Kinds of sealed objects, bound to their records so that one cannot be passed
+// off as another.
+enum ObjectKind : uint32_t {
+  kManifestObject = 1,
+  kBlockObject = 2,
+  kIndexObject = 3,
+};
+
+// Types of the entries of write-ahead log batches and data blocks.
+constexpr uint8_t kValueEntry = 0;
+constexpr uint8_t kDeletionEntry = 1;
+
+// Header of an encoded entry, followed by its key and value.
+struct EntryHeader {
+  uint8_t type;
+  uint32_t key_length;
+  uint32_t value_length;
+} ABSL_ATTRIBUTE_PACKED;
+
+// Header of a sealed record, followed by its ciphertext and tag.
+struct RecordHeader {
+  uint32_t length;
+  uint8_t token[kTokenLength];
+} ABSL_ATTRIBUTE_PACKED;
+
+// Associated data authenticated along with the data of a record. |index| is
+// the index of a data block in its segment, and |record| the index of the
+// record among those an object is sealed in.
+struct RecordAssociatedData {
+  uint8_t store_id[kKvStoreIdLength];
+  uint32_t kind;
+  uint64_t object_id;
+  uint64_t index;
+  uint64_t record;
+  uint64_t object_length;
+  uint32_t length;
+} ABSL_ATTRIBUTE_PACKED;
+
+// Plaintext header of the manifest file, followed by the sealed manifest.
+struct ManifestFileHeader {
+  char magic[sizeof(kManifestMagic)];
+  uint8_t store_id[kKvStoreIdLength];
+  uint64_t length;
+} ABSL_ATTRIBUTE_PACKED;
+
+// Header of the manifest, followed by |segment_count| segment records.
+struct ManifestHeader {
+  uint64_t version;
+  uint64_t wal_number;
+  uint64_t next_segment_id;
+  uint32_t segment_count;
+} ABSL_ATTRIBUTE_PACKED;
+
+// Location and digest of the sealed index of a segment.
+struct SegmentRecord {
+  uint64_t id;
+  uint64_t entry_count;
+  uint64_t index_offset;
+  uint64_t index_sealed_length;
+  uint64_t index_length;
+  uint8_t digest[kDigestLength];
+} ABSL_ATTRIBUTE_PACKED;
+
+// Index entry of a data block, followed by the first key of the block.
+struct BlockRecord {
+  uint64_t offset;
+  uint32_t sealed_length;
+  uint32_t length;
+  uint32_t first_key_length;
+} ABSL_ATTRIBUTE_PACKED;
+
+bool is_transient_error(int err) { return (err == EAGAIN) || (err == EINTR); }
+
+// Returns -1 on failure, or min(|len|, bytes to EOF) on success.
+ssize_t pread_all(int fd, void *buf, size_t len, off_t offset) {
+  size_t bytes_read_total = 0;
+  while (bytes_read_total < len) {
+    int bytes_read;
+    do {
+      bytes_read = enc_untrusted_pread64(
+          fd, static_cast<uint8_t *>(buf) + bytes_read_total,
+          len - bytes_read_total, offset + bytes_read_total);
+    } while ((bytes_read == -1) && is_transient_error(errno));
+    if (bytes_read == -1) {
+      return -1;
+    }
+    if (bytes_read == 0) {
+      break;
+    }
+    bytes_read_total += bytes_read;
+  }
+  return bytes_read_total;
+}
+
+// Returns false on failure.
+bool pwrite_all(int fd, const void *buf, size_t len, off_t offset) {
+  size_t bytes_written_total = 0;
+  while (bytes_written_total < len) {
+    int bytes_written;
+    do {
+      bytes_written = enc_untrusted_pwrite64(
+          fd, static_cast<const uint8_t *>(buf) + bytes_written_total,
+          len - bytes_written_total, offset + bytes_written_total);
+    } while ((bytes_written == -1) && is_transient_error(errno));
+    if (bytes_written <= 0) {
+      return false;
+    }
+    bytes_written_total += bytes_written;
+  }
+  return true;
+}
+
+template <typename T>
+void AppendPod(const T &value, std::vector<uint8_t> *out) {
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(&value);
+  out->insert(out->end(), data, data + sizeof(value));
+}
+
+void AppendBytes(absl::string_view bytes, std::vector<uint8_t> *out) {
+  out->insert(out->end(), bytes.begin(), bytes.end());
+}
+
+// Reads fixed-size values and strings from a buffer, failing past its end.
+class ByteReader {
+ public:
+  ByteReader(const uint8_t *data, size_t size)
+      : data_(data), end_(data + size) {}
+
+  template <typename T>
+  bool Read(T *value) {
+    if (static_cast<size_t>(end_ - data_) < sizeof(T)) {
+      return false;
+    }
+    memcpy(value, data_, sizeof(T));
+    data_ += sizeof(T);
+    return true;
+  }
+
+  bool ReadBytes(size_t length, absl::string_view *bytes) {
+    if (static_cast<size_t>(end_ - data_) < length) {
+      return false;
+    }
+    *bytes = absl::string_view(reinterpret_cast<const char *>(data_), length);
+    data_ += length;
+    return true;
+  }
+
+  bool done() const { return data_ == end_; }
+
+ private:
+  const uint8_t *data_;
+  const uint8_t *end_;
+};
+
+// Appends an entry to |out|.
+void AppendEntry(bool deleted, absl::string_view key, absl::string_view value,
+                 std::vector<uint8_t> *out) {
+  EntryHeader header;
+  header.type = deleted ? kDeletionEntry : kValueEntry;
+  header.key_length = key.size();
+  header.value_length = value.size();
+  AppendPod(header, out);
+  AppendBytes(key, out);
+  AppendBytes(value, out);
+}
+
+// Reads an entry from |reader|. Returns false if it is malformed.
+bool ReadEntry(ByteReader *reader, bool *deleted, absl::string_view *key,
+               absl::string_view *value) {
+  EntryHeader header;
+  if (!reader->Read(&header) ||
+      (header.type != kValueEntry && header.type != kDeletionEntry) ||
+      header.key_length > kMaxKvKeyLength ||
+      header.value_length > kMaxKvValueLength ||
+      !reader->ReadBytes(header.key_length, key) ||
+      !reader->ReadBytes(header.value_length, value)) {
+    return false;
+  }
+  *deleted = header.type == kDeletionEntry;
+  return true;
+}
+
+// Seals the |length| bytes of |data|, an object of |kind| identified by
+// |object_id| and |index|, and appends the sealed records to |out|. Returns
+// false on failure.
+bool Seal(GcmCryptor *cryptor, const uint8_t *store_id, uint32_t kind,
+          uint64_t object_id, uint64_t index, const uint8_t *data,
+          size_t length, std::vector<uint8_t> *out) {
+  RecordAssociatedData associated_data;
+  memcpy(associated_data.store_id, store_id, kKvStoreIdLength);
+  associated_data.kind = kind;
+  associated_data.object_id = object_id;
+  associated_data.index = index;
+  associated_data.object_length = length;
+  size_t offset = 0;
+  for (uint64_t record = 0; offset < length; record++) {
+    const size_t record_length = std::min(kMaxKvRecordLength, length - offset);
+    associated_data.record = record;
+    associated_data.length = record_length;
+    RecordHeader header;
+    header.length = record_length;
+    const size_t start = out->size();
+    out->resize(start + sizeof(header) + record_length + kTagLength);
+    if (!cryptor->EncryptRecord(
+            data + offset, record_length,
+            reinterpret_cast<const uint8_t *>(&associated_data),
+            sizeof(associated_data), header.token,
+            out->data() + start + sizeof(header))) {
+      return false;
+    }
+    memcpy(out->data() + start, &header, sizeof(header));
+    offset += record_length;
+  }
+  return true;
+}
+
+// Opens the |sealed_length| bytes of |sealed| as an object of |length| bytes
+// sealed by Seal() into |out|. Returns false on failure.
+bool Unseal(const GcmCryptor *cryptor, const uint8_t *store_id, uint32_t kind,
+            uint64_t object_id, uint64_t index, const uint8_t *sealed,
+            size_t sealed_length, size_t length, std::vector<uint8_t> *out) {
+  RecordAssociatedData associated_data;
+  memcpy(associated_data.store_id, store_id, kKvStoreIdLength);
+  associated_data.kind = kind;
+  associated_data.object_id = object_id;
+  associated_data.index = index;
+  associated_data.object_length = length;
+  out->resize(length);
+  size_t in = 0;
+  size_t offset = 0;
+  for (uint64_t record = 0; offset < length; record++) {
+    const size_t record_length = std::min(kMaxKvRecordLength, length - offset);
+    RecordHeader header;
+    if (sealed_length - in < sizeof(header) + record_length + kTagLength) {
+      return false;
+    }
+    memcpy(&header, sealed + in, sizeof(header));
+    associated_data.record = record;
+    associated_data.length = record_length;
+    if (header.length != record_length ||
+        !cryptor->DecryptRecord(
+            sealed + in + sizeof(header), record_length,
+            reinterpret_cast<const uint8_t *>(&associated_data),
+            sizeof(associated_data), header.token, out->data() + offset)) {
+      return false;
+    }
+    in += sizeof(header) + record_length + kTagLength;
+    offset += record_length;
+  }
+  return in == sealed_length;
+}
+
+// Returns a hash of |key|. Bloom filters are persisted, so the hash must not
+// change across builds.
+uint64_t HashKey(absl::string_view key) {
+  // FNV-1a, followed by the SplitMix64 finalizer to spread the bits.
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (char c : key) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ULL;
+  }
+  hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+  return hash ^ (hash >> 31);
+}
+
+// Adds |key| to the bloom filter |bloom| with |hash_count| hash functions,
+// derived from one hash by double hashing.
+void BloomAdd(absl::string_view key, uint32_t hash_count,
+              std::vector<uint8_t> *bloom) {
+  const uint64_t bit_count = bloom->size() * 8;
+  uint64_t hash = HashKey(key);
+  const uint64_t delta = (hash >> 33) | (hash << 31);
+  for (uint32_t i = 0; i < hash_count; i++) {
+    const uint64_t bit = hash % bit_count;
+    (*bloom)[bit / 8] |= 1 << (bit % 8);
+    hash += delta;
+  }
+}
+
+// Returns false if |key| is certainly not in the bloom filter |bloom|.
+bool BloomMayContain(absl::string_view key, uint32_t hash_count,
+                     const std::vector<uint8_t> &bloom) {
+  if (bloom.empty()) {
+    return true;
+  }
+  const uint64_t bit_count = bloom.size() * 8;
+  uint64_t hash = HashKey(key);
+  const uint64_t delta = (hash >> 33) | (hash << 31);
+  for (uint32_t i = 0; i < hash_count; i++) {
+    const uint64_t bit = hash % bit_count;
+    if ((bloom[bit / 8] & (1 << (bit % 8))) == 0) {
+      return false;
+    }
+    hash += delta;
+  }
+  return true;
+}
+
+// Returns the root of the RFC 6962 Merkle tree with the |count| leaf hashes at
+// |leaves|.
+Digest MerkleRoot(const Digest *leaves, size_t count) {
+  if (count == 0) {
+    return EmptyMerkleRoot();
+  }
+  if (count == 1) {
+    return leaves[0];
+  }
+  size_t split = 1;
+  while (split * 2 < count) {
+    split *= 2;
+  }
+  return HashMerkleChildren(MerkleRoot(leaves, split),
+                            MerkleRoot(leaves + split, count - split));
+}
+
+// Sanitizes the options a store is opened with.
+SecureKvOptions SanitizeOptions(SecureKvOptions options) {
+  options.block_length =
+      std::min(std::max<size_t>(options.block_length, 1), kMaxKvRecordLength);
+  options.compaction_trigger =
+      std::max<size_t>(options.compaction_trigger, 1);
+  return options;
+}
+
+}  // namespace
+
+struct SecureKvStore::Segment {
+  // Location of a sealed data block in the segment file, and its first key.
+  struct Block {
+    uint64_t offset;
+    uint32_t sealed_length;
+    uint32_t length;
+    std::string first_key;
+  };
+
+  ~Segment() {
+    if (host_fd != -1) {
+      enc_untrusted_close(host_fd);
+    }
+  }
+
+  // Returns the index of the block that holds |key| if the segment holds it,
+  // or the number of blocks if |key| is out of the range of the segment.
+  size_t FindBlock(absl::string_view key) const {
+    if (blocks.empty() || key < blocks.front().first_key || key > last_key) {
+      return blocks.size();
+    }
+    return SeekBlock(key);
+  }
+
+  // Returns the index of the block where entries with keys not less than
+  // |key| start, given that |key| is not past the last key.
+  size_t SeekBlock(absl::string_view key) const {
+    auto it = std::upper_bound(
+        blocks.begin(), blocks.end(), key,
+        [](absl::string_view lhs, const Block &rhs) {
+          return lhs < rhs.first_key;
+        });
+    return it == blocks.begin() ? 0 : it - blocks.begin() - 1;
+  }
+
+  uint64_t id = 0;
+  int host_fd = -1;
+  uint64_t entry_count = 0;
+
+  // Location, lengths, and digest of the sealed index.
+  uint64_t index_offset = 0;
+  uint64_t index_sealed_length = 0;
+  uint64_t index_length = 0;
+  Digest digest;
+
+  // The index, held in the enclave.
+  std::vector<Block> blocks;
+  std::string last_key;
+  uint32_t bloom_hash_count = 0;
+  std::vector<uint8_t> bloom;
+};
+
+class SecureKvStore::EntrySource {
+ public:
+  virtual ~EntrySource() = default;
+
+  // Moves to the first entry with a key not less than |target|. Returns false
+  // on failure.
+  virtual bool Seek(absl::string_view target) = 0;
+
+  // Moves to the next entry. Returns false on failure.
+  virtual bool Next() = 0;
+
+  // Returns whether the source is at an entry.
+  virtual bool Valid() const = 0;
+
+  // Return the key, value, and type of the current entry. The returned views
+  // remain valid until the source moves.
+  virtual absl::string_view key() const = 0;
+  virtual absl::string_view value() const = 0;
+  virtual bool deleted() const = 0;
+};
+
+class SecureKvStore::MemtableSource : public SecureKvStore::EntrySource {
+ public:
+  explicit MemtableSource(const std::map<std::string, MemEntry> *memtable)
+      : memtable_(memtable), it_(memtable->begin()) {}
+
+  bool Seek(absl::string_view target) override {
+    it_ = memtable_->lower_bound(std::string(target));
+    return true;
+  }
+
+  bool Next() override {
+    ++it_;
+    return true;
+  }
+
+  bool Valid() const override { return it_ != memtable_->end(); }
+  absl::string_view key() const override { return it_->first; }
+  absl::string_view value() const override { return it_->second.value; }
+  bool deleted() const override { return it_->second.deleted; }
+
+ private:
+  const std::map<std::string, MemEntry> *memtable_;
+  std::map<std::string, MemEntry>::const_iterator it_;
+};
+
+// Streams the entries of a segment, reading and verifying one data block at a
+// time.
+class SecureKvStore::SegmentSource : public SecureKvStore::EntrySource {
+ public:
+  SegmentSource(const SecureKvStore *store, const Segment *segment)
+      : store_(store),
+        segment_(segment),
+        block_index_(0),
+        reader_(nullptr, 0),
+        valid_(false),
+        deleted_(false) {}
+
+  bool Seek(absl::string_view target) override {
+    if (segment_->blocks.empty() || target > segment_->last_key) {
+      valid_ = false;
+      return true;
+    }
+    if (!LoadBlock(segment_->SeekBlock(target))) {
+      return false;
+    }
+    while (valid_ && key_ < target) {
+      if (!Next()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool Next() override {
+    if (!reader_.done()) {
+      return ReadEntry();
+    }
+    if (block_index_ + 1 >= segment_->blocks.size()) {
+      valid_ = false;
+      return true;
+    }
+    return LoadBlock(block_index_ + 1);
+  }
+
+  bool Valid() const override { return valid_; }
+  absl::string_view key() const override { return key_; }
+  absl::string_view value() const override { return value_; }
+  bool deleted() const override { return deleted_; }
+
+ private:
+  // Reads and verifies block |index| and moves to its first entry.
+  bool LoadBlock(size_t index) {
+    block_index_ = index;
+    if (!store_->ReadBlock(*segment_, index, &block_)) {
+      valid_ = false;
+      return false;
+    }
+    reader_ = ByteReader(block_.data(), block_.size());
+    return ReadEntry();
+  }
+
+  bool ReadEntry() {
+    valid_ = storage::ReadEntry(&reader_, &deleted_, &key_, &value_);
+    if (!valid_) {
+      LOG(ERROR) << "Malformed block " << block_index_ << " in segment "
+                 << segment_->id << " of secure key-value store: "
+                 << store_->path_;
+      errno = EIO;
+    }
+    return valid_;
+  }
+
+  const SecureKvStore *store_;
+  const Segment *segment_;
+  size_t block_index_;
+  std::vector<uint8_t> block_;
+  ByteReader reader_;
+  bool valid_;
+  bool deleted_;
+  absl::string_view key_;
+  absl::string_view value_;
+};
+
+// Merges sources ordered from newest to oldest. For a key present in several
+// sources, the entry of the newest one is returned.
+class SecureKvStore::MergingSource : public SecureKvStore::EntrySource {
+ public:
+  explicit MergingSource(std::vector<std::unique_ptr<EntrySource>> sources)
+      : sources_(std::move(sources)), current_(nullptr) {}
+
+  bool Seek(absl::string_view target) override {
+    for (auto &source : sources_) {
+      if (!source->Seek(target)) {
+        return false;
+      }
+    }
+    FindCurrent();
+    return true;
+  }
+
+  bool Next() override {
+    for (auto &source : sources_) {
+      if (source->Valid() && source->key() == current_key_ &&
+          !source->Next()) {
+        return false;
+      }
+    }
+    FindCurrent();
+    return true;
+  }
+
+  bool Valid() const override { return current_ != nullptr; }
+  absl::string_view key() const override { return current_->key(); }
+  absl::string_view value() const override { return current_->value(); }
+  bool deleted() const override { return current_->deleted(); }
+
+ private:
+  // Points |current_| at the newest source with the smallest key.
+  void FindCurrent() {
+    current_ = nullptr;
+    for (auto &source : sources_) {
+      if (source->Valid() &&
+          (current_ == nullptr || source->key() < current_->key())) {
+        current_ = source.get();
+      }
+    }
+    if (current_) {
+      current_key_.assign(current_->key().data(), current_->key().size());
+    }
+  }
+
+  std::vector<std::unique_ptr<EntrySource>> sources_;
+  EntrySource *current_;
+  std::string current_key_;
+};
+
+void SecureKvWriteBatch::Put(absl::string_view key, absl::string_view value) {
+  ops_.push_back({false, std::string(key), std::string(value)});
+}
+
+void SecureKvWriteBatch::Delete(absl::string_view key) {
+  ops_.push_back({true, std::string(key), std::string()});
+}
+
+std::unique_ptr<SecureKvStore> SecureKvStore::Open(
+    const char *path, const uint8_t *key, uint32_t key_length,
+    const SecureKvOptions &options, const Digest *expected_root) {
+  if (!path || path[0] != '/') {
+    LOG(ERROR) << "Secure key-value store path is expected to be absolute.";
+    errno = EINVAL;
+    return nullptr;
+  }
+  if (!key || key_length != kKeyLength) {
+    LOG(ERROR) << "Attempt made to set an invalid key.";
+    errno = EINVAL;
+    return nullptr;
+  }
+
+  std::unique_ptr<SecureKvStore> store =
+      absl::WrapUnique(new SecureKvStore(path, options));
+  absl::MutexLock lock(&store->mu_);
+  store->master_key_ = GcmCryptorKey(key, key_length);
+  store->cryptor_ = GcmCryptorRegistry::GetInstance().GetGcmCryptor(
+      kMaxKvRecordLength, store->master_key_);
+  if (!store->cryptor_) {
+    LOG(ERROR) << "Unable to instantiate GCM cryptor.";
+    errno = EIO;
+    return nullptr;
+  }
+
+  struct stat st;
+  const std::string manifest_path = store->FilePath(".manifest");
+  if (enc_untrusted_stat(manifest_path.c_str(), &st) == 0) {
+    if (!store->LoadManifest()) {
+      return nullptr;
+    }
+  } else if (errno != ENOENT) {
+    LOG(ERROR) << "Failed to stat the manifest of secure key-value store: "
+               << path;
+    return nullptr;
+  } else if (expected_root) {
+    // A store that should exist has been removed.
+    LOG(ERROR) << "Secure key-value store is missing its manifest: " << path;
+    errno = EIO;
+    return nullptr;
+  } else if (!store->Create()) {
+    return nullptr;
+  }
+
+  if (expected_root && !(store->root_ == *expected_root)) {
+    LOG(ERROR) << "Secure key-value store is not in the expected state: "
+               << path;
+    errno = EIO;
+    return nullptr;
+  }
+
+  store->wal_ = store->OpenWal(store->wal_number_, /*create=*/false);
+  if (!store->wal_ || !store->ReplayWal()) {
+    return nullptr;
+  }
+  return store;
+}
+
+SecureKvStore::SecureKvStore(std::string path, const SecureKvOptions &options)
+    : path_(std::move(path)),
+      options_(SanitizeOptions(options)),
+      cryptor_(nullptr),
+      version_(0),
+      wal_number_(0),
+      next_segment_id_(0),
+      memtable_bytes_(0) {
+  memset(store_id_, 0, sizeof(store_id_));
+}
+
+SecureKvStore::~SecureKvStore() {
+  {
+    absl::MutexLock lock(&mu_);
+    if (!wal_) {
+      return;
+    }
+  }
+  Close();
+}
+
+std::string SecureKvStore::FilePath(absl::string_view suffix) const {
+  return absl::StrCat(path_, suffix);
+}
+
+int SecureKvStore::CheckOpen() const {
+  if (!wal_) {
+    errno = EBADF;
+    return -1;
+  }
+  return 0;
+}
+
+bool SecureKvStore::Create() {
+  if (RAND_bytes(store_id_, sizeof(store_id_)) != 1) {
+    errno = EIO;
+    return false;
+  }
+  version_ = 0;
+  wal_number_ = 1;
+  next_segment_id_ = 1;
+
+  // The write-ahead log is created before the manifest that refers to it.
+  std::unique_ptr<SecureLog> wal = OpenWal(wal_number_, /*create=*/true);
+  if (!wal || wal->Close() != 0 || !WriteManifest()) {
+    LOG(ERROR) << "Failed to create secure key-value store: " << path_;
+    return false;
+  }
+  return true;
+}
+
+bool SecureKvStore::LoadManifest() {
+  const std::string manifest_path = FilePath(".manifest");
+  int fd = enc_untrusted_open(manifest_path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    LOG(ERROR) << "Failed to open the manifest of secure key-value store: "
+               << path_;
+    return false;
+  }
+  struct stat st;
+  std::vector<uint8_t> contents;
+  bool read = enc_untrusted_fstat(fd, &st) == 0 && st.st_size >= 0 &&
+              static_cast<uint64_t>(st.st_size) <= kMaxManifestFileLength;
+  if (read) {
+    contents.resize(st.st_size);
+    read = pread_all(fd, contents.data(), contents.size(), 0) ==
+           static_cast<ssize_t>(contents.size());
+  }
+  enc_untrusted_close(fd);
+
+  ManifestFileHeader file_header;
+  std::vector<uint8_t> manifest;
+  if (!read || contents.size() < sizeof(file_header)) {
+    LOG(ERROR) << "Failed to read the manifest of secure key-value store: "
+               << path_;
+    errno = EIO;
+    return false;
+  }
+  memcpy(&file_header, contents.data(), sizeof(file_header));
+  memcpy(store_id_, file_header.store_id, kKvStoreIdLength);
+  ManifestHeader header;
+  ByteReader reader(nullptr, 0);
+  if (memcmp(file_header.magic, kManifestMagic, sizeof(kManifestMagic)) != 0 ||
+      !Unseal(cryptor_, store_id_, kManifestObject, 0, 0,
+              contents.data() + sizeof(file_header),
+              contents.size() - sizeof(file_header), file_header.length,
+              &manifest) ||
+      !(reader = ByteReader(manifest.data(), manifest.size()),
+        reader.Read(&header))) {
+    LOG(ERROR) << "Integrity verification of the manifest failed for secure "
+                  "key-value store: "
+               << path_;
+    errno = EIO;
+    return false;
+  }
+
+  version_ = header.version;
+  wal_number_ = header.wal_number;
+  next_segment_id_ = header.next_segment_id;
+  std::vector<Digest> leaves(1 + header.segment_count);
+  for (uint32_t i = 0; i < header.segment_count; i++) {
+    SegmentRecord record;
+    if (!reader.Read(&record)) {
+      LOG(ERROR) << "Malformed manifest in secure key-value store: " << path_;
+      errno = EIO;
+      return false;
+    }
+    auto segment = absl::make_unique<Segment>();
+    segment->id = record.id;
+    segment->entry_count = record.entry_count;
+    segment->index_offset = record.index_offset;
+    segment->index_sealed_length = record.index_sealed_length;
+    segment->index_length = record.index_length;
+    segment->digest.assign(record.digest, kDigestLength);
+    if (!LoadSegmentIndex(segment.get())) {
+      return false;
+    }
+    leaves[1 + i] = segment->digest;
+    segments_.push_back(std::move(segment));
+  }
+
+  std::vector<uint8_t> state(store_id_, store_id_ + kKvStoreIdLength);
+  AppendPod(header, &state);
+  leaves[0] = HashMerkleLeaf(state.data(), state.size());
+  root_ = MerkleRoot(leaves.data(), leaves.size());
+  return true;
+}
+
+bool SecureKvStore::WriteManifest() {
+  version_++;
+  ManifestHeader header;
+  header.version = version_;
+  header.wal_number = wal_number_;
+  header.next_segment_id = next_segment_id_;
+  header.segment_count = segments_.size();
+  std::vector<uint8_t> manifest;
+  AppendPod(header, &manifest);
+  std::vector<Digest> leaves(1 + segments_.size());
+  for (size_t i = 0; i < segments_.size(); i++) {
+    const Segment &segment = *segments_[i];
+    SegmentRecord record;
+    record.id = segment.id;
+    record.entry_count = segment.entry_count;
+    record.index_offset = segment.index_offset;
+    record.index_sealed_length = segment.index_sealed_length;
+    record.index_length = segment.index_length;
+    memcpy(record.digest, segment.digest.data(), kDigestLength);
+    AppendPod(record, &manifest);
+    leaves[1 + i] = segment.digest;
+  }
+
+  ManifestFileHeader file_header;
+  memcpy(file_header.magic, kManifestMagic, sizeof(kManifestMagic));
+  memcpy(file_header.store_id, store_id_, kKvStoreIdLength);
+  file_header.length = manifest.size();
+  std::vector<uint8_t> contents;
+  AppendPod(file_header, &contents);
+  if (!Seal(cryptor_, store_id_, kManifestObject, 0, 0, manifest.data(),
+            manifest.size(), &contents)) {
+    LOG(ERROR) << "Failed to seal the manifest of secure key-value store: "
+               << path_;
+    errno = EIO;
+    return false;
+  }
+  if (contents.size() > kMaxManifestFileLength) {
+    LOG(ERROR) << "The manifest of secure key-value store is too large: "
+               << path_;
+    errno = EFBIG;
+    return false;
+  }
+
+  // The manifest is replaced atomically by renaming a complete copy over it.
+  const std::string manifest_path = FilePath(".manifest");
+  const std::string temp_path = FilePath(".manifest.tmp");
+  int fd = enc_untrusted_open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                              S_IRUSR | S_IWUSR);
+  if (fd == -1) {
+    LOG(ERROR) << "Failed to write the manifest of secure key-value store: "
+               << path_ << ", errno = " << errno;
+    return false;
+  }
+  bool written = pwrite_all(fd, contents.data(), contents.size(), 0) &&
+                 enc_untrusted_fsync(fd) == 0;
+  written = enc_untrusted_close(fd) == 0 && written;
+  if (!written ||
+      enc_untrusted_rename(temp_path.c_str(), manifest_path.c_str()) != 0) {
+    LOG(ERROR) << "Failed to write the manifest of secure key-value store: "
+               << path_ << ", errno = " << errno;
+    return false;
+  }
+
+  // Make the rename durable. This also persists the directory entries of the
+  // segment files and write-ahead log the manifest refers to, which are in the
+  // same directory.
+  const std::string directory = path_.substr(0, path_.rfind('/') + 1);
+  int dir_fd = enc_untrusted_open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+  bool synced = dir_fd != -1 && enc_untrusted_fsync(dir_fd) == 0;
+  if (dir_fd != -1) {
+    enc_untrusted_close(dir_fd);
+  }
+  if (!synced) {
+    LOG(ERROR) << "Failed to sync the directory of secure key-value store: "
+               << path_ << ", errno = " << errno;
+    return false;
+  }
+
+  std::vector<uint8_t> state(store_id_, store_id_ + kKvStoreIdLength);
+  AppendPod(header, &state);
+  leaves[0] = HashMerkleLeaf(state.data(), state.size());
+  root_ = MerkleRoot(leaves.data(), leaves.size());
+  return true;
+}
+
+bool SecureKvStore::LoadSegmentIndex(Segment *segment) {
+  const std::string segment_path = FilePath(absl::StrCat(".seg-", segment->id));
+  segment->host_fd = enc_untrusted_open(segment_path.c_str(), O_RDONLY);
+  if (segment->host_fd == -1) {
+    LOG(ERROR) << "Failed to open segment " << segment->id
+               << " of secure key-value store: " << path_;
+    return false;
+  }
+
+  std::vector<uint8_t> sealed(segment->index_sealed_length);
+  std::vector<uint8_t> index;
+  if (pread_all(segment->host_fd, sealed.data(), sealed.size(),
+                segment->index_offset) != static_cast<ssize_t>(sealed.size()) ||
+      !(HashMerkleLeaf(sealed.data(), sealed.size()) == segment->digest) ||
+      !Unseal(cryptor_, store_id_, kIndexObject, segment->id, 0,
+              sealed.data(), sealed.size(), segment->index_length, &index)) {
+    LOG(ERROR) << "Integrity verification failed for the index of segment "
+               << segment->id << " of secure key-value store: " << path_;
+    errno = EIO;
+    return false;
+  }
+
+  ByteReader reader(index.data(), index.size());
+  uint32_t block_count;
+  bool valid = reader.Read(&block_count) && block_count > 0;
+  for (uint32_t i = 0; valid && i < block_count; i++) {
+    BlockRecord record;
+    absl::string_view first_key;
+    valid = reader.Read(&record) &&
+            reader.ReadBytes(record.first_key_length, &first_key) &&
+            record.length > 0 && record.length <= kMaxKvRecordLength &&
+            record.offset + record.sealed_length <= segment->index_offset;
+    if (valid) {
+      segment->blocks.push_back({record.offset, record.sealed_length,
+                                 record.length, std::string(first_key)});
+    }
+  }
+  uint32_t last_key_length;
+  absl::string_view last_key;
+  uint32_t bloom_length;
+  absl::string_view bloom;
+  valid = valid && reader.Read(&last_key_length) &&
+          reader.ReadBytes(last_key_length, &last_key) &&
+          reader.Read(&segment->bloom_hash_count) &&
+          segment->bloom_hash_count <= kMaxBloomHashCount &&
+          reader.Read(&bloom_length) &&
+          reader.ReadBytes(bloom_length, &bloom) &&
+          reader.done();
+  if (!valid) {
+    LOG(ERROR) << "Malformed index of segment " << segment->id
+               << " of secure key-value store: " << path_;
+    errno = EIO;
+    return false;
+  }
+  segment->last_key.assign(last_key.data(), last_key.size());
+  segment->bloom.assign(bloom.begin(), bloom.end());
+  return true;
+}
+
+std::unique_ptr<SecureLog> SecureKvStore::OpenWal(uint64_t number,
+                                                  bool create) {
+  const std::string wal_path = FilePath(absl::StrCat(".wal-", number));
+  int flags = O_RDWR | O_APPEND;
+  if (create) {
+    flags |= O_CREAT | O_TRUNC;
+  }
+  std::unique_ptr<SecureLog> wal =
+      SecureLog::Open(wal_path.c_str(), flags, S_IRUSR | S_IWUSR);
+  if (!wal) {
+    LOG(ERROR) << "Failed to open the write-ahead log of secure key-value "
+                  "store: "
+               << path_;
+    return nullptr;
+  }
+  if (wal->SetMasterKey(master_key_.data(), master_key_.size()) != 0) {
+    return nullptr;
+  }
+  return wal;
+}
+
+bool SecureKvStore::ReplayWal() {
+  off_t size = wal_->GetSize();
+  if (size < 0) {
+    return false;
+  }
+  std::vector<uint8_t> data(size);
+  size_t read_count = 0;
+  while (read_count < data.size()) {
+    ssize_t bytes_read =
+        wal_->Read(data.data() + read_count, data.size() - read_count);
+    if (bytes_read <= 0) {
+      if (bytes_read == 0) {
+        errno = EIO;
+      }
+      return false;
+    }
+    read_count += bytes_read;
+  }
+
+  // The log is a sequence of batches, each preceded by its length.
+  ByteReader reader(data.data(), data.size());
+  while (!reader.done()) {
+    uint32_t length;
+    absl::string_view batch;
+    if (!reader.Read(&length) || !reader.ReadBytes(length, &batch) ||
+        !ApplyBatch(reinterpret_cast<const uint8_t *>(batch.data()),
+                    batch.size())) {
+      LOG(ERROR) << "Malformed write-ahead log in secure key-value store: "
+                 << path_;
+      errno = EIO;
+      return false;
+    }
+  }
+
+  if (memtable_bytes_ >= options_.memtable_limit && !FlushMemtable()) {
+    return false;
+  }
+  return true;
+}
+
+bool SecureKvStore::ApplyBatch(const uint8_t *data, size_t size) {
+  ByteReader reader(data, size);
+  uint32_t count;
+  if (!reader.Read(&count)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    bool deleted;
+    absl::string_view key;
+    absl::string_view value;
+    if (!ReadEntry(&reader, &deleted, &key, &value)) {
+      return false;
+    }
+    ApplyEntry(deleted, key, value);
+  }
+  return reader.done();
+}
+
+void SecureKvStore::ApplyEntry(bool deleted, absl::string_view key,
+                               absl::string_view value) {
+  MemEntry &entry = memtable_[std::string(key)];
+  entry.deleted = deleted;
+  entry.value.assign(value.data(), value.size());
+  memtable_bytes_ += key.size() + value.size() + kMemEntryOverhead;
+}
+
+bool SecureKvStore::ReadBlock(const Segment &segment, size_t index,
+                              std::vector<uint8_t> *block) const {
+  const Segment::Block &location = segment.blocks[index];
+  std::vector<uint8_t> sealed(location.sealed_length);
+  if (pread_all(segment.host_fd, sealed.data(), sealed.size(),
+                location.offset) != static_cast<ssize_t>(sealed.size()) ||
+      !Unseal(cryptor_, store_id_, kBlockObject, segment.id, index,
+              sealed.data(), sealed.size(), location.length, block)) {
+    LOG(ERROR) << "Integrity verification failed for block " << index
+               << " of segment " << segment.id
+               << " of secure key-value store: " << path_;
+    errno = EIO;
+    return false;
+  }
+  return true;
+}
+
+bool SecureKvStore::SearchSegment(const Segment &segment,
+                                  absl::string_view key, bool *found,
+                                  bool *deleted, std::string *value) const {
+  *found = false;
+  const size_t index = segment.FindBlock(key);
+  if (index == segment.blocks.size() ||
+      !BloomMayContain(key, segment.bloom_hash_count, segment.bloom)) {
+    return true;
+  }
+
+  std::vector<uint8_t> block;
+  if (!ReadBlock(segment, index, &block)) {
+    return false;
+  }
+  ByteReader reader(block.data(), block.size());
+  while (!reader.done()) {
+    bool entry_deleted;
+    absl::string_view entry_key;
+    absl::string_view entry_value;
+    if (!ReadEntry(&reader, &entry_deleted, &entry_key, &entry_value)) {
+      LOG(ERROR) << "Malformed block " << index << " in segment " << segment.id
+                 << " of secure key-value store: " << path_;
+      errno = EIO;
+      return false;
+    }
+    if (entry_key == key) {
+      *found = true;
+      *deleted = entry_deleted;
+      value->assign(entry_value.data(), entry_value.size());
+      return true;
+    }
+    if (entry_key > key) {
+      break;
+    }
+  }
+  return true;
+}
+
+bool SecureKvStore::WriteSegment(EntrySource *source, bool drop_deletions,
+                                 size_t expected_entries,
+                                 std::unique_ptr<Segment> *segment) {
+  auto new_segment = absl::make_unique<Segment>();
+  new_segment->id = next_segment_id_++;
+  const std::string segment_path =
+      FilePath(absl::StrCat(".seg-", new_segment->id));
+  new_segment->host_fd = enc_untrusted_open(
+      segment_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if (new_segment->host_fd == -1) {
+    LOG(ERROR) << "Failed to create a segment of secure key-value store: "
+               << path_ << ", errno = " << errno;
+    return false;
+  }
+
+  // The segment file is removed on failure.
+  auto fail = [&]() {
+    int saved_errno = errno;
+    new_segment.reset();
+    enc_untrusted_unlink(segment_path.c_str());
+    errno = saved_errno;
+    return false;
+  };
+
+  if (options_.bloom_bits_per_key > 0) {
+    const size_t bloom_bits =
+        std::max<size_t>(expected_entries * options_.bloom_bits_per_key, 64);
+    new_segment->bloom.assign((bloom_bits + 7) / 8, 0);
+    // The number of hash functions minimizing the false positive rate is
+    // ln(2) times the number of bits per key.
+    new_segment->bloom_hash_count = std::min<uint32_t>(
+        std::max<uint32_t>(options_.bloom_bits_per_key * 69 / 100, 1),
+        kMaxBloomHashCount);
+  }
+
+  // Sealed blocks are buffered and written to the host in large writes.
+  std::vector<uint8_t> block;
+  std::string block_first_key;
+  std::vector<uint8_t> pending;
+  uint64_t written = 0;
+  auto write_pending = [&]() {
+    if (!pwrite_all(new_segment->host_fd, pending.data(), pending.size(),
+                    written)) {
+      LOG(ERROR) << "Failed to write a segment of secure key-value store: "
+                 << path_ << ", errno = " << errno;
+      return false;
+    }
+    written += pending.size();
+    pending.clear();
+    return true;
+  };
+  auto seal_block = [&]() {
+    Segment::Block location;
+    location.offset = written + pending.size();
+    location.length = block.size();
+    location.first_key = std::move(block_first_key);
+    const size_t start = pending.size();
+    if (!Seal(cryptor_, store_id_, kBlockObject, new_segment->id,
+              new_segment->blocks.size(), block.data(), block.size(),
+              &pending)) {
+      LOG(ERROR) << "Failed to seal a block of secure key-value store: "
+                 << path_;
+      errno = EIO;
+      return false;
+    }
+    location.sealed_length = pending.size() - start;
+    new_segment->blocks.push_back(std::move(location));
+    block.clear();
+    return pending.size() < kSegmentWriteBufferLength || write_pending();
+  };
+
+  for (; source->Valid(); ) {
+    if (!drop_deletions || !source->deleted()) {
+      const absl::string_view key = source->key();
+      const absl::string_view value = source->value();
+      const size_t entry_length =
+          sizeof(EntryHeader) + key.size() + value.size();
+      if (!block.empty() &&
+          (block.size() >= options_.block_length ||
+           block.size() + entry_length > kMaxKvRecordLength) &&
+          !seal_block()) {
+        return fail();
+      }
+      if (block.empty()) {
+        block_first_key.assign(key.data(), key.size());
+      }
+      AppendEntry(source->deleted(), key, value, &block);
+      if (!new_segment->bloom.empty()) {
+        BloomAdd(key, new_segment->bloom_hash_count, &new_segment->bloom);
+      }
+      new_segment->last_key.assign(key.data(), key.size());
+      new_segment->entry_count++;
+    }
+    if (!source->Next()) {
+      return fail();
+    }
+  }
+
+  // A merge that leaves no entries yields no segment.
+  if (new_segment->entry_count == 0) {
+    fail();
+    segment->reset();
+    return true;
+  }
+  if (!seal_block()) {
+    return fail();
+  }
+
+  std::vector<uint8_t> index;
+  AppendPod(static_cast<uint32_t>(new_segment->blocks.size()), &index);
+  for (const Segment::Block &location : new_segment->blocks) {
+    BlockRecord record;
+    record.offset = location.offset;
+    record.sealed_length = location.sealed_length;
+    record.length = location.length;
+    record.first_key_length = location.first_key.size();
+    AppendPod(record, &index);
+    AppendBytes(location.first_key, &index);
+  }
+  AppendPod(static_cast<uint32_t>(new_segment->last_key.size()), &index);
+  AppendBytes(new_segment->last_key, &index);
+  AppendPod(new_segment->bloom_hash_count, &index);
+  AppendPod(static_cast<uint32_t>(new_segment->bloom.size()), &index);
+  AppendBytes(absl::string_view(
+                  reinterpret_cast<const char *>(new_segment->bloom.data()),
+                  new_segment->bloom.size()),
+              &index);
+
+  new_segment->index_offset = written + pending.size();
+  new_segment->index_length = index.size();
+  const size_t start = pending.size();
+  if (!Seal(cryptor_, store_id_, kIndexObject, new_segment->id, 0,
+            index.data(), index.size(), &pending)) {
+    LOG(ERROR) << "Failed to seal a segment index of secure key-value store: "
+               << path_;
+    errno = EIO;
+    return fail();
+  }
+  new_segment->index_sealed_length = pending.size() - start;
+  new_segment->digest =
+      HashMerkleLeaf(pending.data() + start, pending.size() - start);
+  if (!write_pending() || enc_untrusted_fsync(new_segment->host_fd) != 0) {
+    return fail();
+  }
+  *segment = std::move(new_segment);
+  return true;
+}
+
+bool SecureKvStore::FlushMemtable() {
+  if (memtable_.empty()) {
+    return true;
+  }
+
+  // Writes go to a new log from here on, so the old log can be removed once
+  // the manifest records the segment holding its writes.
+  const uint64_t old_wal_number = wal_number_;
+  std::unique_ptr<SecureLog> new_wal =
+      OpenWal(old_wal_number + 1, /*create=*/true);
+  if (!new_wal) {
+    return false;
+  }
+
+  // Deletions need not be kept if there is no older segment to override.
+  MemtableSource source(&memtable_);
+  std::unique_ptr<Segment> segment;
+  if (!WriteSegment(&source, /*drop_deletions=*/segments_.empty(),
+                    memtable_.size(), &segment)) {
+    return false;
+  }
+  const bool added = segment != nullptr;
+  if (added) {
+    segments_.push_back(std::move(segment));
+  }
+  wal_number_ = old_wal_number + 1;
+  if (!WriteManifest()) {
+    wal_number_ = old_wal_number;
+    if (added) {
+      const std::string segment_path =
+          FilePath(absl::StrCat(".seg-", segments_.back()->id));
+      segments_.pop_back();
+      enc_untrusted_unlink(segment_path.c_str());
+    }
+    return false;
+  }
+
+  wal_->Close();
+  wal_ = std::move(new_wal);
+  const std::string old_wal_path =
+      FilePath(absl::StrCat(".wal-", old_wal_number));
+  if (enc_untrusted_unlink(old_wal_path.c_str()) != 0) {
+    LOG(WARNING) << "Failed to remove an old write-ahead log of secure "
+                    "key-value store: "
+                 << path_;
+  }
+  memtable_.clear();
+  memtable_bytes_ = 0;
+
+  // The flush is complete even if compaction fails, and compaction is retried
+  // after the next flush.
+  if (segments_.size() >= options_.compaction_trigger && !CompactSegments()) {
+    LOG(ERROR) << "Failed to compact secure key-value store: " << path_;
+  }
+  return true;
+}
+
+bool SecureKvStore::CompactSegments() {
+  if (segments_.empty()) {
+    return true;
+  }
+
+  std::vector<std::unique_ptr<EntrySource>> sources;
+  size_t expected_entries = 0;
+  for (auto it = segments_.rbegin(); it != segments_.rend(); ++it) {
+    sources.push_back(absl::make_unique<SegmentSource>(this, it->get()));
+    expected_entries += (*it)->entry_count;
+  }
+  MergingSource merged(std::move(sources));
+  std::unique_ptr<Segment> segment;
+  // The merge covers the oldest segment, so deletions need not be kept.
+  if (!merged.Seek("") ||
+      !WriteSegment(&merged, /*drop_deletions=*/true, expected_entries,
+                    &segment)) {
+    return false;
+  }
+
+  std::vector<std::unique_ptr<Segment>> old_segments = std::move(segments_);
+  segments_.clear();
+  if (segment) {
+    segments_.push_back(std::move(segment));
+  }
+  if (!WriteManifest()) {
+    if (!segments_.empty()) {
+      const std::string segment_path =
+          FilePath(absl::StrCat(".seg-", segments_.back()->id));
+      enc_untrusted_unlink(segment_path.c_str());
+    }
+    segments_ = std::move(old_segments);
+    return false;
+  }
+
+  for (auto &old_segment : old_segments) {
+    const std::string segment_path =
+        FilePath(absl::StrCat(".seg-", old_segment->id));
+    old_segment.reset();
+    if (enc_untrusted_unlink(segment_path.c_str()) != 0) {
+      LOG(WARNING) << "Failed to remove a compacted segment of secure "
+                      "key-value store: "
+                   << path_;
+    }
+  }
+  return true;
+}
+
+int SecureKvStore::Get(absl::string_view key, std::string *value) {
+  absl::ReaderMutexLock lock(&mu_);
+  if (CheckOpen() == -1) {
+    return -1;
+  }
+  if (!value) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  auto it = memtable_.find(std::string(key));
+  if (it != memtable_.end()) {
+    if (it->second.deleted) {
+      errno = ENOENT;
+      return -1;
+    }
+    *value = it->second.value;
+    return 0;
+  }
+
+  // Newer segments override older ones.
+  for (auto segment = segments_.rbegin(); segment != segments_.rend();
+       ++segment) {
+    bool found;
+    bool deleted;
+    if (!SearchSegment(**segment, key, &found, &deleted, value)) {
+      return -1;
+    }
+    if (found) {
+      if (deleted) {
+        errno = ENOENT;
+        return -1;
+      }
+      return 0;
+    }
+  }
+  errno = ENOENT;
+  return -1;
+}
+
+int SecureKvStore::Put(absl::string_view key, absl::string_view value) {
+  SecureKvWriteBatch batch;
+  batch.Put(key, value);
+  return Write(batch);
+}
+
+int SecureKvStore::Delete(absl::string_view key) {
+  SecureKvWriteBatch batch;
+  batch.Delete(key);
+  return Write(batch);
+}
+
+int SecureKvStore::Write(const SecureKvWriteBatch &batch) {
+  absl::MutexLock lock(&mu_);
+  if (CheckOpen() == -1) {
+    return -1;
+  }
+  if (batch.ops_.empty()) {
+    return 0;
+  }
+
+  // The batch is appended to the log as a single append, preceded by its
+  // length.
+  std::vector<uint8_t> record(sizeof(uint32_t));
+  AppendPod(static_cast<uint32_t>(batch.ops_.size()), &record);
+  for (const SecureKvWriteBatch::Op &op : batch.ops_) {
+    if (op.key.size() > kMaxKvKeyLength ||
+        op.value.size() > kMaxKvValueLength) {
+      errno = EINVAL;
+      return -1;
+    }
+    AppendEntry(op.deleted, op.key, op.value, &record);
+  }
+  const uint32_t length = record.size() - sizeof(uint32_t);
+  memcpy(record.data(), &length, sizeof(length));
+  if (wal_->Append(record.data(), record.size()) !=
+      static_cast<ssize_t>(record.size())) {
+    return -1;
+  }
+
+  for (const SecureKvWriteBatch::Op &op : batch.ops_) {
+    ApplyEntry(op.deleted, op.key, op.value);
+  }
+  if (options_.sync_writes && wal_->Sync() != 0) {
+    return -1;
+  }
+
+  // The writes are in the log, so a failure to flush loses nothing and the
+  // flush is retried on the next write.
+  if (memtable_bytes_ >= options_.memtable_limit && !FlushMemtable()) {
+    LOG(ERROR) << "Failed to flush the memtable of secure key-value store: "
+               << path_ << ", errno = " << errno;
+  }
+  return 0;
+}
+
+int SecureKvStore::Scan(
+    absl::string_view start, absl::string_view end,
+    const std::function<bool(absl::string_view key, absl::string_view value)>
+        &visitor) {
+  absl::ReaderMutexLock lock(&mu_);
+  if (CheckOpen() == -1) {
+    return -1;
+  }
+
+  std::vector<std::unique_ptr<EntrySource>> sources;
+  sources.push_back(absl::make_unique<MemtableSource>(&memtable_));
+  for (auto it = segments_.rbegin(); it != segments_.rend(); ++it) {
+    sources.push_back(absl::make_unique<SegmentSource>(this, it->get()));
+  }
+  MergingSource merged(std::move(sources));
+  if (!merged.Seek(start)) {
+    return -1;
+  }
+  while (merged.Valid() && (end.empty() || merged.key() < end)) {
+    if (!merged.deleted() && !visitor(merged.key(), merged.value())) {
+      break;
+    }
+    if (!merged.Next()) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int SecureKvStore::Sync() {
+  absl::MutexLock lock(&mu_);
+  if (CheckOpen() == -1) {
+    return -1;
+  }
+  return wal_->Sync();
+}
+
+int SecureKvStore::Flush() {
+  absl::MutexLock lock(&mu_);
+  if (CheckOpen() == -1) {
+    return -1;
+  }
+  return FlushMemtable() ? 0 : -1;
+}
+
+int SecureKvStore::Compact() {
+  absl::MutexLock lock(&mu_);
+  if (CheckOpen() == -1) {
+    return -1;
+  }
+  return CompactSegments() ? 0 : -1;
+}
+
+int SecureKvStore::Close() {
+  absl::MutexLock lock(&mu_);
+  if (CheckOpen() == -1) {
+    return -1;
+  }
+  int result = wal_->Close();
+  wal_.reset();
+  segments_.clear();
+  memtable_.clear();
+  memtable_bytes_ = 0;
+  return result;
+}
+
+Digest SecureKvStore::GetRootHash() {
+  absl::ReaderMutexLock lock(&mu_);
+  return root_;
+}
+
+size_t SecureKvStore::SegmentCount() {
+  absl::ReaderMutexLock lock(&mu_);
+  return segments_.size();
+}
+
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
@@ -0,0 +1,298 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_STORAGE_SECURE_SECURE_KV_STORE_H_
+#define ASYLO_PLATFORM_STORAGE_SECURE_SECURE_KV_STORE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "asylo/platform/crypto/gcmlib/gcm_cryptor.h"
+#include "asylo/platform/storage/secure/authenticated_dictionary.h"
+#include "asylo/platform/storage/secure/secure_log.h"
+
+namespace asylo {
+namespace platform {
+namespace storage {
+
+// Maximum lengths of the keys and values of a secure key-value store.
+constexpr size_t kMaxKvKeyLength = 1024;
+constexpr size_t kMaxKvValueLength = 60 * 1024;
+
+// Length of the random identifier of a store, bound to all its sealed data.
+constexpr size_t kKvStoreIdLength = 16;
+
+// Tuning parameters of a secure key-value store.
+struct SecureKvOptions {
+  // Approximate number of bytes of keys and values held in the memtable before
+  // it is written out to a segment.
+  size_t memtable_limit = 4 * 1024 * 1024;
+
+  // Target length of the data blocks of segments, each sealed as one record.
+  size_t block_length = 4096;
+
+  // Number of segments at which all segments are compacted into one.
+  size_t compaction_trigger = 4;
+
+  // Bits per key of the bloom filter of each segment.
+  size_t bloom_bits_per_key = 10;
+
+  // Whether every write makes the write-ahead log durable before returning.
+  // Otherwise writes become durable on Sync(), Close(), or when the memtable
+  // is written out.
+  bool sync_writes = false;
+};
+
+// A batch of puts and deletions applied atomically by SecureKvStore::Write().
+// Later operations on a key override earlier ones.
+class SecureKvWriteBatch {
+ public:
+  void Put(absl::string_view key, absl::string_view value);
+  void Delete(absl::string_view key);
+  void Clear() { ops_.clear(); }
+  size_t size() const { return ops_.size(); }
+
+ private:
+  friend class SecureKvStore;
+
+  struct Op {
+    bool deleted;
+    std::string key;
+    std::string value;
+  };
+
+  std::vector<Op> ops_;
+};
+
+// Embedded, log-structured key-value store kept on untrusted storage.
+//
+// Writes are appended to a SecureLog serving as write-ahead log and applied to
+// an in-enclave memtable. A full memtable is written out as an immutable
+// segment of keys in sorted order, divided in data blocks that are each sealed
+// as a GcmCryptor record. Only the index of a segment - the first key of each
+// block - and its bloom filter are held in the enclave; data blocks are read
+// from the host and verified on demand. Once enough segments accumulate they
+// are merged into one, dropping overwritten values and deletions.
+//
+// Records are sealed with AES-GCM under the per-record keys that GcmCryptor
+// derives from the store key, not with the nonce-misuse-resistant AES-GCM-SIV
+// of AeadCryptor::CreateAesGcmSivCryptor(). Their confidentiality therefore
+// relies on GcmCryptor never repeating a nonce under a derived key.
+//
+// A manifest, sealed and replaced atomically, lists the segments along with a
+// digest of each. The Merkle root over the manifest state is available from
+// GetRootHash(); a caller that keeps it in trusted storage (e.g. sealed along
+// with a monotonic counter) and passes it back to Open() detects the host
+// rolling the store back to an earlier state. The root covers the segments
+// only: writes still in the write-ahead log are protected by its integrity
+// chain, which detects tampering but not rollback of the log as a whole, so a
+// caller relying on the root calls Flush() before recording it.
+//
+// The files of a store share the |path| prefix. A store may be opened by a
+// single instance at a time. The class is thread-safe; reads run
+// concurrently with each other, and writes are serialized.
+class SecureKvStore {
+ public:
+  // Opens the store at the absolute (canonical) path prefix |path| with the
+  // |key_length|-byte |key|, creating it if it does not exist. If
+  // |expected_root| is not null, opening fails unless the store is in the
+  // state it had when GetRootHash() returned |expected_root|. Returns nullptr
+  // on failure, with errno set.
+  static std::unique_ptr<SecureKvStore> Open(
+      const char *path, const uint8_t *key, uint32_t key_length,
+      const SecureKvOptions &options = SecureKvOptions(),
+      const Digest *expected_root = nullptr);
+
+  // Closes the store, if it has not been closed yet.
+  ~SecureKvStore();
+
+  SecureKvStore(const SecureKvStore &) = delete;
+  SecureKvStore &operator=(const SecureKvStore &) = delete;
+
+  // Looks up |key| and stores its value in |value|. Returns 0 on success, or
+  // -1 on failure, with errno set to ENOENT if |key| is not present.
+  int Get(absl::string_view key, std::string *value) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Sets the value of |key| to |value|. Returns 0 on success, or -1 on
+  // failure.
+  int Put(absl::string_view key, absl::string_view value)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Removes |key|. Returns 0 on success, whether or not |key| was present, or
+  // -1 on failure.
+  int Delete(absl::string_view key) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Applies all operations of |batch| atomically. Returns 0 on success, or -1
+  // on failure, in which case none of the operations are applied.
+  int Write(const SecureKvWriteBatch &batch) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Calls |visitor| in key order with each key in [|start|, |end|) and its
+  // value, or with all keys from |start| on if |end| is empty, until
+  // |visitor| returns false. Segments are streamed from the host as the scan
+  // proceeds. |visitor| must not call into the store. Returns 0 on success, or
+  // -1 on failure.
+  int Scan(absl::string_view start, absl::string_view end,
+           const std::function<bool(absl::string_view key,
+                                    absl::string_view value)> &visitor)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Makes all writes so far durable. Returns 0 on success, or -1 on failure.
+  int Sync() ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Writes the memtable out to a segment, if it is not empty, and compacts the
+  // segments if there are enough of them. Returns 0 on success, or -1 on
+  // failure.
+  int Flush() ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Merges all segments into one. Returns 0 on success, or -1 on failure.
+  int Compact() ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Makes all writes durable and closes the store. Returns 0 on success, or -1
+  // on failure.
+  int Close() ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns the Merkle root over the state recorded by the manifest.
+  Digest GetRootHash() ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns the number of segments of the store.
+  size_t SegmentCount() ABSL_LOCKS_EXCLUDED(mu_);
+
+ private:
+  struct MemEntry {
+    bool deleted;
+    std::string value;
+  };
+
+  struct Segment;
+
+  // Sorted sequences of entries - the memtable, a segment, and a merge of
+  // several of those - defined in the implementation.
+  class EntrySource;
+  class MemtableSource;
+  class SegmentSource;
+  class MergingSource;
+
+  SecureKvStore(std::string path, const SecureKvOptions &options);
+
+  // Creates a new store. Returns false on failure.
+  bool Create() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Loads and verifies the manifest and the indices of the segments it lists.
+  // Returns false on failure.
+  bool LoadManifest() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Seals the current state into a new manifest, replacing the previous one.
+  // Returns false on failure.
+  bool WriteManifest() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Loads and verifies the index of |segment| from its file. Returns false on
+  // failure.
+  bool LoadSegmentIndex(Segment *segment) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Opens the write-ahead log numbered |number|, creating it empty if
+  // |create|. Returns nullptr on failure.
+  std::unique_ptr<SecureLog> OpenWal(uint64_t number, bool create)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Applies the batches in the write-ahead log to the memtable. Returns false
+  // on failure.
+  bool ReplayWal() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Applies an entry for |key| to the memtable.
+  void ApplyEntry(bool deleted, absl::string_view key, absl::string_view value)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Applies the encoded batch of |size| bytes at |data| to the memtable.
+  // Returns false if the batch is malformed.
+  bool ApplyBatch(const uint8_t *data, size_t size)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Writes the memtable out to a segment and switches to a new write-ahead
+  // log. Returns false on failure, leaving the memtable in place.
+  bool FlushMemtable() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Merges all segments into one. Returns false on failure.
+  bool CompactSegments() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Writes the entries of |source| to a new segment, which is set in
+  // |segment|, or to nothing if there are no entries to write. Deletions are
+  // dropped if |drop_deletions|. |expected_entries| sizes the bloom filter.
+  // Returns false on failure.
+  bool WriteSegment(EntrySource *source, bool drop_deletions,
+                    size_t expected_entries, std::unique_ptr<Segment> *segment)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Reads and verifies data block |index| of |segment| into |block|. Returns
+  // false on failure.
+  bool ReadBlock(const Segment &segment, size_t index,
+                 std::vector<uint8_t> *block) const;
+
+  // Looks |key| up in |segment|. Returns false on failure, and otherwise sets
+  // |found|, and if found, |deleted| and |value|.
+  bool SearchSegment(const Segment &segment, absl::string_view key,
+                     bool *found, bool *deleted, std::string *value) const;
+
+  // Returns -1 with errno set if the store is closed, and 0 otherwise.
+  int CheckOpen() const ABSL_SHARED_LOCKS_REQUIRED(mu_);
+
+  // Returns the path of the file of the store with |suffix|.
+  std::string FilePath(absl::string_view suffix) const;
+
+  const std::string path_;
+  const SecureKvOptions options_;
+
+  // Key, cryptor, and identifier of the store, all set when the store is
+  // opened and constant afterwards. The cryptor is owned by the cryptor
+  // registry.
+  crypto::gcmlib::GcmCryptorKey master_key_;
+  crypto::gcmlib::GcmCryptor *cryptor_;
+  uint8_t store_id_[kKvStoreIdLength];
+
+  // State recorded by the manifest.
+  uint64_t version_ ABSL_GUARDED_BY(mu_);
+  uint64_t wal_number_ ABSL_GUARDED_BY(mu_);
+  uint64_t next_segment_id_ ABSL_GUARDED_BY(mu_);
+  Digest root_ ABSL_GUARDED_BY(mu_);
+
+  // Segments, oldest first.
+  std::vector<std::unique_ptr<Segment>> segments_ ABSL_GUARDED_BY(mu_);
+
+  // Write-ahead log holding the writes applied to the memtable, or nullptr
+  // once the store is closed.
+  std::unique_ptr<SecureLog> wal_ ABSL_GUARDED_BY(mu_);
+
+  std::map<std::string, MemEntry> memtable_ ABSL_GUARDED_BY(mu_);
+  size_t memtable_bytes_ ABSL_GUARDED_BY(mu_);
+
+  absl::Mutex mu_;
+};
+
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_STORAGE_SECURE_SECURE_KV_STORE_H_
@@ -0,0 +1,368 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/storage/secure/secure_kv_store.h"
+
+#include <fcntl.h>
+#include <openssl/rand.h>
+#include <sys/stat.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/flags/flag.h"
+#include "absl/strings/escaping.h"
+#include "absl/strings/str_cat.h"
+#include "asylo/platform/crypto/gcmlib/gcm_cryptor.h"
+#include "asylo/platform/host_call/trusted/host_calls.h"
+#include "asylo/platform/storage/utils/fd_closer.h"
+#include "asylo/test/util/test_flags.h"
+#include "asylo/util/cleansing_types.h"
+
+namespace asylo {
+namespace {
+
+using platform::crypto::gcmlib::kKeyLength;
+using platform::storage::Digest;
+using platform::storage::FdCloser;
+using platform::storage::kMaxKvValueLength;
+using platform::storage::SecureKvOptions;
+using platform::storage::SecureKvStore;
+using platform::storage::SecureKvWriteBatch;
+
+class SecureKvStoreTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    // Every test uses a fresh store, as its files are not known upfront.
+    uint8_t suffix[8];
+    ASSERT_EQ(RAND_bytes(suffix, sizeof(suffix)), 1);
+    path_ = absl::StrCat(
+        absl::GetFlag(FLAGS_test_tmpdir), "/SecureKvStoreTest-",
+        absl::BytesToHexString(absl::string_view(
+            reinterpret_cast<const char *>(suffix), sizeof(suffix))));
+    key_.resize(kKeyLength);
+    ASSERT_EQ(RAND_bytes(key_.data(), key_.size()), 1);
+  }
+
+  std::unique_ptr<SecureKvStore> OpenStore(
+      const SecureKvOptions &options = SecureKvOptions(),
+      const Digest *expected_root = nullptr) {
+    return SecureKvStore::Open(path_.c_str(), key_.data(), key_.size(),
+                               options, expected_root);
+  }
+
+  // Returns options that make the store flush and compact after a few writes.
+  static SecureKvOptions SmallOptions() {
+    SecureKvOptions options;
+    options.memtable_limit = 16 * 1024;
+    options.block_length = 512;
+    options.compaction_trigger = 3;
+    return options;
+  }
+
+  // Returns the value of |key| in |store|, or "<missing>" if it is absent.
+  static std::string GetValue(SecureKvStore *store, const std::string &key) {
+    std::string value;
+    if (store->Get(key, &value) != 0) {
+      return errno == ENOENT ? "<missing>" : "<error>";
+    }
+    return value;
+  }
+
+  // Returns all entries of |store| with keys in [|start|, |end|).
+  static std::map<std::string, std::string> ScanAll(SecureKvStore *store,
+                                                    absl::string_view start,
+                                                    absl::string_view end) {
+    std::map<std::string, std::string> entries;
+    EXPECT_EQ(store->Scan(start, end,
+                          [&entries](absl::string_view key,
+                                     absl::string_view value) {
+                            entries.emplace(std::string(key),
+                                            std::string(value));
+                            return true;
+                          }),
+              0);
+    return entries;
+  }
+
+  // Reads the raw contents of the store file with |suffix| into |contents|.
+  bool ReadRawFile(absl::string_view suffix,
+                   std::vector<uint8_t> *contents) const {
+    const std::string path = absl::StrCat(path_, suffix);
+    struct stat st;
+    if (enc_untrusted_stat(path.c_str(), &st) != 0) {
+      return false;
+    }
+    int fd = enc_untrusted_open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    FdCloser fd_closer(fd, &enc_untrusted_close);
+    contents->resize(st.st_size);
+    return enc_untrusted_read(fd, contents->data(), contents->size()) ==
+           contents->size();
+  }
+
+  // Replaces the contents of the store file with |suffix| with |contents|.
+  bool WriteRawFile(absl::string_view suffix,
+                    const std::vector<uint8_t> &contents) const {
+    const std::string path = absl::StrCat(path_, suffix);
+    int fd = enc_untrusted_open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                                S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+      return false;
+    }
+    FdCloser fd_closer(fd, &enc_untrusted_close);
+    return enc_untrusted_write(fd, contents.data(), contents.size()) ==
+           contents.size();
+  }
+
+  std::string path_;
+  CleansingVector<uint8_t> key_;
+};
+
+TEST_F(SecureKvStoreTest, PutGetDeleteSuccess) {
+  std::unique_ptr<SecureKvStore> store = OpenStore();
+  ASSERT_NE(store, nullptr);
+  EXPECT_EQ(store->Put("apple", "red"), 0);
+  EXPECT_EQ(store->Put("banana", "yellow"), 0);
+  EXPECT_EQ(store->Put("apple", "green"), 0);
+  EXPECT_EQ(GetValue(store.get(), "apple"), "green");
+  EXPECT_EQ(GetValue(store.get(), "banana"), "yellow");
+  EXPECT_EQ(GetValue(store.get(), "cherry"), "<missing>");
+  EXPECT_EQ(store->Delete("apple"), 0);
+  EXPECT_EQ(GetValue(store.get(), "apple"), "<missing>");
+  EXPECT_EQ(store->Put("", "empty key"), 0);
+  EXPECT_EQ(GetValue(store.get(), ""), "empty key");
+
+  // Values longer than the limit are rejected.
+  EXPECT_EQ(store->Put("big", std::string(kMaxKvValueLength, 'x')), 0);
+  EXPECT_EQ(GetValue(store.get(), "big").size(), kMaxKvValueLength);
+  EXPECT_EQ(store->Put("big", std::string(kMaxKvValueLength + 1, 'x')), -1);
+  EXPECT_EQ(errno, EINVAL);
+  EXPECT_EQ(store->Close(), 0);
+  EXPECT_EQ(store->Put("apple", "red"), -1);
+  EXPECT_EQ(errno, EBADF);
+}
+
+TEST_F(SecureKvStoreTest, ReopenReplaysLog) {
+  std::unique_ptr<SecureKvStore> store = OpenStore();
+  ASSERT_NE(store, nullptr);
+  EXPECT_EQ(store->Put("apple", "red"), 0);
+  EXPECT_EQ(store->Put("banana", "yellow"), 0);
+  EXPECT_EQ(store->Delete("banana"), 0);
+  EXPECT_EQ(store->Sync(), 0);
+  EXPECT_EQ(store->Close(), 0);
+
+  store = OpenStore();
+  ASSERT_NE(store, nullptr);
+  EXPECT_EQ(store->SegmentCount(), 0);
+  EXPECT_EQ(GetValue(store.get(), "apple"), "red");
+  EXPECT_EQ(GetValue(store.get(), "banana"), "<missing>");
+}
+
+TEST_F(SecureKvStoreTest, WriteBatchSuccess) {
+  std::unique_ptr<SecureKvStore> store = OpenStore();
+  ASSERT_NE(store, nullptr);
+  EXPECT_EQ(store->Put("cherry", "red"), 0);
+
+  SecureKvWriteBatch batch;
+  batch.Put("apple", "red");
+  batch.Put("banana", "yellow");
+  batch.Delete("cherry");
+  batch.Put("apple", "green");
+  EXPECT_EQ(batch.size(), 4);
+  EXPECT_EQ(store->Write(batch), 0);
+  EXPECT_EQ(store->Close(), 0);
+
+  store = OpenStore();
+  ASSERT_NE(store, nullptr);
+  EXPECT_EQ(GetValue(store.get(), "apple"), "green");
+  EXPECT_EQ(GetValue(store.get(), "banana"), "yellow");
+  EXPECT_EQ(GetValue(store.get(), "cherry"), "<missing>");
+
+  // A batch with an invalid write is rejected as a whole.
+  batch.Clear();
+  batch.Put("durian", "green");
+  batch.Put(std::string(2000, 'k'), "");
+  EXPECT_EQ(store->Write(batch), -1);
+  EXPECT_EQ(errno, EINVAL);
+  EXPECT_EQ(GetValue(store.get(), "durian"), "<missing>");
+}
+
+TEST_F(SecureKvStoreTest, FlushAndCompactSuccess) {
+  std::map<std::string, std::string> expected;
+  std::unique_ptr<SecureKvStore> store = OpenStore(SmallOptions());
+  ASSERT_NE(store, nullptr);
+  for (int round = 0; round < 4; round++) {
+    for (int i = 0; i < 500; i++) {
+      const std::string key = absl::StrCat("key", (i * 7919) % 1000);
+      if (i % 11 == round) {
+        EXPECT_EQ(store->Delete(key), 0);
+        expected.erase(key);
+      } else {
+        const std::string value = absl::StrCat("value", round, "-", i);
+        EXPECT_EQ(store->Put(key, value), 0);
+        expected[key] = value;
+      }
+    }
+  }
+  // Flushes have happened, and compaction kept the segment count down.
+  EXPECT_GT(store->SegmentCount(), 0);
+  EXPECT_LT(store->SegmentCount(), SmallOptions().compaction_trigger);
+
+  for (int i = 0; i < 1000; i++) {
+    const std::string key = absl::StrCat("key", i);
+    auto it = expected.find(key);
+    EXPECT_EQ(GetValue(store.get(), key),
+              it == expected.end() ? "<missing>" : it->second);
+  }
+  EXPECT_EQ(store->Close(), 0);
+
+  store = OpenStore(SmallOptions());
+  ASSERT_NE(store, nullptr);
+  EXPECT_EQ(ScanAll(store.get(), "", ""), expected);
+  EXPECT_EQ(store->Flush(), 0);
+  EXPECT_EQ(store->Compact(), 0);
+  EXPECT_EQ(store->SegmentCount(), 1);
+  EXPECT_EQ(ScanAll(store.get(), "", ""), expected);
+}
+
+TEST_F(SecureKvStoreTest, ScanMergesSegmentsAndMemtable) {
+  SecureKvOptions options;
+  options.block_length = 64;
+  std::unique_ptr<SecureKvStore> store = OpenStore(options);
+  ASSERT_NE(store, nullptr);
+  std::map<std::string, std::string> expected;
+  for (int i = 0; i < 100; i++) {
+    const std::string key = absl::StrCat("key", 100 + i);
+    EXPECT_EQ(store->Put(key, "old"), 0);
+    expected[key] = "old";
+  }
+  EXPECT_EQ(store->Flush(), 0);
+  for (int i = 0; i < 100; i += 3) {
+    const std::string key = absl::StrCat("key", 100 + i);
+    EXPECT_EQ(store->Put(key, "new"), 0);
+    expected[key] = "new";
+  }
+  EXPECT_EQ(store->Flush(), 0);
+  for (int i = 0; i < 100; i += 5) {
+    const std::string key = absl::StrCat("key", 100 + i);
+    EXPECT_EQ(store->Delete(key), 0);
+    expected.erase(key);
+  }
+  EXPECT_EQ(store->SegmentCount(), 2);
+
+  EXPECT_EQ(ScanAll(store.get(), "", ""), expected);
+  std::map<std::string, std::string> range(expected.lower_bound("key120"),
+                                           expected.lower_bound("key150"));
+  EXPECT_EQ(ScanAll(store.get(), "key120", "key150"), range);
+
+  // The visitor stops the scan.
+  int visited = 0;
+  EXPECT_EQ(store->Scan("", "",
+                        [&visited](absl::string_view, absl::string_view) {
+                          return ++visited < 10;
+                        }),
+            0);
+  EXPECT_EQ(visited, 10);
+}
+
+TEST_F(SecureKvStoreTest, TamperedSegmentFailure) {
+  std::unique_ptr<SecureKvStore> store = OpenStore();
+  ASSERT_NE(store, nullptr);
+  EXPECT_EQ(store->Put("apple", "red"), 0);
+  EXPECT_EQ(store->Flush(), 0);
+  EXPECT_EQ(store->Close(), 0);
+
+  // The first block starts the first segment, just past its record header.
+  std::vector<uint8_t> contents;
+  ASSERT_TRUE(ReadRawFile(".seg-1", &contents));
+  contents[60] ^= 1;
+  ASSERT_TRUE(WriteRawFile(".seg-1", contents));
+  store = OpenStore();
+  ASSERT_NE(store, nullptr);
+  std::string value;
+  EXPECT_EQ(store->Get("apple", &value), -1);
+  EXPECT_EQ(errno, EIO);
+  EXPECT_EQ(store->Close(), 0);
+
+  // A tampered index fails verification on open.
+  contents[60] ^= 1;
+  contents.back() ^= 1;
+  ASSERT_TRUE(WriteRawFile(".seg-1", contents));
+  EXPECT_EQ(OpenStore(), nullptr);
+}
+
+TEST_F(SecureKvStoreTest, RollbackFailure) {
+  std::unique_ptr<SecureKvStore> store = OpenStore();
+  ASSERT_NE(store, nullptr);
+  EXPECT_EQ(store->Put("apple", "red"), 0);
+  EXPECT_EQ(store->Flush(), 0);
+  std::vector<uint8_t> old_manifest;
+  ASSERT_TRUE(ReadRawFile(".manifest", &old_manifest));
+  const Digest old_root = store->GetRootHash();
+  EXPECT_EQ(store->Put("apple", "green"), 0);
+  EXPECT_EQ(store->Flush(), 0);
+  const Digest root = store->GetRootHash();
+  EXPECT_FALSE(root == old_root);
+  EXPECT_EQ(store->Close(), 0);
+
+  store = OpenStore(SecureKvOptions(), &root);
+  ASSERT_NE(store, nullptr);
+  EXPECT_EQ(GetValue(store.get(), "apple"), "green");
+  EXPECT_EQ(store->Close(), 0);
+
+  // Restoring the older manifest is detected against the expected root.
+  ASSERT_TRUE(WriteRawFile(".manifest", old_manifest));
+  EXPECT_EQ(OpenStore(SecureKvOptions(), &root), nullptr);
+  EXPECT_EQ(errno, EIO);
+}
+
+TEST_F(SecureKvStoreTest, OversizedManifestFailure) {
+  std::unique_ptr<SecureKvStore> store = OpenStore();
+  ASSERT_NE(store, nullptr);
+  EXPECT_EQ(store->Put("apple", "red"), 0);
+  EXPECT_EQ(store->Close(), 0);
+
+  // The size of the manifest reported by the host is checked before the file
+  // is read into the enclave.
+  ASSERT_EQ(enc_untrusted_truncate(absl::StrCat(path_, ".manifest").c_str(),
+                                   1ULL << 40),
+            0);
+  EXPECT_EQ(OpenStore(), nullptr);
+  EXPECT_EQ(errno, EIO);
+}
+
+TEST_F(SecureKvStoreTest, WrongKeyFailure) {
+  std::unique_ptr<SecureKvStore> store = OpenStore();
+  ASSERT_NE(store, nullptr);
+  EXPECT_EQ(store->Put("apple", "red"), 0);
+  EXPECT_EQ(store->Close(), 0);
+
+  key_[0] ^= 1;
+  EXPECT_EQ(OpenStore(), nullptr);
+  EXPECT_EQ(errno, EIO);
+}
+
+}  // namespace
+}  // namespace asylo
@@ -0,0 +1,629 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/storage/secure/secure_log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <openssl/rand.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <unordered_set>
+#include <utility>
+
+#include "absl/base/attributes.h"
+#include "absl/memory/memory.h"
+#include "asylo/platform/host_call/trusted/host_calls.h"
+#include "asylo/util/logging.h"
+
+namespace asylo {
+namespace platform {
+namespace storage {
+
+using crypto::gcmlib::GcmCryptorRegistry;
+using crypto::gcmlib::kKeyLength;
+using crypto::gcmlib::kTagLength;
+using crypto::gcmlib::kTokenLength;
+
+namespace {
+
+// Identifies a secure log and the version of its layout.
+constexpr char kLogMagic[8] = {'A', 'S', 'Y', 'L', 'O', 'L', 'G', '1'};
+
+// Number of bytes of the log file read from the host at once when reading
+// records, unless a record is longer.
+constexpr size_t kReadAheadLength = 64 * 1024;
+
+// Header of a secure log, authenticated by its tag. Records follow the header.
+struct LogHeader {
+  char magic[sizeof(kLogMagic)];
+  uint8_t log_id[kLogIdLength];
+  uint64_t record_count;
+  uint64_t data_size;
+  uint64_t end_offset;
+  uint8_t head_tag[kTagLength];
+  uint8_t header_tag[kTagLength];
+} ABSL_ATTRIBUTE_PACKED;
+
+// Header of a record, followed by the ciphertext of the record data and its
+// tag.
+struct RecordHeader {
+  uint32_t length;
+  uint8_t token[kTokenLength];
+} ABSL_ATTRIBUTE_PACKED;
+
+// Associated data authenticated along with the data of a record.
+struct RecordAssociatedData {
+  uint8_t log_id[kLogIdLength];
+  uint64_t index;
+  uint8_t previous_tag[kTagLength];
+  uint32_t length;
+} ABSL_ATTRIBUTE_PACKED;
+
+// Paths of the logs opened for writing. Avoid using absl based containers
+// which may perform system calls, as this class is expected to be used in
+// trusted primitives layer where system calls might not be available.
+struct WriterRegistry {
+  absl::Mutex mu;
+  std::unordered_set<std::string> paths ABSL_GUARDED_BY(mu);
+};
+
+WriterRegistry &GetWriterRegistry() {
+  static WriterRegistry *registry = new WriterRegistry;
+  return *registry;
+}
+
+bool is_transient_error(int err) { return (err == EAGAIN) || (err == EINTR); }
+
+// Returns -1 on failure, or min(|len|, bytes to EOF) on success.
+ssize_t pread_all(int fd, void *buf, size_t len, off_t offset) {
+  size_t bytes_read_total = 0;
+  while (bytes_read_total < len) {
+    int bytes_read;
+    do {
+      bytes_read = enc_untrusted_pread64(
+          fd, static_cast<uint8_t *>(buf) + bytes_read_total,
+          len - bytes_read_total, offset + bytes_read_total);
+    } while ((bytes_read == -1) && is_transient_error(errno));
+    if (bytes_read == -1) {
+      return -1;
+    }
+    if (bytes_read == 0) {
+      break;
+    }
+    bytes_read_total += bytes_read;
+  }
+  return bytes_read_total;
+}
+
+// Returns false on failure.
+bool pwrite_all(int fd, const void *buf, size_t len, off_t offset) {
+  size_t bytes_written_total = 0;
+  while (bytes_written_total < len) {
+    int bytes_written;
+    do {
+      bytes_written = enc_untrusted_pwrite64(
+          fd, static_cast<const uint8_t *>(buf) + bytes_written_total,
+          len - bytes_written_total, offset + bytes_written_total);
+    } while ((bytes_written == -1) && is_transient_error(errno));
+    if (bytes_written <= 0) {
+      return false;
+    }
+    bytes_written_total += bytes_written;
+  }
+  return true;
+}
+
+// Returns the number of bytes a record with |length| bytes of data takes in
+// the log file.
+size_t SealedRecordLength(size_t length) {
+  return sizeof(RecordHeader) + length + kTagLength;
+}
+
+}  // namespace
+
+std::unique_ptr<SecureLog> SecureLog::Open(const char *path, int flags,
+                                           mode_t mode) {
+  if (!path || path[0] != '/') {
+    LOG(ERROR) << "Secure log path is expected to be absolute.";
+    errno = EINVAL;
+    return nullptr;
+  }
+
+  const int access_mode = flags & O_ACCMODE;
+  const bool readable = access_mode != O_WRONLY;
+  const bool writable = access_mode != O_RDONLY;
+  if (writable) {
+    WriterRegistry &registry = GetWriterRegistry();
+    absl::MutexLock lock(&registry.mu);
+    if (!registry.paths.insert(path).second) {
+      LOG(ERROR) << "Secure log is already open for writing: " << path;
+      errno = EBUSY;
+      return nullptr;
+    }
+  }
+
+  // The header is read on open even if the log is opened for writing only.
+  int host_flags = flags & ~(O_APPEND | O_ACCMODE);
+  host_flags |= writable ? O_RDWR : O_RDONLY;
+  int host_fd = enc_untrusted_open(path, host_flags, mode);
+  if (host_fd == -1) {
+    LOG(ERROR) << "Failed to open secure log: " << path;
+    if (writable) {
+      int open_errno = errno;
+      WriterRegistry &registry = GetWriterRegistry();
+      absl::MutexLock lock(&registry.mu);
+      registry.paths.erase(path);
+      errno = open_errno;
+    }
+    return nullptr;
+  }
+
+  return absl::WrapUnique(new SecureLog(path, host_fd, readable, writable));
+}
+
+SecureLog::SecureLog(std::string path, int host_fd, bool readable,
+                     bool writable)
+    : path_(std::move(path)),
+      readable_(readable),
+      writable_(writable),
+      host_fd_(host_fd),
+      cryptor_(nullptr),
+      record_count_(0),
+      data_size_(0),
+      end_offset_(sizeof(LogHeader)),
+      dirty_(false),
+      read_ahead_offset_(0) {
+  memset(log_id_, 0, sizeof(log_id_));
+  memset(head_tag_, 0, sizeof(head_tag_));
+  absl::MutexLock lock(&mu_);
+  Rewind();
+}
+
+SecureLog::~SecureLog() {
+  if (host_fd_ != -1) {
+    Close();
+  }
+}
+
+int SecureLog::SetMasterKey(const uint8_t *key_data, uint32_t key_length) {
+  if (!key_data || key_length != kKeyLength) {
+    LOG(ERROR) << "Attempt made to set an invalid key.";
+    errno = EINVAL;
+    return -1;
+  }
+
+  absl::MutexLock lock(&mu_);
+  if (host_fd_ == -1) {
+    errno = EBADF;
+    return -1;
+  }
+
+  if (cryptor_) {
+    if (memcmp(master_key_.data(), key_data, kKeyLength) != 0) {
+      LOG(ERROR) << "Attempt made to set a new key on a secure log: " << path_;
+      errno = EINVAL;
+      return -1;
+    }
+    return 0;
+  }
+
+  master_key_ = crypto::gcmlib::GcmCryptorKey(key_data, key_length);
+  cryptor_ = GcmCryptorRegistry::GetInstance().GetGcmCryptor(
+      kMaxLogRecordLength, master_key_);
+  if (!cryptor_) {
+    LOG(ERROR) << "Unable to instantiate GCM cryptor.";
+    return -1;
+  }
+
+  struct stat st;
+  if (enc_untrusted_fstat(host_fd_, &st) == -1) {
+    LOG(ERROR) << "Failed to stat secure log: " << path_;
+    cryptor_ = nullptr;
+    return -1;
+  }
+
+  // A new log gets its header right away, unless it cannot be written, in
+  // which case it reads as empty.
+  if (st.st_size == 0) {
+    if (writable_ &&
+        (1 != RAND_bytes(log_id_, sizeof(log_id_)) || !WriteHeader())) {
+      LOG(ERROR) << "Failed to create secure log: " << path_;
+      cryptor_ = nullptr;
+      return -1;
+    }
+    Rewind();
+    return 0;
+  }
+
+  if (!LoadHeader(st.st_size)) {
+    cryptor_ = nullptr;
+    return -1;
+  }
+  Rewind();
+  return 0;
+}
+
+bool SecureLog::LoadHeader(off_t file_size) {
+  LogHeader header;
+  if (file_size < static_cast<off_t>(sizeof(header)) ||
+      pread_all(host_fd_, &header, sizeof(header), 0) != sizeof(header)) {
+    LOG(ERROR) << "Failed to read the header of secure log: " << path_;
+    errno = EIO;
+    return false;
+  }
+
+  uint8_t header_tag[kTagLength];
+  if (memcmp(header.magic, kLogMagic, sizeof(kLogMagic)) != 0 ||
+      !cryptor_->GetAuthTag(header_tag, reinterpret_cast<uint8_t *>(&header),
+                            offsetof(LogHeader, header_tag)) ||
+      memcmp(header_tag, header.header_tag, kTagLength) != 0) {
+    LOG(ERROR) << "Integrity verification of the header failed for secure "
+                  "log: "
+               << path_;
+    errno = EIO;
+    return false;
+  }
+
+  // Records appended after the last header update are discarded. A log
+  // shorter than its header records has been truncated.
+  if (header.end_offset < sizeof(header) ||
+      header.end_offset > static_cast<uint64_t>(file_size)) {
+    LOG(ERROR) << "Secure log is shorter than its header records: " << path_;
+    errno = EIO;
+    return false;
+  }
+  if (header.end_offset < static_cast<uint64_t>(file_size) && writable_ &&
+      enc_untrusted_ftruncate(host_fd_, header.end_offset) == -1) {
+    LOG(ERROR) << "Failed to discard the uncommitted records of secure log: "
+               << path_;
+    return false;
+  }
+
+  memcpy(log_id_, header.log_id, kLogIdLength);
+  record_count_ = header.record_count;
+  data_size_ = header.data_size;
+  end_offset_ = header.end_offset;
+  memcpy(head_tag_, header.head_tag, kTagLength);
+  return true;
+}
+
+bool SecureLog::WriteHeader() {
+  LogHeader header;
+  memcpy(header.magic, kLogMagic, sizeof(kLogMagic));
+  memcpy(header.log_id, log_id_, kLogIdLength);
+  header.record_count = record_count_;
+  header.data_size = data_size_;
+  header.end_offset = end_offset_;
+  memcpy(header.head_tag, head_tag_, kTagLength);
+  if (!cryptor_->GetAuthTag(header.header_tag,
+                            reinterpret_cast<uint8_t *>(&header),
+                            offsetof(LogHeader, header_tag))) {
+    return false;
+  }
+
+  if (!pwrite_all(host_fd_, &header, sizeof(header), 0)) {
+    LOG(ERROR) << "Failed to write the header of secure log: " << path_
+               << ", errno = " << errno;
+    return false;
+  }
+
+  dirty_ = false;
+  return true;
+}
+
+bool SecureLog::CommitAppends() {
+  return !dirty_ || WriteHeader();
+}
+
+int SecureLog::CheckKeySet() const {
+  if (host_fd_ == -1) {
+    errno = EBADF;
+    return -1;
+  }
+  if (!cryptor_) {
+    LOG(ERROR) << "Attempt made to access a secure log before setting the key: "
+               << path_;
+    errno = EACCES;
+    return -1;
+  }
+  return 0;
+}
+
+ssize_t SecureLog::Append(const void *buf, size_t count) {
+  absl::MutexLock lock(&mu_);
+  if (CheckKeySet() == -1) {
+    return -1;
+  }
+  if (!writable_) {
+    errno = EBADF;
+    return -1;
+  }
+  if (!buf) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (count == 0) {
+    return 0;
+  }
+
+  // All records of the append are sealed into a single buffer, and written
+  // with a single host call. The state of the log is updated once they are
+  // written.
+  const size_t records_count =
+      (count + kMaxLogRecordLength - 1) / kMaxLogRecordLength;
+  std::vector<uint8_t> sealed(records_count * SealedRecordLength(0) + count);
+  const uint8_t *data = static_cast<const uint8_t *>(buf);
+  uint8_t *out = sealed.data();
+  RecordAssociatedData associated_data;
+  memcpy(associated_data.log_id, log_id_, kLogIdLength);
+  memcpy(associated_data.previous_tag, head_tag_, kTagLength);
+  for (size_t idx = 0; idx < records_count; idx++) {
+    const size_t offset = idx * kMaxLogRecordLength;
+    const size_t length = std::min(kMaxLogRecordLength, count - offset);
+    associated_data.index = record_count_ + idx;
+    associated_data.length = length;
+
+    RecordHeader record_header;
+    record_header.length = length;
+    uint8_t *ciphertext = out + sizeof(RecordHeader);
+    if (!cryptor_->EncryptRecord(
+            data + offset, length,
+            reinterpret_cast<const uint8_t *>(&associated_data),
+            sizeof(associated_data), record_header.token, ciphertext)) {
+      LOG(ERROR) << "Failed to seal a record of secure log: " << path_;
+      errno = EIO;
+      return -1;
+    }
+    memcpy(out, &record_header, sizeof(record_header));
+    memcpy(associated_data.previous_tag, ciphertext + length, kTagLength);
+    out += SealedRecordLength(length);
+  }
+
+  if (!pwrite_all(host_fd_, sealed.data(), sealed.size(), end_offset_)) {
+    LOG(ERROR) << "Failed to append to secure log: " << path_
+               << ", errno = " << errno;
+    return -1;
+  }
+
+  record_count_ += records_count;
+  data_size_ += count;
+  end_offset_ += sealed.size();
+  memcpy(head_tag_, associated_data.previous_tag, kTagLength);
+  dirty_ = true;
+
+  // The appended records need no verification, so the position moves past
+  // them without reading them back.
+  position_ = data_size_;
+  read_index_ = record_count_;
+  read_offset_ = end_offset_;
+  memcpy(read_tag_, head_tag_, kTagLength);
+  record_.clear();
+  record_offset_ = 0;
+  return count;
+}
+
+void SecureLog::Rewind() {
+  position_ = 0;
+  read_index_ = 0;
+  read_offset_ = sizeof(LogHeader);
+  memset(read_tag_, 0, kTagLength);
+  record_.clear();
+  record_offset_ = 0;
+}
+
+bool SecureLog::ReadHost(uint64_t offset, size_t length, uint8_t *data) {
+  if (offset < read_ahead_offset_ ||
+      offset + length > read_ahead_offset_ + read_ahead_.size()) {
+    read_ahead_.resize(std::min<uint64_t>(std::max(length, kReadAheadLength),
+                                          end_offset_ - offset));
+    read_ahead_offset_ = offset;
+    ssize_t bytes_read =
+        pread_all(host_fd_, read_ahead_.data(), read_ahead_.size(), offset);
+    if (bytes_read == -1) {
+      read_ahead_.clear();
+      return false;
+    }
+    read_ahead_.resize(bytes_read);
+    if (static_cast<size_t>(bytes_read) < length) {
+      errno = EIO;
+      return false;
+    }
+  }
+
+  memcpy(data, read_ahead_.data() + (offset - read_ahead_offset_), length);
+  return true;
+}
+
+bool SecureLog::ReadNextRecord() {
+  RecordHeader record_header;
+  if (read_index_ >= record_count_ ||
+      read_offset_ + SealedRecordLength(0) > end_offset_ ||
+      !ReadHost(read_offset_, sizeof(record_header),
+                reinterpret_cast<uint8_t *>(&record_header))) {
+    LOG(ERROR) << "Failed to read a record of secure log: " << path_;
+    errno = EIO;
+    return false;
+  }
+
+  const size_t length = record_header.length;
+  const size_t sealed_length = SealedRecordLength(length);
+  if (length == 0 || length > kMaxLogRecordLength ||
+      read_offset_ + sealed_length > end_offset_) {
+    LOG(ERROR) << "Invalid record length in secure log: " << path_;
+    errno = EIO;
+    return false;
+  }
+
+  std::vector<uint8_t> ciphertext(length + kTagLength);
+  if (!ReadHost(read_offset_ + sizeof(record_header), ciphertext.size(),
+                ciphertext.data())) {
+    LOG(ERROR) << "Failed to read a record of secure log: " << path_;
+    errno = EIO;
+    return false;
+  }
+
+  // The record is verified as the successor of the last verified one, and the
+  // last record as the head of the chain.
+  RecordAssociatedData associated_data;
+  memcpy(associated_data.log_id, log_id_, kLogIdLength);
+  associated_data.index = read_index_;
+  memcpy(associated_data.previous_tag, read_tag_, kTagLength);
+  associated_data.length = length;
+  const uint8_t *tag = ciphertext.data() + length;
+  record_.resize(length);
+  if (!cryptor_->DecryptRecord(
+          ciphertext.data(), length,
+          reinterpret_cast<const uint8_t *>(&associated_data),
+          sizeof(associated_data), record_header.token, record_.data()) ||
+      (read_index_ + 1 == record_count_ &&
+       memcmp(tag, head_tag_, kTagLength) != 0)) {
+    LOG(ERROR) << "Integrity verification failed for record " << read_index_
+               << " of secure log: " << path_;
+    record_.clear();
+    errno = EIO;
+    return false;
+  }
+
+  memcpy(read_tag_, tag, kTagLength);
+  read_index_++;
+  read_offset_ += sealed_length;
+  record_offset_ = 0;
+  return true;
+}
+
+ssize_t SecureLog::Read(void *buf, size_t count) {
+  absl::MutexLock lock(&mu_);
+  if (CheckKeySet() == -1) {
+    return -1;
+  }
+  if (!readable_) {
+    errno = EBADF;
+    return -1;
+  }
+  if (!buf) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  uint8_t *out = static_cast<uint8_t *>(buf);
+  size_t read_count = 0;
+  while (read_count < count && position_ < data_size_) {
+    if (record_offset_ == record_.size() && !ReadNextRecord()) {
+      return -1;
+    }
+    const size_t length =
+        std::min(count - read_count, record_.size() - record_offset_);
+    memcpy(out + read_count, record_.data() + record_offset_, length);
+    record_offset_ += length;
+    read_count += length;
+    position_ += length;
+  }
+  return read_count;
+}
+
+off_t SecureLog::Seek(off_t offset, int whence) {
+  absl::MutexLock lock(&mu_);
+  if (CheckKeySet() == -1) {
+    return -1;
+  }
+
+  off_t target;
+  switch (whence) {
+    case SEEK_SET:
+      target = offset;
+      break;
+    case SEEK_CUR:
+      target = static_cast<off_t>(position_) + offset;
+      break;
+    case SEEK_END:
+      target = static_cast<off_t>(data_size_) + offset;
+      break;
+    default:
+      errno = EINVAL;
+      return -1;
+  }
+  if (target < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  // Records are verified in order, so the records before the target are
+  // verified on the way to it.
+  if (static_cast<uint64_t>(target) < position_) {
+    Rewind();
+  }
+  while (position_ < static_cast<uint64_t>(target) && position_ < data_size_) {
+    if (record_offset_ == record_.size() && !ReadNextRecord()) {
+      return -1;
+    }
+    const size_t length = std::min<uint64_t>(target - position_,
+                                             record_.size() - record_offset_);
+    record_offset_ += length;
+    position_ += length;
+  }
+  position_ = target;
+  return target;
+}
+
+int SecureLog::Sync() {
+  absl::MutexLock lock(&mu_);
+  if (CheckKeySet() == -1) {
+    return -1;
+  }
+
+  // The records are made durable before the header that covers them.
+  if (dirty_ && (enc_untrusted_fsync(host_fd_) == -1 || !WriteHeader())) {
+    return -1;
+  }
+  return enc_untrusted_fsync(host_fd_);
+}
+
+int SecureLog::Close() {
+  absl::MutexLock lock(&mu_);
+  if (host_fd_ == -1) {
+    errno = EBADF;
+    return -1;
+  }
+
+  bool committed = !cryptor_ || CommitAppends();
+  int close_result = enc_untrusted_close(host_fd_);
+  host_fd_ = -1;
+  if (writable_) {
+    WriterRegistry &registry = GetWriterRegistry();
+    absl::MutexLock registry_lock(&registry.mu);
+    registry.paths.erase(path_);
+  }
+  return (committed && close_result == 0) ? 0 : -1;
+}
+
+off_t SecureLog::GetSize() {
+  absl::MutexLock lock(&mu_);
+  if (CheckKeySet() == -1) {
+    return -1;
+  }
+  return data_size_;
+}
+
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
@@ -0,0 +1,184 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_STORAGE_SECURE_SECURE_LOG_H_
+#define ASYLO_PLATFORM_STORAGE_SECURE_SECURE_LOG_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "asylo/platform/crypto/gcmlib/gcm_cryptor.h"
+
+namespace asylo {
+namespace platform {
+namespace storage {
+
+// Maximum length of the data sealed in a single log record. Longer appends are
+// split into several records.
+constexpr size_t kMaxLogRecordLength = 64 * 1024;
+
+// Length of the random identifier of a log, bound to each of its records.
+constexpr size_t kLogIdLength = 16;
+
+// Append-only secure log. The data of each append is sealed in records of up
+// to kMaxLogRecordLength bytes, each followed by its own integrity tag.
+// Records are chained - the tag of a record authenticates its index in the log
+// and the tag of the preceding record along with its data - so that appending
+// costs a single host write and sealing of the appended data only, regardless
+// of the length of the log. The log is read sequentially, each record being
+// verified as it is streamed, and the tag of the last record is checked
+// against the head of the chain authenticated by the log header.
+//
+// The header is updated when the log is synced or closed. A log whose enclave
+// goes away before the update reopens as of its last update, with records
+// appended afterwards discarded. Records are written without syncing them
+// first on close, so the guarantee extends to a power loss only if the host
+// storage persists writes in order; Sync() makes the current state durable.
+//
+// A log may be opened for writing by a single descriptor at a time. The class
+// is thread-safe.
+class SecureLog {
+ public:
+  // Opens the log at the absolute (canonical) |path| with |flags| and |mode|
+  // as for open(), except that writes always append to the log. The log is
+  // accessed once its key is set. Returns nullptr on failure, with errno set.
+  static std::unique_ptr<SecureLog> Open(const char *path, int flags,
+                                         mode_t mode);
+
+  // Closes the log, if it has not been closed yet.
+  ~SecureLog();
+
+  SecureLog(const SecureLog &) = delete;
+  SecureLog &operator=(const SecureLog &) = delete;
+
+  // Sets the master key of the log, and loads and verifies the header of an
+  // existing log, or creates a new log. Setting the key the log already has is
+  // a no-op. Returns 0 on success, or -1 on failure.
+  int SetMasterKey(const uint8_t *key_data, uint32_t key_length)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Appends |count| bytes of |buf| to the log, and moves the position to the
+  // end of the log. Returns |count| on success, or -1 on failure.
+  ssize_t Append(const void *buf, size_t count) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Reads up to |count| bytes from the position into |buf|, verifying the
+  // records they are read from. Returns the number of bytes read, 0 at the end
+  // of the log, or -1 on failure.
+  ssize_t Read(void *buf, size_t count) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Moves the position as for lseek(). Moving it backwards restarts the
+  // verification from the start of the log. Returns the new position, or -1
+  // on failure.
+  off_t Seek(off_t offset, int whence) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Updates the header, if any records were appended since it was last
+  // updated, and makes the log durable. Returns 0 on success, or -1 on
+  // failure.
+  int Sync() ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Updates the header, if any records were appended since it was last
+  // updated, and closes the log. Returns 0 on success, or -1 on failure.
+  int Close() ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns the length of the data in the log, or -1 if the key has not been
+  // set.
+  off_t GetSize() ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns the host descriptor of the log file.
+  int host_fd() const { return host_fd_; }
+
+ private:
+  SecureLog(std::string path, int host_fd, bool readable, bool writable);
+
+  // Verifies the header of the log of |file_size| bytes, and discards any
+  // records appended after it was last updated. Returns false on failure.
+  bool LoadHeader(off_t file_size) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Writes the header for the current state of the log. Returns false on
+  // failure.
+  bool WriteHeader() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Updates the header if any records were appended since it was last updated.
+  // Returns false on failure.
+  bool CommitAppends() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Moves the position to the start of the log.
+  void Rewind() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Reads and verifies the record at the read offset into |record_|. Returns
+  // false on failure.
+  bool ReadNextRecord() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Reads |length| bytes of the log file at |offset| into |data|, reading
+  // ahead of the range. Returns false on failure.
+  bool ReadHost(uint64_t offset, size_t length, uint8_t *data)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Returns -1 with errno set if the key has not been set, and 0 otherwise.
+  int CheckKeySet() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const std::string path_;
+  const bool readable_;
+  const bool writable_;
+  int host_fd_;
+
+  // Cryptor of the log, set along with the key. The cryptor is owned by the
+  // cryptor registry.
+  crypto::gcmlib::GcmCryptor *cryptor_ ABSL_GUARDED_BY(mu_);
+  crypto::gcmlib::GcmCryptorKey master_key_ ABSL_GUARDED_BY(mu_);
+
+  // State of the log - the number of records, the length of the data, the
+  // offset of the end of the last record, and the tag of the last record.
+  uint8_t log_id_[kLogIdLength] ABSL_GUARDED_BY(mu_);
+  uint64_t record_count_ ABSL_GUARDED_BY(mu_);
+  uint64_t data_size_ ABSL_GUARDED_BY(mu_);
+  uint64_t end_offset_ ABSL_GUARDED_BY(mu_);
+  uint8_t head_tag_[crypto::gcmlib::kTagLength] ABSL_GUARDED_BY(mu_);
+
+  // Whether records were appended since the header was last updated.
+  bool dirty_ ABSL_GUARDED_BY(mu_);
+
+  // Read state - the logical position, the index and offset of the next record
+  // to verify, the tag of the last verified record, and the data of that
+  // record along with the offset of the position in it.
+  uint64_t position_ ABSL_GUARDED_BY(mu_);
+  uint64_t read_index_ ABSL_GUARDED_BY(mu_);
+  uint64_t read_offset_ ABSL_GUARDED_BY(mu_);
+  uint8_t read_tag_[crypto::gcmlib::kTagLength] ABSL_GUARDED_BY(mu_);
+  std::vector<uint8_t> record_ ABSL_GUARDED_BY(mu_);
+  size_t record_offset_ ABSL_GUARDED_BY(mu_);
+
+  // Bytes of the log file read ahead of the records verified so far, and
+  // their offset in the file.
+  std::vector<uint8_t> read_ahead_ ABSL_GUARDED_BY(mu_);
+  uint64_t read_ahead_offset_ ABSL_GUARDED_BY(mu_);
+
+  absl::Mutex mu_;
+};
+
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_STORAGE_SECURE_SECURE_LOG_H_
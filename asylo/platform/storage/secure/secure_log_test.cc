@@ -0,0 +1,270 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/storage/secure/secure_log.h"
+
+#include <fcntl.h>
+#include <openssl/rand.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/flags/flag.h"
+#include "absl/strings/str_cat.h"
+#include "asylo/platform/crypto/gcmlib/gcm_cryptor.h"
+#include "asylo/platform/host_call/trusted/host_calls.h"
+#include "asylo/platform/storage/utils/fd_closer.h"
+#include "asylo/test/util/test_flags.h"
+#include "asylo/util/cleansing_types.h"
+
+namespace asylo {
+namespace {
+
+using platform::crypto::gcmlib::kKeyLength;
+using platform::storage::FdCloser;
+using platform::storage::kMaxLogRecordLength;
+using platform::storage::SecureLog;
+
+class SecureLogTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    path_ =
+        absl::StrCat(absl::GetFlag(FLAGS_test_tmpdir), "/SecureLogTest.log");
+    remove(path_.c_str());
+    key_.resize(kKeyLength);
+    ASSERT_EQ(RAND_bytes(key_.data(), key_.size()), 1);
+  }
+
+  // Opens the log with |flags| and sets its key.
+  std::unique_ptr<SecureLog> OpenLog(int flags) {
+    std::unique_ptr<SecureLog> log =
+        SecureLog::Open(path_.c_str(), flags, S_IRUSR | S_IWUSR);
+    if (log && log->SetMasterKey(key_.data(), key_.size()) != 0) {
+      return nullptr;
+    }
+    return log;
+  }
+
+  // Returns |length| random bytes.
+  static std::vector<uint8_t> RandomData(size_t length) {
+    std::vector<uint8_t> data(length);
+    RAND_bytes(data.data(), data.size());
+    return data;
+  }
+
+  // Reads the whole log in reads of |read_length| bytes into |data|. Returns
+  // false on failure.
+  static bool ReadAll(SecureLog *log, size_t read_length,
+                      std::vector<uint8_t> *data) {
+    data->clear();
+    std::vector<uint8_t> buffer(read_length);
+    ssize_t bytes_read;
+    while ((bytes_read = log->Read(buffer.data(), buffer.size())) > 0) {
+      data->insert(data->end(), buffer.begin(), buffer.begin() + bytes_read);
+    }
+    return bytes_read == 0;
+  }
+
+  // Reads the raw contents of the log file into |contents|.
+  bool ReadRawFile(std::vector<uint8_t> *contents) const {
+    struct stat st;
+    if (enc_untrusted_stat(path_.c_str(), &st) != 0) {
+      return false;
+    }
+    int fd = enc_untrusted_open(path_.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    FdCloser fd_closer(fd, &enc_untrusted_close);
+    contents->resize(st.st_size);
+    return enc_untrusted_read(fd, contents->data(), contents->size()) ==
+           contents->size();
+  }
+
+  // Replaces the contents of the log file with |contents|.
+  bool WriteRawFile(const std::vector<uint8_t> &contents) const {
+    int fd = enc_untrusted_open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                                S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+      return false;
+    }
+    FdCloser fd_closer(fd, &enc_untrusted_close);
+    return enc_untrusted_write(fd, contents.data(), contents.size()) ==
+           contents.size();
+  }
+
+  std::string path_;
+  CleansingVector<uint8_t> key_;
+};
+
+TEST_F(SecureLogTest, AppendReadSuccess) {
+  // Appends shorter and longer than a record.
+  std::vector<uint8_t> data = RandomData(100);
+  std::vector<uint8_t> long_data = RandomData(2 * kMaxLogRecordLength + 5);
+  data.insert(data.end(), long_data.begin(), long_data.end());
+
+  std::unique_ptr<SecureLog> log = OpenLog(O_RDWR | O_CREAT | O_APPEND);
+  ASSERT_NE(log, nullptr);
+  EXPECT_EQ(log->Append(data.data(), 100), 100);
+  EXPECT_EQ(log->Append(long_data.data(), long_data.size()), long_data.size());
+  EXPECT_EQ(log->GetSize(), data.size());
+  EXPECT_EQ(log->Close(), 0);
+
+  log = OpenLog(O_RDONLY);
+  ASSERT_NE(log, nullptr);
+  EXPECT_EQ(log->GetSize(), data.size());
+  std::vector<uint8_t> read_data;
+  ASSERT_TRUE(ReadAll(log.get(), 1000, &read_data));
+  EXPECT_EQ(read_data, data);
+  EXPECT_EQ(log->Append(data.data(), data.size()), -1);
+  EXPECT_EQ(log->Close(), 0);
+}
+
+TEST_F(SecureLogTest, AppendAfterReopenSuccess) {
+  std::vector<uint8_t> data = RandomData(300);
+
+  std::unique_ptr<SecureLog> log = OpenLog(O_WRONLY | O_CREAT | O_APPEND);
+  ASSERT_NE(log, nullptr);
+  EXPECT_EQ(log->Append(data.data(), 100), 100);
+  EXPECT_EQ(log->Read(data.data(), 1), -1);
+  EXPECT_EQ(log->Close(), 0);
+
+  log = OpenLog(O_RDWR | O_APPEND);
+  ASSERT_NE(log, nullptr);
+  EXPECT_EQ(log->Append(data.data() + 100, 200), 200);
+  EXPECT_EQ(log->Seek(0, SEEK_CUR), data.size());
+  EXPECT_EQ(log->Seek(0, SEEK_SET), 0);
+  std::vector<uint8_t> read_data;
+  ASSERT_TRUE(ReadAll(log.get(), 7, &read_data));
+  EXPECT_EQ(read_data, data);
+  EXPECT_EQ(log->Close(), 0);
+}
+
+TEST_F(SecureLogTest, SeekSuccess) {
+  std::vector<uint8_t> data = RandomData(3 * kMaxLogRecordLength);
+  std::unique_ptr<SecureLog> log = OpenLog(O_RDWR | O_CREAT | O_APPEND);
+  ASSERT_NE(log, nullptr);
+  EXPECT_EQ(log->Append(data.data(), data.size()), data.size());
+
+  uint8_t byte;
+  const off_t offset = kMaxLogRecordLength + 10;
+  EXPECT_EQ(log->Seek(offset, SEEK_SET), offset);
+  EXPECT_EQ(log->Read(&byte, 1), 1);
+  EXPECT_EQ(byte, data[offset]);
+  EXPECT_EQ(log->Seek(-2, SEEK_CUR), offset - 1);
+  EXPECT_EQ(log->Read(&byte, 1), 1);
+  EXPECT_EQ(byte, data[offset - 1]);
+  EXPECT_EQ(log->Seek(-1, SEEK_END), data.size() - 1);
+  EXPECT_EQ(log->Read(&byte, 1), 1);
+  EXPECT_EQ(byte, data.back());
+  EXPECT_EQ(log->Read(&byte, 1), 0);
+  EXPECT_EQ(log->Seek(-1, SEEK_SET), -1);
+  EXPECT_EQ(log->Close(), 0);
+}
+
+TEST_F(SecureLogTest, UncommittedRecordsDiscarded) {
+  std::vector<uint8_t> data = RandomData(200);
+  std::unique_ptr<SecureLog> log = OpenLog(O_RDWR | O_CREAT | O_APPEND);
+  ASSERT_NE(log, nullptr);
+  EXPECT_EQ(log->Append(data.data(), 100), 100);
+  EXPECT_EQ(log->Sync(), 0);
+  std::vector<uint8_t> synced;
+  ASSERT_TRUE(ReadRawFile(&synced));
+  EXPECT_EQ(log->Append(data.data() + 100, 100), 100);
+  EXPECT_EQ(log->Close(), 0);
+
+  // The header as of the sync is restored, as if the enclave went away before
+  // updating it.
+  std::vector<uint8_t> contents;
+  ASSERT_TRUE(ReadRawFile(&contents));
+  ASSERT_GT(contents.size(), synced.size());
+  std::copy(synced.begin(), synced.end(), contents.begin());
+  ASSERT_TRUE(WriteRawFile(contents));
+
+  log = OpenLog(O_RDWR | O_APPEND);
+  ASSERT_NE(log, nullptr);
+  EXPECT_EQ(log->GetSize(), 100);
+  std::vector<uint8_t> read_data;
+  ASSERT_TRUE(ReadAll(log.get(), 64, &read_data));
+  EXPECT_EQ(read_data, std::vector<uint8_t>(data.begin(), data.begin() + 100));
+  EXPECT_EQ(log->Close(), 0);
+  ASSERT_TRUE(ReadRawFile(&contents));
+  EXPECT_EQ(contents.size(), synced.size());
+}
+
+TEST_F(SecureLogTest, ModifiedRecordFailure) {
+  std::vector<uint8_t> data = RandomData(100);
+  std::unique_ptr<SecureLog> log = OpenLog(O_RDWR | O_CREAT | O_APPEND);
+  ASSERT_NE(log, nullptr);
+  EXPECT_EQ(log->Append(data.data(), data.size()), data.size());
+  EXPECT_EQ(log->Close(), 0);
+
+  std::vector<uint8_t> contents;
+  ASSERT_TRUE(ReadRawFile(&contents));
+  contents[contents.size() - 20]++;
+  ASSERT_TRUE(WriteRawFile(contents));
+
+  log = OpenLog(O_RDONLY);
+  ASSERT_NE(log, nullptr);
+  EXPECT_EQ(log->Read(data.data(), data.size()), -1);
+}
+
+TEST_F(SecureLogTest, DroppedRecordFailure) {
+  std::vector<uint8_t> data = RandomData(100);
+  std::unique_ptr<SecureLog> log = OpenLog(O_RDWR | O_CREAT | O_APPEND);
+  ASSERT_NE(log, nullptr);
+  EXPECT_EQ(log->Append(data.data(), 50), 50);
+  EXPECT_EQ(log->Append(data.data() + 50, 50), 50);
+  EXPECT_EQ(log->Close(), 0);
+
+  // A truncated log does not open.
+  std::vector<uint8_t> contents;
+  ASSERT_TRUE(ReadRawFile(&contents));
+  contents.pop_back();
+  ASSERT_TRUE(WriteRawFile(contents));
+  EXPECT_EQ(OpenLog(O_RDONLY), nullptr);
+}
+
+TEST_F(SecureLogTest, SingleWriterOnly) {
+  std::unique_ptr<SecureLog> log = OpenLog(O_RDWR | O_CREAT | O_APPEND);
+  ASSERT_NE(log, nullptr);
+  EXPECT_EQ(SecureLog::Open(path_.c_str(), O_WRONLY | O_APPEND, 0), nullptr);
+  EXPECT_EQ(errno, EBUSY);
+  EXPECT_NE(OpenLog(O_RDONLY), nullptr);
+  EXPECT_EQ(log->Close(), 0);
+  EXPECT_NE(OpenLog(O_WRONLY | O_APPEND), nullptr);
+}
+
+TEST_F(SecureLogTest, KeyNotSetFailure) {
+  std::unique_ptr<SecureLog> log = SecureLog::Open(
+      path_.c_str(), O_RDWR | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR);
+  ASSERT_NE(log, nullptr);
+  uint8_t byte = 0;
+  EXPECT_EQ(log->Append(&byte, 1), -1);
+  EXPECT_EQ(errno, EACCES);
+  EXPECT_EQ(log->Read(&byte, 1), -1);
+  EXPECT_EQ(log->Close(), 0);
+}
+
+}  // namespace
+}  // namespace asylo
@@ -0,0 +1,306 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <fcntl.h>
+#include <openssl/rand.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "absl/flags/flag.h"
+#include "absl/strings/str_cat.h"
+#include "asylo/platform/crypto/gcmlib/gcm_cryptor.h"
+#include "asylo/platform/storage/secure/aead_handler.h"
+#include "asylo/platform/storage/secure/enclave_storage_secure.h"
+#include "asylo/platform/storage/secure/persisted_authenticated_dictionary.h"
+#include "asylo/platform/storage/secure/undo_journal.h"
+#include "asylo/test/util/benchmark.h"
+#include "asylo/test/util/test_flags.h"
+
+namespace asylo {
+namespace platform {
+namespace storage {
+namespace {
+
+// Layout and cache settings the benchmarks are run with, so that their results
+// are comparable across block lengths and with the cache disabled.
+struct Config {
+  size_t block_length;
+  size_t cache_capacity;
+};
+
+constexpr Config kConfigs[] = {
+    {kDefaultBlockLength, kDefaultBlockCacheCapacity},
+    {kDefaultBlockLength, 0},
+    {4096, kDefaultBlockCacheCapacity},
+    {4096, 0},
+};
+
+// Sizes of the files opened by the open time benchmark.
+constexpr size_t kOpenFileSizes[] = {64 * 1024, 1024 * 1024,
+                                     16 * 1024 * 1024};
+
+// Size of the files read and written by the throughput benchmarks.
+constexpr size_t kFileSize = 4 * 1024 * 1024;
+
+// Lengths of the reads and writes of the throughput benchmarks.
+constexpr size_t kRequestLengths[] = {128, 4096, 64 * 1024};
+
+// Length of the reads and writes of the latency and scaling benchmarks.
+constexpr size_t kSmallRequestLength = 4096;
+
+// Numbers of threads reading a file concurrently, and the number of reads by
+// each thread per iteration.
+constexpr int kThreadCounts[] = {1, 2, 4, 8};
+constexpr int kReadsPerThread = 64;
+
+std::string ConfigName(const Config &config) {
+  return absl::StrCat("block_length=", config.block_length,
+                      "/cache=", config.cache_capacity);
+}
+
+// Benchmarks of secure files accessed through the enclave_storage_secure API.
+// Run explicitly, e.g. on the dlopen backend with --config=asylo-dlopen, and
+// compare the logged results across configurations.
+class SecureStorageBenchmark : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    path_ = absl::StrCat(absl::GetFlag(FLAGS_test_tmpdir),
+                         "/SecureStorageBenchmark.dat");
+    key_.resize(crypto::gcmlib::kKeyLength);
+    ASSERT_EQ(RAND_bytes(key_.data(), key_.size()), 1);
+    data_.resize(kOpenFileSizes[2]);
+    ASSERT_EQ(RAND_bytes(data_.data(), data_.size()), 1);
+  }
+
+  void TearDown() override {
+    AeadHandler::GetInstance().SetBlockCacheCapacity(
+        kDefaultBlockCacheCapacity);
+    RemoveFile();
+  }
+
+  void RemoveFile() {
+    remove(path_.c_str());
+    remove(absl::StrCat(path_, kMerkleTreeFileSuffix).c_str());
+    remove(absl::StrCat(path_, kUndoJournalFileSuffix).c_str());
+  }
+
+  // Opens the benchmarked file with |flags| and sets its key. Returns the file
+  // descriptor, or -1 on failure.
+  int OpenFile(const Config &config, int flags) {
+    AeadHandler::GetInstance().SetBlockCacheCapacity(config.cache_capacity);
+    int fd = secure_open(path_.c_str(), flags, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+      return -1;
+    }
+    if (AeadHandler::GetInstance().SetMasterKey(
+            fd, key_.data(), key_.size(), config.block_length) != 0) {
+      secure_close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  // Creates the benchmarked file with |size| bytes of random data.
+  void CreateFile(const Config &config, size_t size) {
+    RemoveFile();
+    int fd = OpenFile(config, O_RDWR | O_CREAT);
+    ASSERT_NE(fd, -1);
+    constexpr size_t kChunkLength = 64 * 1024;
+    for (size_t offset = 0; offset < size; offset += kChunkLength) {
+      size_t length = std::min(kChunkLength, size - offset);
+      ASSERT_EQ(secure_write(fd, data_.data() + offset, length), length);
+    }
+    ASSERT_EQ(secure_close(fd), 0);
+  }
+
+  std::string path_;
+  std::vector<uint8_t> key_;
+  std::vector<uint8_t> data_;
+};
+
+TEST_F(SecureStorageBenchmark, OpenTimeVersusFileSize) {
+  for (const Config &config : kConfigs) {
+    for (size_t size : kOpenFileSizes) {
+      CreateFile(config, size);
+      LogBenchmarkResult(
+          absl::StrCat("Open/", ConfigName(config), "/", size),
+          RunBenchmark([&] {
+            int fd = OpenFile(config, O_RDONLY);
+            ASSERT_NE(fd, -1);
+            ASSERT_EQ(secure_close(fd), 0);
+          }));
+    }
+  }
+}
+
+TEST_F(SecureStorageBenchmark, ReadThroughput) {
+  for (const Config &config : kConfigs) {
+    CreateFile(config, kFileSize);
+    int fd = OpenFile(config, O_RDONLY);
+    ASSERT_NE(fd, -1);
+    std::vector<uint8_t> buffer(kRequestLengths[2]);
+    for (size_t length : kRequestLengths) {
+      off_t offset = 0;
+      ASSERT_EQ(secure_lseek(fd, 0, SEEK_SET), 0);
+      LogBenchmarkResult(
+          absl::StrCat("Read/Sequential/", ConfigName(config), "/", length),
+          RunBenchmark([&] {
+            if (offset + length > kFileSize) {
+              offset = 0;
+              ASSERT_EQ(secure_lseek(fd, 0, SEEK_SET), 0);
+            }
+            ASSERT_EQ(secure_read(fd, buffer.data(), length), length);
+            offset += length;
+          }),
+          length);
+
+      std::mt19937_64 rng(length);
+      std::uniform_int_distribution<size_t> request(0,
+                                                    kFileSize / length - 1);
+      LogBenchmarkResult(
+          absl::StrCat("Read/Random/", ConfigName(config), "/", length),
+          RunBenchmark([&] {
+            ASSERT_EQ(secure_pread(fd, buffer.data(), length,
+                                   request(rng) * length),
+                      length);
+          }),
+          length);
+    }
+    ASSERT_EQ(secure_close(fd), 0);
+  }
+}
+
+TEST_F(SecureStorageBenchmark, WriteThroughput) {
+  for (const Config &config : kConfigs) {
+    CreateFile(config, kFileSize);
+    int fd = OpenFile(config, O_RDWR);
+    ASSERT_NE(fd, -1);
+    for (size_t length : kRequestLengths) {
+      off_t offset = 0;
+      ASSERT_EQ(secure_lseek(fd, 0, SEEK_SET), 0);
+      LogBenchmarkResult(
+          absl::StrCat("Write/Sequential/", ConfigName(config), "/", length),
+          RunBenchmark([&] {
+            if (offset + length > kFileSize) {
+              offset = 0;
+              ASSERT_EQ(secure_lseek(fd, 0, SEEK_SET), 0);
+            }
+            ASSERT_EQ(secure_write(fd, data_.data() + offset, length),
+                      length);
+            offset += length;
+          }),
+          length);
+
+      std::mt19937_64 rng(length);
+      std::uniform_int_distribution<size_t> request(0,
+                                                    kFileSize / length - 1);
+      LogBenchmarkResult(
+          absl::StrCat("Write/Random/", ConfigName(config), "/", length),
+          RunBenchmark([&] {
+            off_t request_offset = request(rng) * length;
+            ASSERT_EQ(secure_lseek(fd, request_offset, SEEK_SET),
+                      request_offset);
+            ASSERT_EQ(secure_write(fd, data_.data() + request_offset, length),
+                      length);
+          }),
+          length);
+    }
+    ASSERT_EQ(secure_close(fd), 0);
+  }
+}
+
+TEST_F(SecureStorageBenchmark, FsyncLatency) {
+  // Writes update the digest right away, or only when the file is synced.
+  constexpr uint32_t kDigestUpdateIntervals[] = {kDefaultDigestUpdateInterval,
+                                                 0};
+  for (const Config &config : kConfigs) {
+    CreateFile(config, kFileSize);
+    for (uint32_t interval : kDigestUpdateIntervals) {
+      int fd = OpenFile(config, O_RDWR);
+      ASSERT_NE(fd, -1);
+      ASSERT_EQ(
+          AeadHandler::GetInstance().SetDigestUpdateInterval(fd, interval), 0);
+      std::mt19937_64 rng(interval);
+      std::uniform_int_distribution<size_t> request(
+          0, kFileSize / kSmallRequestLength - 1);
+      LogBenchmarkResult(
+          absl::StrCat("WriteFsync/", ConfigName(config),
+                       "/digest_update_interval=", interval),
+          RunBenchmark([&] {
+            off_t request_offset = request(rng) * kSmallRequestLength;
+            ASSERT_EQ(secure_lseek(fd, request_offset, SEEK_SET),
+                      request_offset);
+            ASSERT_EQ(secure_write(fd, data_.data() + request_offset,
+                                   kSmallRequestLength),
+                      kSmallRequestLength);
+            ASSERT_EQ(secure_fsync(fd), 0);
+          }));
+      ASSERT_EQ(secure_close(fd), 0);
+    }
+  }
+}
+
+TEST_F(SecureStorageBenchmark, MultiThreadedReadScaling) {
+  for (const Config &config : kConfigs) {
+    CreateFile(config, kFileSize);
+    int fd = OpenFile(config, O_RDONLY);
+    ASSERT_NE(fd, -1);
+    for (int thread_count : kThreadCounts) {
+      // Each thread reads from random offsets of the file through the shared
+      // descriptor.
+      uint64_t seed = 0;
+      LogBenchmarkResult(
+          absl::StrCat("ConcurrentRead/", ConfigName(config),
+                       "/threads=", thread_count),
+          RunBenchmark([&] {
+            std::vector<std::thread> threads;
+            for (int idx = 0; idx < thread_count; idx++) {
+              threads.emplace_back([fd, thread_seed = seed++] {
+                std::mt19937_64 rng(thread_seed);
+                std::uniform_int_distribution<size_t> request(
+                    0, kFileSize / kSmallRequestLength - 1);
+                std::vector<uint8_t> buffer(kSmallRequestLength);
+                for (int read = 0; read < kReadsPerThread; read++) {
+                  EXPECT_EQ(secure_pread(fd, buffer.data(), buffer.size(),
+                                         request(rng) * kSmallRequestLength),
+                            kSmallRequestLength);
+                }
+              });
+            }
+            for (std::thread &thread : threads) {
+              thread.join();
+            }
+          }),
+          thread_count * kReadsPerThread * kSmallRequestLength);
+    }
+    ASSERT_EQ(secure_close(fd), 0);
+  }
+}
+
+}  // namespace
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
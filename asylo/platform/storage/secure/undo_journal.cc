@@ -0,0 +1,295 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/storage/secure/undo_journal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "absl/base/attributes.h"
+#include "asylo/platform/host_call/trusted/host_calls.h"
+#include "asylo/platform/storage/utils/fd_closer.h"
+#include "asylo/util/logging.h"
+
+namespace asylo {
+namespace platform {
+namespace storage {
+namespace {
+
+// Identifies an undo journal and the version of its layout.
+constexpr char kJournalMagic[8] = {'A', 'S', 'Y', 'L', 'O', 'U', 'J', '1'};
+
+// Upper bound on the number of bytes read from the host at once on recovery.
+constexpr size_t kMaxRecoveryReadLength = 1 << 20;
+
+// Header of an undo journal. Entries follow the header, each consisting of the
+// index of a block followed by the image of the secure block.
+struct JournalHeader {
+  char magic[sizeof(kJournalMagic)];
+  uint8_t commit_id[kCommitIdLength];
+  uint32_t secure_block_length;
+} ABSL_ATTRIBUTE_PACKED;
+
+using BlockIndex = uint64_t;
+
+bool is_transient_error(int err) { return (err == EAGAIN) || (err == EINTR); }
+
+// Returns -1 on failure, or min(|len|, bytes to EOF) on success.
+ssize_t pread_all(int fd, void *buf, size_t len, off_t offset) {
+  size_t bytes_read_total = 0;
+  while (bytes_read_total < len) {
+    int bytes_read;
+    do {
+      bytes_read = enc_untrusted_pread64(
+          fd, static_cast<uint8_t *>(buf) + bytes_read_total,
+          len - bytes_read_total, offset + bytes_read_total);
+    } while ((bytes_read == -1) && is_transient_error(errno));
+    if (bytes_read == -1) {
+      return -1;
+    }
+    if (bytes_read == 0) {
+      break;
+    }
+    bytes_read_total += bytes_read;
+  }
+  return bytes_read_total;
+}
+
+// Returns false on failure.
+bool pwrite_all(int fd, const void *buf, size_t len, off_t offset) {
+  size_t bytes_written_total = 0;
+  while (bytes_written_total < len) {
+    int bytes_written;
+    do {
+      bytes_written = enc_untrusted_pwrite64(
+          fd, static_cast<const uint8_t *>(buf) + bytes_written_total,
+          len - bytes_written_total, offset + bytes_written_total);
+    } while ((bytes_written == -1) && is_transient_error(errno));
+    if (bytes_written <= 0) {
+      return false;
+    }
+    bytes_written_total += bytes_written;
+  }
+  return true;
+}
+
+// Writes the entries in |entries| to the secure file open at |fd|. Returns
+// false on failure.
+bool RestoreEntries(int fd, size_t secure_block_length, off_t blocks_offset,
+                    const uint8_t *entries, size_t entries_count) {
+  const size_t entry_length = sizeof(BlockIndex) + secure_block_length;
+  const uint64_t max_block_index =
+      (std::numeric_limits<off_t>::max() - blocks_offset) /
+          secure_block_length -
+      1;
+  for (size_t idx = 0; idx < entries_count; idx++) {
+    const uint8_t *entry = entries + idx * entry_length;
+    BlockIndex block_index;
+    memcpy(&block_index, entry, sizeof(block_index));
+    if (block_index > max_block_index) {
+      LOG(ERROR) << "Invalid block index in undo journal: " << block_index;
+      return false;
+    }
+    if (!pwrite_all(fd, entry + sizeof(BlockIndex), secure_block_length,
+                    blocks_offset + block_index * secure_block_length)) {
+      LOG(ERROR) << "Failed to restore block " << block_index
+                 << " from undo journal, errno = " << errno;
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+UndoJournal::UndoJournal(std::string path, size_t secure_block_length)
+    : path_(std::move(path)),
+      secure_block_length_(secure_block_length),
+      length_(0),
+      fd_(-1) {
+  memset(commit_id_, 0, sizeof(commit_id_));
+}
+
+UndoJournal::~UndoJournal() {
+  if (fd_ != -1) {
+    enc_untrusted_close(fd_);
+  }
+}
+
+bool UndoJournal::Open() {
+  if (fd_ != -1) {
+    return true;
+  }
+
+  fd_ = enc_untrusted_open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                           S_IRUSR | S_IWUSR);
+  if (fd_ == -1) {
+    LOG(ERROR) << "Failed to open undo journal, path = " << path_
+               << ", errno = " << errno;
+    return false;
+  }
+  length_ = 0;
+  return true;
+}
+
+bool UndoJournal::Reset(const uint8_t *commit_id) {
+  memcpy(commit_id_, commit_id, sizeof(commit_id_));
+  recorded_blocks_.clear();
+  if (length_ == 0) {
+    return true;
+  }
+
+  // Once the journal is empty, it can no longer roll the file back, and the
+  // state identified by |commit_id| is the only one the file verifies as.
+  if (enc_untrusted_ftruncate(fd_, 0) == -1) {
+    LOG(ERROR) << "Failed to truncate undo journal, path = " << path_
+               << ", errno = " << errno;
+    return false;
+  }
+  length_ = 0;
+  return true;
+}
+
+bool UndoJournal::IsRecorded(uint64_t block_index) const {
+  return recorded_blocks_.find(block_index) != recorded_blocks_.end();
+}
+
+bool UndoJournal::Record(uint64_t first_block_index, const uint8_t *blocks,
+                         size_t blocks_count) {
+  // The header and all new entries are written by a single host call.
+  std::vector<uint8_t> buffer;
+  if (length_ == 0) {
+    JournalHeader header;
+    memcpy(header.magic, kJournalMagic, sizeof(kJournalMagic));
+    memcpy(header.commit_id, commit_id_, sizeof(commit_id_));
+    header.secure_block_length = secure_block_length_;
+    const uint8_t *header_data = reinterpret_cast<const uint8_t *>(&header);
+    buffer.insert(buffer.end(), header_data, header_data + sizeof(header));
+  }
+
+  const size_t header_length = buffer.size();
+  for (size_t idx = 0; idx < blocks_count; idx++) {
+    const BlockIndex block_index = first_block_index + idx;
+    if (IsRecorded(block_index)) {
+      continue;
+    }
+    const uint8_t *index_data = reinterpret_cast<const uint8_t *>(&block_index);
+    buffer.insert(buffer.end(), index_data, index_data + sizeof(block_index));
+    const uint8_t *block = blocks + idx * secure_block_length_;
+    buffer.insert(buffer.end(), block, block + secure_block_length_);
+  }
+  if (buffer.size() == header_length) {
+    return true;
+  }
+
+  if (!Open() || !pwrite_all(fd_, buffer.data(), buffer.size(), length_)) {
+    LOG(ERROR) << "Failed to write undo journal, path = " << path_
+               << ", errno = " << errno;
+    return false;
+  }
+  length_ += buffer.size();
+  for (size_t idx = 0; idx < blocks_count; idx++) {
+    recorded_blocks_.insert(first_block_index + idx);
+  }
+  return true;
+}
+
+bool UndoJournal::Recover(const std::string &path, size_t secure_block_length,
+                          const uint8_t *commit_id,
+                          const std::string &file_path, off_t blocks_offset,
+                          bool *restored) {
+  *restored = false;
+  int fd = enc_untrusted_open(path.c_str(), O_RDWR);
+  if (fd == -1) {
+    // No journal has been recorded for the file.
+    return errno == ENOENT;
+  }
+  FdCloser fd_closer(fd, &enc_untrusted_close);
+
+  JournalHeader header;
+  ssize_t bytes_read = pread_all(fd, &header, sizeof(header), 0);
+  if (bytes_read == -1) {
+    LOG(ERROR) << "Failed to read undo journal, path = " << path;
+    return false;
+  }
+
+  // Only a journal recorded for the state the file header identifies is
+  // restored. Otherwise, the header was updated after the journal was
+  // recorded, and the journal is stale.
+  if (bytes_read == sizeof(header) &&
+      memcmp(header.magic, kJournalMagic, sizeof(kJournalMagic)) == 0 &&
+      header.secure_block_length == secure_block_length &&
+      memcmp(header.commit_id, commit_id, kCommitIdLength) == 0) {
+    int file_fd = enc_untrusted_open(file_path.c_str(), O_WRONLY);
+    if (file_fd == -1) {
+      LOG(ERROR) << "Failed to open file to restore undo journal, path = "
+                 << file_path << ", errno = " << errno;
+      return false;
+    }
+    FdCloser file_fd_closer(file_fd, &enc_untrusted_close);
+
+    // A partially written entry at the end of the journal is ignored, since
+    // its block was not overwritten yet.
+    const size_t entry_length = sizeof(BlockIndex) + secure_block_length;
+    const size_t entries_per_read =
+        std::max<size_t>(kMaxRecoveryReadLength / entry_length, 1);
+    std::vector<uint8_t> buffer(entries_per_read * entry_length);
+    off_t offset = sizeof(header);
+    while (true) {
+      bytes_read = pread_all(fd, buffer.data(), buffer.size(), offset);
+      if (bytes_read == -1) {
+        LOG(ERROR) << "Failed to read undo journal, path = " << path;
+        return false;
+      }
+      const size_t entries_count = bytes_read / entry_length;
+      if (entries_count == 0) {
+        break;
+      }
+      if (!RestoreEntries(file_fd, secure_block_length, blocks_offset,
+                          buffer.data(), entries_count)) {
+        return false;
+      }
+      *restored = true;
+      offset += entries_count * entry_length;
+    }
+
+    if (*restored && enc_untrusted_fsync(file_fd) == -1) {
+      LOG(ERROR) << "Failed to sync file restored from undo journal, path = "
+                 << file_path << ", errno = " << errno;
+      return false;
+    }
+  }
+
+  if (enc_untrusted_ftruncate(fd, 0) == -1) {
+    LOG(ERROR) << "Failed to truncate undo journal, path = " << path
+               << ", errno = " << errno;
+    return false;
+  }
+  return true;
+}
+
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
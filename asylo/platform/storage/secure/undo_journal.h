@@ -0,0 +1,120 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_STORAGE_SECURE_UNDO_JOURNAL_H_
+#define ASYLO_PLATFORM_STORAGE_SECURE_UNDO_JOURNAL_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+#include <unordered_set>
+
+namespace asylo {
+namespace platform {
+namespace storage {
+
+// Suffix appended to the path of a secure file to form the path of its undo
+// journal.
+constexpr char kUndoJournalFileSuffix[] = ".journal";
+
+// Length of the identifier of the committed state of a file that a journal
+// rolls back to.
+constexpr size_t kCommitIdLength = 16;
+
+// Undo journal of a secure file whose header is updated less often than its
+// blocks are written. Before a block of the last committed state of the file is
+// overwritten, the image of the block as committed is appended to the journal,
+// once per commit interval. Opening a file whose header still identifies the
+// state recorded in its journal, because the enclave went away before the next
+// commit, restores the recorded images, and so returns the file to its last
+// committed state. Blocks appended after the commit need no images, since the
+// committed header does not cover them.
+//
+// Journal contents are untrusted. A restored file is verified against its
+// header like any other file, so a tampered journal yields a file that fails
+// verification rather than one with forged contents.
+//
+// The class is not thread-safe; callers must serialize access.
+class UndoJournal {
+ public:
+  // Creates a journal at |path| for a file with secure blocks of
+  // |secure_block_length| bytes. The file is not accessed until Record() is
+  // called.
+  UndoJournal(std::string path, size_t secure_block_length);
+
+  ~UndoJournal();
+
+  UndoJournal(const UndoJournal &) = delete;
+  UndoJournal &operator=(const UndoJournal &) = delete;
+
+  // Starts a new commit interval for the committed state identified by
+  // |commit_id|, a buffer of kCommitIdLength bytes, discarding the images
+  // recorded in the previous interval. Returns false on failure.
+  bool Reset(const uint8_t *commit_id);
+
+  // Returns whether the image of block |block_index| has been recorded in the
+  // current commit interval.
+  bool IsRecorded(uint64_t block_index) const;
+
+  // Records the images of |blocks_count| consecutive blocks starting at
+  // |first_block_index|, read from |blocks|, skipping blocks recorded earlier
+  // in the interval. The images are written to the journal before the call
+  // returns. Returns false on failure.
+  bool Record(uint64_t first_block_index, const uint8_t *blocks,
+              size_t blocks_count);
+
+  // Restores the images recorded in the journal at |path| to the secure file
+  // at |file_path|, whose blocks start at |blocks_offset|, if the journal was
+  // recorded for the committed state identified by |commit_id|, and then
+  // empties the journal. A journal recorded for another state is stale and is
+  // emptied without being restored. |*restored| is set to whether any images
+  // were restored. Returns false on failure.
+  static bool Recover(const std::string &path, size_t secure_block_length,
+                      const uint8_t *commit_id, const std::string &file_path,
+                      off_t blocks_offset, bool *restored);
+
+ private:
+  // Opens the journal file for writing, if not open yet, discarding its
+  // contents. Returns false on failure.
+  bool Open();
+
+  const std::string path_;
+  const size_t secure_block_length_;
+
+  // Identifier of the committed state the recorded images belong to.
+  uint8_t commit_id_[kCommitIdLength];
+
+  // Length of the journal file, including the header, or 0 if no images have
+  // been recorded in the current interval.
+  off_t length_;
+
+  // Indices of blocks recorded in the current interval. Avoid using absl based
+  // containers which may perform system calls, as this class is expected to be
+  // used in trusted primitives layer where system calls might not be available.
+  std::unordered_set<uint64_t> recorded_blocks_;
+
+  // Descriptor of the journal file, opened on first use.
+  int fd_;
+};
+
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_STORAGE_SECURE_UNDO_JOURNAL_H_
@@ -0,0 +1,371 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_STORAGE_UTILS_CONCURRENT_RECORD_STORE_H_
+#define ASYLO_PLATFORM_STORAGE_UTILS_CONCURRENT_RECORD_STORE_H_
+
+#include <sys/types.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "asylo/util/logging.h"
+#include "asylo/platform/storage/utils/random_access_storage.h"
+#include "asylo/util/asylo_macros.h"
+#include "asylo/util/status.h"
+#include "asylo/util/status_macros.h"
+#include "asylo/util/statusor.h"
+
+namespace asylo {
+
+// A thread-safe variant of RecordStore. T must be a POD type.
+//
+// Like RecordStore, this class presents a storage resource as a collection of
+// fixed-size records of type T addressed by byte offset, and leaves the layout
+// of records to the caller. Unlike RecordStore, its methods may be called
+// concurrently from any number of threads.
+//
+// The cache is partitioned into shards selected by record offset, each guarded
+// by its own mutex, so that threads touching different records rarely contend.
+// Each shard stores its entries in an array allocated when the store is
+// created and evicts them with the CLOCK algorithm: a hit sets an entry's
+// reference bit, and the clock hand clears reference bits until it finds an
+// entry without one. Newly loaded entries start without a reference bit, so a
+// scan through many records only displaces other records that have not been
+// touched since they were loaded.
+//
+// Flush() submits all dirty records to the storage resource in offset order
+// with a single RandomAccessStorage::WriteV() call, which lets resources such
+// as UntrustedFile write each run of adjacent records at once.
+//
+// Records are read from and written back to storage without holding the lock
+// of their shard. An entry being loaded or written back is marked busy, and
+// threads accessing its record wait for the transfer to complete, while the
+// other records of the shard remain available. Transfers of different records
+// may therefore reach |io| concurrently, so |io| must support concurrent calls
+// at non-overlapping offsets, as UntrustedFile does. The caller must not access
+// |io| through other objects while methods of the ConcurrentRecordStore are
+// running.
+template <typename T>
+class ConcurrentRecordStore {
+ public:
+  using value_type = T;
+
+  // Check that reading an object of type T from storage makes sense.
+  static_assert(std::is_trivially_copy_assignable<T>::value,
+                "T must satisfy std::is_trivially_copy_assignable");
+
+  // Default number of cache shards.
+  static constexpr size_t kDefaultShardCount = 16;
+
+  // Initializes a ConcurrentRecordStore backed by a storage resource |io| and
+  // configures a cache with a |capacity| specified as a count of elements of
+  // type T, divided evenly between |shard_count| shards. The shard count is
+  // reduced if needed so that every shard holds at least one element. The
+  // ConcurrentRecordStore does not take ownership of |io| and it is the
+  // responsibility of the caller to ensure it remains valid over the lifetime
+  // of the ConcurrentRecordStore.
+  ConcurrentRecordStore(size_t capacity, RandomAccessStorage *io,
+                        size_t shard_count = kDefaultShardCount)
+      : io_(io) {
+    capacity = std::max<size_t>(capacity, 1);
+    shard_count_ = std::min(std::max<size_t>(shard_count, 1), capacity);
+    shards_.reset(new Shard[shard_count_]);
+    for (size_t i = 0; i < shard_count_; i++) {
+      // Spread the remainder over the first shards so that the total capacity
+      // is exactly |capacity|.
+      size_t shard_capacity =
+          capacity / shard_count_ + (i < capacity % shard_count_ ? 1 : 0);
+      shards_[i].Init(shard_capacity);
+    }
+  }
+
+  ConcurrentRecordStore(const ConcurrentRecordStore<T> &) = delete;
+
+  ConcurrentRecordStore &operator=(const ConcurrentRecordStore<T> &) = delete;
+
+  // Flush the cache to disk and finalizes the ConcurrentRecordStore.
+  ~ConcurrentRecordStore() {
+    Status status = Flush();
+    LOG_IF(ERROR, !status.ok()) << "Could not flush cache: " << status;
+  }
+
+  // Flushes the cache to persistent storage and ensures the underlying storage
+  // resource has been synchronized. Returns an error status on failure. Other
+  // operations on the store are blocked while the flush is in progress.
+  ASYLO_MUST_USE_RESULT Status Flush() ABSL_NO_THREAD_SAFETY_ANALYSIS {
+    // Shards are always locked in index order, so concurrent flushes cannot
+    // deadlock.
+    for (size_t i = 0; i < shard_count_; i++) {
+      shards_[i].mu.Lock();
+    }
+    Status status = FlushLocked();
+    for (size_t i = shard_count_; i > 0; i--) {
+      shards_[i - 1].mu.Unlock();
+    }
+    return status;
+  }
+
+  // Reads a record from storage into |item|, returning an error status on
+  // failure. |offset| specifies a byte-offset into the underlying storage
+  // resource. The returned value may be read from cache, in which case it will
+  // reflect the most recent value written via this instance.
+  ASYLO_MUST_USE_RESULT Status Read(off_t offset, T *item) {
+    Shard &shard = GetShard(offset);
+    absl::MutexLock lock(&shard.mu);
+    size_t slot;
+    while (true) {
+      auto it = shard.index.find(offset);
+      if (it != shard.index.end()) {
+        Entry &entry = shard.entries[it->second];
+        if (entry.busy) {
+          // Wait for the record to be loaded or written back, then look it up
+          // again, since the transfer may have failed or evicted it.
+          shard.mu.Await(absl::Condition(&entry, &Entry::Idle));
+          continue;
+        }
+        entry.referenced = true;
+        *item = entry.value;
+        return Status::OkStatus();
+      }
+
+      ASYLO_ASSIGN_OR_RETURN(slot, AllocateEntry(&shard));
+      if (!shard.index.contains(offset)) {
+        break;
+      }
+      // Another thread cached the record while a victim was written back.
+      shard.free_slots.push_back(slot);
+    }
+
+    // Load the record without holding the shard lock. Threads looking up the
+    // record meanwhile wait for the entry to become idle.
+    Entry &entry = shard.entries[slot];
+    entry.offset = offset;
+    entry.dirty = false;
+    entry.referenced = false;
+    entry.busy = true;
+    shard.index[offset] = slot;
+    T value;
+    shard.mu.Unlock();
+    Status status = io_->Read(&value, offset, sizeof(T));
+    shard.mu.Lock();
+    entry.busy = false;
+    if (!status.ok()) {
+      // Return the entry to the free list so that garbage data is never
+      // written back to disk.
+      shard.index.erase(offset);
+      shard.free_slots.push_back(slot);
+      return status;
+    }
+    entry.value = value;
+    *item = value;
+    return Status::OkStatus();
+  }
+
+  // Writes |item| to the record store, returning an error status on failure.
+  // |offset| specifies a byte-offset into the underlying storage resource. Note
+  // that the caller is responsible for managing the layout of records in
+  // storage and it is an error to write overlapping elements to the
+  // ConcurrentRecordStore. Writes are cached and may not be persisted to
+  // storage until Flush() is called or the ConcurrentRecordStore is destroyed.
+  ASYLO_MUST_USE_RESULT Status Write(off_t offset, const T &item) {
+    Shard &shard = GetShard(offset);
+    absl::MutexLock lock(&shard.mu);
+    size_t slot;
+    while (true) {
+      auto it = shard.index.find(offset);
+      if (it != shard.index.end()) {
+        Entry &entry = shard.entries[it->second];
+        if (entry.busy) {
+          shard.mu.Await(absl::Condition(&entry, &Entry::Idle));
+          continue;
+        }
+        entry.value = item;
+        entry.dirty = true;
+        entry.referenced = true;
+        return Status::OkStatus();
+      }
+
+      ASYLO_ASSIGN_OR_RETURN(slot, AllocateEntry(&shard));
+      if (!shard.index.contains(offset)) {
+        break;
+      }
+      shard.free_slots.push_back(slot);
+    }
+
+    Entry &entry = shard.entries[slot];
+    entry.offset = offset;
+    entry.value = item;
+    entry.dirty = true;
+    entry.referenced = false;
+    shard.index[offset] = slot;
+    return Status::OkStatus();
+  }
+
+  // Returns true if a record specified by its byte-offset is present in the
+  // cache.
+  bool IsCached(off_t offset) const {
+    Shard &shard = GetShard(offset);
+    absl::MutexLock lock(&shard.mu);
+    return shard.index.contains(offset);
+  }
+
+ private:
+  struct Entry {
+    // Returns whether the entry is not being loaded or written back.
+    bool Idle() const { return !busy; }
+
+    off_t offset;     // Byte offset of this record.
+    T value;          // Cached record value.
+    bool dirty;       // True if this entry has been modified.
+    bool referenced;  // CLOCK reference bit, set when the entry is hit.
+    bool busy;        // True while the record is transferred to or from |io_|.
+  };
+
+  struct Shard {
+    // Allocates room for |capacity| entries, all of which start out free.
+    void Init(size_t capacity) ABSL_NO_THREAD_SAFETY_ANALYSIS {
+      entries.resize(capacity, Entry{});
+      free_slots.reserve(capacity);
+      for (size_t i = capacity; i > 0; i--) {
+        free_slots.push_back(i - 1);
+      }
+      index.reserve(capacity);
+    }
+
+    absl::Mutex mu;
+
+    // Cache entries. The array is sized when the shard is created and never
+    // reallocated, so eviction does not allocate.
+    std::vector<Entry> entries ABSL_GUARDED_BY(mu);
+
+    // Indices of entries that do not currently hold a record.
+    std::vector<size_t> free_slots ABSL_GUARDED_BY(mu);
+
+    // Index of entries by record offset.
+    absl::flat_hash_map<off_t, size_t> index ABSL_GUARDED_BY(mu);
+
+    // Position of the CLOCK hand in |entries|.
+    size_t hand ABSL_GUARDED_BY(mu) = 0;
+
+    // Returns whether an entry is free or could be evicted.
+    bool HasIdleEntry() const ABSL_SHARED_LOCKS_REQUIRED(mu) {
+      return !free_slots.empty() ||
+             std::any_of(entries.begin(), entries.end(),
+                         [](const Entry &entry) { return entry.Idle(); });
+    }
+  };
+
+  Shard &GetShard(off_t offset) const {
+    return shards_[static_cast<uint64_t>(offset) / sizeof(T) % shard_count_];
+  }
+
+  // Returns the index of an unused entry in |shard|, evicting a record if the
+  // shard is full. A dirty record is written back without holding the shard
+  // lock, so the record of the caller may have been cached by another thread
+  // on return. Returns an error status if a dirty record could not be written
+  // back.
+  StatusOr<size_t> AllocateEntry(Shard *shard)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(shard->mu) {
+    // The hand clears at most one full revolution of reference bits before it
+    // reaches an unreferenced entry, unless every entry is busy.
+    size_t busy_count = 0;
+    while (true) {
+      if (!shard->free_slots.empty()) {
+        size_t slot = shard->free_slots.back();
+        shard->free_slots.pop_back();
+        return slot;
+      }
+      if (busy_count == shard->entries.size()) {
+        shard->mu.Await(absl::Condition(shard, &Shard::HasIdleEntry));
+        busy_count = 0;
+        continue;
+      }
+
+      size_t slot = shard->hand;
+      shard->hand = (shard->hand + 1) % shard->entries.size();
+      Entry &entry = shard->entries[slot];
+      if (entry.busy) {
+        busy_count++;
+        continue;
+      }
+      busy_count = 0;
+      if (entry.referenced) {
+        entry.referenced = false;
+        continue;
+      }
+      if (entry.dirty) {
+        // Threads accessing the record wait until it is written back, so the
+        // entry is unchanged when the lock is taken again.
+        T value = entry.value;
+        off_t offset = entry.offset;
+        entry.busy = true;
+        shard->mu.Unlock();
+        Status status = io_->Write(&value, offset, sizeof(T));
+        shard->mu.Lock();
+        entry.busy = false;
+        ASYLO_RETURN_IF_ERROR(status);
+        entry.dirty = false;
+      }
+      shard->index.erase(entry.offset);
+      return slot;
+    }
+  }
+
+  // Writes all dirty entries to storage and synchronizes it. Must be called
+  // with every shard locked.
+  Status FlushLocked() ABSL_NO_THREAD_SAFETY_ANALYSIS {
+    std::vector<Entry *> dirty;
+    for (size_t i = 0; i < shard_count_; i++) {
+      for (Entry &entry : shards_[i].entries) {
+        if (entry.dirty) {
+          dirty.push_back(&entry);
+        }
+      }
+    }
+    std::sort(dirty.begin(), dirty.end(), [](const Entry *a, const Entry *b) {
+      return a->offset < b->offset;
+    });
+
+    std::vector<WriteSegment> segments;
+    segments.reserve(dirty.size());
+    for (Entry *entry : dirty) {
+      segments.push_back({&entry->value, entry->offset, sizeof(T)});
+    }
+    ASYLO_RETURN_IF_ERROR(io_->WriteV(segments.data(), segments.size()));
+    for (Entry *entry : dirty) {
+      entry->dirty = false;
+    }
+    return io_->Sync();
+  }
+
+  RandomAccessStorage *io_;  // Record backing store.
+
+  size_t shard_count_;
+  std::unique_ptr<Shard[]> shards_;
+};
+
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_STORAGE_UTILS_CONCURRENT_RECORD_STORE_H_
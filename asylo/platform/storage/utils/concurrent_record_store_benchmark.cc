@@ -0,0 +1,176 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "asylo/platform/storage/utils/concurrent_record_store.h"
+#include "asylo/platform/storage/utils/fd_closer.h"
+#include "asylo/platform/storage/utils/record_store.h"
+#include "asylo/platform/storage/utils/test_utils.h"
+#include "asylo/platform/storage/utils/untrusted_file.h"
+#include "asylo/test/util/benchmark.h"
+#include "asylo/test/util/status_matchers.h"
+
+namespace asylo {
+namespace {
+
+// Number of records in the benchmarked file, and the number of records cached.
+constexpr size_t kRecordCount = 64 * 1024;
+constexpr size_t kCapacity = 16 * 1024;
+
+// Numbers of threads accessing the store concurrently, and the number of
+// operations by each thread per iteration. One operation in kWriteInterval is
+// a write.
+constexpr int kThreadCounts[] = {1, 2, 4, 8, 16};
+constexpr int kOpsPerThread = 4096;
+constexpr int kWriteInterval = 8;
+
+// Number of adjacent dirty records written back by the flush benchmark.
+constexpr size_t kFlushRecordCount = 4096;
+
+// A RecordStore shared between threads by guarding it with a single mutex,
+// which is how callers had to use it before ConcurrentRecordStore.
+class LockedRecordStore {
+ public:
+  LockedRecordStore(size_t capacity, RandomAccessStorage *io)
+      : records_(capacity, io) {}
+
+  Status Read(off_t offset, uint64_t *item) {
+    absl::MutexLock lock(&mu_);
+    return records_.Read(offset, item);
+  }
+
+  Status Write(off_t offset, const uint64_t &item) {
+    absl::MutexLock lock(&mu_);
+    return records_.Write(offset, item);
+  }
+
+  Status Flush() {
+    absl::MutexLock lock(&mu_);
+    return records_.Flush();
+  }
+
+ private:
+  absl::Mutex mu_;
+  RecordStore<uint64_t> records_;
+};
+
+// Fills |file| with kRecordCount records.
+void FillFile(UntrustedFile *file) {
+  std::vector<uint64_t> records(kRecordCount);
+  for (size_t i = 0; i < kRecordCount; i++) {
+    records[i] = i;
+  }
+  ASYLO_ASSERT_OK(
+      file->Write(records.data(), 0, records.size() * sizeof(uint64_t)));
+}
+
+// Runs a mixed read and write workload with uniformly random offsets against
+// |records| from each of |thread_count| threads.
+template <typename Store>
+void BenchmarkMixedWorkload(const char *name, Store *records,
+                            int thread_count) {
+  int64_t round = 0;
+  BenchmarkResult result = RunBenchmark([&] {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; t++) {
+      threads.emplace_back([records, thread_count, t, round] {
+        std::mt19937_64 random(round * thread_count + t);
+        std::uniform_int_distribution<size_t> index(0, kRecordCount - 1);
+        for (int i = 0; i < kOpsPerThread; i++) {
+          off_t offset = index(random) * sizeof(uint64_t);
+          uint64_t record;
+          if (i % kWriteInterval == 0) {
+            ASYLO_EXPECT_OK(records->Write(offset, offset));
+          } else {
+            ASYLO_EXPECT_OK(records->Read(offset, &record));
+          }
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    round++;
+  });
+  LogBenchmarkResult(
+      absl::StrCat("MixedWorkload/", name, "/threads=", thread_count), result,
+      thread_count * kOpsPerThread * sizeof(uint64_t));
+}
+
+// Compares a mutex-guarded RecordStore with a ConcurrentRecordStore as the
+// number of threads grows.
+TEST(ConcurrentRecordStoreBenchmark, MixedWorkloadScaling) {
+  int fd = CreateEmptyTempFileOrDie("mixed.tmp");
+  platform::storage::FdCloser closer(fd);
+  UntrustedFile file(fd);
+  FillFile(&file);
+
+  for (int thread_count : kThreadCounts) {
+    {
+      LockedRecordStore records(kCapacity, &file);
+      BenchmarkMixedWorkload("RecordStore", &records, thread_count);
+    }
+    {
+      ConcurrentRecordStore<uint64_t> records(kCapacity, &file);
+      BenchmarkMixedWorkload("ConcurrentRecordStore", &records, thread_count);
+    }
+  }
+}
+
+// Dirties kFlushRecordCount adjacent records of |records| and flushes them.
+template <typename Store>
+void BenchmarkFlush(const char *name, Store *records) {
+  uint64_t round = 0;
+  BenchmarkResult result = RunBenchmark([&] {
+    for (size_t i = 0; i < kFlushRecordCount; i++) {
+      ASYLO_EXPECT_OK(records->Write(i * sizeof(uint64_t), round + i));
+    }
+    ASYLO_EXPECT_OK(records->Flush());
+    round++;
+  });
+  LogBenchmarkResult(absl::StrCat("Flush/", name), result,
+                     kFlushRecordCount * sizeof(uint64_t));
+}
+
+// Compares flushing many adjacent dirty records from each store.
+TEST(ConcurrentRecordStoreBenchmark, Flush) {
+  int fd = CreateEmptyTempFileOrDie("flush.tmp");
+  platform::storage::FdCloser closer(fd);
+  UntrustedFile file(fd);
+  FillFile(&file);
+
+  {
+    LockedRecordStore records(kCapacity, &file);
+    BenchmarkFlush("RecordStore", &records);
+  }
+  {
+    ConcurrentRecordStore<uint64_t> records(kCapacity, &file);
+    BenchmarkFlush("ConcurrentRecordStore", &records);
+  }
+}
+
+}  // namespace
+}  // namespace asylo
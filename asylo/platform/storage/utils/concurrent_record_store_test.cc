@@ -0,0 +1,300 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/storage/utils/concurrent_record_store.h"
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/synchronization/notification.h"
+#include "asylo/platform/storage/utils/fd_closer.h"
+#include "asylo/platform/storage/utils/test_utils.h"
+#include "asylo/platform/storage/utils/untrusted_file.h"
+#include "asylo/test/util/status_matchers.h"
+
+namespace asylo {
+namespace {
+
+// A RandomAccessStorage that forwards to another instance and counts writes.
+class CountingStorage : public RandomAccessStorage {
+ public:
+  explicit CountingStorage(RandomAccessStorage *io) : io_(io) {}
+
+  StatusOr<size_t> Size() const override { return io_->Size(); }
+
+  Status Read(void *buffer, off_t offset, size_t size) override {
+    return io_->Read(buffer, offset, size);
+  }
+
+  Status Write(const void *buffer, off_t offset, size_t size) override {
+    write_count_++;
+    return io_->Write(buffer, offset, size);
+  }
+
+  Status WriteV(const WriteSegment *segments, size_t count) override {
+    batch_count_++;
+    for (size_t i = 1; i < count; i++) {
+      EXPECT_LT(segments[i - 1].offset, segments[i].offset);
+    }
+    return io_->WriteV(segments, count);
+  }
+
+  Status Sync() override { return io_->Sync(); }
+
+  Status Truncate(size_t size) override { return io_->Truncate(size); }
+
+  size_t write_count() const { return write_count_; }
+
+  size_t batch_count() const { return batch_count_; }
+
+ private:
+  RandomAccessStorage *io_;
+  size_t write_count_ = 0;
+  size_t batch_count_ = 0;
+};
+
+// A RandomAccessStorage that forwards to another instance, and blocks reads at
+// one offset until released.
+class BlockingStorage : public RandomAccessStorage {
+ public:
+  BlockingStorage(RandomAccessStorage *io, off_t blocked_offset)
+      : io_(io), blocked_offset_(blocked_offset) {}
+
+  StatusOr<size_t> Size() const override { return io_->Size(); }
+
+  Status Read(void *buffer, off_t offset, size_t size) override {
+    if (offset == blocked_offset_) {
+      blocked_.Notify();
+      released_.WaitForNotification();
+    }
+    return io_->Read(buffer, offset, size);
+  }
+
+  Status Write(const void *buffer, off_t offset, size_t size) override {
+    return io_->Write(buffer, offset, size);
+  }
+
+  Status Sync() override { return io_->Sync(); }
+
+  Status Truncate(size_t size) override { return io_->Truncate(size); }
+
+  // Waits until a read at the blocked offset has started.
+  void WaitUntilBlocked() { blocked_.WaitForNotification(); }
+
+  // Lets reads at the blocked offset proceed.
+  void Release() { released_.Notify(); }
+
+ private:
+  RandomAccessStorage *io_;
+  const off_t blocked_offset_;
+  absl::Notification blocked_;
+  absl::Notification released_;
+};
+
+// Ensure that reading and writing records through a ConcurrentRecordStore
+// returns the expected values.
+TEST(ConcurrentRecordStoreTest, WriteRead) {
+  int fd = CreateEmptyTempFileOrDie("write_read.tmp");
+  platform::storage::FdCloser closer(fd);
+  UntrustedFile file(fd);
+
+  constexpr size_t kCapacity = 16;
+  constexpr size_t kRecordCount = 256;
+  ConcurrentRecordStore<size_t> records(kCapacity, &file, /*shard_count=*/4);
+
+  for (size_t i = 0; i < kRecordCount; i++) {
+    size_t record;
+    off_t offset = i * sizeof(size_t);
+    ASYLO_EXPECT_OK(records.Write(offset, i));
+    ASYLO_EXPECT_OK(records.Read(offset, &record));
+    EXPECT_EQ(record, i);
+  }
+
+  for (size_t i = 0; i < kRecordCount; i++) {
+    size_t record;
+    off_t offset = i * sizeof(size_t);
+    ASYLO_EXPECT_OK(records.Read(offset, &record));
+    EXPECT_EQ(record, i);
+  }
+}
+
+// Ensure that a record which keeps being hit survives a scan through more
+// records than the cache can hold.
+TEST(ConcurrentRecordStoreTest, Eviction) {
+  int fd = CreateEmptyTempFileOrDie("eviction.tmp");
+  platform::storage::FdCloser closer(fd);
+  UntrustedFile file(fd);
+
+  constexpr size_t kCapacity = 16;
+  constexpr size_t kRecordCount = 256;
+  ConcurrentRecordStore<size_t> records(kCapacity, &file, /*shard_count=*/1);
+
+  ASYLO_ASSERT_OK(records.Write(0, 0));
+  size_t record;
+  ASYLO_ASSERT_OK(records.Read(0, &record));
+  for (size_t i = 1; i < kRecordCount; i++) {
+    off_t offset = i * sizeof(size_t);
+    ASYLO_EXPECT_OK(records.Write(offset, i));
+    EXPECT_TRUE(records.IsCached(offset));
+    EXPECT_TRUE(records.IsCached(0));
+    ASYLO_ASSERT_OK(records.Read(0, &record));
+  }
+  EXPECT_FALSE(records.IsCached(sizeof(size_t)));
+
+  ASYLO_ASSERT_OK(records.Flush());
+  for (size_t i = 0; i < kRecordCount; i++) {
+    ASYLO_EXPECT_OK(file.Read(&record, i * sizeof(size_t), sizeof(size_t)));
+    EXPECT_EQ(record, i);
+  }
+}
+
+// Ensure that Flush() submits the dirty records as one batch in offset order,
+// and that cached writes are flushed when the store goes out of scope.
+TEST(ConcurrentRecordStoreTest, Flush) {
+  int fd = CreateEmptyTempFileOrDie("flush.tmp");
+  platform::storage::FdCloser closer(fd);
+  UntrustedFile file(fd);
+  CountingStorage counting(&file);
+
+  constexpr size_t kCapacity = 256;
+  constexpr size_t kRecordCount = 256;
+
+  {
+    ConcurrentRecordStore<size_t> records(kCapacity, &counting);
+    // Leave a gap after the first half so the dirty records form two runs.
+    for (size_t i = 0; i < kRecordCount; i++) {
+      if (i == kRecordCount / 2) {
+        continue;
+      }
+      ASYLO_EXPECT_OK(records.Write(i * sizeof(size_t), i));
+    }
+    ASYLO_ASSERT_OK(records.Flush());
+    EXPECT_EQ(counting.batch_count(), 1);
+
+    // Flushing again has nothing new to write.
+    ASYLO_ASSERT_OK(records.Flush());
+    EXPECT_EQ(counting.batch_count(), 2);
+
+    ASYLO_EXPECT_OK(records.Write(kRecordCount / 2 * sizeof(size_t),
+                                  kRecordCount / 2));
+  }
+  EXPECT_EQ(counting.batch_count(), 3);
+  EXPECT_EQ(counting.write_count(), 0);
+
+  EXPECT_THAT(file.Size(), IsOkAndHolds(kRecordCount * sizeof(size_t)));
+  for (size_t i = 0; i < kRecordCount; i++) {
+    size_t record;
+    ASYLO_EXPECT_OK(file.Read(&record, i * sizeof(size_t), sizeof(size_t)));
+    EXPECT_EQ(record, i);
+  }
+}
+
+// Ensure that a record being loaded from storage does not block accesses to
+// other records of its shard, and that readers of the record wait for it.
+TEST(ConcurrentRecordStoreTest, LoadOutsideShardLock) {
+  int fd = CreateEmptyTempFileOrDie("load_outside_lock.tmp");
+  platform::storage::FdCloser closer(fd);
+  UntrustedFile file(fd);
+
+  constexpr size_t kRecordCount = 8;
+  for (size_t i = 0; i < kRecordCount; i++) {
+    ASYLO_ASSERT_OK(file.Write(&i, i * sizeof(size_t), sizeof(size_t)));
+  }
+  constexpr off_t kBlockedOffset = 0;
+  BlockingStorage blocking(&file, kBlockedOffset);
+  ConcurrentRecordStore<size_t> records(/*capacity=*/4, &blocking,
+                                        /*shard_count=*/1);
+
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 2; t++) {
+    readers.emplace_back([&records] {
+      size_t record;
+      ASYLO_EXPECT_OK(records.Read(kBlockedOffset, &record));
+      EXPECT_EQ(record, 0);
+    });
+  }
+  blocking.WaitUntilBlocked();
+
+  // The other records remain accessible, including through evictions.
+  for (size_t i = 1; i < kRecordCount; i++) {
+    size_t record;
+    ASYLO_EXPECT_OK(records.Read(i * sizeof(size_t), &record));
+    EXPECT_EQ(record, i);
+    ASYLO_EXPECT_OK(records.Write(i * sizeof(size_t), i + kRecordCount));
+  }
+  EXPECT_TRUE(records.IsCached(kBlockedOffset));
+
+  blocking.Release();
+  for (auto &reader : readers) {
+    reader.join();
+  }
+  ASYLO_ASSERT_OK(records.Flush());
+  for (size_t i = 1; i < kRecordCount; i++) {
+    size_t record;
+    ASYLO_EXPECT_OK(file.Read(&record, i * sizeof(size_t), sizeof(size_t)));
+    EXPECT_EQ(record, i + kRecordCount);
+  }
+}
+
+// Ensure that concurrent readers and writers observe their own writes and
+// that all writes reach storage.
+TEST(ConcurrentRecordStoreTest, ConcurrentWriteRead) {
+  int fd = CreateEmptyTempFileOrDie("concurrent.tmp");
+  platform::storage::FdCloser closer(fd);
+  UntrustedFile file(fd);
+
+  constexpr size_t kCapacity = 64;
+  constexpr size_t kThreadCount = 8;
+  constexpr size_t kRecordsPerThread = 128;
+
+  {
+    ConcurrentRecordStore<size_t> records(kCapacity, &file);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < kThreadCount; t++) {
+      threads.emplace_back([&records, t] {
+        // Interleave the threads' records so that every thread touches every
+        // shard.
+        for (size_t i = 0; i < kRecordsPerThread; i++) {
+          size_t index = i * kThreadCount + t;
+          ASYLO_EXPECT_OK(records.Write(index * sizeof(size_t), index));
+        }
+        for (size_t i = 0; i < kRecordsPerThread; i++) {
+          size_t index = i * kThreadCount + t;
+          size_t record;
+          ASYLO_EXPECT_OK(records.Read(index * sizeof(size_t), &record));
+          EXPECT_EQ(record, index);
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+
+  for (size_t i = 0; i < kThreadCount * kRecordsPerThread; i++) {
+    size_t record;
+    ASYLO_EXPECT_OK(file.Read(&record, i * sizeof(size_t), sizeof(size_t)));
+    EXPECT_EQ(record, i);
+  }
+}
+
+}  // namespace
+}  // namespace asylo
@@ -25,10 +25,27 @@
 
 #include "asylo/util/asylo_macros.h"
 #include "asylo/util/status.h"
+#include "asylo/util/status_macros.h"
 #include "asylo/util/statusor.h"
 
 namespace asylo {
 
+// A buffer to be filled from a storage resource at a byte offset by
+// RandomAccessStorage::ReadV().
+struct ReadSegment {
+  void *buffer;
+  off_t offset;
+  size_t size;
+};
+
+// A buffer to be written to a storage resource at a byte offset by
+// RandomAccessStorage::WriteV().
+struct WriteSegment {
+  const void *buffer;
+  off_t offset;
+  size_t size;
+};
+
 // This class defines an abstract interface to persistent storage, modeled as a
 // collection of variable-size records indexed by their byte offset into a flat
 // array. This is provided to isolate the secure storage implementation from the
@@ -51,6 +68,34 @@ class RandomAccessStorage {
   virtual ASYLO_MUST_USE_RESULT Status Write(const void *buffer, off_t offset,
                                              size_t size) = 0;
 
+  // Reads each of |count| |segments| from storage, as if by calling Read() on
+  // each in turn. Implementations may submit the whole batch at once, and may
+  // merge segments whose byte ranges are adjacent in the order given. On
+  // failure, the contents of all segment buffers are undefined. The default
+  // implementation calls Read() once per segment.
+  virtual ASYLO_MUST_USE_RESULT Status ReadV(const ReadSegment *segments,
+                                             size_t count) {
+    for (size_t i = 0; i < count; i++) {
+      ASYLO_RETURN_IF_ERROR(
+          Read(segments[i].buffer, segments[i].offset, segments[i].size));
+    }
+    return Status::OkStatus();
+  }
+
+  // Writes each of |count| |segments| to storage, as if by calling Write() on
+  // each in turn. Implementations may submit the whole batch at once, and may
+  // merge segments whose byte ranges are adjacent in the order given. On
+  // failure, any subset of the segments may have been written. The default
+  // implementation calls Write() once per segment.
+  virtual ASYLO_MUST_USE_RESULT Status WriteV(const WriteSegment *segments,
+                                              size_t count) {
+    for (size_t i = 0; i < count; i++) {
+      ASYLO_RETURN_IF_ERROR(
+          Write(segments[i].buffer, segments[i].offset, segments[i].size));
+    }
+    return Status::OkStatus();
+  }
+
   // Commits pending writes to the underlying storage resource. This method is
   // provided for implementations where Write() does not commit to durable
   // storage synchronously, for instance because it writes via a user-space
@@ -23,6 +23,7 @@
 #include <iterator>
 #include <list>
 #include <type_traits>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "asylo/util/logging.h"
@@ -87,8 +88,25 @@ class RecordStore {
   // Flushes the cache to persistent storage and ensures the underlying storage
   // resource has been synchronized. Returns an error status on failure.
   ASYLO_MUST_USE_RESULT Status Flush() {
+    // Write dirty entries back as a single batch ordered by offset, so that
+    // the storage resource can merge adjacent records into larger writes.
+    std::vector<NodeRef> dirty;
     for (auto it = cache_.begin(); it != cache_.end(); it++) {
-      ASYLO_RETURN_IF_ERROR(Commit(it));
+      if (it->dirty) {
+        dirty.push_back(it);
+      }
+    }
+    std::sort(dirty.begin(), dirty.end(), [](NodeRef a, NodeRef b) {
+      return a->offset < b->offset;
+    });
+    std::vector<WriteSegment> segments;
+    segments.reserve(dirty.size());
+    for (NodeRef entry : dirty) {
+      segments.push_back({&entry->value, entry->offset, sizeof(T)});
+    }
+    ASYLO_RETURN_IF_ERROR(io_->WriteV(segments.data(), segments.size()));
+    for (NodeRef entry : dirty) {
+      entry->dirty = false;
     }
     ASYLO_RETURN_IF_ERROR(io_->Sync());
     return Status::OkStatus();
@@ -18,12 +18,56 @@
 
 #include "asylo/platform/storage/utils/untrusted_file.h"
 
+#include <limits.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
 #include "asylo/util/posix_error_space.h"
+#include "asylo/util/status_macros.h"
 
 namespace asylo {
+namespace {
+
+// Transfers |iovcnt| buffers described by |iov| starting at byte |offset| of
+// |fd| with |transfer|, which is either preadv(2) or pwritev(2). Partial
+// transfers are resumed, and calls are split to pass at most IOV_MAX buffers
+// at a time. |iov| is modified to track progress. Returns |eof_error| if
+// |transfer| makes no progress.
+Status TransferAll(ssize_t (*transfer)(int, const struct iovec *, int, off_t),
+                   int fd, struct iovec *iov, size_t iovcnt, off_t offset,
+                   error::GoogleError eof_error, const char *message) {
+  while (iovcnt > 0) {
+    ssize_t result = transfer(
+        fd, iov, static_cast<int>(std::min<size_t>(iovcnt, IOV_MAX)), offset);
+    if (result == 0) {
+      return Status{eof_error, message};
+    }
+
+    if (result < 0) {
+      return Status{static_cast<error::PosixError>(errno), message};
+    }
+
+    offset += result;
+    size_t count = result;
+    while (iovcnt > 0 && count >= iov->iov_len) {
+      count -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (count > 0) {
+      iov->iov_base = reinterpret_cast<uint8_t *>(iov->iov_base) + count;
+      iov->iov_len -= count;
+    }
+  }
+  return Status::OkStatus();
+}
+
+}  // namespace
 
 UntrustedFile::UntrustedFile(int fd) : fd_(fd) {}
 
@@ -36,23 +80,18 @@ UntrustedFile::~UntrustedFile() {
 }
 
 Status UntrustedFile::Read(void *buffer, off_t offset, size_t size) {
-  off_t result = lseek(fd_, offset, SEEK_SET);
-  if (result == -1) {
-    return Status{static_cast<error::PosixError>(errno),
-                  "lseek() failed in UntrustedFile::Read()"};
-  }
-
   size_t count = 0;
   while (count < size) {
-    ssize_t result =
-        read(fd_, reinterpret_cast<uint8_t *>(buffer) + count, size - count);
+    ssize_t result = pread(fd_, reinterpret_cast<uint8_t *>(buffer) + count,
+                           size - count, offset + count);
     if (result == 0) {
-      return Status{error::NOT_FOUND, "read() failed in UntrustedFile::Read()"};
+      return Status{error::NOT_FOUND,
+                    "pread() failed in UntrustedFile::Read()"};
     }
 
     if (result < 0) {
       return Status{static_cast<error::PosixError>(errno),
-                    "read() failed in UntrustedFile::Read()"};
+                    "pread() failed in UntrustedFile::Read()"};
     }
 
     count += result;
@@ -61,6 +100,28 @@ Status UntrustedFile::Read(void *buffer, off_t offset, size_t size) {
   return Status::OkStatus();
 }
 
+Status UntrustedFile::ReadV(const ReadSegment *segments, size_t count) {
+  std::vector<struct iovec> iov;
+  iov.reserve(count);
+  size_t i = 0;
+  while (i < count) {
+    off_t offset = segments[i].offset;
+    off_t end = offset;
+    iov.clear();
+    for (; i < count && segments[i].offset == end; i++) {
+      if (segments[i].size > 0) {
+        iov.push_back({segments[i].buffer, segments[i].size});
+      }
+      end += segments[i].size;
+    }
+    ASYLO_RETURN_IF_ERROR(
+        TransferAll(preadv, fd_, iov.data(), iov.size(), offset,
+                    error::NOT_FOUND,
+                    "preadv() failed in UntrustedFile::ReadV()"));
+  }
+  return Status::OkStatus();
+}
+
 StatusOr<size_t> UntrustedFile::Size() const {
   off_t result = lseek(fd_, 0, SEEK_END);
   if (result == -1) {
@@ -79,38 +140,22 @@ Status UntrustedFile::Sync() {
 }
 
 Status UntrustedFile::Write(const void *buffer, off_t offset, size_t size) {
-  off_t result = lseek(fd_, offset, SEEK_SET);
-  if (result == -1) {
-    return Status{static_cast<error::PosixError>(errno),
-                  "lseek() failed in UntrustedFile::Write()"};
-  }
-
-  if (result < offset) {
-    if (ftruncate(fd_, offset) != 0) {
-      return Status{static_cast<error::PosixError>(errno),
-                    "ftruncate() failed in UntrustedFile::Write()"};
-    }
-    off_t result = lseek(fd_, offset, SEEK_SET);
-    if (result == -1) {
-      return Status{
-          static_cast<error::PosixError>(errno),
-          "lseek() failed after extending file in UntrustedFile::Write()"};
-    }
-  }
-
+  // pwrite(2) past the end of the file extends it, leaving a zero-filled hole
+  // between the old end and |offset|.
   size_t count = 0;
   while (count < size) {
-    ssize_t result = write(
-        fd_, reinterpret_cast<const uint8_t *>(buffer) + count, size - count);
+    ssize_t result =
+        pwrite(fd_, reinterpret_cast<const uint8_t *>(buffer) + count,
+               size - count, offset + count);
 
     if (result == 0) {
       return Status{error::RESOURCE_EXHAUSTED,
-                    "write() failed in UntrustedFile::Write()"};
+                    "pwrite() failed in UntrustedFile::Write()"};
     }
 
     if (result < 0) {
       return Status{static_cast<error::PosixError>(errno),
-                    "write() failed in UntrustedFile::Write()"};
+                    "pwrite() failed in UntrustedFile::Write()"};
     }
     count += result;
   }
@@ -118,6 +163,30 @@ Status UntrustedFile::Write(const void *buffer, off_t offset, size_t size) {
   return Status::OkStatus();
 }
 
+Status UntrustedFile::WriteV(const WriteSegment *segments, size_t count) {
+  std::vector<struct iovec> iov;
+  iov.reserve(count);
+  size_t i = 0;
+  while (i < count) {
+    off_t offset = segments[i].offset;
+    off_t end = offset;
+    iov.clear();
+    for (; i < count && segments[i].offset == end; i++) {
+      if (segments[i].size > 0) {
+        // iovec is shared by reads and writes, so its base is not const.
+        iov.push_back(
+            {const_cast<void *>(segments[i].buffer), segments[i].size});
+      }
+      end += segments[i].size;
+    }
+    ASYLO_RETURN_IF_ERROR(
+        TransferAll(pwritev, fd_, iov.data(), iov.size(), offset,
+                    error::RESOURCE_EXHAUSTED,
+                    "pwritev() failed in UntrustedFile::WriteV()"));
+  }
+  return Status::OkStatus();
+}
+
 Status UntrustedFile::Truncate(size_t size) {
   if (ftruncate(fd_, size) != 0) {
     return Status{static_cast<error::PosixError>(errno),
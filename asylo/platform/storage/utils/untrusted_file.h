@@ -27,9 +27,11 @@ namespace asylo {
 class UntrustedFile : public RandomAccessStorage {
  public:
   // Constructs an UntrustedFile wrapping an open file descriptor. |fd| is
-  // expected to support read(2), write(2), lseek(2), ftruncate(2), and
-  // fsync(2).  |fd| remains owned by the caller and is not closed by the
-  // UntrustedFile instance.
+  // expected to support pread(2), pwrite(2), preadv(2), pwritev(2), lseek(2),
+  // ftruncate(2), and fsync(2).  |fd| remains owned by the caller and is not
+  // closed by the UntrustedFile instance. Reads and writes do not use or move
+  // the file offset of |fd|, so they may be issued from several threads at
+  // once.
   explicit UntrustedFile(int fd);
 
   ~UntrustedFile();
@@ -40,6 +42,14 @@ class UntrustedFile : public RandomAccessStorage {
 
   Status Write(const void *buffer, off_t offset, size_t size) override;
 
+  // Reads each run of segments that are adjacent in the file with a single
+  // preadv(2) call.
+  Status ReadV(const ReadSegment *segments, size_t count) override;
+
+  // Writes each run of segments that are adjacent in the file with a single
+  // pwritev(2) call.
+  Status WriteV(const WriteSegment *segments, size_t count) override;
+
   // Synchronizes pending writes to the underlying file via fsync(2).
   Status Sync() override;
 
@@ -18,6 +18,8 @@
 
 #include "asylo/platform/storage/utils/untrusted_file.h"
 
+#include <vector>
+
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include "asylo/platform/storage/utils/fd_closer.h"
@@ -77,5 +79,45 @@ TEST(UntrustedFileTest, WriteHoles) {
   }
 }
 
+TEST(UntrustedFileTest, WriteVReadV) {
+  int fd = CreateEmptyTempFileOrDie("write_v_read_v.tmp");
+  platform::storage::FdCloser closer(fd);
+
+  UntrustedFile file(fd);
+  constexpr int kCount = 1024;
+
+  // Write records to the first two of every four slots in one batch, leaving a
+  // two-slot hole between each pair of adjacent records.
+  std::vector<int> records(kCount);
+  std::vector<WriteSegment> writes;
+  for (int i = 0; i < kCount; i++) {
+    records[i] = i;
+    if (i % 4 < 2) {
+      writes.push_back(
+          {&records[i], static_cast<off_t>(i * sizeof(int)), sizeof(int)});
+    }
+  }
+  ASYLO_ASSERT_OK(file.WriteV(writes.data(), writes.size()));
+  EXPECT_THAT(file.Size(), IsOkAndHolds((kCount - 2) * sizeof(int)));
+
+  // Read every slot back in one batch. The holes read as zeros.
+  std::vector<int> read_back(kCount - 2, -1);
+  std::vector<ReadSegment> reads;
+  for (int i = 0; i < kCount - 2; i++) {
+    reads.push_back(
+        {&read_back[i], static_cast<off_t>(i * sizeof(int)), sizeof(int)});
+  }
+  ASYLO_ASSERT_OK(file.ReadV(reads.data(), reads.size()));
+  for (int i = 0; i < kCount - 2; i++) {
+    EXPECT_EQ(read_back[i], i % 4 < 2 ? i : 0);
+  }
+
+  // Reading past the end of the file fails.
+  int record;
+  ReadSegment past_end = {
+      &record, static_cast<off_t>((kCount - 2) * sizeof(int)), sizeof(int)};
+  EXPECT_THAT(file.ReadV(&past_end, 1), StatusIs(error::NOT_FOUND));
+}
+
 }  // namespace
 }  // namespace asylo
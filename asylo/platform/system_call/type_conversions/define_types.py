@@ -33,7 +33,7 @@ define_constants(
     name="FileStatusFlag",
     values=[
         "O_RDONLY", "O_WRONLY", "O_RDWR", "O_CREAT", "O_APPEND", "O_EXCL",
-        "O_TRUNC", "O_NONBLOCK", "O_DIRECT", "O_CLOEXEC"
+        "O_TRUNC", "O_NONBLOCK", "O_DIRECT", "O_CLOEXEC", "O_DIRECTORY"
     ],
     include_header_file="fcntl.h",
     multi_valued=True)
@@ -60,10 +60,10 @@ TEST_F(GeneratedTypesFunctionsTest, FileStatusFlagTest) {
   std::vector<int64_t> from_bits = {
       kLinux_O_RDONLY, kLinux_O_WRONLY, kLinux_O_RDWR,  kLinux_O_CREAT,
       kLinux_O_APPEND, kLinux_O_EXCL,   kLinux_O_TRUNC, kLinux_O_NONBLOCK,
-      kLinux_O_DIRECT, kLinux_O_CLOEXEC};
-  std::vector<int64_t> to_bits = {O_RDONLY, O_WRONLY, O_RDWR,  O_CREAT,
-                                  O_APPEND, O_EXCL,   O_TRUNC, O_NONBLOCK,
-                                  O_DIRECT, O_CLOEXEC};
+      kLinux_O_DIRECT, kLinux_O_CLOEXEC, kLinux_O_DIRECTORY};
+  std::vector<int64_t> to_bits = {O_RDONLY, O_WRONLY,  O_RDWR,  O_CREAT,
+                                  O_APPEND, O_EXCL,    O_TRUNC, O_NONBLOCK,
+                                  O_DIRECT, O_CLOEXEC, O_DIRECTORY};
 
   TestMultiValuedEnums(from_bits, to_bits, FromkLinuxFileStatusFlag,
                        TokLinuxFileStatusFlag);
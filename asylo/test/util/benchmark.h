@@ -0,0 +1,85 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_TEST_UTIL_BENCHMARK_H_
+#define ASYLO_TEST_UTIL_BENCHMARK_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "asylo/util/logging.h"
+
+namespace asylo {
+
+// Timing of the final batch of iterations run by RunBenchmark().
+struct BenchmarkResult {
+  int64_t iterations;
+  absl::Duration elapsed;
+
+  double NanosPerIteration() const {
+    return absl::ToDoubleNanoseconds(elapsed) / iterations;
+  }
+
+  // Returns the throughput when each iteration processes |bytes| bytes.
+  double MegabytesPerSecond(size_t bytes) const {
+    return bytes * iterations / absl::ToDoubleSeconds(elapsed) / (1 << 20);
+  }
+};
+
+// Runs |body| in batches of doubling size until a batch takes at least
+// |min_time|, and returns the timing of that batch. Benchmarks built on this
+// helper are gtest targets tagged "manual" and "benchmark", so they run inside
+// enclaves like any other test but only when requested explicitly.
+template <typename Body>
+BenchmarkResult RunBenchmark(
+    Body body, absl::Duration min_time = absl::Milliseconds(200)) {
+  BenchmarkResult result = {1, absl::ZeroDuration()};
+  while (true) {
+    absl::Time start = absl::Now();
+    for (int64_t i = 0; i < result.iterations; ++i) {
+      body();
+    }
+    result.elapsed = absl::Now() - start;
+    if (result.elapsed >= min_time || result.iterations >= (int64_t{1} << 40)) {
+      return result;
+    }
+    result.iterations *= 2;
+  }
+}
+
+// Logs |result| under |name|. If |bytes| is non-zero, also logs the throughput
+// when each iteration processes |bytes| bytes.
+inline void LogBenchmarkResult(absl::string_view name,
+                               const BenchmarkResult &result,
+                               size_t bytes = 0) {
+  if (bytes == 0) {
+    LOG(INFO) << name << ": " << result.NanosPerIteration() << " ns/op ("
+              << result.iterations << " iterations)";
+  } else {
+    LOG(INFO) << name << ": " << result.NanosPerIteration() << " ns/op, "
+              << result.MegabytesPerSecond(bytes) << " MiB/s ("
+              << result.iterations << " iterations)";
+  }
+}
+
+}  // namespace asylo
+
+#endif  // ASYLO_TEST_UTIL_BENCHMARK_H_
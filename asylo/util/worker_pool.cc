@@ -0,0 +1,121 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/util/worker_pool.h"
+
+#include <algorithm>
+
+#include "asylo/util/logging.h"
+
+namespace asylo {
+namespace {
+
+bool LoopDone(size_t *running) { return *running == 0; }
+
+}  // namespace
+
+WorkerPool::WorkerPool(size_t max_workers)
+    : max_workers_(max_workers), worker_failed_(false), stopping_(false) {}
+
+WorkerPool::~WorkerPool() {
+  std::vector<pthread_t> workers;
+  {
+    absl::MutexLock lock(&mu_);
+    stopping_ = true;
+    workers.swap(workers_);
+  }
+  for (pthread_t worker : workers) {
+    pthread_join(worker, nullptr);
+  }
+}
+
+void WorkerPool::ParallelFor(size_t count,
+                             const std::function<void(size_t)> &task) {
+  if (count == 0) {
+    return;
+  }
+  if (count == 1 || max_workers_ == 0) {
+    for (size_t index = 0; index < count; ++index) {
+      task(index);
+    }
+    return;
+  }
+
+  Loop loop = {&task, count, /*next=*/0, /*running=*/0};
+  absl::MutexLock lock(&mu_);
+  loops_.push_back(&loop);
+  AddWorkers(count - 1);
+
+  // Run tasks of the loop on this thread too, until none is left to start.
+  while (loop.next < loop.count) {
+    size_t index = StartTask(&loop);
+    mu_.Unlock();
+    task(index);
+    mu_.Lock();
+    --loop.running;
+  }
+  mu_.Await(absl::Condition(&LoopDone, &loop.running));
+}
+
+void WorkerPool::AddWorkers(size_t count) {
+  count = std::min(count, max_workers_);
+  while (!worker_failed_ && workers_.size() < count) {
+    pthread_t worker;
+    if (pthread_create(&worker, nullptr, &WorkerPool::RunWorker, this) != 0) {
+      LOG(WARNING) << "Failed to start a worker thread, continuing with "
+                   << workers_.size() << " worker threads.";
+      worker_failed_ = true;
+      break;
+    }
+    workers_.push_back(worker);
+  }
+}
+
+size_t WorkerPool::StartTask(Loop *loop) {
+  size_t index = loop->next++;
+  ++loop->running;
+  if (loop->next == loop->count) {
+    loops_.erase(std::find(loops_.begin(), loops_.end(), loop));
+  }
+  return index;
+}
+
+void *WorkerPool::RunWorker(void *arg) {
+  static_cast<WorkerPool *>(arg)->Run();
+  return nullptr;
+}
+
+bool WorkerPool::HasWork() const { return stopping_ || !loops_.empty(); }
+
+void WorkerPool::Run() {
+  absl::MutexLock lock(&mu_);
+  while (true) {
+    mu_.Await(absl::Condition(this, &WorkerPool::HasWork));
+    if (loops_.empty()) {
+      return;
+    }
+    Loop *loop = loops_.front();
+    size_t index = StartTask(loop);
+    mu_.Unlock();
+    (*loop->task)(index);
+    mu_.Lock();
+    --loop->running;
+  }
+}
+
+}  // namespace asylo
@@ -0,0 +1,98 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_UTIL_WORKER_POOL_H_
+#define ASYLO_UTIL_WORKER_POOL_H_
+
+#include <pthread.h>
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+namespace asylo {
+
+// A pool of up to |max_workers| worker threads that run the tasks of parallel
+// loops. Worker threads are created the first time they are needed and are
+// reused by later loops until the pool is destroyed.
+//
+// The thread calling ParallelFor() runs tasks of its own loop as well, so a
+// loop always completes, even when no worker thread can be created. Loops
+// started concurrently share the worker threads.
+//
+// The class is thread-safe.
+class WorkerPool {
+ public:
+  explicit WorkerPool(size_t max_workers);
+
+  // Stops and joins the worker threads. No loop may be running.
+  ~WorkerPool() ABSL_LOCKS_EXCLUDED(mu_);
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  // Calls |task| once for each index in [0, |count|), on the calling thread and
+  // on up to |count| - 1 worker threads, and returns once all calls returned.
+  void ParallelFor(size_t count, const std::function<void(size_t)> &task)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+ private:
+  // A loop started by ParallelFor().
+  struct Loop {
+    const std::function<void(size_t)> *task;
+    size_t count;
+    // Index of the next task to start.
+    size_t next;
+    // Number of tasks started but not returned yet.
+    size_t running;
+  };
+
+  // Entry point of the worker threads.
+  static void *RunWorker(void *arg);
+
+  // Creates worker threads until there are |count| or the pool is full. Stops
+  // creating threads once a thread cannot be created.
+  void AddWorkers(size_t count) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Starts the next task of |loop|, which must have one left, and returns its
+  // index.
+  size_t StartTask(Loop *loop) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Returns whether worker threads have tasks to run or are to stop.
+  bool HasWork() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Runs tasks until the pool is stopped.
+  void Run() ABSL_LOCKS_EXCLUDED(mu_);
+
+  const size_t max_workers_;
+
+  absl::Mutex mu_;
+  // Loops with tasks left to start, in the order they were started.
+  std::deque<Loop *> loops_ ABSL_GUARDED_BY(mu_);
+  std::vector<pthread_t> workers_ ABSL_GUARDED_BY(mu_);
+  bool worker_failed_ ABSL_GUARDED_BY(mu_);
+  bool stopping_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace asylo
+
+#endif  // ASYLO_UTIL_WORKER_POOL_H_
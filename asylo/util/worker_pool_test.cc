@@ -0,0 +1,90 @@
+/*
+ *
+ * Copyright 2019 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/util/worker_pool.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/synchronization/barrier.h"
+
+namespace asylo {
+namespace {
+
+using ::testing::Each;
+using ::testing::Eq;
+
+TEST(WorkerPoolTest, RunsEachTaskOnce) {
+  WorkerPool pool(/*max_workers=*/3);
+  for (size_t count : {0, 1, 2, 4, 100}) {
+    std::vector<std::atomic<int>> calls(count);
+    pool.ParallelFor(count, [&calls](size_t index) { ++calls[index]; });
+    for (const std::atomic<int> &call : calls) {
+      EXPECT_THAT(call.load(), Eq(1));
+    }
+  }
+}
+
+TEST(WorkerPoolTest, RunsTasksInParallel) {
+  constexpr size_t kThreads = 4;
+  WorkerPool pool(/*max_workers=*/kThreads - 1);
+
+  // Each task waits for all the others, so the loop only completes if every
+  // task runs on its own thread.
+  absl::Barrier barrier(kThreads);
+  pool.ParallelFor(kThreads, [&barrier](size_t) { barrier.Block(); });
+}
+
+TEST(WorkerPoolTest, RunsInlineWithoutWorkers) {
+  WorkerPool pool(/*max_workers=*/0);
+  std::vector<std::thread::id> ids(10);
+  pool.ParallelFor(ids.size(), [&ids](size_t index) {
+    ids[index] = std::this_thread::get_id();
+  });
+  EXPECT_THAT(ids, Each(Eq(std::this_thread::get_id())));
+}
+
+TEST(WorkerPoolTest, SharesWorkersBetweenConcurrentLoops) {
+  constexpr int kCallers = 8;
+  constexpr size_t kTasks = 50;
+  WorkerPool pool(/*max_workers=*/2);
+
+  std::vector<std::vector<int>> calls(kCallers, std::vector<int>(kTasks));
+  std::vector<std::thread> callers;
+  for (int caller = 0; caller < kCallers; ++caller) {
+    callers.emplace_back([&pool, &calls, caller] {
+      for (int round = 0; round < 20; ++round) {
+        pool.ParallelFor(kTasks, [&calls, caller](size_t index) {
+          ++calls[caller][index];
+        });
+      }
+    });
+  }
+  for (std::thread &caller : callers) {
+    caller.join();
+  }
+  for (const std::vector<int> &caller_calls : calls) {
+    EXPECT_THAT(caller_calls, Each(Eq(20)));
+  }
+}
+
+}  // namespace
+}  // namespace asylo